@@ -0,0 +1,57 @@
+/*
+ * Salida por el puerto serie del usuario, en dos modos:
+ *
+ *  - registro (por defecto): cada mensaje se escribe tal cual;
+ *  - panel ('d'): un panel ANSI a pantalla completa (lib/PanelTerminal)
+ *    con el estado del sensor, las cuentas atrás, el último resultado, el
+ *    enlace y la cola de subida. Sólo se envían los campos que cambian.
+ *    Los mensajes del registro no salen por el puerto; el último se ve
+ *    en la línea "Mensaje" del panel.
+ *
+ * Todos los mensajes del firmware pasan por 'consola' en vez de Serial
+ * para que el modo panel pueda retenerlos. Los volcados para las
+ * herramientas de host (métricas, perfilador, registro de vuelo) siguen
+ * escribiendo en Serial: sus comandos salen antes del modo panel.
+ */
+#ifndef CONSOLA_H
+#define CONSOLA_H
+
+#include <Arduino.h>
+#include <stdint.h>
+#include "entrega_resultados.h"
+
+// Periodo de refresco del panel
+#define PERIODO_PANEL_MS 500
+
+class SalidaConsola : public Print {
+public:
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* datos, size_t n) override;
+  using Print::write;
+};
+
+extern SalidaConsola consola;
+
+// Lo que el panel muestra del estado de main.cpp; el resto (enlace, cola
+// de subida) lo toma de las métricas
+struct DatosPanel {
+  uint8_t estado;
+  uint32_t msEnEstado;
+  uint8_t tiempoSoplado;        // 0 si no se sabe
+  bool sopladoAdaptativo;
+  bool resultadoPendiente;      // prueba terminada y aún sin leer
+  const ResultadoEntregado* ultimo;  // nullptr si no hay
+  uint32_t idConfirmatoria;     // 0 si no hay pendiente
+  uint32_t msHastaConfirmatoria;
+  uint32_t idSujeto;
+};
+
+bool panelActivo();
+void activarPanel();
+// Vuelve al modo registro; el terminal queda debajo del panel
+void desactivarPanel();
+// Milisegundos hasta el próximo refresco; 0 si ya toca
+uint32_t msHastaPanel(uint32_t ahoraMs);
+void actualizarPanel(const DatosPanel& datos, uint32_t ahoraMs);
+
+#endif
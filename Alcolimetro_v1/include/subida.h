@@ -0,0 +1,46 @@
+/*
+ * Subida de registros al colector desde el firmware: cola persistente en
+ * LittleFS, transporte TCP por WiFi y manejo del WiFi según haya o no
+ * registros pendientes.
+ *
+ * Cada prueba genera un registro de resultado; al cerrarse una sesión
+ * (prueba original y, si la hubo, la confirmatoria) se añade un registro
+ * de sesión, y cada cambio de configuración del sensor uno de
+ * configuración. Todos usan el esquema de esquema_registros.h.
+ *
+ * El colector baja órdenes de configuración con cada ACK; para que un
+ * equipo sin pruebas también las reciba se sincroniza cada
+ * PERIODO_SINCRONIZACION_MS aunque la cola esté vacía. Cada comando
+ * aplicado se confirma con un registro de confirmación.
+ *
+ * El WiFi sólo se usa si se compila con WIFI_SSID, WIFI_CLAVE y
+ * COLECTOR_HOST definidos (build_flags en platformio.ini); sin ellos los
+ * registros se siguen guardando en la cola.
+ */
+#ifndef SUBIDA_H
+#define SUBIDA_H
+
+#include <stdint.h>
+#include "bus_eventos.h"
+#include "protocolo_subida.h"
+
+void iniciarSubida();
+void encolarPrueba(const EventoPruebaRegistrada& prueba);
+void encolarConfiguracion(const EventoConfiguracion& config);
+// Secuencia de subida de una prueba reciente, 0 si no se encoló. Tras un
+// reinicio en caliente recordarPrueba() devuelve la prueba original a la
+// tabla para que la confirmatoria se enlace con ella.
+uint32_t secuenciaPrueba(uint32_t idPrueba);
+void recordarPrueba(uint32_t idPrueba, uint32_t secuencia, uint32_t marcaMs,
+                    const ResultadoPrueba& resultado);
+void servicioSubida(uint32_t ahoraMs);
+// Comandos bajados del colector pendientes de aplicar; false si no hay
+bool tomarOrdenConfiguracion(OrdenConfiguracion& orden);
+// Encola la confirmación de un comando con el estado CONFIRMACION_* y lo
+// que el sensor devolvió al leerlo
+void confirmarComando(const ComandoOrden& comando, uint8_t estado, uint16_t valorLeido);
+// true mientras el WiFi está encendido; impide el sueño ligero
+bool subidaActiva();
+void imprimirSubida();
+
+#endif
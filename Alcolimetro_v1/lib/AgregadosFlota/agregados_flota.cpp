@@ -0,0 +1,120 @@
+#include "agregados_flota.h"
+
+#define HORAS_DIA 24
+#define SEGUNDOS_HORA 3600
+
+// Conversión entre días y fechas del calendario civil (algoritmo de
+// H. Hinnant), sólo para fechas desde 1970
+uint32_t mesDeDia(uint32_t dia) {
+  uint32_t z = dia + 719468;
+  uint32_t era = z / 146097;
+  uint32_t doe = z - era * 146097;
+  uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  uint32_t mp = (5 * doy + 2) / 153;
+  uint32_t m = mp < 10 ? mp + 3 : mp - 9;
+  uint32_t y = yoe + era * 400 + (m <= 2);
+  return (y - 1970) * 12 + m - 1;
+}
+
+uint32_t primerDiaDeMes(uint32_t mes) {
+  uint32_t y = 1970 + mes / 12;
+  uint32_t m = mes % 12 + 1;
+  y -= m <= 2;
+  uint32_t era = y / 400;
+  uint32_t yoe = y - era * 400;
+  uint32_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5;
+  uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+static void sumarRango(const std::map<uint32_t, Agregado>& cubetas, uint32_t desde,
+                       uint32_t hasta, Agregado& total) {
+  for (auto i = cubetas.lower_bound(desde); i != cubetas.end() && i->first < hasta; ++i) {
+    total.sumar(i->second);
+  }
+}
+
+AgregadosFlota::AgregadosFlota(uint32_t retencionHoras, uint32_t retencionDias)
+  : retencionHoras(retencionHoras), retencionDias(retencionDias) {}
+
+void AgregadosFlota::sumarEn(Serie& s, uint32_t hora, const Agregado& a) {
+  uint32_t dia = hora / HORAS_DIA;
+  if (hora >= horasPodadasHasta) s.horas[hora].sumar(a);
+  if (dia >= diasPodadosHasta) s.dias[dia].sumar(a);
+  s.meses[mesDeDia(dia)].sumar(a);
+}
+
+bool AgregadosFlota::anotar(uint32_t idDispositivo, uint32_t idSitio, uint32_t secuencia,
+                            int64_t instante, uint16_t alcoholMg100ml, uint8_t alarma) {
+  uint32_t& siguiente = siguienteSecuencia[idDispositivo];
+  if (secuencia < siguiente) return false;
+  siguiente = secuencia + 1;
+
+  Agregado a = {};
+  a.pruebas = 1;
+  a.porAlarma[alarma < 3 ? alarma : 2] = 1;
+  a.sumaMg = alcoholMg100ml;
+  a.maxMg = alcoholMg100ml;
+  uint32_t hora = instante > 0 ? (uint32_t)(instante / SEGUNDOS_HORA) : 0;
+  sumarEn(porSerie[clave(AMBITO_EQUIPO, idDispositivo)], hora, a);
+  sumarEn(porSerie[clave(AMBITO_SITIO, idSitio)], hora, a);
+  sumarEn(porSerie[clave(AMBITO_FLOTA, 0)], hora, a);
+  return true;
+}
+
+Agregado AgregadosFlota::consultar(AmbitoAgregado ambito, uint32_t id, int64_t desde,
+                                   int64_t hasta) const {
+  Agregado total = {};
+  auto i = porSerie.find(clave(ambito, ambito == AMBITO_FLOTA ? 0 : id));
+  if (i == porSerie.end() || hasta <= desde) return total;
+  const Serie& s = i->second;
+
+  uint32_t h0 = desde > 0 ? (uint32_t)(desde / SEGUNDOS_HORA) : 0;
+  uint32_t h1 = hasta > 0 ? (uint32_t)((hasta + SEGUNDOS_HORA - 1) / SEGUNDOS_HORA) : 0;
+  // Días enteros [d0, d1) dentro del intervalo; el resto, por horas
+  uint32_t d0 = (h0 + HORAS_DIA - 1) / HORAS_DIA;
+  uint32_t d1 = h1 / HORAS_DIA;
+  if (d0 >= d1) {
+    sumarRango(s.horas, h0, h1, total);
+    return total;
+  }
+  sumarRango(s.horas, h0, d0 * HORAS_DIA, total);
+  sumarRango(s.horas, d1 * HORAS_DIA, h1, total);
+
+  // Meses enteros [m0, m1) dentro de los días; el resto, por días
+  uint32_t m0 = mesDeDia(d0);
+  if (primerDiaDeMes(m0) < d0) m0++;
+  uint32_t m1 = mesDeDia(d1);
+  if (m0 >= m1) {
+    sumarRango(s.dias, d0, d1, total);
+    return total;
+  }
+  sumarRango(s.dias, d0, primerDiaDeMes(m0), total);
+  sumarRango(s.meses, m0, m1, total);
+  sumarRango(s.dias, primerDiaDeMes(m1), d1, total);
+  return total;
+}
+
+void AgregadosFlota::podar(int64_t ahora) {
+  uint32_t hora = ahora > 0 ? (uint32_t)(ahora / SEGUNDOS_HORA) : 0;
+  uint32_t dia = hora / HORAS_DIA;
+  uint32_t limiteHoras = hora > retencionHoras ? hora - retencionHoras : 0;
+  uint32_t limiteDias = dia > retencionDias ? dia - retencionDias : 0;
+  if (limiteHoras <= horasPodadasHasta && limiteDias <= diasPodadosHasta) return;
+  if (limiteHoras > horasPodadasHasta) horasPodadasHasta = limiteHoras;
+  if (limiteDias > diasPodadosHasta) diasPodadosHasta = limiteDias;
+  for (auto& par : porSerie) {
+    Serie& s = par.second;
+    s.horas.erase(s.horas.begin(), s.horas.lower_bound(horasPodadasHasta));
+    s.dias.erase(s.dias.begin(), s.dias.lower_bound(diasPodadosHasta));
+  }
+}
+
+size_t AgregadosFlota::cubetas() const {
+  size_t n = 0;
+  for (const auto& par : porSerie) {
+    n += par.second.horas.size() + par.second.dias.size() + par.second.meses.size();
+  }
+  return n;
+}
@@ -0,0 +1,97 @@
+/*
+ * Agregados de resultados por hora, día y mes en el colector.
+ *
+ * Cada resultado guardado se suma al llegar a las tres escalas de su
+ * equipo, de su sitio y de la flota: pruebas, pruebas por alarma
+ * (ALARM_NONE, ALARM_DRINKING, ALARM_DRUNK) y suma y máximo de mg/100ml.
+ * Todo es acumulable en cualquier orden, así que un resultado que llega
+ * tarde sólo suma en sus cubetas. Los repetidos se descartan por la
+ * secuencia de la cola del equipo, que sube siempre.
+ *
+ * Una consulta de un intervalo de horas enteras suma meses completos,
+ * luego días completos y sólo las horas de los extremos: como mucho unas
+ * cien cubetas sea cual sea el intervalo.
+ *
+ * Las horas más antiguas que la retención se podan (son casi toda la
+ * memoria); en ese tramo una consulta sólo cuenta los días enteros.
+ */
+#ifndef AGREGADOS_FLOTA_H
+#define AGREGADOS_FLOTA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <unordered_map>
+
+#define RETENCION_HORAS_DEFECTO (14 * 24)
+#define RETENCION_DIAS_DEFECTO 400
+
+// Equipos sin sitio conocido
+#define SITIO_DESCONOCIDO 0
+
+enum AmbitoAgregado : uint8_t {
+  AMBITO_FLOTA = 0,
+  AMBITO_SITIO,
+  AMBITO_EQUIPO
+};
+
+struct Agregado {
+  uint32_t pruebas;
+  uint32_t porAlarma[3];   // índice: byte de alarma del sensor
+  uint64_t sumaMg;
+  uint16_t maxMg;
+
+  void sumar(const Agregado& o) {
+    pruebas += o.pruebas;
+    for (uint8_t i = 0; i < 3; i++) porAlarma[i] += o.porAlarma[i];
+    sumaMg += o.sumaMg;
+    if (o.maxMg > maxMg) maxMg = o.maxMg;
+  }
+  float mediaMg() const { return pruebas > 0 ? (float)sumaMg / pruebas : 0; }
+};
+
+// Claves de las cubetas: horas, días y meses desde el 1 de enero de 1970 (UTC)
+uint32_t mesDeDia(uint32_t dia);
+uint32_t primerDiaDeMes(uint32_t mes);
+
+class AgregadosFlota {
+public:
+  explicit AgregadosFlota(uint32_t retencionHoras = RETENCION_HORAS_DEFECTO,
+                          uint32_t retencionDias = RETENCION_DIAS_DEFECTO);
+
+  // Suma una prueba hecha en 'instante' (segundos UTC). Devuelve false sin
+  // sumar nada si la secuencia de ese equipo ya se contó
+  bool anotar(uint32_t idDispositivo, uint32_t idSitio, uint32_t secuencia,
+              int64_t instante, uint16_t alcoholMg100ml, uint8_t alarma);
+
+  // Intervalo [desde, hasta) en segundos, ampliado a horas enteras; 'id' no
+  // cuenta en AMBITO_FLOTA
+  Agregado consultar(AmbitoAgregado ambito, uint32_t id, int64_t desde, int64_t hasta) const;
+
+  // Quita las horas y días que han salido de la retención
+  void podar(int64_t ahora);
+
+  size_t series() const { return porSerie.size(); }
+  size_t cubetas() const;
+
+private:
+  struct Serie {
+    std::map<uint32_t, Agregado> horas;
+    std::map<uint32_t, Agregado> dias;
+    std::map<uint32_t, Agregado> meses;
+  };
+
+  static uint64_t clave(AmbitoAgregado ambito, uint32_t id) {
+    return (uint64_t)ambito << 32 | id;
+  }
+  void sumarEn(Serie& s, uint32_t hora, const Agregado& a);
+
+  uint32_t retencionHoras;
+  uint32_t retencionDias;
+  uint32_t horasPodadasHasta = 0;   // cubetas anteriores ya no existen
+  uint32_t diasPodadosHasta = 0;
+  std::unordered_map<uint64_t, Serie> porSerie;
+  std::unordered_map<uint32_t, uint32_t> siguienteSecuencia;  // por equipo
+};
+
+#endif
@@ -0,0 +1,68 @@
+#include "anomalias_flota.h"
+
+#include <math.h>
+
+DetectorAnomalias::DetectorAnomalias(size_t equipos) {
+  indice.reserve(equipos);
+  estados.reserve(equipos);
+}
+
+uint32_t DetectorAnomalias::posicion(uint32_t idDispositivo) {
+  auto r = indice.emplace(idDispositivo, (uint32_t)estados.size());
+  if (r.second) estados.push_back(EstadoEquipo{});
+  return r.first->second;
+}
+
+uint8_t DetectorAnomalias::alarmas(uint32_t idDispositivo) const {
+  auto i = indice.find(idDispositivo);
+  return i != indice.end() ? estados[i->second].alarmas : 0;
+}
+
+uint8_t DetectorAnomalias::observar(uint32_t idDispositivo, const ObservacionPrueba& o,
+                                    Anomalia* nuevas) {
+  EstadoEquipo& estado = estados[posicion(idDispositivo)];
+  uint8_t antes = estado.alarmas;
+  uint8_t numNuevas = 0;
+
+  for (uint8_t m = 0; m < NUM_METRICAS_SALUD; m++) {
+    if (!(o.presentes & (1u << m))) continue;
+    const ParametrosMetrica& p = PARAMETROS_SALUD[m];
+    Estadistico& e = estado.metricas[m];
+    uint16_t& muestras = estado.muestras[m];
+    float x = fminf(o.valores[m], p.tope);
+
+    // Calentamiento: media y varianza de todas las muestras (Welford)
+    if (muestras < CALENTAMIENTO_ANOMALIA) {
+      float n = muestras + 1;
+      float d = x - e.media;
+      e.media += d / n;
+      e.varianza += (d * (x - e.media) - e.varianza) / n;
+      muestras++;
+      continue;
+    }
+    if (muestras < UINT16_MAX) muestras++;
+
+    float sigma = fmaxf(sqrtf(e.varianza), p.sigmaMinima);
+    float z = fminf((x - e.media) / sigma, MAX_Z_ANOMALIA);
+    // Acotado para que, al volver a lo normal, la alarma no dure indefinidamente
+    e.cusum = fminf(fmaxf(0, e.cusum + z - p.k), 2 * p.h);
+
+    uint8_t bit = (uint8_t)(1u << m);
+    if (estado.alarmas & bit) {
+      if (e.cusum == 0) estado.alarmas &= (uint8_t)~bit;
+      continue;  // referencia congelada
+    }
+    if (e.cusum > p.h) {
+      estado.alarmas |= bit;
+      nuevas[numNuevas++] = {idDispositivo, (MetricaSalud)m, x, e.media, sigma, e.cusum};
+      continue;
+    }
+    float d = x - e.media;
+    e.media += p.alfa * d;
+    e.varianza = (1 - p.alfa) * (e.varianza + p.alfa * d * d);
+  }
+
+  if (antes == 0 && estado.alarmas != 0) enAlarma++;
+  if (antes != 0 && estado.alarmas == 0) enAlarma--;
+  return numNuevas;
+}
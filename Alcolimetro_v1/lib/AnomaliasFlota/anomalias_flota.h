@@ -0,0 +1,115 @@
+/*
+ * Detección de anomalías por equipo en el colector, en flujo.
+ *
+ * Cada registro de resultado trae lo que el firmware observó en la prueba:
+ * timeouts del enlace desde la anterior, soplidos interrumpidos, el
+ * contenido de alcohol y la duración del precalentamiento. Un sensor que
+ * se degrada los hace subir. Por equipo y métrica se lleva una media y una
+ * varianza exponenciales (EWMA) como referencia y un CUSUM de subidas
+ * sobre el valor tipificado; la métrica entra en alarma cuando el CUSUM
+ * pasa de h y sale cuando vuelve a cero. Mientras está en alarma
+ * la referencia no se actualiza, para que la deriva no se convierta en el
+ * nivel normal.
+ *
+ * Del alcohol sólo se vigilan las pruebas sin alarma: lo que mide el
+ * sensor a los sujetos sobrios es su línea base, y un desplazamiento ahí
+ * es deriva del sensor y no de quién sopla.
+ *
+ * Todo el estado de un equipo cabe en una línea de caché de un array
+ * contiguo; el índice por id es aparte. Con 100 000 equipos son unos
+ * 6,4 MB más el índice.
+ */
+#ifndef ANOMALIAS_FLOTA_H
+#define ANOMALIAS_FLOTA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+enum MetricaSalud : uint8_t {
+  SALUD_TIMEOUTS = 0,        // timeouts del enlace desde la prueba anterior
+  SALUD_INTERRUPCIONES,      // soplidos interrumpidos en la prueba
+  SALUD_ALCOHOL,             // mg/100ml, sólo pruebas sin alarma
+  SALUD_PRECALENTAMIENTO,    // ms
+  NUM_METRICAS_SALUD
+};
+
+struct ParametrosMetrica {
+  const char* nombre;
+  float alfa;           // peso de cada muestra en la referencia
+  float sigmaMinima;    // evita tipificar con varianza ~0 (métricas casi siempre a 0)
+  float tope;           // los valores se recortan aquí antes de nada
+  // CUSUM sobre valores tipificados: holgura k y umbral h, en desviaciones
+  float k;
+  float h;
+};
+
+// Ajustados con tools/bench_anomalias: con 5 min entre pruebas, unas 0,003
+// alarmas falsas por equipo y día
+inline constexpr ParametrosMetrica PARAMETROS_SALUD[NUM_METRICAS_SALUD] = {
+  {"timeouts", 0.02f, 0.5f, 20, 0.5f, 8},
+  {"interrupciones", 0.01f, 0.5f, 5, 0.5f, 10},
+  {"alcohol_sin_alarma", 0.02f, 3, 100, 0.5f, 10},
+  {"precalentamiento_ms", 0.02f, 400, 60000, 0.5f, 8},
+};
+
+// Cada muestra suma al CUSUM como mucho MAX_Z_ANOMALIA - k, así que una
+// sola prueba rara no basta para la alarma
+#define MAX_Z_ANOMALIA 3.0f
+
+// Muestras por métrica antes de vigilar; hasta entonces la referencia es
+// la media y la varianza acumuladas
+#define CALENTAMIENTO_ANOMALIA 20
+
+struct ObservacionPrueba {
+  float valores[NUM_METRICAS_SALUD];
+  uint8_t presentes;    // bit por métrica; los registros antiguos no traen todas
+};
+
+struct Estadistico {
+  float media;
+  float varianza;
+  float cusum;
+};
+
+struct alignas(64) EstadoEquipo {
+  Estadistico metricas[NUM_METRICAS_SALUD];
+  uint16_t muestras[NUM_METRICAS_SALUD];  // se satura
+  uint8_t alarmas;                        // bit por métrica
+};
+static_assert(sizeof(EstadoEquipo) == 64, "una línea de caché por equipo");
+
+struct Anomalia {
+  uint32_t idDispositivo;
+  MetricaSalud metrica;
+  float valor;
+  float media;          // referencia antes de la deriva
+  float desviacion;
+  float cusum;
+};
+
+class DetectorAnomalias {
+public:
+  // Reserva sitio para 'equipos' sin reubicar
+  explicit DetectorAnomalias(size_t equipos = 0);
+
+  // Actualiza el equipo y escribe en 'nuevas' las métricas que entran en
+  // alarma con esta prueba (como mucho NUM_METRICAS_SALUD); devuelve cuántas
+  uint8_t observar(uint32_t idDispositivo, const ObservacionPrueba& o, Anomalia* nuevas);
+
+  // Máscara de métricas en alarma; 0 si el equipo no se conoce
+  uint8_t alarmas(uint32_t idDispositivo) const;
+  size_t equipos() const { return estados.size(); }
+  size_t equiposEnAlarma() const { return enAlarma; }
+  size_t bytesPorEquipo() const { return sizeof(EstadoEquipo); }
+
+private:
+  uint32_t posicion(uint32_t idDispositivo);
+
+  std::unordered_map<uint32_t, uint32_t> indice;
+  std::vector<EstadoEquipo> estados;
+  size_t enAlarma = 0;
+};
+
+#endif
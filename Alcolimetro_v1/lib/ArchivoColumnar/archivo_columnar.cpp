@@ -0,0 +1,623 @@
+#include "archivo_columnar.h"
+
+#include <algorithm>
+#include <array>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+#define MAGIA_TROZO 0x4C4F4341UL  // "ACOL"
+#define VERSION_TROZO 1
+
+static_assert(sizeof(MapaZona) == 40, "mapa de zonas sin relleno");
+static_assert(sizeof(CabeceraTrozo) == 128, "cabecera sin relleno");
+
+// Primera palabra de cada columna
+enum CodificacionColumna : uint32_t {
+  COD_FOR = 1,         // bases, bits por bloque y bloques empaquetados
+  COD_DICCIONARIO,     // numEntradas, entradas ordenadas y códigos COD_FOR
+  COD_DELTA2,          // primer valor (64 bits) y deltas de la delta COD_FOR
+  COD_CRUDA64          // valores de 64 bits tal cual
+};
+
+// ---------------------------------------------------------------------------
+// Núcleos de bloque
+
+typedef uint32_t Vector4 __attribute__((vector_size(16)));
+
+static inline Vector4 cargar4(const uint32_t* p) {
+  Vector4 v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+// Un desempaquetador por anchura: con B constante el paso j y su
+// desplazamiento se resuelven al compilar y cada paso son unas pocas
+// instrucciones vectoriales
+template <unsigned B>
+static void desempaquetarAncho(const uint32_t* entrada, uint32_t base, uint32_t* salida) {
+  const Vector4 vbase = {base, base, base, base};
+  if (B == 0) {
+    for (unsigned j = 0; j < VALORES_POR_BLOQUE / 4; j++) memcpy(salida + 4 * j, &vbase, 16);
+    return;
+  }
+  const uint32_t m = B >= 32 ? 0xFFFFFFFFu : (1u << (B % 32)) - 1;
+  const Vector4 mascara = {m, m, m, m};
+#pragma GCC unroll 32
+  for (unsigned j = 0; j < VALORES_POR_BLOQUE / 4; j++) {
+    const unsigned bit = j * B, palabra = bit / 32, desplazamiento = bit % 32;
+    Vector4 v = cargar4(entrada + 4 * palabra) >> desplazamiento;
+    if (desplazamiento + B > 32) {
+      v |= cargar4(entrada + 4 * (palabra + 1)) << (32 - desplazamiento);
+    }
+    v = (v & mascara) + vbase;
+    memcpy(salida + 4 * j, &v, 16);
+  }
+}
+
+typedef void (*Desempaquetador)(const uint32_t*, uint32_t, uint32_t*);
+
+template <size_t... B>
+static constexpr std::array<Desempaquetador, sizeof...(B)> tablaDesempaquetar(
+    std::index_sequence<B...>) {
+  return {{&desempaquetarAncho<B>...}};
+}
+
+static const std::array<Desempaquetador, 33> DESEMPAQUETAR =
+    tablaDesempaquetar(std::make_index_sequence<33>());
+
+void empaquetarBloque(const uint32_t* valores, unsigned bits, uint32_t* salida) {
+  for (unsigned j = 0; bits > 0 && j < VALORES_POR_BLOQUE / 4; j++) {
+    unsigned bit = j * bits, palabra = bit / 32, desplazamiento = bit % 32;
+    for (unsigned carril = 0; carril < 4; carril++) {
+      uint32_t v = valores[4 * j + carril];
+      salida[4 * palabra + carril] |= v << desplazamiento;
+      if (desplazamiento + bits > 32) {
+        salida[4 * (palabra + 1) + carril] |= v >> (32 - desplazamiento);
+      }
+    }
+  }
+}
+
+void desempaquetarBloque(const uint32_t* entrada, unsigned bits, uint32_t base,
+                         uint32_t* salida) {
+  DESEMPAQUETAR[bits](entrada, base, salida);
+}
+
+// ---------------------------------------------------------------------------
+// Columnas
+
+static uint32_t numBloques(uint32_t filas) {
+  return (filas + VALORES_POR_BLOQUE - 1) / VALORES_POR_BLOQUE;
+}
+
+static unsigned bitsPara(uint32_t v) {
+  return v == 0 ? 0 : 32 - (unsigned)__builtin_clz(v);
+}
+
+static uint32_t zigzag(int32_t v) {
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t desdeZigzag(uint32_t v) {
+  return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+// Marco de referencia por bloque: mínimo del bloque y bits de la diferencia
+// con el máximo. El último bloque se rellena con el mínimo.
+static void codificarFor(const uint32_t* valores, uint32_t n, std::vector<uint32_t>& salida) {
+  uint32_t bloques = numBloques(n);
+  size_t inicio = salida.size();
+  salida.push_back(COD_FOR);
+  salida.resize(inicio + 1 + bloques + (bloques + 3) / 4, 0);
+  uint32_t bloque[VALORES_POR_BLOQUE];
+  for (uint32_t k = 0; k < bloques; k++) {
+    uint32_t desde = k * VALORES_POR_BLOQUE;
+    uint32_t cuenta = std::min<uint32_t>(VALORES_POR_BLOQUE, n - desde);
+    uint32_t minimo = *std::min_element(valores + desde, valores + desde + cuenta);
+    uint32_t maximo = *std::max_element(valores + desde, valores + desde + cuenta);
+    unsigned bits = bitsPara(maximo - minimo);
+    for (uint32_t i = 0; i < VALORES_POR_BLOQUE; i++) {
+      bloque[i] = i < cuenta ? valores[desde + i] - minimo : 0;
+    }
+    size_t datos = salida.size();
+    salida.resize(datos + 4 * bits, 0);
+    empaquetarBloque(bloque, bits, salida.data() + datos);
+    salida[inicio + 1 + k] = minimo;
+    ((uint8_t*)(salida.data() + inicio + 1 + bloques))[k] = (uint8_t)bits;
+  }
+}
+
+static void codificarDiccionario(const uint32_t* valores, uint32_t n,
+                                 std::vector<uint32_t>& salida) {
+  std::vector<uint32_t> entradas(valores, valores + n);
+  std::sort(entradas.begin(), entradas.end());
+  entradas.erase(std::unique(entradas.begin(), entradas.end()), entradas.end());
+  std::vector<uint32_t> codigos(n);
+  for (uint32_t i = 0; i < n; i++) {
+    codigos[i] = (uint32_t)(std::lower_bound(entradas.begin(), entradas.end(), valores[i]) -
+                            entradas.begin());
+  }
+  salida.push_back(COD_DICCIONARIO);
+  salida.push_back((uint32_t)entradas.size());
+  salida.insert(salida.end(), entradas.begin(), entradas.end());
+  codificarFor(codigos.data(), n, salida);
+}
+
+// Delta de la delta con la primera delta a 0; si alguna no cabe en 32
+// bits la columna va sin comprimir
+static void codificarTiempos(const int64_t* valores, uint32_t n, std::vector<uint32_t>& salida) {
+  std::vector<uint32_t> zz(n, 0);
+  int64_t deltaAnterior = 0;
+  bool cabe = true;
+  for (uint32_t i = 1; i < n && cabe; i++) {
+    int64_t delta = valores[i] - valores[i - 1];
+    int64_t dd = delta - deltaAnterior;
+    cabe = dd >= INT32_MIN && dd <= INT32_MAX;
+    zz[i] = zigzag((int32_t)dd);
+    deltaAnterior = delta;
+  }
+  uint64_t primero = (uint64_t)valores[0];
+  if (!cabe) {
+    salida.push_back(COD_CRUDA64);
+    size_t p = salida.size();
+    salida.resize(p + 2 * (size_t)n);
+    memcpy(salida.data() + p, valores, 8 * (size_t)n);
+    return;
+  }
+  salida.push_back(COD_DELTA2);
+  salida.push_back((uint32_t)primero);
+  salida.push_back((uint32_t)(primero >> 32));
+  codificarFor(zz.data(), n, salida);
+}
+
+// Vista de una columna COD_FOR ya comprobada
+struct VistaFor {
+  const uint32_t* bases;
+  const uint8_t* bits;
+  const uint32_t* datos;
+  uint32_t bloques;
+};
+
+static bool verFor(const uint32_t* p, size_t palabras, uint32_t filas, VistaFor& v) {
+  v.bloques = numBloques(filas);
+  size_t cabecera = 1 + v.bloques + (v.bloques + 3) / 4;
+  if (palabras < cabecera || p[0] != COD_FOR) return false;
+  v.bases = p + 1;
+  v.bits = (const uint8_t*)(p + 1 + v.bloques);
+  v.datos = p + cabecera;
+  size_t datos = 0;
+  for (uint32_t k = 0; k < v.bloques; k++) {
+    if (v.bits[k] > 32) return false;
+    datos += 4 * (size_t)v.bits[k];
+  }
+  return cabecera + datos <= palabras;
+}
+
+// Recorre una VistaFor bloque a bloque
+struct LectorFor {
+  VistaFor v;
+  const uint32_t* siguiente;
+  uint32_t bloque;
+
+  explicit LectorFor(const VistaFor& vista) : v(vista), siguiente(vista.datos), bloque(0) {}
+  void leer(uint32_t* salida) {
+    unsigned bits = v.bits[bloque];
+    desempaquetarBloque(siguiente, bits, v.bases[bloque], salida);
+    siguiente += 4 * bits;
+    bloque++;
+  }
+};
+
+struct VistaDiccionario {
+  const uint32_t* entradas;
+  uint32_t numEntradas;
+  VistaFor codigos;
+};
+
+static bool verDiccionario(const uint32_t* p, size_t palabras, uint32_t filas,
+                           VistaDiccionario& v) {
+  if (palabras < 2 || p[0] != COD_DICCIONARIO || p[1] == 0 || p[1] > palabras - 2) return false;
+  v.numEntradas = p[1];
+  v.entradas = p + 2;
+  return verFor(p + 2 + v.numEntradas, palabras - 2 - v.numEntradas, filas, v.codigos);
+}
+
+// Tiempos de COD_DELTA2 o COD_CRUDA64 bloque a bloque
+struct LectorTiempos {
+  bool crudo = false;
+  const uint32_t* crudos = nullptr;
+  uint32_t filas = 0;
+  VistaFor v = {};
+  const uint32_t* siguiente = nullptr;
+  uint32_t bloque = 0;
+  int64_t valor = 0;
+  int64_t delta = 0;
+
+  // El primer valor va en la cabecera de la columna y su delta de la
+  // delta, la primera empaquetada, es 0
+  bool ver(const uint32_t* p, size_t palabras, uint32_t n) {
+    filas = n;
+    if (palabras >= 1 + 2 * (size_t)filas && p[0] == COD_CRUDA64) {
+      crudo = true;
+      crudos = p + 1;
+      return true;
+    }
+    if (palabras < 3 || p[0] != COD_DELTA2 || !verFor(p + 3, palabras - 3, filas, v)) return false;
+    valor = (int64_t)((uint64_t)p[1] | (uint64_t)p[2] << 32);
+    siguiente = v.datos;
+    return true;
+  }
+
+  void leer(int64_t* salida) {
+    if (crudo) {
+      uint32_t desde = bloque * VALORES_POR_BLOQUE;
+      memcpy(salida, crudos + 2 * (size_t)desde,
+             8 * (size_t)std::min<uint32_t>(VALORES_POR_BLOQUE, filas - desde));
+      bloque++;
+      return;
+    }
+    uint32_t zz[VALORES_POR_BLOQUE];
+    unsigned bits = v.bits[bloque];
+    desempaquetarBloque(siguiente, bits, v.bases[bloque], zz);
+    siguiente += 4 * bits;
+    bloque++;
+    // La suma en cadena no se vectoriza; es lo único serie del recorrido
+    for (uint32_t i = 0; i < VALORES_POR_BLOQUE; i++) {
+      delta += desdeZigzag(zz[i]);
+      valor += delta;
+      salida[i] = valor;
+    }
+  }
+};
+
+static bool cabeceraValida(const CabeceraTrozo& c) {
+  if (c.magia != MAGIA_TROZO || c.version != VERSION_TROZO || c.numColumnas != NUM_COLUMNAS ||
+      c.filas == 0 || c.filas > MAX_FILAS_TROZO || c.inicioAlmacen > c.finAlmacen ||
+      c.posicionColumna[0] != sizeof(CabeceraTrozo) ||
+      c.posicionColumna[NUM_COLUMNAS] != c.bytes) {
+    return false;
+  }
+  for (uint8_t i = 0; i < NUM_COLUMNAS; i++) {
+    if (c.posicionColumna[i] % 4 != 0 || c.posicionColumna[i + 1] < c.posicionColumna[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// ---------------------------------------------------------------------------
+// Trozos
+
+bool codificarTrozo(const FilaArchivo* filas, uint32_t n, uint64_t inicioAlmacen,
+                    uint64_t finAlmacen, std::vector<uint8_t>& salida) {
+  if (n == 0 || n > MAX_FILAS_TROZO) return false;
+  CabeceraTrozo c;
+  memset(&c, 0, sizeof(c));
+  c.magia = MAGIA_TROZO;
+  c.version = VERSION_TROZO;
+  c.numColumnas = NUM_COLUMNAS;
+  c.filas = n;
+  c.inicioAlmacen = inicioAlmacen;
+  c.finAlmacen = finAlmacen;
+  MapaZona& z = c.zona;
+  z.minInstante = z.maxInstante = filas[0].instante;
+  z.minEquipo = z.maxEquipo = filas[0].idDispositivo;
+  z.minSujeto = z.maxSujeto = filas[0].idSujeto;
+  z.minAlcohol = z.maxAlcohol = filas[0].alcoholMg100ml;
+  for (uint32_t i = 0; i < n; i++) {
+    const FilaArchivo& f = filas[i];
+    z.minInstante = std::min(z.minInstante, f.instante);
+    z.maxInstante = std::max(z.maxInstante, f.instante);
+    z.minEquipo = std::min(z.minEquipo, f.idDispositivo);
+    z.maxEquipo = std::max(z.maxEquipo, f.idDispositivo);
+    z.minSujeto = std::min(z.minSujeto, f.idSujeto);
+    z.maxSujeto = std::max(z.maxSujeto, f.idSujeto);
+    z.minAlcohol = std::min(z.minAlcohol, f.alcoholMg100ml);
+    z.maxAlcohol = std::max(z.maxAlcohol, f.alcoholMg100ml);
+    if (f.alarma < 8) z.alarmas |= (uint8_t)(1u << f.alarma);
+  }
+
+  std::vector<uint32_t> palabras(sizeof(c) / 4, 0);
+  std::vector<uint32_t> valores(n);
+  std::vector<int64_t> tiempos(n);
+  for (uint8_t col = 0; col < NUM_COLUMNAS; col++) {
+    c.posicionColumna[col] = (uint32_t)(palabras.size() * 4);
+    if (col == COL_RECIBIDO || col == COL_INSTANTE) {
+      for (uint32_t i = 0; i < n; i++) {
+        tiempos[i] = col == COL_RECIBIDO ? filas[i].recibido : filas[i].instante;
+      }
+      codificarTiempos(tiempos.data(), n, palabras);
+      continue;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+      const FilaArchivo& f = filas[i];
+      switch (col) {
+        case COL_EQUIPO: valores[i] = f.idDispositivo; break;
+        case COL_SECUENCIA: valores[i] = f.secuencia; break;
+        case COL_MARCA: valores[i] = f.marcaMs; break;
+        case COL_SUJETO: valores[i] = f.idSujeto; break;
+        case COL_VINCULADA: valores[i] = f.secuenciaVinculada; break;
+        case COL_ALCOHOL: valores[i] = f.alcoholMg100ml; break;
+        case COL_ALARMA: valores[i] = f.alarma; break;
+        case COL_BANDERAS: valores[i] = f.banderas; break;
+        case COL_TIMEOUTS: valores[i] = f.timeoutsEnlace; break;
+        case COL_INTERRUMPIDOS: valores[i] = f.soplidosInterrumpidos; break;
+        default: valores[i] = f.precalentamientoMs; break;
+      }
+    }
+    if (col == COL_EQUIPO) {
+      codificarDiccionario(valores.data(), n, palabras);
+    } else {
+      codificarFor(valores.data(), n, palabras);
+    }
+  }
+  c.bytes = (uint32_t)(palabras.size() * 4);
+  c.posicionColumna[NUM_COLUMNAS] = c.bytes;
+  memcpy(palabras.data(), &c, sizeof(c));
+  salida.resize(c.bytes);
+  memcpy(salida.data(), palabras.data(), c.bytes);
+  return true;
+}
+
+bool decodificarTrozo(const uint8_t* datos, size_t n, std::vector<FilaArchivo>& filas) {
+  CabeceraTrozo c;
+  if (n < sizeof(c)) return false;
+  memcpy(&c, datos, sizeof(c));
+  if (!cabeceraValida(c) || c.bytes > n) return false;
+  std::vector<uint32_t> palabras(c.bytes / 4);
+  memcpy(palabras.data(), datos, c.bytes);
+  uint32_t bloques = numBloques(c.filas);
+  size_t rellenas = (size_t)bloques * VALORES_POR_BLOQUE;
+  std::vector<uint32_t> valores(rellenas);
+  std::vector<int64_t> tiempos(rellenas);
+  size_t base = filas.size();
+  filas.resize(base + c.filas);
+  FilaArchivo* f = filas.data() + base;
+
+  for (uint8_t col = 0; col < NUM_COLUMNAS; col++) {
+    const uint32_t* p = palabras.data() + c.posicionColumna[col] / 4;
+    size_t tam = (c.posicionColumna[col + 1] - c.posicionColumna[col]) / 4;
+    if (col == COL_RECIBIDO || col == COL_INSTANTE) {
+      LectorTiempos lector;
+      if (!lector.ver(p, tam, c.filas)) return false;
+      for (uint32_t k = 0; k < bloques; k++) lector.leer(tiempos.data() + k * VALORES_POR_BLOQUE);
+      for (uint32_t i = 0; i < c.filas; i++) {
+        (col == COL_RECIBIDO ? f[i].recibido : f[i].instante) = tiempos[i];
+      }
+      continue;
+    }
+    VistaDiccionario d;
+    VistaFor v;
+    if (col == COL_EQUIPO) {
+      if (!verDiccionario(p, tam, c.filas, d)) return false;
+      v = d.codigos;
+    } else if (!verFor(p, tam, c.filas, v)) {
+      return false;
+    }
+    LectorFor lector(v);
+    for (uint32_t k = 0; k < bloques; k++) lector.leer(valores.data() + k * VALORES_POR_BLOQUE);
+    for (uint32_t i = 0; i < c.filas; i++) {
+      uint32_t x = valores[i];
+      switch (col) {
+        case COL_EQUIPO:
+          if (x >= d.numEntradas) return false;
+          f[i].idDispositivo = d.entradas[x];
+          break;
+        case COL_SECUENCIA: f[i].secuencia = x; break;
+        case COL_MARCA: f[i].marcaMs = x; break;
+        case COL_SUJETO: f[i].idSujeto = x; break;
+        case COL_VINCULADA: f[i].secuenciaVinculada = x; break;
+        case COL_ALCOHOL: f[i].alcoholMg100ml = (uint16_t)x; break;
+        case COL_ALARMA: f[i].alarma = (uint8_t)x; break;
+        case COL_BANDERAS: f[i].banderas = (uint8_t)x; break;
+        case COL_TIMEOUTS: f[i].timeoutsEnlace = (uint8_t)x; break;
+        case COL_INTERRUMPIDOS: f[i].soplidosInterrumpidos = (uint8_t)x; break;
+        default: f[i].precalentamientoMs = (uint16_t)x; break;
+      }
+    }
+  }
+  return true;
+}
+
+// ---------------------------------------------------------------------------
+// Fichero
+
+static bool escribirTodo(int fd, const void* datos, size_t n, uint64_t posicion) {
+  const uint8_t* p = (const uint8_t*)datos;
+  while (n > 0) {
+    ssize_t escritos = pwrite(fd, p, n, (off_t)posicion);
+    if (escritos <= 0) return false;
+    p += escritos;
+    n -= (size_t)escritos;
+    posicion += (uint64_t)escritos;
+  }
+  return true;
+}
+
+static bool leerTodo(int fd, void* datos, size_t n, uint64_t posicion) {
+  uint8_t* p = (uint8_t*)datos;
+  while (n > 0) {
+    ssize_t leidos = pread(fd, p, n, (off_t)posicion);
+    if (leidos <= 0) return false;
+    p += leidos;
+    n -= (size_t)leidos;
+    posicion += (uint64_t)leidos;
+  }
+  return true;
+}
+
+ArchivoColumnar::~ArchivoColumnar() {
+  if (fd >= 0) close(fd);
+}
+
+bool ArchivoColumnar::abrir(const char* ruta, uint64_t tamAlmacen) {
+  fd = open(ruta, O_RDWR | O_CREAT, 0644);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0) return false;
+  uint64_t tamFichero = (uint64_t)st.st_size;
+
+  uint64_t posicion = 0;
+  Trozo t;
+  while (posicion + sizeof(t.cabecera) <= tamFichero &&
+         leerTodo(fd, &t.cabecera, sizeof(t.cabecera), posicion)) {
+    const CabeceraTrozo& c = t.cabecera;
+    if (!cabeceraValida(c) || c.inicioAlmacen != finAlmacenArchivado ||
+        c.finAlmacen > tamAlmacen || posicion + c.bytes > tamFichero) {
+      break;
+    }
+    t.posicion = posicion;
+    trozos.push_back(t);
+    finAlmacenArchivado = c.finAlmacen;
+    filasArchivadas += c.filas;
+    posicion += c.bytes;
+  }
+  // Lo que sigue es un trozo interrumpido o de otro almacén
+  if (posicion < tamFichero && ftruncate(fd, (off_t)posicion) != 0) return false;
+  finFichero = posicion;
+  return true;
+}
+
+bool ArchivoColumnar::anexar(const FilaArchivo* filas, uint32_t n, uint64_t finAlmacen) {
+  if (fd < 0) return false;
+  std::vector<uint8_t> bytes;
+  if (!codificarTrozo(filas, n, finAlmacenArchivado, finAlmacen, bytes)) return false;
+  if (!escribirTodo(fd, bytes.data(), bytes.size(), finFichero) || fsync(fd) != 0) return false;
+  Trozo t;
+  t.posicion = finFichero;
+  memcpy(&t.cabecera, bytes.data(), sizeof(t.cabecera));
+  trozos.push_back(t);
+  finFichero += bytes.size();
+  finAlmacenArchivado = finAlmacen;
+  filasArchivadas += n;
+  return true;
+}
+
+bool ArchivoColumnar::leerColumna(const Trozo& t, ColumnaArchivo c,
+                                  std::vector<uint32_t>& palabras) const {
+  uint32_t desde = t.cabecera.posicionColumna[c], hasta = t.cabecera.posicionColumna[c + 1];
+  palabras.resize((hasta - desde) / 4);
+  return leerTodo(fd, palabras.data(), hasta - desde, t.posicion + desde);
+}
+
+bool ArchivoColumnar::leerTrozo(size_t i, std::vector<FilaArchivo>& filas) const {
+  if (i >= trozos.size()) return false;
+  std::vector<uint8_t> bytes(trozos[i].cabecera.bytes);
+  return leerTodo(fd, bytes.data(), bytes.size(), trozos[i].posicion) &&
+         decodificarTrozo(bytes.data(), bytes.size(), filas);
+}
+
+// Bloque entero dentro del recorrido: sin saltos y con 128 vueltas fijas,
+// el compilador lo hace con vectores
+static inline void acumularBloque(const uint32_t* alcohol, const uint32_t* alarma,
+                                  uint32_t& suma, uint32_t& maximo, uint32_t* porAlarma) {
+  uint32_t s = 0, m = 0, ninguna = 0, bebido = 0;
+  for (uint32_t i = 0; i < VALORES_POR_BLOQUE; i++) {
+    s += alcohol[i];
+    m = alcohol[i] > m ? alcohol[i] : m;
+    ninguna += alarma[i] == 0;
+    bebido += alarma[i] == 1;
+  }
+  suma = s;
+  maximo = m;
+  porAlarma[0] = ninguna;
+  porAlarma[1] = bebido;
+  porAlarma[2] = VALORES_POR_BLOQUE - ninguna - bebido;
+}
+
+bool ArchivoColumnar::agregar(int64_t desde, int64_t hasta,
+                              const std::function<bool(uint32_t)>& equipo, Agregado& total,
+                              EstadisticasRecorrido* estadisticas) const {
+  EstadisticasRecorrido e = {0, 0, 0, 0};
+  std::vector<uint32_t> colEquipo, colAlcohol, colAlarma, colInstante;
+  std::vector<uint8_t> seleccion;
+  uint32_t alcohol[VALORES_POR_BLOQUE], alarma[VALORES_POR_BLOQUE];
+  uint32_t codigos[VALORES_POR_BLOQUE];
+  int64_t instantes[VALORES_POR_BLOQUE];
+  bool bien = true;
+
+  for (const Trozo& t : trozos) {
+    const CabeceraTrozo& c = t.cabecera;
+    e.trozos++;
+    if (c.zona.maxInstante < desde || c.zona.minInstante >= hasta) {
+      e.descartadosZona++;
+      continue;
+    }
+    bool completo = c.zona.minInstante >= desde && c.zona.maxInstante < hasta;
+
+    // Equipos aceptados, uno por entrada del diccionario
+    bool filtrar = false;
+    VistaDiccionario d;
+    if (equipo) {
+      if (!leerColumna(t, COL_EQUIPO, colEquipo) ||
+          !verDiccionario(colEquipo.data(), colEquipo.size(), c.filas, d)) {
+        bien = false;
+        continue;
+      }
+      seleccion.assign(d.numEntradas, 0);
+      uint32_t aceptados = 0;
+      for (uint32_t i = 0; i < d.numEntradas; i++) {
+        seleccion[i] = equipo(d.entradas[i]);
+        aceptados += seleccion[i];
+      }
+      if (aceptados == 0) {
+        e.descartadosZona++;
+        continue;
+      }
+      filtrar = aceptados < d.numEntradas;
+      e.bytesLeidos += colEquipo.size() * 4;
+    }
+
+    VistaFor vAlcohol, vAlarma;
+    LectorTiempos tiempos;
+    if (!leerColumna(t, COL_ALCOHOL, colAlcohol) || !leerColumna(t, COL_ALARMA, colAlarma) ||
+        !verFor(colAlcohol.data(), colAlcohol.size(), c.filas, vAlcohol) ||
+        !verFor(colAlarma.data(), colAlarma.size(), c.filas, vAlarma) ||
+        (!completo && (!leerColumna(t, COL_INSTANTE, colInstante) ||
+                       !tiempos.ver(colInstante.data(), colInstante.size(), c.filas)))) {
+      bien = false;
+      continue;
+    }
+    e.bytesLeidos += (colAlcohol.size() + colAlarma.size()) * 4;
+    if (!completo) e.bytesLeidos += colInstante.size() * 4;
+    e.filasLeidas += c.filas;
+
+    LectorFor lAlcohol(vAlcohol), lAlarma(vAlarma);
+    LectorFor lCodigos(filtrar ? d.codigos : vAlcohol);
+    uint32_t bloques = numBloques(c.filas);
+    for (uint32_t k = 0; k < bloques; k++) {
+      uint32_t n = std::min<uint32_t>(VALORES_POR_BLOQUE, c.filas - k * VALORES_POR_BLOQUE);
+      lAlcohol.leer(alcohol);
+      lAlarma.leer(alarma);
+      uint32_t suma = 0, maximo = 0, pruebas = 0;
+      uint32_t porAlarma[3] = {0, 0, 0};
+      if (completo && !filtrar && n == VALORES_POR_BLOQUE) {
+        acumularBloque(alcohol, alarma, suma, maximo, porAlarma);
+        pruebas = n;
+      } else {
+        if (filtrar) lCodigos.leer(codigos);
+        if (!completo) tiempos.leer(instantes);
+        for (uint32_t i = 0; i < n; i++) {
+          uint32_t dentro = (completo || (instantes[i] >= desde && instantes[i] < hasta)) &&
+                            (!filtrar || (codigos[i] < d.numEntradas && seleccion[codigos[i]]));
+          uint32_t mascara = 0u - dentro;
+          suma += alcohol[i] & mascara;
+          maximo = std::max(maximo, alcohol[i] & mascara);
+          pruebas += dentro;
+          porAlarma[0] += dentro & (alarma[i] == 0);
+          porAlarma[1] += dentro & (alarma[i] == 1);
+        }
+        porAlarma[2] = pruebas - porAlarma[0] - porAlarma[1];
+      }
+      total.pruebas += pruebas;
+      for (uint8_t a = 0; a < 3; a++) total.porAlarma[a] += porAlarma[a];
+      total.sumaMg += suma;
+      if (maximo > total.maxMg) total.maxMg = (uint16_t)maximo;
+    }
+  }
+  if (estadisticas != nullptr) *estadisticas = e;
+  return bien;
+}
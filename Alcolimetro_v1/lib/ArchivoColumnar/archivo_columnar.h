@@ -0,0 +1,157 @@
+/*
+ * Archivo columnar comprimido del historial frío de resultados.
+ *
+ * El colector convierte cada tramo sellado del CSV de resultados (los
+ * segmentos de lib/IndiceSujetos) en un trozo de <resultados>.archivo con
+ * una columna por campo:
+ *
+ *   - equipo: diccionario ordenado de los equipos del trozo y sus códigos
+ *   - recibido e instante: delta de la delta, casi siempre pocos bits
+ *     porque llegan casi en orden
+ *   - el resto (alcohol, alarma, sujeto...): marco de referencia por
+ *     bloque de 128 valores, que con la alarma deja 2 bits por prueba
+ *
+ * Todo va empaquetado por bloques de 128 valores en cuatro carriles
+ * entrelazados (valor i en el carril i % 4), así que desempaquetar un
+ * bloque son 32 pasos de cuatro desplazamientos iguales: un vector de
+ * 4 × 32 bits. Cada trozo lleva en la cabecera sus mínimos y máximos
+ * (mapa de zonas) y dónde empieza cada columna, y un recorrido sólo lee
+ * las columnas que necesita de los trozos que el mapa no descarta.
+ *
+ * Como en el índice, el almacén manda: un trozo a medio escribir o que
+ * va más allá del final del CSV se descarta al abrir, y lo que queda
+ * detrás de finArchivado() se vuelve a convertir.
+ */
+#ifndef ARCHIVO_COLUMNAR_H
+#define ARCHIVO_COLUMNAR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <vector>
+#include "agregados_flota.h"
+
+#define VALORES_POR_BLOQUE 128
+#define MAX_FILAS_TROZO (1u << 16)
+
+// Una línea del CSV de resultados del colector
+struct FilaArchivo {
+  uint32_t idDispositivo;
+  uint32_t secuencia;
+  uint32_t marcaMs;
+  uint32_t idSujeto;
+  uint32_t secuenciaVinculada;
+  uint16_t alcoholMg100ml;
+  uint8_t alarma;
+  uint8_t banderas;
+  uint8_t timeoutsEnlace;
+  uint8_t soplidosInterrumpidos;
+  uint16_t precalentamientoMs;
+  int64_t recibido;
+  int64_t instante;
+};
+
+enum ColumnaArchivo : uint8_t {
+  COL_EQUIPO = 0,
+  COL_SECUENCIA,
+  COL_MARCA,
+  COL_SUJETO,
+  COL_VINCULADA,
+  COL_ALCOHOL,
+  COL_ALARMA,
+  COL_BANDERAS,
+  COL_TIMEOUTS,
+  COL_INTERRUMPIDOS,
+  COL_PRECALENTAMIENTO,
+  COL_RECIBIDO,
+  COL_INSTANTE,
+  NUM_COLUMNAS
+};
+
+struct MapaZona {
+  int64_t minInstante;
+  int64_t maxInstante;
+  uint32_t minEquipo;
+  uint32_t maxEquipo;
+  uint32_t minSujeto;
+  uint32_t maxSujeto;
+  uint16_t minAlcohol;
+  uint16_t maxAlcohol;
+  uint8_t alarmas;          // bit por valor de alarma presente (0..7)
+  uint8_t relleno[3];
+};
+
+// En el fichero, seguida de las columnas; posicionColumna es relativa al
+// inicio del trozo y la última entrada es el final. Little endian.
+struct CabeceraTrozo {
+  uint32_t magia;
+  uint16_t version;
+  uint16_t numColumnas;
+  uint32_t filas;
+  uint32_t bytes;
+  uint64_t inicioAlmacen;
+  uint64_t finAlmacen;
+  MapaZona zona;
+  uint32_t posicionColumna[NUM_COLUMNAS + 1];
+};
+
+struct EstadisticasRecorrido {
+  uint32_t trozos;
+  uint32_t descartadosZona;     // por el mapa de zonas o el diccionario
+  uint64_t filasLeidas;
+  uint64_t bytesLeidos;
+};
+
+// Núcleos de un bloque de VALORES_POR_BLOQUE valores de 'bits' bits
+// (0..32): empaquetar escribe 4·bits palabras, que han de estar a cero;
+// desempaquetar suma 'base' a cada valor
+void empaquetarBloque(const uint32_t* valores, unsigned bits, uint32_t* salida);
+void desempaquetarBloque(const uint32_t* entrada, unsigned bits, uint32_t base,
+                         uint32_t* salida);
+
+// Codifica de 1 a MAX_FILAS_TROZO filas del tramo [inicioAlmacen,
+// finAlmacen) del CSV como un trozo completo, cabecera incluida
+bool codificarTrozo(const FilaArchivo* filas, uint32_t n, uint64_t inicioAlmacen,
+                    uint64_t finAlmacen, std::vector<uint8_t>& salida);
+bool decodificarTrozo(const uint8_t* datos, size_t n, std::vector<FilaArchivo>& filas);
+
+class ArchivoColumnar {
+public:
+  ~ArchivoColumnar();
+
+  // Abre o crea el archivo de un almacén de 'tamAlmacen' bytes
+  bool abrir(const char* ruta, uint64_t tamAlmacen);
+
+  // Hasta dónde del almacén está archivado
+  uint64_t finArchivado() const { return finAlmacenArchivado; }
+
+  // Añade un trozo con las filas de [finArchivado(), finAlmacen)
+  bool anexar(const FilaArchivo* filas, uint32_t n, uint64_t finAlmacen);
+
+  // Suma a 'total' las pruebas con instante en [desde, hasta) de los
+  // equipos que acepta 'equipo' (todos si está vacío)
+  bool agregar(int64_t desde, int64_t hasta, const std::function<bool(uint32_t)>& equipo,
+               Agregado& total, EstadisticasRecorrido* estadisticas = nullptr) const;
+
+  bool leerTrozo(size_t i, std::vector<FilaArchivo>& filas) const;
+
+  size_t numTrozos() const { return trozos.size(); }
+  uint64_t filas() const { return filasArchivadas; }
+  uint64_t bytesArchivo() const { return finFichero; }
+
+private:
+  struct Trozo {
+    uint64_t posicion;
+    CabeceraTrozo cabecera;
+  };
+
+  bool leerColumna(const Trozo& t, ColumnaArchivo c, std::vector<uint32_t>& palabras) const;
+
+  int fd = -1;
+  uint64_t finFichero = 0;
+  uint64_t finAlmacenArchivado = 0;
+  uint64_t filasArchivadas = 0;
+  std::vector<Trozo> trozos;
+};
+
+#endif
@@ -0,0 +1,169 @@
+/*
+ * Bus de eventos publicación/suscripción resuelto en compilación.
+ *
+ * Cada tema es un tipo Tema<Evento, Suscriptores...>. Un suscriptor es un
+ * tipo con una función estática alRecibir(const Evento&); publicar() se
+ * expande a una secuencia fija de llamadas directas, sin punteros a
+ * función ni memoria dinámica.
+ *
+ * Un suscriptor lento puede declarar
+ *   static constexpr bool diferido = true;
+ *   static constexpr size_t capacidadCola = N;   // opcional, 8 por defecto
+ * y recibe los eventos más tarde, cuando loop() llama a despachar(). Si su
+ * cola está llena el evento se descarta y se cuenta en perdidos().
+ */
+#ifndef BUS_EVENTOS_H
+#define BUS_EVENTOS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+#include "protocolo_ze29a.h"
+
+// Eventos del sensor
+
+struct EventoEstado {
+  uint8_t anterior;
+  uint8_t actual;
+  uint32_t marcaMs;
+};
+
+struct EventoResultado {
+  ResultadoPrueba resultado;
+  uint32_t marcaMs;
+  uint32_t secuencia;     // de la prueba terminada (entrega_resultados.h)
+};
+
+// Lo observado durante una prueba para vigilar el sensor desde el colector
+// (lib/AnomaliasFlota)
+struct SaludPrueba {
+  uint8_t timeoutsEnlace;         // desde la prueba anterior, saturado
+  uint8_t soplidosInterrumpidos;  // saturado
+  uint16_t precalentamientoMs;    // 0 si no se vio entero
+};
+
+// Resultado ya anotado en el historial de pruebas, con su vínculo a la
+// prueba original si era la confirmatoria
+struct EventoPruebaRegistrada {
+  ResultadoPrueba resultado;
+  uint32_t idPrueba;
+  uint32_t idVinculado;   // 0 si no hay
+  uint32_t idSujeto;      // 0 si no se indicó
+  bool confirmatoria;
+  bool cierraSesion;      // no queda prueba confirmatoria pendiente
+  uint32_t marcaMs;
+  uint32_t secuenciaResultado;  // la del EventoResultado de origen
+  SaludPrueba salud;
+};
+
+enum TipoFalloEnlace : uint8_t {
+  FALLO_TIMEOUT = 0,          // leerRespuesta sin trama completa
+  FALLO_RESPUESTA_INVALIDA,   // cabecera o comando inesperados
+  FALLO_CHECKSUM,
+  FALLO_RECHAZO               // el sensor respondió pero rechazó el comando
+};
+
+struct EventoFalloEnlace {
+  TipoFalloEnlace tipo;
+  uint8_t comando;   // 0 si no se conoce
+  uint8_t bytesParciales;
+  uint32_t marcaMs;
+};
+
+enum ParametroConfiguracion : uint8_t {
+  CONFIG_TIEMPO_SOPLADO = 0,
+  CONFIG_UMBRALES
+};
+
+struct EventoConfiguracion {
+  ParametroConfiguracion parametro;
+  uint8_t valor;       // tiempo de soplado o umbral de bebido
+  uint8_t valor2;      // umbral de ebriedad
+  uint32_t marcaMs;
+};
+
+namespace bus {
+
+template <typename S, typename = void>
+struct EsDiferido : std::false_type {};
+template <typename S>
+struct EsDiferido<S, std::void_t<decltype(S::diferido)>>
+  : std::integral_constant<bool, S::diferido> {};
+
+template <typename S, typename = void>
+struct Capacidad : std::integral_constant<size_t, 8> {};
+template <typename S>
+struct Capacidad<S, std::void_t<decltype(S::capacidadCola)>>
+  : std::integral_constant<size_t, S::capacidadCola> {};
+
+// Cola acotada de un suscriptor diferido para un tipo de evento. Sólo se
+// usa desde loop(), así que no necesita sincronización.
+template <typename S, typename Evento>
+struct ColaDiferida {
+  static constexpr size_t N = Capacidad<S>::value;
+  inline static Evento eventos[N];
+  inline static size_t cabeza = 0;
+  inline static size_t cantidad = 0;
+  inline static uint32_t perdidos = 0;
+
+  static void encolar(const Evento& e) {
+    if (cantidad == N) {
+      perdidos++;
+      return;
+    }
+    eventos[(cabeza + cantidad) % N] = e;
+    cantidad++;
+  }
+
+  static void vaciar() {
+    while (cantidad > 0) {
+      Evento e = eventos[cabeza];
+      cabeza = (cabeza + 1) % N;
+      cantidad--;
+      S::alRecibir(e);
+    }
+  }
+};
+
+template <typename S, typename Evento>
+inline void entregar(const Evento& e) {
+  if constexpr (EsDiferido<S>::value) {
+    ColaDiferida<S, Evento>::encolar(e);
+  } else {
+    S::alRecibir(e);
+  }
+}
+
+template <typename S, typename Evento>
+inline void vaciarSiDiferido() {
+  if constexpr (EsDiferido<S>::value) ColaDiferida<S, Evento>::vaciar();
+}
+
+template <typename S, typename Evento>
+inline uint32_t perdidosSiDiferido() {
+  if constexpr (EsDiferido<S>::value) {
+    return ColaDiferida<S, Evento>::perdidos;
+  } else {
+    return 0;
+  }
+}
+
+}  // namespace bus
+
+template <typename Evento, typename... Suscriptores>
+struct Tema {
+  static void publicar(const Evento& e) {
+    (bus::entregar<Suscriptores>(e), ...);
+  }
+
+  // Entrega lo pendiente a los suscriptores diferidos
+  static void despachar() {
+    (bus::vaciarSiDiferido<Suscriptores, Evento>(), ...);
+  }
+
+  static uint32_t perdidos() {
+    return (0u + ... + bus::perdidosSiDiferido<Suscriptores, Evento>());
+  }
+};
+
+#endif
@@ -0,0 +1,34 @@
+#include "calidad_enlace.h"
+#include <algorithm>
+
+const uint16_t TASAS_BARRIDO_HZ[NUM_TASAS_BARRIDO] = {5, 10, 20, 25, 33, 40, 50};
+
+void CalidadEnlace::reiniciar() {
+  numMuestras = 0;
+  ordenadas = true;
+  maximo = 0;
+  correctas = perdidas = erroresChecksum = invalidas = 0;
+  bytesFueraDeTurno = 0;
+}
+
+void CalidadEnlace::registrarRtt(uint32_t us) {
+  correctas++;
+  if (us > maximo) maximo = us;
+  // Pasado el máximo de muestras sólo se cuentan; el máximo sigue exacto
+  if (numMuestras < MAX_MUESTRAS_ENLACE) {
+    muestras[numMuestras++] = us;
+    ordenadas = false;
+  }
+}
+
+uint32_t CalidadEnlace::percentilUs(uint8_t p) {
+  if (numMuestras == 0) return 0;
+  if (!ordenadas) {
+    std::sort(muestras, muestras + numMuestras);
+    ordenadas = true;
+  }
+  // Rango más cercano: ceil(p/100 * n), base 1
+  uint32_t rango = ((uint32_t)p * numMuestras + 99) / 100;
+  if (rango == 0) rango = 1;
+  return muestras[rango - 1];
+}
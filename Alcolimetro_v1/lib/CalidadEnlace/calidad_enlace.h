@@ -0,0 +1,150 @@
+/*
+ * Medida de la calidad del enlace serie con el sensor.
+ *
+ * Envía N consultas de estado (0x85) a una tasa fija, una por turno: cada
+ * consulta tiene hasta el siguiente turno para recibir su respuesta
+ * completa o cuenta como perdida. Registra el RTT (desde que se escribe
+ * la trama hasta el último byte de la respuesta), los errores de
+ * checksum, las respuestas inválidas y los bytes que llegan fuera de
+ * turno. El barrido repite la medida subiendo la tasa para encontrar la
+ * máxima sin pérdidas.
+ *
+ * A 9600 baudios pregunta y respuesta ocupan ~19 ms de línea, así que por
+ * encima de ~50 Hz no cabe una consulta por turno.
+ */
+#ifndef CALIDAD_ENLACE_H
+#define CALIDAD_ENLACE_H
+
+#include <stdint.h>
+#include "protocolo_ze29a.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+#define MAX_MUESTRAS_ENLACE 1000
+#define CONSULTAS_ENLACE_DEFECTO 200
+#define TASA_ENLACE_DEFECTO_HZ 20
+#define CONSULTAS_POR_TASA_BARRIDO 40
+
+// Tasas probadas en el barrido, de menor a mayor
+#define NUM_TASAS_BARRIDO 7
+extern const uint16_t TASAS_BARRIDO_HZ[NUM_TASAS_BARRIDO];
+
+class CalidadEnlace {
+public:
+  CalidadEnlace() { reiniciar(); }
+
+  void reiniciar();
+  void registrarRtt(uint32_t us);
+  void registrarPerdida() { perdidas++; }
+  void registrarErrorChecksum() { erroresChecksum++; }
+  void registrarInvalida() { invalidas++; }
+  void registrarFueraDeTurno(uint32_t bytes) { bytesFueraDeTurno += bytes; }
+
+  uint32_t enviadas() const { return correctas + perdidas + erroresChecksum + invalidas; }
+  uint32_t respuestasCorrectas() const { return correctas; }
+  uint32_t tramasPerdidas() const { return perdidas; }
+  uint32_t tramasConErrorChecksum() const { return erroresChecksum; }
+  uint32_t respuestasInvalidas() const { return invalidas; }
+  uint32_t bytesFuera() const { return bytesFueraDeTurno; }
+  bool sinPerdidas() const { return correctas > 0 && correctas == enviadas(); }
+
+  // Percentil por rango más cercano (0-100); ordena las muestras
+  uint32_t percentilUs(uint8_t p);
+  uint32_t maximoUs() const { return maximo; }
+
+private:
+  uint32_t muestras[MAX_MUESTRAS_ENLACE];
+  uint32_t numMuestras;
+  bool ordenadas;
+  uint32_t maximo;
+  uint32_t correctas;
+  uint32_t perdidas;
+  uint32_t erroresChecksum;
+  uint32_t invalidas;
+  uint32_t bytesFueraDeTurno;
+};
+
+// Cede la CPU en las esperas de la medida. Con margen duerme un tick y
+// corren también las tareas de menor prioridad; cerca del plazo basta
+// yield() para no retrasar la consulta ni el RTT.
+inline void cederEnlace(uint32_t restanteUs) {
+#ifdef ARDUINO
+  if (restanteUs > 2000) {
+    delay(1);
+  } else {
+    yield();
+  }
+#else
+  (void)restanteUs;
+#endif
+}
+
+// Ejecuta la medida sobre 'puerto' (available/read/write/flush como
+// HardwareSerial) con 'reloj' devolviendo microsegundos
+template <typename Puerto, typename Reloj>
+void medirEnlace(Puerto& puerto, Reloj reloj, uint16_t consultas,
+                 uint16_t tasaHz, CalidadEnlace& calidad) {
+  uint8_t consulta[LONGITUD_TRAMA];
+  construirTrama(consulta, CMD_LEER_ESTADO);
+  uint32_t periodoUs = 1000000UL / (tasaHz > 0 ? tasaHz : 1);
+
+  calidad.reiniciar();
+  while (puerto.available()) puerto.read();
+  uint32_t turno = reloj();
+  for (uint16_t i = 0; i < consultas; i++, turno += periodoUs) {
+    int32_t restante;
+    while ((restante = (int32_t)(turno - reloj())) > 0) {
+      cederEnlace((uint32_t)restante);
+    }
+    uint32_t fuera = 0;
+    while (puerto.available()) {
+      puerto.read();
+      fuera++;
+    }
+    calidad.registrarFueraDeTurno(fuera);
+
+    puerto.write(consulta, LONGITUD_TRAMA);
+    uint32_t enviado = reloj();
+    uint32_t limite = turno + periodoUs;
+    AnalizadorTramas analizador(false);
+    bool completa = false;
+    while (!completa && (int32_t)(reloj() - limite) < 0) {
+      if (puerto.available()) {
+        completa = analizador.alimentar((uint8_t)puerto.read());
+      } else {
+        cederEnlace(0);  // el RTT no admite el tick de delay()
+      }
+    }
+
+    if (!completa) {
+      calidad.registrarPerdida();
+    } else if (!analizador.tramaConChecksumValido()) {
+      calidad.registrarErrorChecksum();
+    } else if (analizador.trama()[1] != CMD_LEER_ESTADO) {
+      calidad.registrarInvalida();
+    } else {
+      calidad.registrarRtt(reloj() - enviado);
+    }
+  }
+}
+
+// Repite la medida con cada tasa de TASAS_BARRIDO_HZ mientras no haya
+// pérdidas; devuelve la tasa más alta sin pérdidas o 0. 'informar' recibe
+// (tasaHz, calidad) tras cada tasa.
+template <typename Puerto, typename Reloj, typename Informe>
+uint16_t barrerTasas(Puerto& puerto, Reloj reloj, CalidadEnlace& calidad,
+                     Informe informar) {
+  uint16_t maxima = 0;
+  for (uint8_t i = 0; i < NUM_TASAS_BARRIDO; i++) {
+    medirEnlace(puerto, reloj, CONSULTAS_POR_TASA_BARRIDO, TASAS_BARRIDO_HZ[i],
+                calidad);
+    informar(TASAS_BARRIDO_HZ[i], calidad);
+    if (!calidad.sinPerdidas()) break;
+    maxima = TASAS_BARRIDO_HZ[i];
+  }
+  return maxima;
+}
+
+#endif
@@ -0,0 +1,184 @@
+/*
+ * Colas en anillo acotadas y sin cerrojos, sólo cabecera.
+ *
+ *   ColaSpsc<T, N>  un productor y un consumidor
+ *   ColaMpsc<T, N>  varios productores y un consumidor
+ *
+ * La capacidad N es fija en compilación y potencia de dos; los índices
+ * corren libres en 32 bits y se enmascaran al acceder. Ninguna operación
+ * bloquea ni reserva memoria: meter() en una cola llena y sacar() en una
+ * vacía devuelven false.
+ *
+ * Orden de memoria: el productor escribe el elemento y publica con un
+ * store release; el consumidor lo ve con un load acquire antes de leerlo,
+ * y devuelve el hueco con otro release. Con std::atomic esto genera memw
+ * en Xtensa y movs simples en x86, donde el modelo TSO ya lo garantiza.
+ *
+ * Desde una ISR del ESP32: los índices son atómicos de 32 bits sin
+ * cerrojo (S32C1I en Xtensa), así que cualquier extremo puede ser una
+ * ISR siempre que cada papel lo ocupe uno solo (en SPSC) o que sólo haya
+ * un consumidor (en MPSC). Las variantes meterIsr()/sacarIsr() son las
+ * mismas operaciones forzadas en línea para que el código quede dentro
+ * de la ISR, que está en IRAM, y no en flash. La cola debe estar en RAM
+ * interna (no en PSRAM) y T tiene que poder copiarse con memcpy.
+ *
+ * Cada índice va en su propia línea de caché para que productor y
+ * consumidor no se pisen: 64 bytes en el host. La RAM interna del ESP32
+ * no tiene caché de datos y ahí basta con alinear a 4 bytes.
+ */
+#ifndef COLAS_ANILLO_H
+#define COLAS_ANILLO_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+
+#ifdef ESP32
+#define LINEA_CACHE_COLA 4
+#else
+#define LINEA_CACHE_COLA 64
+#endif
+
+#define EN_LINEA_COLA inline __attribute__((always_inline))
+
+namespace colas {
+
+template <size_t N>
+constexpr bool potenciaDeDos() {
+  return N >= 2 && (N & (N - 1)) == 0;
+}
+
+template <typename T, size_t N>
+struct ComprobarCola {
+  static_assert(potenciaDeDos<N>(), "la capacidad debe ser potencia de dos");
+  static_assert(N <= (1u << 31), "los índices son de 32 bits");
+  static_assert(std::is_trivially_copyable<T>::value,
+                "los elementos se copian sin constructores");
+  static_assert(std::atomic<uint32_t>::is_always_lock_free,
+                "hacen falta atómicos sin cerrojo");
+};
+
+}  // namespace colas
+
+template <typename T, size_t N>
+class ColaSpsc : colas::ComprobarCola<T, N> {
+public:
+  static constexpr size_t capacidad = N;
+
+  bool meter(const T& valor) { return meterEnLinea(valor); }
+  bool sacar(T& valor) { return sacarEnLinea(valor); }
+  EN_LINEA_COLA bool meterIsr(const T& valor) { return meterEnLinea(valor); }
+  EN_LINEA_COLA bool sacarIsr(T& valor) { return sacarEnLinea(valor); }
+
+  // Aproximado si el otro extremo está operando
+  size_t tamano() const {
+    return cabeza.load(std::memory_order_acquire) - cola.load(std::memory_order_acquire);
+  }
+  bool vacia() const { return tamano() == 0; }
+
+private:
+  EN_LINEA_COLA bool meterEnLinea(const T& valor) {
+    uint32_t c = cabeza.load(std::memory_order_relaxed);
+    // La posición del consumidor se relee sólo si la copia local dice que
+    // no hay sitio: ahorra tráfico entre núcleos en el caso normal
+    if (c - colaVista == N) {
+      colaVista = cola.load(std::memory_order_acquire);
+      if (c - colaVista == N) return false;
+    }
+    elementos[c & (N - 1)] = valor;
+    cabeza.store(c + 1, std::memory_order_release);
+    return true;
+  }
+
+  EN_LINEA_COLA bool sacarEnLinea(T& valor) {
+    uint32_t c = cola.load(std::memory_order_relaxed);
+    if (c == cabezaVista) {
+      cabezaVista = cabeza.load(std::memory_order_acquire);
+      if (c == cabezaVista) return false;
+    }
+    valor = elementos[c & (N - 1)];
+    cola.store(c + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Lado del productor
+  alignas(LINEA_CACHE_COLA) std::atomic<uint32_t> cabeza{0};
+  uint32_t colaVista = 0;
+  // Lado del consumidor
+  alignas(LINEA_CACHE_COLA) std::atomic<uint32_t> cola{0};
+  uint32_t cabezaVista = 0;
+  alignas(LINEA_CACHE_COLA) T elementos[N];
+};
+
+// Cola de Vyukov acotada: cada celda lleva un número de secuencia que dice
+// de quién es. Un productor reserva la celda con un CAS sobre la cabeza,
+// copia el elemento y la publica. Si lo interrumpen entre la reserva y la
+// publicación, los demás productores siguen (la cabeza ya avanzó) y el
+// consumidor ve la cola vacía en esa celda hasta que termine: nadie espera
+// activamente, así que también se puede meter desde una ISR.
+template <typename T, size_t N>
+class ColaMpsc : colas::ComprobarCola<T, N> {
+public:
+  static constexpr size_t capacidad = N;
+
+  ColaMpsc() {
+    for (uint32_t i = 0; i < N; i++) {
+      celdas[i].secuencia.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  bool meter(const T& valor) { return meterEnLinea(valor); }
+  bool sacar(T& valor) { return sacarEnLinea(valor); }
+  EN_LINEA_COLA bool meterIsr(const T& valor) { return meterEnLinea(valor); }
+  EN_LINEA_COLA bool sacarIsr(T& valor) { return sacarEnLinea(valor); }
+
+  size_t tamano() const {
+    return cabeza.load(std::memory_order_acquire) - cola.load(std::memory_order_acquire);
+  }
+  bool vacia() const { return tamano() == 0; }
+
+private:
+  struct Celda {
+    std::atomic<uint32_t> secuencia;
+    T dato;
+  };
+
+  EN_LINEA_COLA bool meterEnLinea(const T& valor) {
+    uint32_t pos = cabeza.load(std::memory_order_relaxed);
+    Celda* celda;
+    for (;;) {
+      celda = &celdas[pos & (N - 1)];
+      uint32_t sec = celda->secuencia.load(std::memory_order_acquire);
+      int32_t diferencia = (int32_t)(sec - pos);
+      if (diferencia == 0) {
+        // Libre para esta vuelta: reservarla
+        if (cabeza.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+      } else if (diferencia < 0) {
+        return false;  // la celda aún guarda un elemento de la vuelta anterior
+      } else {
+        pos = cabeza.load(std::memory_order_relaxed);  // otro productor ganó
+      }
+    }
+    celda->dato = valor;
+    celda->secuencia.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  EN_LINEA_COLA bool sacarEnLinea(T& valor) {
+    uint32_t pos = cola.load(std::memory_order_relaxed);
+    Celda& celda = celdas[pos & (N - 1)];
+    if (celda.secuencia.load(std::memory_order_acquire) != pos + 1) return false;
+    valor = celda.dato;
+    // Libre para la vuelta siguiente
+    celda.secuencia.store(pos + N, std::memory_order_release);
+    cola.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  alignas(LINEA_CACHE_COLA) std::atomic<uint32_t> cabeza{0};
+  alignas(LINEA_CACHE_COLA) std::atomic<uint32_t> cola{0};
+  alignas(LINEA_CACHE_COLA) Celda celdas[N];
+};
+
+#endif
@@ -0,0 +1,167 @@
+#include "cola_persistente.h"
+
+#define MAGIA_COLA 0x414C4351  // "QCLA"
+#define VERSION_COLA 2  // 1: resultados de 12 bytes sin esquema
+#define TAM_CABECERA_COLA 24
+
+ColaPersistente::ColaPersistente()
+  : archivo(nullptr), reserva(nullptr), tope(0), capacidad(0), primera(1), siguiente(1), perdidos(0),
+    numInvalidos(0) {
+}
+
+ColaPersistente::~ColaPersistente() {
+  if (archivo != nullptr) fclose(archivo);
+}
+
+uint32_t ReservaSecuenciasArchivo::leer() {
+  FILE* f = fopen(ruta, "rb");
+  if (f == nullptr) return 0;
+  uint8_t b[4];
+  bool ok = fread(b, 1, sizeof(b), f) == sizeof(b);
+  fclose(f);
+  return ok ? leerU32(b) : 0;
+}
+
+bool ReservaSecuenciasArchivo::guardar(uint32_t nuevoTope) {
+  FILE* f = fopen(ruta, "wb");
+  if (f == nullptr) return false;
+  uint8_t b[4];
+  escribirU32(b, nuevoTope);
+  bool ok = fwrite(b, 1, sizeof(b), f) == sizeof(b);
+  return fclose(f) == 0 && ok;
+}
+
+bool ColaPersistente::abrir(const char* ruta, uint32_t nuevaCapacidad,
+                            ReservaSecuencias* nuevaReserva) {
+  capacidad = nuevaCapacidad;
+  reserva = nuevaReserva;
+  tope = reserva != nullptr ? reserva->leer() : 0;
+  // Primera secuencia que una cola nueva puede usar sin repetir
+  uint32_t inicio = tope > 1 ? tope : 1;
+  archivo = fopen(ruta, "r+b");
+  if (archivo != nullptr) {
+    uint8_t c[TAM_CABECERA_COLA];
+    if (fread(c, 1, sizeof(c), archivo) == sizeof(c) && leerU32(c) == MAGIA_COLA) {
+      if (leerU32(c + 4) == VERSION_COLA && leerU32(c + 8) == capacidad) {
+        primera = leerU32(c + 12);
+        siguiente = leerU32(c + 16);
+        perdidos = leerU32(c + 20);
+        if (primera <= siguiente && siguiente - primera <= capacidad) {
+          // Una cola de antes de la reserva, o una reserva borrada
+          reservarHasta(siguiente);
+          return true;
+        }
+      }
+      // La cabecera se ha mantenido igual en todas las versiones
+      if (leerU32(c + 16) > inicio) inicio = leerU32(c + 16);
+    }
+    fclose(archivo);
+  }
+
+  // Nueva o incompatible: vacía, siguiendo la numeración de la anterior
+  archivo = fopen(ruta, "w+b");
+  if (archivo == nullptr) return false;
+  primera = siguiente = inicio;
+  perdidos = 0;
+  reservarHasta(siguiente);
+  return guardarCabecera();
+}
+
+void ColaPersistente::reservarHasta(uint32_t secuencia) {
+  if (reserva == nullptr || secuencia < tope) return;
+  // Si no se puede guardar se sigue encolando (perder el resultado es
+  // peor) y se reintenta con la próxima secuencia
+  uint32_t nuevoTope = secuencia + BLOQUE_RESERVA_SECUENCIAS;
+  if (reserva->guardar(nuevoTope)) tope = nuevoTope;
+}
+
+bool ColaPersistente::guardarCabecera() {
+  uint8_t c[TAM_CABECERA_COLA];
+  escribirU32(c, MAGIA_COLA);
+  escribirU32(c + 4, VERSION_COLA);
+  escribirU32(c + 8, capacidad);
+  escribirU32(c + 12, primera);
+  escribirU32(c + 16, siguiente);
+  escribirU32(c + 20, perdidos);
+  if (fseek(archivo, 0, SEEK_SET) != 0) return false;
+  bool ok = fwrite(c, 1, sizeof(c), archivo) == sizeof(c);
+  return fflush(archivo) == 0 && ok;
+}
+
+static long posicionRanura(uint32_t secuencia, uint32_t capacidad) {
+  return TAM_CABECERA_COLA + (long)(secuencia % capacidad) * MAX_TAM_REGISTRO;
+}
+
+uint32_t ColaPersistente::encolar(uint8_t* registro, size_t longitud) {
+  if (archivo == nullptr || longitud < OFFSET_SECUENCIA + 4 ||
+      longitud > MAX_TAM_REGISTRO) {
+    return 0;
+  }
+  // Llena: la ranura nueva es la del más antiguo, que sólo se da por
+  // perdido cuando la escritura sale bien
+  bool llena = pendientes() == capacidad;
+  uint32_t secuencia = siguiente;
+  reservarHasta(secuencia);
+  escribirU32(registro + OFFSET_SECUENCIA, secuencia);
+
+  if (fseek(archivo, posicionRanura(secuencia, capacidad), SEEK_SET) != 0 ||
+      fwrite(registro, 1, longitud, archivo) != longitud) {
+    return 0;
+  }
+  // El registro se escribe antes que la cabecera: un corte entre ambos
+  // deja la cola como estaba
+  if (llena) {
+    primera++;
+    perdidos++;
+  }
+  siguiente++;
+  if (!guardarCabecera()) return 0;
+  return secuencia;
+}
+
+// Lee la ranura de 'secuencia' en 'registro'; devuelve su longitud o 0
+// si está dañada o tiene otra secuencia (escritura cortada tras dar la
+// vuelta al anillo)
+size_t ColaPersistente::leerRanura(uint32_t secuencia, uint8_t* registro) {
+  if (fseek(archivo, posicionRanura(secuencia, capacidad), SEEK_SET) != 0 ||
+      fread(registro, 1, TAM_CABECERA_REGISTRO, archivo) != TAM_CABECERA_REGISTRO) {
+    return 0;
+  }
+  size_t longitud = longitudRegistro(registro);
+  if (longitud < OFFSET_SECUENCIA + 4 || longitud > MAX_TAM_REGISTRO ||
+      fread(registro + TAM_CABECERA_REGISTRO, 1, longitud - TAM_CABECERA_REGISTRO,
+            archivo) != longitud - TAM_CABECERA_REGISTRO ||
+      leerU32(registro + OFFSET_SECUENCIA) != secuencia) {
+    return 0;
+  }
+  return longitud;
+}
+
+uint32_t ColaPersistente::leerPendientes(uint8_t* destino, uint32_t maximo,
+                                         size_t* bytes) {
+  *bytes = 0;
+  if (archivo == nullptr) return 0;
+  uint32_t n = 0;
+  while (n < maximo && n < pendientes()) {
+    size_t longitud = leerRanura(primera + n, destino + *bytes);
+    if (longitud > 0) {
+      *bytes += longitud;
+      n++;
+      continue;
+    }
+    // El lote va de seguido desde primera: una dañada en medio lo corta
+    // y se descarta cuando pase a ser la más antigua
+    if (n > 0) break;
+    primera++;
+    numInvalidos++;
+    guardarCabecera();
+  }
+  return n;
+}
+
+void ColaPersistente::confirmar(uint32_t hasta) {
+  if (hasta <= primera) return;
+  if (hasta > siguiente) hasta = siguiente;
+  primera = hasta;
+  guardarCabecera();
+}
@@ -0,0 +1,109 @@
+/*
+ * Cola persistente de registros pendientes de subir.
+ *
+ * Anillo de ranuras de MAX_TAM_REGISTRO bytes en un archivo, cada una con
+ * un registro ya codificado según esquema_registros.h de cualquier tipo
+ * (resultado, sesión, configuración o confirmación). Una cabecera con la
+ * secuencia más antigua sin confirmar y la siguiente a asignar, seguida de
+ * 'capacidad' ranuras (la secuencia s ocupa la ranura s % capacidad). Un
+ * registro sólo sale de la cola cuando el colector confirma su secuencia,
+ * así la entrega es al menos una vez aunque el equipo se reinicie. Si la
+ * cola se llena se descarta el más antiguo y se cuenta. Una ranura dañada
+ * (corte a mitad de escritura, flash corrupta) también se descarta y se
+ * cuenta, para que no bloquee la subida de las siguientes.
+ *
+ * Las secuencias no se repiten nunca, ni cuando el archivo se crea de nuevo
+ * (formato de cola nuevo, LittleFS reformateado): el colector descarta como
+ * duplicado todo lo que quede por debajo de lo que ya confirmó. Para eso la
+ * cola reserva las secuencias por bloques en una ReservaSecuencias que
+ * vive fuera del archivo, y una cola nueva empieza donde acaba la reserva.
+ *
+ * Usa stdio: en el ESP32 el archivo vive en LittleFS a través del VFS.
+ */
+#ifndef COLA_PERSISTENTE_H
+#define COLA_PERSISTENTE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "protocolo_subida.h"
+
+// Secuencias reservadas por cada escritura en la ReservaSecuencias
+#define BLOQUE_RESERVA_SECUENCIAS 256
+
+// Guarda fuera del archivo de la cola la primera secuencia sin reservar
+class ReservaSecuencias {
+public:
+  virtual ~ReservaSecuencias() {}
+  // 0 si no hay nada guardado
+  virtual uint32_t leer() = 0;
+  virtual bool guardar(uint32_t tope) = 0;
+};
+
+// Reserva en un archivo aparte, para el host
+class ReservaSecuenciasArchivo : public ReservaSecuencias {
+public:
+  explicit ReservaSecuenciasArchivo(const char* ruta) : ruta(ruta) {}
+  uint32_t leer() override;
+  bool guardar(uint32_t tope) override;
+
+private:
+  const char* ruta;
+};
+
+class ColaPersistente {
+public:
+  ColaPersistente();
+  ~ColaPersistente();
+
+  // Abre la cola existente o crea una vacía si no existe o no es válida.
+  // Sin reserva una cola nueva vuelve a empezar en la secuencia 1.
+  bool abrir(const char* ruta, uint32_t capacidad,
+             ReservaSecuencias* reserva = nullptr);
+  bool abierta() const { return archivo != nullptr; }
+
+  // Guarda un registro codificado escribiendo en él la secuencia
+  // asignada; devuelve la secuencia o 0
+  uint32_t encolar(uint8_t* registro, size_t longitud);
+
+  template <typename R>
+  uint32_t encolar(R& r) {
+    uint8_t registro[MAX_TAM_REGISTRO];
+    size_t n = codificarRegistro(r, registro);
+    r.secuencia = encolar(registro, n);
+    return r.secuencia;
+  }
+
+  // Copia seguidos hasta 'maximo' registros pendientes empezando por el
+  // más antiguo; 'destino' debe tener sitio para maximo * MAX_TAM_REGISTRO
+  // bytes. Devuelve cuántos copió y en 'bytes' lo que ocupan. Las ranuras
+  // dañadas al principio se descartan; una detrás de otras válidas corta
+  // el lote y se descarta en la llamada siguiente.
+  uint32_t leerPendientes(uint8_t* destino, uint32_t maximo, size_t* bytes);
+
+  // Confirmación acumulativa: descarta todas las secuencias < hasta
+  void confirmar(uint32_t hasta);
+
+  uint32_t pendientes() const { return siguiente - primera; }
+  uint32_t primeraPendiente() const { return primera; }
+  uint32_t siguienteSecuencia() const { return siguiente; }
+  uint32_t descartados() const { return perdidos; }
+  // Ranuras dañadas descartadas desde que se abrió
+  uint32_t invalidos() const { return numInvalidos; }
+
+private:
+  bool guardarCabecera();
+  size_t leerRanura(uint32_t secuencia, uint8_t* registro);
+  void reservarHasta(uint32_t secuencia);
+
+  FILE* archivo;
+  ReservaSecuencias* reserva;
+  uint32_t tope;        // primera secuencia sin reservar
+  uint32_t capacidad;
+  uint32_t primera;     // secuencia más antigua sin confirmar
+  uint32_t siguiente;   // próxima secuencia a asignar (empieza en 1)
+  uint32_t perdidos;
+  uint32_t numInvalidos;
+};
+
+#endif
@@ -0,0 +1,143 @@
+#include "enlace_subida.h"
+
+EnlaceSubida::EnlaceSubida(ColaPersistente& cola, Transporte& transporte,
+                           const ConfigSubida& config)
+  : cola(cola), transporte(transporte), config(config), estado(LIBRE),
+    enviadoMs(0), esperadoHasta(0), proximoIntentoMs(0),
+    espera(config.reintentoMinimoMs), semilla(config.idDispositivo | 1),
+    sincronizacionPedida(false), ultimoAckMs(0), ordenRecibida(), ultimaOrden(0),
+    numLotes(0), numConfirmados(0), numFallos(0), numFallosSeguidos(0) {
+  if (this->config.registrosPorLote == 0 ||
+      this->config.registrosPorLote > MAX_REGISTROS_LOTE) {
+    this->config.registrosPorLote = MAX_REGISTROS_LOTE;
+  }
+}
+
+uint32_t EnlaceSubida::azar() {
+  // xorshift32: basta para repartir los reintentos
+  semilla ^= semilla << 13;
+  semilla ^= semilla >> 17;
+  semilla ^= semilla << 5;
+  return semilla;
+}
+
+uint32_t EnlaceSubida::msHastaReintento(uint32_t ahoraMs) const {
+  int32_t restante = (int32_t)(proximoIntentoMs - ahoraMs);
+  return restante > 0 ? (uint32_t)restante : 0;
+}
+
+void EnlaceSubida::fallo(uint32_t ahoraMs) {
+  numFallos++;
+  numFallosSeguidos++;
+  transporte.desconectar();
+  estado = LIBRE;
+  // Espera en [espera/2, espera) y se duplica hasta el máximo
+  proximoIntentoMs = ahoraMs + espera / 2 + azar() % (espera / 2 + 1);
+  espera = espera * 2 > config.reintentoMaximoMs ? config.reintentoMaximoMs
+                                                 : espera * 2;
+}
+
+bool EnlaceSubida::enviarLote(uint32_t ahoraMs) {
+  // Los registros ya están codificados: se copian de la cola a la carga
+  uint8_t* carga = mensaje + SUBIDA_CABECERA;
+  size_t bytes = 0;
+  uint32_t n = cola.leerPendientes(carga + 5, config.registrosPorLote, &bytes);
+  // Sin nada que enviar porque todo lo pendiente estaba dañado no es un
+  // fallo del enlace
+  if (n == 0 && !sincronizacionPedida) return cola.pendientes() == 0;
+
+  escribirU32(carga, config.idDispositivo);
+  carga[4] = (uint8_t)n;
+  escribirU32(carga + 5 + bytes, ahoraMs);
+  size_t longitud = cerrarMensaje(mensaje, MENSAJE_LOTE, (uint16_t)(5 + bytes + 4));
+  if (!transporte.enviar(mensaje, longitud)) return false;
+
+  numLotes++;
+  // Un lote vacío queda respondido con cualquier ACK
+  esperadoHasta = n > 0 ? cola.primeraPendiente() + n : 0;
+  enviadoMs = ahoraMs;
+  estado = ESPERANDO_ACK;
+  return true;
+}
+
+void EnlaceSubida::procesarRespuesta(uint32_t ahoraMs) {
+  uint8_t bytes[64];
+  int n;
+  while ((n = transporte.recibir(bytes, sizeof(bytes))) > 0) {
+    for (int i = 0; i < n; i++) {
+      if (!analizador.alimentar(bytes[i])) continue;
+      if (analizador.tipo() == MENSAJE_ORDEN) {
+        recibirOrden();
+        continue;
+      }
+      if (analizador.tipo() != MENSAJE_ACK || analizador.longitudCarga() < 8 ||
+          leerU32(analizador.carga()) != config.idDispositivo) {
+        continue;
+      }
+      uint32_t hasta = leerU32(analizador.carga() + 4);
+      uint32_t antes = cola.primeraPendiente();
+      cola.confirmar(hasta);
+      numConfirmados += cola.primeraPendiente() - antes;
+      if (hasta >= esperadoHasta) {
+        estado = LIBRE;
+        sincronizacionPedida = false;
+        ultimoAckMs = ahoraMs;
+        espera = config.reintentoMinimoMs;
+        numFallosSeguidos = 0;
+        return;
+      }
+    }
+  }
+  if (n < 0 || ahoraMs - enviadoMs >= config.esperaAckMs) fallo(ahoraMs);
+}
+
+void EnlaceSubida::recibirOrden() {
+  uint32_t id;
+  OrdenConfiguracion orden;
+  if (!decodificarOrden(analizador.carga(), analizador.longitudCarga(), id, orden) ||
+      id != config.idDispositivo) {
+    return;
+  }
+  uint32_t mayor = ultimaOrden;
+  // Los comandos de un despliegue comparten idOrden y van seguidos: se
+  // aceptan todos o ninguno, porque ultimaOrden descarta sus reenvíos
+  uint8_t i = 0;
+  while (i < orden.numComandos) {
+    uint32_t idOrden = orden.comandos[i].idOrden;
+    uint8_t fin = i;
+    while (fin < orden.numComandos && orden.comandos[fin].idOrden == idOrden) fin++;
+    if (idOrden > ultimaOrden) {
+      // Sin sitio se para: el colector lo reenvía hasta que se confirme
+      if (ordenRecibida.numComandos + (fin - i) > MAX_COMANDOS_ORDEN) break;
+      for (uint8_t j = i; j < fin; j++) {
+        ordenRecibida.comandos[ordenRecibida.numComandos++] = orden.comandos[j];
+      }
+      if (idOrden > mayor) mayor = idOrden;
+    }
+    i = fin;
+  }
+  ultimaOrden = mayor;
+}
+
+bool EnlaceSubida::tomarOrden(OrdenConfiguracion& orden) {
+  if (ordenRecibida.numComandos == 0) return false;
+  orden = ordenRecibida;
+  ordenRecibida.numComandos = 0;
+  return true;
+}
+
+void EnlaceSubida::servicio(uint32_t ahoraMs) {
+  if (estado == ESPERANDO_ACK) {
+    procesarRespuesta(ahoraMs);
+    if (estado == ESPERANDO_ACK) return;
+  }
+
+  if ((cola.pendientes() == 0 && !sincronizacionPedida) || msHastaReintento(ahoraMs) > 0) {
+    return;
+  }
+  if (!transporte.conectado() && !transporte.conectar()) {
+    fallo(ahoraMs);
+    return;
+  }
+  if (!enviarLote(ahoraMs)) fallo(ahoraMs);
+}
@@ -0,0 +1,90 @@
+/*
+ * Subida por lotes de la cola persistente al colector.
+ *
+ * servicio() no bloquea: envía un lote con los registros pendientes más
+ * antiguos, espera el ACK acumulativo en llamadas posteriores y sólo
+ * entonces los borra de la cola. Si no hay enlace, se agota el tiempo o
+ * el colector cierra, reintenta con espera exponencial y algo de azar
+ * para que muchos equipos no reintenten a la vez.
+ *
+ * Las ORDEN que llegan con el ACK se guardan hasta que el firmware las
+ * recoge con tomarOrden(); los comandos de un idOrden ya recibido se
+ * descartan, porque el colector los repite hasta ver su confirmación.
+ * sincronizar() fuerza un intercambio aunque no haya nada que subir.
+ */
+#ifndef ENLACE_SUBIDA_H
+#define ENLACE_SUBIDA_H
+
+#include <stdint.h>
+#include "cola_persistente.h"
+#include "protocolo_subida.h"
+#include "transporte.h"
+
+struct ConfigSubida {
+  uint32_t idDispositivo;
+  uint32_t esperaAckMs;
+  uint32_t reintentoMinimoMs;
+  uint32_t reintentoMaximoMs;
+  uint8_t registrosPorLote;   // como mucho MAX_REGISTROS_LOTE
+};
+
+#define CONFIG_SUBIDA_DEFECTO(id) {(id), 3000, 1000, 300000, MAX_REGISTROS_LOTE}
+
+class EnlaceSubida {
+public:
+  EnlaceSubida(ColaPersistente& cola, Transporte& transporte,
+               const ConfigSubida& config);
+
+  void servicio(uint32_t ahoraMs);
+
+  // El próximo servicio() pregunta al colector aunque la cola esté vacía
+  void sincronizar() { sincronizacionPedida = true; }
+  bool sincronizacionPendiente() const { return sincronizacionPedida; }
+  // millis() del último ACK; 0 si aún no hubo ninguno
+  uint32_t ultimaSincronizacionMs() const { return ultimoAckMs; }
+
+  // Comandos recibidos desde la última llamada; false si no hay
+  bool tomarOrden(OrdenConfiguracion& orden);
+
+  bool esperandoAck() const { return estado == ESPERANDO_ACK; }
+  uint32_t lotesEnviados() const { return numLotes; }
+  uint32_t registrosConfirmados() const { return numConfirmados; }
+  uint32_t fallos() const { return numFallos; }
+  uint32_t fallosSeguidos() const { return numFallosSeguidos; }
+  uint32_t msHastaReintento(uint32_t ahoraMs) const;
+
+private:
+  enum Estado { LIBRE, ESPERANDO_ACK };
+
+  bool enviarLote(uint32_t ahoraMs);
+  void procesarRespuesta(uint32_t ahoraMs);
+  void recibirOrden();
+  void fallo(uint32_t ahoraMs);
+  uint32_t azar();
+
+  ColaPersistente& cola;
+  Transporte& transporte;
+  ConfigSubida config;
+  AnalizadorMensajes analizador;
+
+  Estado estado;
+  uint32_t enviadoMs;
+  uint32_t esperadoHasta;     // secuencia que confirmaría el lote entero
+  uint32_t proximoIntentoMs;
+  uint32_t espera;            // espera actual entre reintentos
+  uint32_t semilla;
+  bool sincronizacionPedida;
+  uint32_t ultimoAckMs;
+
+  OrdenConfiguracion ordenRecibida;
+  uint32_t ultimaOrden;       // mayor idOrden aceptado
+
+  uint32_t numLotes;
+  uint32_t numConfirmados;
+  uint32_t numFallos;
+  uint32_t numFallosSeguidos;
+
+  uint8_t mensaje[MAX_MENSAJE_SUBIDA];
+};
+
+#endif
@@ -0,0 +1,185 @@
+/*
+ * Protocolo de subida de resultados al colector, compartido por el
+ * firmware y las herramientas de host.
+ *
+ * Mensaje: cabecera de 6 bytes (0xA1 0xC5, versión, tipo, longitud de la
+ * carga en little endian), la carga y un CRC-16/CCITT de cabecera y carga.
+ *
+ *   LOTE:  idDispositivo(4) numRegistros(1) registros [marcaEnvioMs(4)]
+ *   ACK:   idDispositivo(4) secuenciaConfirmada(4)
+ *   ORDEN: idDispositivo(4) numComandos(1) [idOrden(4) comando(1) valor(1)]...
+ *
+ * Los registros van codificados según esquema_registros.h, uno detrás de
+ * otro; cada uno lleva su tipo y su longitud. marcaEnvioMs es el millis()
+ * del equipo al enviar: con él el colector sitúa en su reloj las marcas
+ * de los registros. Un colector que no lo conoce lo ignora. Resultados, sesiones y
+ * configuración comparten la secuencia de la cola. El ACK es acumulativo:
+ * el colector ha guardado todas las secuencias menores que
+ * secuenciaConfirmada. Todos los enteros van en little endian.
+ *
+ * ORDEN es la bajada de configuración: el colector la manda justo antes
+ * del ACK de un lote con todos los comandos pendientes del equipo, de uno
+ * o varios despliegues (idOrden). El equipo aplica cada comando cuando el
+ * sensor lo admite, lo verifica leyéndolo de vuelta y encola un registro
+ * de confirmación por comando, que sube como cualquier otro registro. Un
+ * lote sin registros sirve para preguntar si hay órdenes. Un equipo que
+ * no conoce ORDEN la ignora.
+ */
+#ifndef PROTOCOLO_SUBIDA_H
+#define PROTOCOLO_SUBIDA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esquema_registros.h"
+
+#define SUBIDA_MAGIA0 0xA1
+#define SUBIDA_MAGIA1 0xC5
+#define SUBIDA_VERSION 1
+#define SUBIDA_CABECERA 6
+#define SUBIDA_CRC 2
+
+#define MENSAJE_LOTE 1
+#define MENSAJE_ACK 2
+#define MENSAJE_ORDEN 3
+
+// Comandos de una orden; nunca se reutiliza un valor
+#define COMANDO_TIEMPO_SOPLADO 1     // valor: segundos (1-10), pasa a manual
+#define COMANDO_LEER_UMBRALES 2      // relee los umbrales del sensor (0x90)
+#define COMANDO_SOPLADO_ADAPTATIVO 3 // valor: 0 manual, 1 adaptativo
+
+#define MAX_COMANDOS_ORDEN 16
+
+struct ComandoOrden {
+  uint32_t idOrden;
+  uint8_t comando;
+  uint8_t valor;
+};
+
+struct OrdenConfiguracion {
+  uint8_t numComandos;
+  ComandoOrden comandos[MAX_COMANDOS_ORDEN];
+};
+
+#define MAX_REGISTROS_LOTE 32
+#define MAX_CARGA_SUBIDA (5 + MAX_REGISTROS_LOTE * MAX_TAM_REGISTRO + 4)
+#define MAX_MENSAJE_SUBIDA (SUBIDA_CABECERA + MAX_CARGA_SUBIDA + SUBIDA_CRC)
+
+inline void escribirU16(uint8_t* p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+inline void escribirU32(uint8_t* p, uint32_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+inline uint16_t leerU16(const uint8_t* p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+inline uint32_t leerU32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+         ((uint32_t)p[3] << 24);
+}
+
+inline uint16_t crc16(const uint8_t* datos, size_t n) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < n; i++) {
+    crc ^= (uint16_t)datos[i] << 8;
+    for (int b = 0; b < 8; b++) {
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+// Completa cabecera y CRC alrededor de una carga ya escrita en
+// mensaje + SUBIDA_CABECERA. Devuelve la longitud total del mensaje.
+inline size_t cerrarMensaje(uint8_t* mensaje, uint8_t tipo, uint16_t longitudCarga) {
+  mensaje[0] = SUBIDA_MAGIA0;
+  mensaje[1] = SUBIDA_MAGIA1;
+  mensaje[2] = SUBIDA_VERSION;
+  mensaje[3] = tipo;
+  escribirU16(mensaje + 4, longitudCarga);
+  size_t n = SUBIDA_CABECERA + longitudCarga;
+  escribirU16(mensaje + n, crc16(mensaje, n));
+  return n + SUBIDA_CRC;
+}
+
+// Escribe la carga de una ORDEN; devuelve su longitud
+inline uint16_t codificarOrden(uint8_t* carga, uint32_t idDispositivo,
+                               const OrdenConfiguracion& orden) {
+  escribirU32(carga, idDispositivo);
+  carga[4] = orden.numComandos;
+  uint8_t* p = carga + 5;
+  for (uint8_t i = 0; i < orden.numComandos; i++) {
+    escribirU32(p, orden.comandos[i].idOrden);
+    p[4] = orden.comandos[i].comando;
+    p[5] = orden.comandos[i].valor;
+    p += 6;
+  }
+  return (uint16_t)(p - carga);
+}
+
+inline bool decodificarOrden(const uint8_t* carga, size_t n, uint32_t& idDispositivo,
+                             OrdenConfiguracion& orden) {
+  if (n < 5 || carga[4] > MAX_COMANDOS_ORDEN || n < 5 + (size_t)carga[4] * 6) return false;
+  idDispositivo = leerU32(carga);
+  orden.numComandos = carga[4];
+  const uint8_t* p = carga + 5;
+  for (uint8_t i = 0; i < orden.numComandos; i++) {
+    orden.comandos[i].idOrden = leerU32(p);
+    orden.comandos[i].comando = p[4];
+    orden.comandos[i].valor = p[5];
+    p += 6;
+  }
+  return true;
+}
+
+// Analizador incremental de mensajes: resincroniza con la magia si
+// encuentra basura o un CRC incorrecto
+class AnalizadorMensajes {
+public:
+  AnalizadorMensajes() : recibidos(0), erroresCrc(0) {}
+
+  // Devuelve true cuando hay un mensaje completo y válido
+  bool alimentar(uint8_t b) {
+    if ((recibidos == 0 && b != SUBIDA_MAGIA0) ||
+        (recibidos == 1 && b != SUBIDA_MAGIA1)) {
+      recibidos = (b == SUBIDA_MAGIA0) ? 1 : 0;
+      if (recibidos) buffer[0] = b;
+      return false;
+    }
+    buffer[recibidos++] = b;
+    if (recibidos < SUBIDA_CABECERA) return false;
+    size_t carga = leerU16(buffer + 4);
+    if (carga > MAX_CARGA_SUBIDA) {
+      recibidos = 0;
+      return false;
+    }
+    if (recibidos < SUBIDA_CABECERA + carga + SUBIDA_CRC) return false;
+
+    recibidos = 0;
+    size_t n = SUBIDA_CABECERA + carga;
+    if (leerU16(buffer + n) != crc16(buffer, n)) {
+      erroresCrc++;
+      return false;
+    }
+    return true;
+  }
+
+  uint8_t tipo() const { return buffer[3]; }
+  uint16_t longitudCarga() const { return leerU16(buffer + 4); }
+  const uint8_t* carga() const { return buffer + SUBIDA_CABECERA; }
+  uint32_t mensajesConErrorCrc() const { return erroresCrc; }
+
+private:
+  uint8_t buffer[MAX_MENSAJE_SUBIDA];
+  size_t recibidos;
+  uint32_t erroresCrc;
+};
+
+#endif
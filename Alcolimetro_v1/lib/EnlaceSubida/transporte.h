@@ -0,0 +1,24 @@
+/*
+ * Transporte intercambiable para la subida de resultados. El enlace sólo
+ * necesita abrir, enviar bytes y leer sin bloquear lo que haya llegado.
+ */
+#ifndef TRANSPORTE_H
+#define TRANSPORTE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+class Transporte {
+public:
+  virtual ~Transporte() {}
+  // Intenta establecer el enlace; falla sin bloquear mucho si no hay red
+  virtual bool conectar() = 0;
+  virtual bool conectado() = 0;
+  virtual void desconectar() = 0;
+  virtual bool enviar(const uint8_t* datos, size_t n) = 0;
+  // No bloquea: copia lo disponible y devuelve cuántos bytes, 0 si no hay
+  // nada o -1 si el otro extremo cerró
+  virtual int recibir(uint8_t* destino, size_t maximo) = 0;
+};
+
+#endif
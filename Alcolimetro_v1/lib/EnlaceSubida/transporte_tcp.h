@@ -0,0 +1,35 @@
+/*
+ * Transporte TCP hacia el colector: WiFiClient en el ESP32 y sockets POSIX
+ * en Linux, para probar contra el colector de tools/colector.
+ */
+#ifndef TRANSPORTE_TCP_H
+#define TRANSPORTE_TCP_H
+
+#include "transporte.h"
+
+#ifdef ARDUINO
+#include <WiFiClient.h>
+#endif
+
+class TransporteTcp : public Transporte {
+public:
+  TransporteTcp(const char* host, uint16_t puerto);
+  ~TransporteTcp() override;
+
+  bool conectar() override;
+  bool conectado() override;
+  void desconectar() override;
+  bool enviar(const uint8_t* datos, size_t n) override;
+  int recibir(uint8_t* destino, size_t maximo) override;
+
+private:
+  const char* host;
+  uint16_t puerto;
+#ifdef ARDUINO
+  WiFiClient cliente;
+#else
+  int fd;
+#endif
+};
+
+#endif
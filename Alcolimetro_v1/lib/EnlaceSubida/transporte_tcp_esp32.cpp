@@ -0,0 +1,43 @@
+#ifdef ARDUINO
+
+#include "transporte_tcp.h"
+#include <WiFi.h>
+
+// Tiempo máximo para abrir la conexión TCP cuando hay WiFi
+#define TIMEOUT_CONEXION_MS 2000
+
+TransporteTcp::TransporteTcp(const char* host, uint16_t puerto)
+  : host(host), puerto(puerto) {
+}
+
+TransporteTcp::~TransporteTcp() {
+  desconectar();
+}
+
+bool TransporteTcp::conectar() {
+  if (WiFi.status() != WL_CONNECTED) return false;
+  cliente.setNoDelay(true);
+  return cliente.connect(host, puerto, TIMEOUT_CONEXION_MS);
+}
+
+bool TransporteTcp::conectado() {
+  return cliente.connected();
+}
+
+void TransporteTcp::desconectar() {
+  cliente.stop();
+}
+
+bool TransporteTcp::enviar(const uint8_t* datos, size_t n) {
+  return cliente.write(datos, n) == n;
+}
+
+int TransporteTcp::recibir(uint8_t* destino, size_t maximo) {
+  if (!cliente.connected() && !cliente.available()) return -1;
+  int disponibles = cliente.available();
+  if (disponibles <= 0) return 0;
+  if ((size_t)disponibles > maximo) disponibles = (int)maximo;
+  return cliente.read(destino, disponibles);
+}
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef ARDUINO
+
+#include "transporte_tcp.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+TransporteTcp::TransporteTcp(const char* host, uint16_t puerto)
+  : host(host), puerto(puerto), fd(-1) {
+}
+
+TransporteTcp::~TransporteTcp() {
+  desconectar();
+}
+
+bool TransporteTcp::conectar() {
+  desconectar();
+  char servicio[8];
+  snprintf(servicio, sizeof(servicio), "%u", puerto);
+  struct addrinfo pistas;
+  memset(&pistas, 0, sizeof(pistas));
+  pistas.ai_family = AF_UNSPEC;
+  pistas.ai_socktype = SOCK_STREAM;
+  struct addrinfo* direcciones = nullptr;
+  if (getaddrinfo(host, servicio, &pistas, &direcciones) != 0) return false;
+
+  for (struct addrinfo* a = direcciones; a != nullptr; a = a->ai_next) {
+    fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+    if (fd < 0) continue;
+    if (connect(fd, a->ai_addr, a->ai_addrlen) == 0) break;
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(direcciones);
+  if (fd < 0) return false;
+
+  int uno = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &uno, sizeof(uno));
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  return true;
+}
+
+bool TransporteTcp::conectado() {
+  return fd >= 0;
+}
+
+void TransporteTcp::desconectar() {
+  if (fd >= 0) close(fd);
+  fd = -1;
+}
+
+bool TransporteTcp::enviar(const uint8_t* datos, size_t n) {
+  while (n > 0 && fd >= 0) {
+    ssize_t r = send(fd, datos, n, MSG_NOSIGNAL);
+    if (r < 0) {
+      if (errno == EAGAIN || errno == EINTR) continue;
+      desconectar();
+      return false;
+    }
+    datos += r;
+    n -= (size_t)r;
+  }
+  return fd >= 0;
+}
+
+int TransporteTcp::recibir(uint8_t* destino, size_t maximo) {
+  if (fd < 0) return -1;
+  ssize_t r = recv(fd, destino, maximo, 0);
+  if (r > 0) return (int)r;
+  if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+    return 0;
+  }
+  desconectar();
+  return -1;
+}
+
+#endif
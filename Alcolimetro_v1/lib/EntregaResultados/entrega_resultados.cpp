@@ -0,0 +1,38 @@
+#include "entrega_resultados.h"
+
+uint32_t EntregaResultados::pruebaCompletada() {
+  // Si la anterior no se llegó a leer, ésta la sustituye: el sensor sólo
+  // guarda el último resultado y pendienteDeLeer() sigue siendo true
+  return ++secuencia;
+}
+
+void EntregaResultados::descartarPendiente() {
+  leida = secuencia;
+}
+
+const ResultadoEntregado& EntregaResultados::guardar(const ResultadoPrueba& r,
+                                                     uint32_t marcaMs) {
+  ResultadoEntregado& entrada = cache[secuencia % CACHE_RESULTADOS];
+  entrada.secuencia = secuencia;
+  entrada.marcaMs = marcaMs;
+  entrada.resultado = r;
+  leida = secuencia;
+  return entrada;
+}
+
+const ResultadoEntregado* EntregaResultados::buscar(uint32_t s) const {
+  if (s == SIN_RESULTADO) return nullptr;
+  const ResultadoEntregado& r = cache[s % CACHE_RESULTADOS];
+  return r.secuencia == s ? &r : nullptr;
+}
+
+bool EntregaResultados::primeraEntrega(uint8_t consumidor, uint32_t s) {
+  if (consumidor >= MAX_CONSUMIDORES_RESULTADO) return false;
+  if ((int32_t)(s - marcas[consumidor]) <= 0) return false;
+  marcas[consumidor] = s;
+  return true;
+}
+
+uint32_t EntregaResultados::marca(uint8_t consumidor) const {
+  return consumidor < MAX_CONSUMIDORES_RESULTADO ? marcas[consumidor] : SIN_RESULTADO;
+}
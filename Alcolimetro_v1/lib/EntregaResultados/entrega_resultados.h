@@ -0,0 +1,66 @@
+/*
+ * Entrega de resultados exactamente una vez.
+ *
+ * Cada prueba que termina (el sensor entra en READ_RESULT) recibe un
+ * número de secuencia. El resultado se lee con 0x86 una sola vez y queda
+ * en caché con su número; las peticiones repetidas (el comando 'r', la
+ * lectura periódica de loop()) se sirven de la caché sin tocar el UART.
+ *
+ * Cada consumidor registrado lleva su marca: la secuencia del último
+ * resultado que recibió. primeraEntrega() sólo deja pasar secuencias
+ * posteriores, así que aunque un resultado se publique dos veces (por
+ * ejemplo al reanudar tras un reinicio) cada consumidor lo procesa una.
+ *
+ * La clase no tiene constructor ni punteros: todo a cero es el estado
+ * inicial, y se puede copiar tal cual a la memoria RTC con el resto del
+ * estado (estado_rtc.h), que no debe inicializarse al arrancar.
+ */
+#ifndef ENTREGA_RESULTADOS_H
+#define ENTREGA_RESULTADOS_H
+
+#include <stdint.h>
+#include <type_traits>
+#include "protocolo_ze29a.h"
+
+#define MAX_CONSUMIDORES_RESULTADO 8
+#define CACHE_RESULTADOS 4
+#define SIN_RESULTADO 0
+
+struct ResultadoEntregado {
+  uint32_t secuencia;   // SIN_RESULTADO si la entrada está libre
+  uint32_t marcaMs;
+  ResultadoPrueba resultado;
+};
+
+class EntregaResultados {
+public:
+  // El sensor entró en READ_RESULT: hay una prueba terminada sin leer
+  uint32_t pruebaCompletada();
+  // Se empezó otra prueba sin leer la anterior: su resultado se pierde
+  void descartarPendiente();
+  bool pendienteDeLeer() const { return secuencia != leida; }
+  uint32_t secuenciaActual() const { return secuencia; }
+
+  // Resultado leído con 0x86 para la prueba actual
+  const ResultadoEntregado& guardar(const ResultadoPrueba& r, uint32_t marcaMs);
+  // Último resultado leído; nullptr si no hay ninguno
+  const ResultadoEntregado* ultimo() const { return buscar(leida); }
+  // nullptr si ya salió de la caché
+  const ResultadoEntregado* buscar(uint32_t secuencia) const;
+
+  // true la primera vez que el consumidor recibe esa secuencia (o una
+  // posterior a su marca); avanza la marca
+  bool primeraEntrega(uint8_t consumidor, uint32_t secuencia);
+  uint32_t marca(uint8_t consumidor) const;
+
+private:
+  ResultadoEntregado cache[CACHE_RESULTADOS];
+  uint32_t secuencia;   // última prueba terminada
+  uint32_t leida;       // última prueba con el resultado en caché
+  uint32_t marcas[MAX_CONSUMIDORES_RESULTADO];
+};
+
+static_assert(std::is_trivial<EntregaResultados>::value,
+              "EntregaResultados va en memoria RTC sin inicializar");
+
+#endif
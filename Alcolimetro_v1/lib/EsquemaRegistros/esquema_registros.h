@@ -0,0 +1,224 @@
+/*
+ * Esquema binario de los registros compartido por el firmware y las
+ * herramientas de host (cola de subida, colector, exportación).
+ *
+ * Cada registro se define una sola vez como lista de campos X(tipo, nombre)
+ * y de esa lista se generan la estructura, el tamaño y los codificadores
+ * y decodificadores constexpr. En el cable:
+ *
+ *   tipo(1) version(1) longitud(2) campos...
+ *
+ * Los campos van en el orden de la definición, empaquetados y en little
+ * endian. 'longitud' cuenta el registro entero, así un lector antiguo
+ * salta los campos añadidos en versiones nuevas y un lector nuevo deja a
+ * cero los que faltan en un registro antiguo.
+ *
+ * Reglas para evolucionar el esquema: sólo se añaden campos al final y se
+ * sube la versión. El primer campo de todo registro es 'secuencia', que
+ * asigna la cola.
+ */
+#ifndef ESQUEMA_REGISTROS_H
+#define ESQUEMA_REGISTROS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TAM_CABECERA_REGISTRO 4
+#define OFFSET_SECUENCIA TAM_CABECERA_REGISTRO
+
+// Tipos de registro; nunca se reutiliza un valor
+#define REGISTRO_RESULTADO 1
+#define REGISTRO_SESION 2
+#define REGISTRO_CONFIGURACION 3
+#define REGISTRO_CONFIRMACION 4
+
+#define BANDERA_CONFIRMATORIA 0x01
+
+// Estado de un comando de configuración bajado del colector
+#define CONFIRMACION_APLICADA 0      // el valor leído de vuelta es el pedido
+#define CONFIRMACION_DISCREPANCIA 1  // el sensor aceptó pero devuelve otro
+#define CONFIRMACION_RECHAZADA 2     // el sensor lo rechazó
+#define CONFIRMACION_SIN_RESPUESTA 3
+#define CONFIRMACION_INVALIDA 4      // comando desconocido o valor fuera de rango
+
+// Resultado de una prueba (respuesta a 0x86). Versión 2: lo observado en
+// la prueba para vigilar el sensor desde el colector (timeouts del enlace
+// desde la prueba anterior y soplidos interrumpidos, saturados, y el
+// precalentamiento, 0 si no se vio entero)
+#define ESQUEMA_RESULTADO(X)          \
+  X(uint32_t, secuencia)              \
+  X(uint32_t, idDispositivo)          \
+  X(uint32_t, marcaMs)                \
+  X(uint32_t, idSujeto)               \
+  X(uint32_t, secuenciaVinculada)     \
+  X(uint16_t, alcoholMg100ml)         \
+  X(uint8_t, alarma)                  \
+  X(uint8_t, banderas)                \
+  X(uint8_t, timeoutsEnlace)          \
+  X(uint8_t, soplidosInterrumpidos)   \
+  X(uint16_t, precalentamientoMs)
+
+// Sesión: prueba original más la confirmatoria, si la hubo
+#define ESQUEMA_SESION(X)             \
+  X(uint32_t, secuencia)              \
+  X(uint32_t, idDispositivo)          \
+  X(uint32_t, inicioMs)               \
+  X(uint32_t, finMs)                  \
+  X(uint32_t, idSujeto)               \
+  X(uint32_t, secuenciaFinal)         \
+  X(uint16_t, alcoholFinalMg100ml)    \
+  X(uint8_t, alarmaFinal)             \
+  X(uint8_t, numPruebas)
+
+// Configuración del sensor vigente
+#define ESQUEMA_CONFIGURACION(X)      \
+  X(uint32_t, secuencia)              \
+  X(uint32_t, idDispositivo)          \
+  X(uint32_t, marcaMs)                \
+  X(uint8_t, tiempoSopladoS)          \
+  X(uint8_t, umbralBebido)            \
+  X(uint8_t, umbralEbrio)             \
+  X(uint8_t, versionFirmware)
+
+// Un comando de una orden de configuración ya aplicado (protocolo_subida.h).
+// valorLeido es lo que devolvió el sensor al leerlo: el tiempo de soplado,
+// umbralBebido | umbralEbrio << 8 o el modo de soplado.
+#define ESQUEMA_CONFIRMACION(X)       \
+  X(uint32_t, secuencia)              \
+  X(uint32_t, idDispositivo)          \
+  X(uint32_t, marcaMs)                \
+  X(uint32_t, idOrden)                \
+  X(uint8_t, comando)                 \
+  X(uint8_t, valorPedido)             \
+  X(uint8_t, estado)                  \
+  X(uint8_t, reservado)               \
+  X(uint16_t, valorLeido)
+
+namespace esquema {
+
+template <typename T>
+constexpr uint8_t* escribirLE(uint8_t* p, T v) {
+  for (size_t i = 0; i < sizeof(T); i++) p[i] = (uint8_t)((uint64_t)v >> (8 * i));
+  return p + sizeof(T);
+}
+
+// Si el registro es más corto (versión antigua) el campo queda a cero
+template <typename T>
+constexpr const uint8_t* leerLE(const uint8_t* p, const uint8_t* fin, T& v) {
+  if (fin - p < (ptrdiff_t)sizeof(T)) {
+    v = 0;
+    return fin;
+  }
+  uint64_t x = 0;
+  for (size_t i = 0; i < sizeof(T); i++) x |= (uint64_t)p[i] << (8 * i);
+  v = (T)x;
+  return p + sizeof(T);
+}
+
+constexpr bool LITTLE_ENDIAN_NATIVO =
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+
+template <typename R>
+struct Esquema;
+
+}  // namespace esquema
+
+#define ESQ_CAMPO(t, n) t n;
+#define ESQ_TAMANO(t, n) +sizeof(t)
+#define ESQ_ESCRIBIR(t, n) p = esquema::escribirLE<t>(p, r.n);
+#define ESQ_LEER(t, n) p = esquema::leerLE<t>(p, fin, r.n);
+
+// Genera la estructura y su Esquema<> a partir de la lista de campos
+#define DEFINIR_REGISTRO(Nombre, TIPO, VERSION, CAMPOS)                      \
+  struct Nombre {                                                            \
+    CAMPOS(ESQ_CAMPO)                                                        \
+  };                                                                         \
+  namespace esquema {                                                        \
+  template <>                                                                \
+  struct Esquema<Nombre> {                                                   \
+    static constexpr uint8_t tipo = TIPO;                                    \
+    static constexpr uint8_t version = VERSION;                              \
+    static constexpr size_t tamCampos = 0 CAMPOS(ESQ_TAMANO);                \
+    static constexpr size_t tamBase = TAM_CABECERA_REGISTRO + tamCampos;     \
+    /* Sin relleno y en little endian la estructura es el formato de cable */ \
+    static constexpr bool sinCopia =                                         \
+        LITTLE_ENDIAN_NATIVO && sizeof(Nombre) == tamCampos;                 \
+                                                                             \
+    /* Escribe cabecera y campos; devuelve el tamaño escrito */              \
+    static constexpr size_t codificar(const Nombre& r, uint8_t* destino) {   \
+      uint8_t* p = destino + TAM_CABECERA_REGISTRO;                          \
+      CAMPOS(ESQ_ESCRIBIR)                                                   \
+      destino[0] = tipo;                                                     \
+      destino[1] = version;                                                  \
+      escribirLE<uint16_t>(destino + 2, (uint16_t)tamBase);                  \
+      return tamBase;                                                        \
+    }                                                                        \
+                                                                             \
+    /* Acepta versiones anteriores y posteriores del mismo tipo */           \
+    static constexpr bool decodificar(const uint8_t* origen, size_t n,       \
+                                      Nombre& r) {                           \
+      if (n < TAM_CABECERA_REGISTRO || origen[0] != tipo) return false;      \
+      uint16_t longitud = 0;                                                 \
+      leerLE<uint16_t>(origen + 2, origen + 4, longitud);                    \
+      if (longitud < TAM_CABECERA_REGISTRO || longitud > n) return false;    \
+      const uint8_t* p = origen + TAM_CABECERA_REGISTRO;                     \
+      const uint8_t* fin = origen + longitud;                                \
+      CAMPOS(ESQ_LEER)                                                       \
+      (void)p;                                                               \
+      return true;                                                           \
+    }                                                                        \
+                                                                             \
+    /* Acceso sin copia: la estructura apunta dentro del buffer. Sólo si */  \
+    /* el formato coincide, la versión trae todos los campos y el */         \
+    /* buffer está alineado; si no, devuelve nullptr y hay que decodificar */ \
+    static const Nombre* reinterpretar(const uint8_t* origen, size_t n) {    \
+      if (!sinCopia || n < tamBase || origen[0] != tipo ||                   \
+          origen[1] < version) {                                             \
+        return nullptr;                                                      \
+      }                                                                      \
+      const uint8_t* campos = origen + TAM_CABECERA_REGISTRO;                \
+      if ((uintptr_t)campos % alignof(Nombre) != 0) return nullptr;          \
+      return reinterpret_cast<const Nombre*>(campos);                        \
+    }                                                                        \
+  };                                                                         \
+  }
+
+DEFINIR_REGISTRO(RegistroResultado, REGISTRO_RESULTADO, 2, ESQUEMA_RESULTADO)
+DEFINIR_REGISTRO(RegistroSesion, REGISTRO_SESION, 1, ESQUEMA_SESION)
+DEFINIR_REGISTRO(RegistroConfiguracion, REGISTRO_CONFIGURACION, 1,
+                 ESQUEMA_CONFIGURACION)
+DEFINIR_REGISTRO(RegistroConfirmacion, REGISTRO_CONFIRMACION, 1, ESQUEMA_CONFIRMACION)
+
+// Tamaño máximo de un registro codificado
+#define MAX_TAM_REGISTRO 48
+
+static_assert(esquema::Esquema<RegistroResultado>::tamBase <= MAX_TAM_REGISTRO, "");
+static_assert(esquema::Esquema<RegistroSesion>::tamBase <= MAX_TAM_REGISTRO, "");
+static_assert(esquema::Esquema<RegistroConfiguracion>::tamBase <= MAX_TAM_REGISTRO, "");
+static_assert(esquema::Esquema<RegistroConfirmacion>::tamBase <= MAX_TAM_REGISTRO, "");
+
+template <typename R>
+constexpr size_t codificarRegistro(const R& r, uint8_t* destino) {
+  return esquema::Esquema<R>::codificar(r, destino);
+}
+
+template <typename R>
+constexpr bool decodificarRegistro(const uint8_t* origen, size_t n, R& r) {
+  return esquema::Esquema<R>::decodificar(origen, n, r);
+}
+
+// Cabecera común a todos los registros
+
+inline uint8_t tipoRegistro(const uint8_t* registro) {
+  return registro[0];
+}
+
+inline uint8_t versionRegistro(const uint8_t* registro) {
+  return registro[1];
+}
+
+inline uint16_t longitudRegistro(const uint8_t* registro) {
+  return (uint16_t)(registro[2] | (registro[3] << 8));
+}
+
+#endif
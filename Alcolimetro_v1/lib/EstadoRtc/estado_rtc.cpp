@@ -0,0 +1,38 @@
+#include "estado_rtc.h"
+
+// CRC-32 (polinomio 0xEDB88320) bit a bit: el estado ocupa unas decenas
+// de bytes y no merece una tabla de 1 KB
+uint32_t crc32(const void* datos, size_t longitud, uint32_t crc) {
+  const uint8_t* p = static_cast<const uint8_t*>(datos);
+  crc = ~crc;
+  for (size_t i = 0; i < longitud; i++) {
+    crc ^= p[i];
+    for (int b = 0; b < 8; b++) {
+      crc = (crc >> 1) ^ (0xEDB88320UL & (0u - (crc & 1u)));
+    }
+  }
+  return ~crc;
+}
+
+static uint32_t crcEstado(const EstadoRtc& estado) {
+  return crc32(&estado, offsetof(EstadoRtc, crc));
+}
+
+void sellarEstadoRtc(EstadoRtc& estado) {
+  estado.magia = MAGIA_ESTADO_RTC;
+  estado.version = VERSION_ESTADO_RTC;
+  estado.tamano = sizeof(EstadoRtc);
+  estado.crc = crcEstado(estado);
+}
+
+bool estadoRtcValido(const EstadoRtc& estado) {
+  return estado.magia == MAGIA_ESTADO_RTC &&
+         estado.version == VERSION_ESTADO_RTC &&
+         estado.tamano == sizeof(EstadoRtc) &&
+         estado.crc == crcEstado(estado);
+}
+
+void invalidarEstadoRtc(EstadoRtc& estado) {
+  estado.magia = 0;
+  estado.crc = 0;
+}
@@ -0,0 +1,53 @@
+/*
+ * Estado de la prueba en curso guardado en la memoria RTC lenta.
+ *
+ * La memoria RTC no se borra en un reinicio por software, watchdog,
+ * excepción o brownout, pero sí al encender. Al arrancar, un estado con
+ * la firma, versión, tamaño y CRC correctos es de antes del reinicio y el
+ * firmware se reanuda en vez de empezar de cero: vuelve a leer el estado
+ * real del sensor y recoge el resultado si ya lo tiene.
+ *
+ * El firmware lo vuelca una vez por vuelta de loop(), justo después de
+ * despachar los eventos diferidos: así un resultado sólo figura como leído
+ * cuando ya está en la cola de subida.
+ */
+#ifndef ESTADO_RTC_H
+#define ESTADO_RTC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "politica_retest.h"
+#include "entrega_resultados.h"
+
+#define MAGIA_ESTADO_RTC 0x43545241UL  // "ARTC"
+#define VERSION_ESTADO_RTC 5
+
+// Más reanudaciones seguidas que estas sin llegar a ESTABLE_TRAS_MS de
+// funcionamiento indican que el propio estado provoca el fallo: se descarta
+#define MAX_REANUDACIONES 3
+#define ESTABLE_TRAS_MS 60000UL
+
+struct EstadoRtc {
+  uint32_t magia;
+  uint16_t version;
+  uint16_t tamano;             // sizeof(EstadoRtc) al guardarlo
+  uint8_t reanudaciones;       // arranques en caliente seguidos
+  uint8_t estadoSensor;        // último estado visto (0x31-0x37)
+  bool sopladoAdaptativo;
+  uint8_t tiempoSoplado;       // último valor de 0x88/0x89, 0 si no se sabe
+  uint32_t idSujeto;
+  uint32_t secuenciaOriginal;  // secuencia de subida de la prueba a confirmar
+  EstadoRetest retest;
+  EntregaResultados entrega;   // resultado pendiente, caché y marcas
+  uint32_t crc;                // CRC-32 de todos los campos anteriores
+};
+
+uint32_t crc32(const void* datos, size_t longitud, uint32_t crc = 0);
+
+// Rellena magia, versión, tamaño y CRC. Los huecos de alineación entran
+// en el CRC: construir el estado con memset y copiarlo con memcpy.
+void sellarEstadoRtc(EstadoRtc& estado);
+bool estadoRtcValido(const EstadoRtc& estado);
+void invalidarEstadoRtc(EstadoRtc& estado);
+
+#endif
@@ -0,0 +1,111 @@
+/*
+ * Contabilidad de estados de consumo.
+ * Este archivo no depende de Arduino: se compila igual en el ESP32 y en
+ * el entorno nativo.
+ */
+#include "gestor_energia.h"
+
+// 240 MHz con la CPU en espera (delay) ronda 40 mA sin WiFi; a 80 MHz
+// unos 20 mA; en sueño ligero < 1 mA. El sensor calienta a ~150 mA.
+const ModeloConsumo MODELO_CONSUMO_DEFECTO = {
+  {40.0f, 20.0f, 0.8f},
+  150.0f,
+  5.0f
+};
+
+GestorEnergia::GestorEnergia(const ModeloConsumo& modelo)
+  : modelo(modelo), estado(ENERGIA_ACTIVO), desdeUs(0),
+    energiaInicioPrueba(0), energiaUltimaPrueba(0), energiaSumaPruebas(0),
+    numPruebas(0), numDespertaresUart(0), pruebaEnCurso(false) {
+  for (int i = 0; i < NUM_ESTADOS_ENERGIA; i++) acumuladoUs[i] = 0;
+}
+
+void GestorEnergia::iniciar(uint64_t ahora) {
+  estado = ENERGIA_ACTIVO;
+  desdeUs = ahora;
+  aplicarFrecuencia(ENERGIA_ACTIVO);
+}
+
+void GestorEnergia::acumular(uint64_t ahora) {
+  if (ahora > desdeUs) acumuladoUs[estado] += ahora - desdeUs;
+  desdeUs = ahora;
+}
+
+void GestorEnergia::cambiarA(EstadoEnergia nuevo, uint64_t ahora) {
+  acumular(ahora);
+  if (nuevo == estado) return;
+  // El sueño ligero no cambia la frecuencia: al despertar se sigue a la
+  // frecuencia previa, por eso sólo se aplica entre ACTIVO y REDUCIDO
+  if (nuevo != ENERGIA_SUENO_LIGERO) aplicarFrecuencia(nuevo);
+  estado = nuevo;
+}
+
+void GestorEnergia::esperar(uint32_t ms) {
+  if (ms > ESPERA_MINIMA_SUENO_MS) {
+    cambiarA(ENERGIA_SUENO_LIGERO, ahoraUs());
+    if (dormirLigero(ms)) numDespertaresUart++;
+    cambiarA(ENERGIA_ACTIVO, ahoraUs());
+    return;
+  }
+  cambiarA(ENERGIA_REDUCIDO, ahoraUs());
+  uint64_t limite = ahoraUs() + (uint64_t)ms * 1000;
+  while (ahoraUs() < limite) pausaTick();
+  cambiarA(ENERGIA_ACTIVO, ahoraUs());
+}
+
+void GestorEnergia::marcarInicioPrueba() {
+  acumular(ahoraUs());
+  energiaInicioPrueba = energiaTotalMj();
+  pruebaEnCurso = true;
+}
+
+void GestorEnergia::marcarFinPrueba() {
+  if (!pruebaEnCurso) return;
+  acumular(ahoraUs());
+  energiaUltimaPrueba = energiaTotalMj() - energiaInicioPrueba;
+  energiaSumaPruebas += energiaUltimaPrueba;
+  numPruebas++;
+  pruebaEnCurso = false;
+}
+
+uint64_t GestorEnergia::tiempoEnUs(EstadoEnergia e) const {
+  uint64_t t = acumuladoUs[e];
+  if (e == estado) {
+    uint64_t ahora = ahoraUs();
+    if (ahora > desdeUs) t += ahora - desdeUs;
+  }
+  return t;
+}
+
+uint64_t GestorEnergia::tiempoTotalUs() const {
+  uint64_t total = 0;
+  for (int i = 0; i < NUM_ESTADOS_ENERGIA; i++) {
+    total += tiempoEnUs((EstadoEnergia)i);
+  }
+  return total;
+}
+
+float GestorEnergia::cicloTrabajo() const {
+  uint64_t total = tiempoTotalUs();
+  if (total == 0) return 1.0f;
+  return (float)tiempoEnUs(ENERGIA_ACTIVO) / (float)total;
+}
+
+float GestorEnergia::energiaEstadoMj(EstadoEnergia e, uint64_t us) const {
+  // mA * V * s = mW * s = mJ
+  return (modelo.corrienteMa[e] + modelo.corrienteSensorMa) * modelo.tensionV *
+         ((float)us / 1e6f);
+}
+
+float GestorEnergia::energiaTotalMj() const {
+  float total = 0;
+  for (int i = 0; i < NUM_ESTADOS_ENERGIA; i++) {
+    total += energiaEstadoMj((EstadoEnergia)i, tiempoEnUs((EstadoEnergia)i));
+  }
+  return total;
+}
+
+float GestorEnergia::energiaMediaPruebaMj() const {
+  if (numPruebas == 0) return 0;
+  return energiaSumaPruebas / numPruebas;
+}
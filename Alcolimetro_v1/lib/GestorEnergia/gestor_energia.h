@@ -0,0 +1,144 @@
+/*
+ * Gestor de energía para el alcoholímetro portátil.
+ *
+ * Contabiliza el tiempo que el ESP32 pasa en cada estado de consumo
+ * (activo a 240 MHz, frecuencia reducida a 80 MHz y sueño ligero) y a partir
+ * de un modelo de corrientes estima el ciclo de trabajo y la energía por
+ * prueba. La contabilidad es portable; las esperas reales (cambio de
+ * frecuencia y sueño ligero) sólo se compilan para ESP32 y en el build
+ * nativo se sustituyen por un reloj simulado.
+ */
+#ifndef GESTOR_ENERGIA_H
+#define GESTOR_ENERGIA_H
+
+#include <stdint.h>
+
+enum EstadoEnergia : uint8_t {
+  ENERGIA_ACTIVO = 0,     // CPU a 240 MHz
+  ENERGIA_REDUCIDO,       // CPU a 80 MHz esperando al UART
+  ENERGIA_SUENO_LIGERO,   // Light sleep, despierta por temporizador o UART
+  NUM_ESTADOS_ENERGIA
+};
+
+// Frecuencias de CPU usadas. 80 MHz es el mínimo que mantiene el APB a
+// 80 MHz, así que los baudios de ambos UART no cambian.
+#define FRECUENCIA_ACTIVO_MHZ 240
+#define FRECUENCIA_REDUCIDA_MHZ 80
+
+// Esperas de hasta esto no compensan entrar en sueño ligero
+#define ESPERA_MINIMA_SUENO_MS 20
+
+// Corrientes de referencia (mA) de la placa DOIT DevKit v1 sin WiFi, y
+// consumo medio del sensor ZE29A. Ajustar con mediciones reales.
+struct ModeloConsumo {
+  float corrienteMa[NUM_ESTADOS_ENERGIA];
+  float corrienteSensorMa;
+  float tensionV;
+};
+
+extern const ModeloConsumo MODELO_CONSUMO_DEFECTO;
+
+class GestorEnergia {
+public:
+  explicit GestorEnergia(const ModeloConsumo& modelo = MODELO_CONSUMO_DEFECTO);
+
+  // Contabilidad pura: registra que a partir de ahoraUs se está en 'estado'
+  void iniciar(uint64_t ahoraUs);
+  void cambiarA(EstadoEnergia estado, uint64_t ahoraUs);
+  EstadoEnergia estadoActual() const { return estado; }
+
+  // Esperas que ajustan el estado de consumo (implementadas por plataforma).
+  // esperar() puede dormir; esperarUart() nunca duerme porque el UART no
+  // recibe durante el sueño ligero, sólo baja la frecuencia y vuelve en
+  // cuanto llega el primer byte. Al salir vuelve al estado de la llamada.
+  void esperar(uint32_t ms);
+  template <typename Puerto>
+  bool esperarUart(Puerto& puerto, uint32_t ms) {
+    if (puerto.available()) return true;
+    EstadoEnergia previo = estado;
+    cambiarA(ENERGIA_REDUCIDO, ahoraUs());
+    uint64_t limite = ahoraUs() + (uint64_t)ms * 1000;
+    bool hayDatos = false;
+    while (!(hayDatos = puerto.available() > 0) && ahoraUs() < limite) {
+      pausaTick();
+    }
+    cambiarA(previo, ahoraUs());
+    return hayDatos;
+  }
+
+  // Para bucles que sondean el UART a pasos cortos: entre empezarEsperaUart()
+  // y terminarEsperaUart() las esperarUart() no tocan la frecuencia, que
+  // cambia una vez al empezar y otra al terminar en lugar de en cada paso
+  void empezarEsperaUart() { cambiarA(ENERGIA_REDUCIDO, ahoraUs()); }
+  void terminarEsperaUart() { cambiarA(ENERGIA_ACTIVO, ahoraUs()); }
+
+  // Marcas de prueba para calcular la energía consumida por prueba
+  void marcarInicioPrueba();
+  void marcarFinPrueba();
+
+  uint64_t tiempoEnUs(EstadoEnergia e) const;
+  uint64_t tiempoTotalUs() const;
+  float cicloTrabajo() const;  // fracción del tiempo en ENERGIA_ACTIVO
+  float energiaTotalMj() const;
+  float energiaUltimaPruebaMj() const { return energiaUltimaPrueba; }
+  float energiaMediaPruebaMj() const;
+  uint32_t pruebasContabilizadas() const { return numPruebas; }
+  uint32_t despertaresUart() const { return numDespertaresUart; }
+
+  // Energía (mJ) de permanecer 'us' microsegundos en un estado
+  float energiaEstadoMj(EstadoEnergia e, uint64_t us) const;
+
+  // Reloj usado por las esperas; en ESP32 es esp_timer, en nativo simulado
+  uint64_t ahoraUs() const;
+
+private:
+  void acumular(uint64_t ahoraUs);
+
+  // Primitivas de plataforma (gestor_energia_esp32.cpp / simulación nativa)
+  void aplicarFrecuencia(EstadoEnergia e);
+  void pausaTick();
+  bool dormirLigero(uint32_t ms);  // true si despertó por UART
+
+  const ModeloConsumo& modelo;
+  EstadoEnergia estado;
+  uint64_t desdeUs;
+  uint64_t acumuladoUs[NUM_ESTADOS_ENERGIA];
+  float energiaInicioPrueba;
+  float energiaUltimaPrueba;
+  float energiaSumaPruebas;
+  uint32_t numPruebas;
+  uint32_t numDespertaresUart;
+  bool pruebaEnCurso;
+};
+
+#ifndef ARDUINO
+// Reloj simulado del build nativo; las esperas del gestor lo avanzan
+void avanzarRelojSimulado(uint64_t us);
+
+// Modelo simulado de una prueba completa para el build nativo. Reproduce
+// la secuencia de sondeos del firmware (precalentamiento, espera de soplido,
+// soplido y cálculo) y devuelve la energía estimada con y sin gestión.
+struct PerfilPrueba {
+  uint32_t precalentamientoMs;   // el sensor tarda ~10 s
+  uint32_t esperaSoplidoMs;      // tiempo hasta que el sujeto sopla
+  uint32_t sopladoMs;            // tiempo de soplado configurado (0x89)
+  uint32_t calculoMs;
+  uint32_t intervaloSondeoMs;    // pausa entre consultas de estado
+  uint32_t latenciaRespuestaMs;  // tiempo hasta el primer byte de respuesta
+  uint32_t transmisionMs;        // 9 bytes a 9600 baudios ~ 9.4 ms
+};
+
+extern const PerfilPrueba PERFIL_PRUEBA_DEFECTO;
+
+struct ResultadoModelo {
+  float cicloTrabajo;
+  float energiaMj;
+  uint32_t duracionMs;
+};
+
+ResultadoModelo simularPrueba(const PerfilPrueba& perfil,
+                              const ModeloConsumo& modelo,
+                              bool gestionActiva);
+#endif
+
+#endif
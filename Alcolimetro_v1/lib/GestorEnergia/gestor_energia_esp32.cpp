@@ -0,0 +1,46 @@
+/*
+ * Primitivas del gestor de energía en el ESP32: cambio de frecuencia de
+ * CPU, pausas de un tick de FreeRTOS y sueño ligero con despertar por
+ * temporizador o por actividad en el UART de la consola.
+ */
+#ifdef ESP32
+
+#include <Arduino.h>
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#include <driver/uart.h>
+#include "gestor_energia.h"
+
+// Flancos en RX de UART0 necesarios para despertar (mínimo del hardware).
+// Los caracteres que despiertan al chip no llegan al buffer.
+#define UMBRAL_DESPERTAR_UART 3
+
+uint64_t GestorEnergia::ahoraUs() const {
+  return (uint64_t)esp_timer_get_time();
+}
+
+void GestorEnergia::aplicarFrecuencia(EstadoEnergia e) {
+  setCpuFrequencyMhz(e == ENERGIA_REDUCIDO ? FRECUENCIA_REDUCIDA_MHZ
+                                           : FRECUENCIA_ACTIVO_MHZ);
+}
+
+void GestorEnergia::pausaTick() {
+  delay(1);  // cede la CPU; la tarea idle ejecuta waiti hasta la interrupción
+}
+
+bool GestorEnergia::dormirLigero(uint32_t ms) {
+  static bool despertarUartConfigurado = false;
+  if (!despertarUartConfigurado) {
+    uart_set_wakeup_threshold(UART_NUM_0, UMBRAL_DESPERTAR_UART);
+    esp_sleep_enable_uart_wakeup(UART_NUM_0);
+    despertarUartConfigurado = true;
+  }
+
+  // Terminar de transmitir por consola; el UART se detiene al dormir
+  Serial.flush();
+  esp_sleep_enable_timer_wakeup((uint64_t)ms * 1000);
+  esp_light_sleep_start();
+  return esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_UART;
+}
+
+#endif
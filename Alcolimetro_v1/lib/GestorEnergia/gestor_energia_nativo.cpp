@@ -0,0 +1,88 @@
+/*
+ * Primitivas del gestor de energía para el build nativo: un reloj simulado
+ * que las esperas avanzan, y el modelo de una prueba completa.
+ */
+#ifndef ARDUINO
+
+#include "gestor_energia.h"
+
+static uint64_t relojSimuladoUs = 0;
+
+void avanzarRelojSimulado(uint64_t us) {
+  relojSimuladoUs += us;
+}
+
+uint64_t GestorEnergia::ahoraUs() const {
+  return relojSimuladoUs;
+}
+
+void GestorEnergia::aplicarFrecuencia(EstadoEnergia) {
+}
+
+void GestorEnergia::pausaTick() {
+  relojSimuladoUs += 1000;  // un tick de FreeRTOS
+}
+
+bool GestorEnergia::dormirLigero(uint32_t ms) {
+  relojSimuladoUs += (uint64_t)ms * 1000;
+  return false;
+}
+
+const PerfilPrueba PERFIL_PRUEBA_DEFECTO = {
+  10000,  // precalentamiento
+  4000,   // espera de soplido
+  3000,   // soplado
+  2000,   // cálculo
+  500,    // intervalo de sondeo (esperarEstado)
+  30,     // latencia del sensor
+  10      // transmisión de 9 bytes a 9600 baudios
+};
+
+// Puerto simulado: el primer byte de respuesta llega 'latencia' después
+// de terminar la transmisión del comando.
+namespace {
+struct PuertoSimulado {
+  const GestorEnergia& g;
+  uint64_t respuestaEnUs;
+  int available() const { return g.ahoraUs() >= respuestaEnUs ? 9 : 0; }
+};
+}
+
+ResultadoModelo simularPrueba(const PerfilPrueba& perfil,
+                              const ModeloConsumo& modelo,
+                              bool gestionActiva) {
+  GestorEnergia g(modelo);
+  g.iniciar(g.ahoraUs());
+  uint64_t inicio = g.ahoraUs();
+  uint64_t fin = inicio + ((uint64_t)perfil.precalentamientoMs +
+                           perfil.esperaSoplidoMs + perfil.sopladoMs +
+                           perfil.calculoMs) * 1000;
+  g.marcarInicioPrueba();
+
+  // Cada sondeo: transmitir, esperar el primer byte, leer y pausar
+  while (g.ahoraUs() < fin) {
+    avanzarRelojSimulado((uint64_t)perfil.transmisionMs * 1000);
+    PuertoSimulado puerto = {g, g.ahoraUs() +
+                                (uint64_t)perfil.latenciaRespuestaMs * 1000};
+    if (gestionActiva) {
+      g.esperarUart(puerto, 500);
+    } else {
+      avanzarRelojSimulado((uint64_t)500 * 1000);  // delay(500) fijo
+    }
+    avanzarRelojSimulado((uint64_t)perfil.transmisionMs * 1000);
+    if (gestionActiva) {
+      g.esperar(perfil.intervaloSondeoMs);
+    } else {
+      avanzarRelojSimulado((uint64_t)perfil.intervaloSondeoMs * 1000);
+    }
+  }
+  g.marcarFinPrueba();
+
+  ResultadoModelo r;
+  r.cicloTrabajo = g.cicloTrabajo();
+  r.energiaMj = g.energiaUltimaPruebaMj();
+  r.duracionMs = (uint32_t)((g.ahoraUs() - inicio) / 1000);
+  return r;
+}
+
+#endif
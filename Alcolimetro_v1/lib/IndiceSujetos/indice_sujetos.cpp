@@ -0,0 +1,268 @@
+#include "indice_sujetos.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MAGIA_SEGMENTO 0x47455349UL  // "ISEG"
+#define VERSION_SEGMENTO 1
+#define TAM_ENTRADA 12                // sujeto(4) posición(8)
+#define SIN_ANTERIOR UINT32_MAX
+
+// En el fichero, seguida del filtro (bitsBloom / 8 bytes), las cercas
+// (numEntradas / ENTRADAS_POR_BLOQUE redondeado, 4 bytes cada una) y la
+// tabla ordenada por sujeto y posición. Little endian, como el host.
+struct CabeceraSegmento {
+  uint32_t magia;
+  uint16_t version;
+  uint16_t hashes;
+  uint64_t inicioAlmacen;
+  uint64_t finAlmacen;
+  uint32_t numEntradas;
+  uint32_t bitsBloom;
+};
+static_assert(sizeof(CabeceraSegmento) == 32, "cabecera sin relleno");
+
+static uint32_t numCercas(uint32_t numEntradas) {
+  return (numEntradas + ENTRADAS_POR_BLOQUE - 1) / ENTRADAS_POR_BLOQUE;
+}
+
+static uint64_t bytesSegmento(const CabeceraSegmento& c) {
+  return sizeof(c) + c.bitsBloom / 8 + (uint64_t)numCercas(c.numEntradas) * 4 +
+         (uint64_t)c.numEntradas * TAM_ENTRADA;
+}
+
+static uint64_t hashSujeto(uint32_t sujeto) {
+  uint64_t x = sujeto + 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+// Doble hash: h1 + i·h2 sobre los bits del filtro
+static bool bloomContiene(const std::vector<uint64_t>& bloom, uint32_t bits, uint32_t sujeto) {
+  uint64_t h = hashSujeto(sujeto);
+  uint32_t h1 = (uint32_t)h, h2 = (uint32_t)(h >> 32) | 1;
+  for (uint32_t i = 0; i < HASHES_BLOOM; i++) {
+    uint32_t bit = (h1 + i * h2) % bits;
+    if (!(bloom[bit / 64] >> (bit % 64) & 1)) return false;
+  }
+  return true;
+}
+
+static void bloomAnadir(std::vector<uint64_t>& bloom, uint32_t bits, uint32_t sujeto) {
+  uint64_t h = hashSujeto(sujeto);
+  uint32_t h1 = (uint32_t)h, h2 = (uint32_t)(h >> 32) | 1;
+  for (uint32_t i = 0; i < HASHES_BLOOM; i++) {
+    uint32_t bit = (h1 + i * h2) % bits;
+    bloom[bit / 64] |= 1ULL << (bit % 64);
+  }
+}
+
+static bool escribirTodo(int fd, const void* datos, size_t n, uint64_t posicion) {
+  const uint8_t* p = (const uint8_t*)datos;
+  while (n > 0) {
+    ssize_t escritos = pwrite(fd, p, n, (off_t)posicion);
+    if (escritos <= 0) return false;
+    p += escritos;
+    n -= (size_t)escritos;
+    posicion += (uint64_t)escritos;
+  }
+  return true;
+}
+
+static bool leerTodo(int fd, void* datos, size_t n, uint64_t posicion) {
+  uint8_t* p = (uint8_t*)datos;
+  while (n > 0) {
+    ssize_t leidos = pread(fd, p, n, (off_t)posicion);
+    if (leidos <= 0) return false;
+    p += leidos;
+    n -= (size_t)leidos;
+    posicion += (uint64_t)leidos;
+  }
+  return true;
+}
+
+IndiceSujetos::IndiceSujetos(size_t presupuestoBytes, uint32_t registrosPorSegmento)
+  : presupuesto(presupuestoBytes), registrosPorSegmento(registrosPorSegmento) {}
+
+IndiceSujetos::~IndiceSujetos() {
+  if (fd >= 0) close(fd);
+}
+
+bool IndiceSujetos::abrir(const char* ruta, uint64_t tamAlmacen) {
+  fd = open(ruta, O_RDWR | O_CREAT, 0644);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0) return false;
+  uint64_t tamFichero = (uint64_t)st.st_size;
+
+  uint64_t posicion = 0;
+  CabeceraSegmento c;
+  while (posicion + sizeof(c) <= tamFichero && leerTodo(fd, &c, sizeof(c), posicion)) {
+    if (c.magia != MAGIA_SEGMENTO || c.version != VERSION_SEGMENTO ||
+        c.hashes != HASHES_BLOOM || c.bitsBloom % 64 != 0 || c.bitsBloom == 0 ||
+        c.inicioAlmacen != finAlmacenSellado || c.finAlmacen > tamAlmacen ||
+        posicion + bytesSegmento(c) > tamFichero) {
+      break;
+    }
+    Segmento s;
+    s.numEntradas = c.numEntradas;
+    s.bitsBloom = c.bitsBloom;
+    s.bloom.resize(c.bitsBloom / 64);
+    s.cercas.resize(numCercas(c.numEntradas));
+    uint64_t p = posicion + sizeof(c);
+    if (!leerTodo(fd, s.bloom.data(), c.bitsBloom / 8, p)) break;
+    p += c.bitsBloom / 8;
+    if (!leerTodo(fd, s.cercas.data(), s.cercas.size() * 4, p)) break;
+    s.posicionTabla = p + s.cercas.size() * 4;
+    memoriaSellados += bytesSellados(s);
+    sellados.push_back(std::move(s));
+    finAlmacenSellado = c.finAlmacen;
+    posicion += bytesSegmento(c);
+  }
+  // Lo que sigue es un sellado interrumpido o de otro almacén
+  if (posicion < tamFichero && ftruncate(fd, (off_t)posicion) != 0) return false;
+  finFichero = posicion;
+  finAlmacenActivo = finAlmacenSellado;
+  ajustarPresupuesto();
+  return true;
+}
+
+bool IndiceSujetos::anotar(uint32_t sujeto, uint64_t posicion, uint64_t fin) {
+  auto r = ultimoDeSujeto.emplace(sujeto, (uint32_t)activos.size());
+  uint32_t anterior = r.second ? SIN_ANTERIOR : r.first->second;
+  r.first->second = (uint32_t)activos.size();
+  activos.push_back({posicion, anterior});
+  finAlmacenActivo = fin;
+  if (activos.size() < registrosPorSegmento && bytesActivos() < presupuesto / 2) return true;
+  return sellar();
+}
+
+bool IndiceSujetos::sellar() {
+  if (fd < 0 || activos.empty()) return fd >= 0;
+  std::vector<std::pair<uint32_t, uint64_t>> entradas;
+  entradas.reserve(activos.size());
+  for (const auto& par : ultimoDeSujeto) {
+    for (uint32_t i = par.second; i != SIN_ANTERIOR; i = activos[i].anterior) {
+      entradas.push_back({par.first, activos[i].posicion});
+    }
+  }
+  std::sort(entradas.begin(), entradas.end());
+
+  CabeceraSegmento c = {MAGIA_SEGMENTO, VERSION_SEGMENTO, HASHES_BLOOM, finAlmacenSellado,
+                        finAlmacenActivo, (uint32_t)entradas.size(), 0};
+  c.bitsBloom = (uint32_t)((ultimoDeSujeto.size() * BITS_BLOOM_POR_SUJETO + 63) / 64 * 64);
+  Segmento s;
+  s.numEntradas = c.numEntradas;
+  s.bitsBloom = c.bitsBloom;
+  s.bloom.assign(c.bitsBloom / 64, 0);
+  for (const auto& par : ultimoDeSujeto) bloomAnadir(s.bloom, s.bitsBloom, par.first);
+  for (size_t i = 0; i < entradas.size(); i += ENTRADAS_POR_BLOQUE) {
+    s.cercas.push_back(entradas[i].first);
+  }
+
+  std::vector<uint8_t> bytes(bytesSegmento(c));
+  uint8_t* p = bytes.data();
+  memcpy(p, &c, sizeof(c));
+  p += sizeof(c);
+  memcpy(p, s.bloom.data(), c.bitsBloom / 8);
+  p += c.bitsBloom / 8;
+  memcpy(p, s.cercas.data(), s.cercas.size() * 4);
+  p += s.cercas.size() * 4;
+  s.posicionTabla = finFichero + (uint64_t)(p - bytes.data());
+  for (const auto& e : entradas) {
+    memcpy(p, &e.first, 4);
+    memcpy(p + 4, &e.second, 8);
+    p += TAM_ENTRADA;
+  }
+  if (!escribirTodo(fd, bytes.data(), bytes.size(), finFichero) || fsync(fd) != 0) {
+    return false;
+  }
+
+  finFichero += bytes.size();
+  finAlmacenSellado = finAlmacenActivo;
+  memoriaSellados += bytesSellados(s);
+  sellados.push_back(std::move(s));
+  ultimoDeSujeto = std::unordered_map<uint32_t, uint32_t>();
+  activos = std::vector<Enlace>();
+  ajustarPresupuesto();
+  return true;
+}
+
+// Filtros de los más antiguos fuera hasta caber en la mitad del presupuesto
+void IndiceSujetos::ajustarPresupuesto() {
+  for (Segmento& s : sellados) {
+    if (memoriaSellados <= presupuesto / 2) break;
+    if (s.bloom.empty()) continue;
+    size_t antes = bytesSellados(s);
+    s.bloom = std::vector<uint64_t>();
+    memoriaSellados -= antes - bytesSellados(s);
+  }
+}
+
+size_t IndiceSujetos::bytesActivos() const {
+  // Nodo de la tabla hash (clave, valor, siguiente y hash) más su cubeta
+  return activos.capacity() * sizeof(Enlace) +
+         ultimoDeSujeto.size() * 32 + ultimoDeSujeto.bucket_count() * sizeof(void*);
+}
+
+size_t IndiceSujetos::bytesSellados(const Segmento& s) const {
+  return sizeof(Segmento) + s.bloom.capacity() * 8 + s.cercas.capacity() * 4;
+}
+
+size_t IndiceSujetos::bytesEnMemoria() const {
+  return bytesActivos() + memoriaSellados;
+}
+
+void IndiceSujetos::buscarEnSegmento(const Segmento& s, uint32_t sujeto,
+                                     std::vector<uint64_t>& posiciones,
+                                     EstadisticasBusqueda& e) const {
+  // El sujeto puede empezar al final del bloque anterior al primero cuya
+  // cerca lo alcanza
+  size_t b = std::lower_bound(s.cercas.begin(), s.cercas.end(), sujeto) - s.cercas.begin();
+  if (b > 0) b--;
+  uint8_t bloque[ENTRADAS_POR_BLOQUE * TAM_ENTRADA];
+  for (; b < s.cercas.size() && s.cercas[b] <= sujeto; b++) {
+    uint32_t n = std::min<uint32_t>(ENTRADAS_POR_BLOQUE, s.numEntradas - (uint32_t)b * ENTRADAS_POR_BLOQUE);
+    if (!leerTodo(fd, bloque, (size_t)n * TAM_ENTRADA,
+                  s.posicionTabla + (uint64_t)b * ENTRADAS_POR_BLOQUE * TAM_ENTRADA)) {
+      return;
+    }
+    e.bloquesLeidos++;
+    for (uint32_t i = 0; i < n; i++) {
+      uint32_t clave;
+      memcpy(&clave, bloque + i * TAM_ENTRADA, 4);
+      if (clave > sujeto) return;
+      if (clave < sujeto) continue;
+      uint64_t posicion;
+      memcpy(&posicion, bloque + i * TAM_ENTRADA + 4, 8);
+      posiciones.push_back(posicion);
+    }
+  }
+}
+
+bool IndiceSujetos::buscar(uint32_t sujeto, std::vector<uint64_t>& posiciones,
+                           EstadisticasBusqueda* estadisticas) const {
+  EstadisticasBusqueda e = {};
+  for (const Segmento& s : sellados) {
+    e.segmentos++;
+    if (!s.bloom.empty() && !bloomContiene(s.bloom, s.bitsBloom, sujeto)) {
+      e.descartadosBloom++;
+      continue;
+    }
+    buscarEnSegmento(s, sujeto, posiciones, e);
+  }
+  auto i = ultimoDeSujeto.find(sujeto);
+  if (i != ultimoDeSujeto.end()) {
+    size_t desde = posiciones.size();
+    for (uint32_t k = i->second; k != SIN_ANTERIOR; k = activos[k].anterior) {
+      posiciones.push_back(activos[k].posicion);
+    }
+    std::reverse(posiciones.begin() + desde, posiciones.end());
+  }
+  if (estadisticas != nullptr) *estadisticas = e;
+  return fd >= 0;
+}
@@ -0,0 +1,101 @@
+/*
+ * Índice de sujeto a posiciones de sus registros en un almacén de solo
+ * anexar (el CSV de resultados del colector).
+ *
+ * Los registros se agrupan en segmentos consecutivos del almacén. El
+ * segmento activo, el más reciente, vive en memoria como tabla hash de
+ * sujeto a la lista de sus posiciones. Cuando se llena (en registros o en
+ * la mitad del presupuesto de memoria) se sella: sus pares (sujeto,
+ * posición) se escriben ordenados en el fichero del índice junto con un
+ * filtro de Bloom de sus sujetos y la clave de inicio de cada bloque de
+ * la tabla ("cercas"). En memoria de un segmento sellado sólo quedan el
+ * filtro y las cercas, así que una búsqueda descarta los segmentos que no
+ * pueden tener al sujeto y en los demás lee uno o dos bloques.
+ *
+ * Si los filtros pasan de la otra mitad del presupuesto se descartan los
+ * de los segmentos más antiguos: esos se consultan siempre, con el mismo
+ * resultado pero más lecturas.
+ *
+ * El almacén manda: un segmento a medio escribir o que apunta más allá
+ * del final del almacén se descarta al abrir, y lo que queda detrás de
+ * finSellado() se vuelve a anotar.
+ */
+#ifndef INDICE_SUJETOS_H
+#define INDICE_SUJETOS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#define REGISTROS_POR_SEGMENTO_DEFECTO (1u << 16)
+#define PRESUPUESTO_INDICE_DEFECTO (64u << 20)
+
+#define BITS_BLOOM_POR_SUJETO 10   // ~1 % de falsos positivos con 7 hashes
+#define HASHES_BLOOM 7
+#define ENTRADAS_POR_BLOQUE 256     // 3 KB de tabla por lectura
+
+struct EstadisticasBusqueda {
+  uint32_t segmentos;          // sellados recorridos
+  uint32_t descartadosBloom;
+  uint32_t bloquesLeidos;
+};
+
+class IndiceSujetos {
+public:
+  explicit IndiceSujetos(size_t presupuestoBytes = PRESUPUESTO_INDICE_DEFECTO,
+                         uint32_t registrosPorSegmento = REGISTROS_POR_SEGMENTO_DEFECTO);
+  ~IndiceSujetos();
+
+  // Abre o crea el fichero del índice de un almacén de 'tamAlmacen' bytes
+  bool abrir(const char* ruta, uint64_t tamAlmacen);
+
+  // Hasta dónde cubren los segmentos sellados; lo posterior del almacén
+  // hay que anotarlo de nuevo tras abrir()
+  uint64_t finSellado() const { return finAlmacenSellado; }
+
+  // Registro de 'sujeto' en [posicion, fin) del almacén, ya escrito en él.
+  // false si falla el sellado (el segmento sigue activo)
+  bool anotar(uint32_t sujeto, uint64_t posicion, uint64_t fin);
+
+  // Añade las posiciones de los registros del sujeto en orden de almacén
+  bool buscar(uint32_t sujeto, std::vector<uint64_t>& posiciones,
+              EstadisticasBusqueda* estadisticas = nullptr) const;
+
+  size_t bytesEnMemoria() const;
+  size_t segmentosSellados() const { return sellados.size(); }
+  size_t registrosActivos() const { return activos.size(); }
+
+private:
+  struct Segmento {
+    uint64_t posicionTabla;       // en el fichero del índice
+    uint32_t numEntradas;
+    uint32_t bitsBloom;
+    std::vector<uint64_t> bloom;  // vacío si se descartó por presupuesto
+    std::vector<uint32_t> cercas;
+  };
+  struct Enlace {
+    uint64_t posicion;
+    uint32_t anterior;            // del mismo sujeto, SIN_ANTERIOR si no hay
+  };
+
+  bool sellar();
+  void ajustarPresupuesto();
+  size_t bytesActivos() const;
+  size_t bytesSellados(const Segmento& s) const;
+  void buscarEnSegmento(const Segmento& s, uint32_t sujeto, std::vector<uint64_t>& posiciones,
+                        EstadisticasBusqueda& e) const;
+
+  size_t presupuesto;
+  uint32_t registrosPorSegmento;
+  int fd = -1;
+  uint64_t finFichero = 0;
+  uint64_t finAlmacenSellado = 0;
+  uint64_t finAlmacenActivo = 0;
+  std::vector<Segmento> sellados;
+  size_t memoriaSellados = 0;
+  std::unordered_map<uint32_t, uint32_t> ultimoDeSujeto;
+  std::vector<Enlace> activos;
+};
+
+#endif
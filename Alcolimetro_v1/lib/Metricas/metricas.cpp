@@ -0,0 +1,8 @@
+#include "metricas.h"
+
+namespace metricas {
+
+// Memoria estática a cero: todas las métricas empiezan en 0
+std::atomic<uint32_t> celdas[TOTAL_CELDAS];
+
+}  // namespace metricas
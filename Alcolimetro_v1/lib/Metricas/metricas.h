@@ -0,0 +1,275 @@
+/*
+ * Registro de métricas de ranuras fijas.
+ *
+ * Las métricas se declaran una vez en METRICAS(X) y cada serie ocupa una
+ * celda fija de un array de std::atomic<uint32_t> cuya posición se conoce
+ * en compilación: actualizar es un fetch_add relajado sobre una dirección
+ * constante, así que se puede dejar activo en producción y llamar desde
+ * cualquier tarea. exportarMetricas() vuelca el registro en el formato de
+ * texto de Prometheus, terminado en "# EOF".
+ *
+ * Tipos: contador (sólo crece), indicador (valor instantáneo) e
+ * histograma (cubetas fijas más suma y cuenta). Una métrica puede tener
+ * varias series con una etiqueta de valores fijos (comando, estado...).
+ * La lectura no es atómica entre celdas: un volcado puede ver una cubeta
+ * incrementada y la suma todavía sin actualizar.
+ */
+#ifndef METRICAS_H
+#define METRICAS_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+enum TipoMetrica : uint8_t {
+  METRICA_CONTADOR = 0,
+  METRICA_INDICADOR,
+  METRICA_HISTOGRAMA
+};
+
+// Valores de las etiquetas; el último recoge lo que no encaja
+inline constexpr const char* SERIE_UNICA[] = {""};
+inline constexpr const char* SERIES_COMANDO[] = {
+  "0x85", "0x86", "0x87", "0x88", "0x89", "0x90", "otro"
+};
+inline constexpr const char* SERIES_ALARMA[] = {
+  "ninguna", "bebido", "ebrio", "desconocida"
+};
+inline constexpr const char* SERIES_ESTADO[] = {
+  "0x31", "0x32", "0x33", "0x34", "0x35", "0x36", "0x37", "otro"
+};
+inline constexpr const char* SERIES_FALLO[] = {
+  "timeout", "respuesta_invalida", "checksum", "rechazo"
+};
+
+inline constexpr uint32_t SIN_LIMITES[] = {0};
+inline constexpr uint32_t LIMITES_PERMANENCIA_MS[] = {
+  100, 500, 1000, 2000, 5000, 10000, 20000, 60000
+};
+
+template <size_t N>
+constexpr uint8_t numSeries(const char* const (&)[N]) {
+  return (uint8_t)N;
+}
+
+template <size_t N>
+constexpr uint8_t numLimites(const uint32_t (&limites)[N]) {
+  return &limites[0] == &SIN_LIMITES[0] ? 0 : (uint8_t)N;
+}
+
+// X(id, tipo, nombre, ayuda, etiqueta, series, limites)
+#define METRICAS(X)                                                          \
+  X(M_COMANDOS_ENVIADOS, METRICA_CONTADOR,                                   \
+    "alcoholimetro_comandos_enviados_total",                                 \
+    "Comandos escritos en el UART del sensor", "comando", SERIES_COMANDO,    \
+    SIN_LIMITES)                                                             \
+  X(M_COMANDOS_BLOQUEADOS, METRICA_CONTADOR,                                 \
+    "alcoholimetro_comandos_bloqueados_total",                               \
+    "Comandos no enviados por no estar permitidos en el estado actual",     \
+    "comando", SERIES_COMANDO, SIN_LIMITES)                                  \
+  X(M_RESPUESTAS, METRICA_CONTADOR, "alcoholimetro_respuestas_total",        \
+    "Tramas completas recibidas del sensor", "comando", SERIES_COMANDO,      \
+    SIN_LIMITES)                                                             \
+  X(M_FALLOS_ENLACE, METRICA_CONTADOR, "alcoholimetro_fallos_enlace_total",  \
+    "Fallos del enlace con el sensor, incluidos rechazos de 0x87 y 0x89",    \
+    "tipo", SERIES_FALLO, SIN_LIMITES)                                       \
+  X(M_RESULTADOS, METRICA_CONTADOR, "alcoholimetro_resultados_total",        \
+    "Resultados leídos por clase de alarma", "alarma", SERIES_ALARMA,        \
+    SIN_LIMITES)                                                             \
+  X(M_RESULTADOS_CACHE, METRICA_CONTADOR,                                   \
+    "alcoholimetro_resultados_cache_total",                                  \
+    "Peticiones de resultado servidas sin leer el sensor", nullptr,          \
+    SERIE_UNICA, SIN_LIMITES)                                                \
+  X(M_ESTADO_SENSOR, METRICA_INDICADOR, "alcoholimetro_estado_sensor",       \
+    "Último estado leído del sensor", nullptr, SERIE_UNICA, SIN_LIMITES)     \
+  X(M_LATENCIA_ALARMA_NS, METRICA_INDICADOR,                                 \
+    "alcoholimetro_latencia_alarma_ns",                                      \
+    "Latencia de la última indicación de alarma", nullptr, SERIE_UNICA,      \
+    SIN_LIMITES)                                                             \
+  X(M_PENDIENTES_SUBIDA, METRICA_INDICADOR,                                  \
+    "alcoholimetro_registros_pendientes_subida",                             \
+    "Registros en la cola de subida sin confirmar", nullptr, SERIE_UNICA,    \
+    SIN_LIMITES)                                                             \
+  X(M_REGISTROS_INVALIDOS_SUBIDA, METRICA_CONTADOR,                          \
+    "alcoholimetro_registros_invalidos_subida_total",                        \
+    "Ranuras dañadas descartadas de la cola de subida", nullptr,             \
+    SERIE_UNICA, SIN_LIMITES)                                                \
+  X(M_PERMANENCIA_ESTADO_MS, METRICA_HISTOGRAMA,                             \
+    "alcoholimetro_permanencia_estado_ms",                                   \
+    "Tiempo observado en cada estado del sensor", "estado", SERIES_ESTADO,   \
+    LIMITES_PERMANENCIA_MS)
+
+#define METRICA_ID(id, ...) id,
+enum IdMetrica : uint8_t { METRICAS(METRICA_ID) NUM_METRICAS };
+
+struct DefinicionMetrica {
+  TipoMetrica tipo;
+  const char* nombre;
+  const char* ayuda;
+  const char* etiqueta;
+  const char* const* series;
+  uint8_t numSeries;
+  const uint32_t* limites;
+  uint8_t numLimites;
+};
+
+#define METRICA_DEFINICION(id, tipo, nombre, ayuda, etiqueta, series, limites) \
+  {tipo, nombre, ayuda, etiqueta, series, numSeries(series), limites,         \
+   numLimites(limites)},
+inline constexpr DefinicionMetrica DEFINICIONES_METRICAS[NUM_METRICAS] = {
+  METRICAS(METRICA_DEFINICION)
+};
+
+namespace metricas {
+
+// Un histograma usa por serie una celda por cubeta, la de +Inf y la suma
+constexpr uint16_t celdasPorSerie(const DefinicionMetrica& d) {
+  return d.tipo == METRICA_HISTOGRAMA ? (uint16_t)(d.numLimites + 2) : 1;
+}
+
+constexpr uint16_t inicio(uint8_t id) {
+  uint16_t total = 0;
+  for (uint8_t i = 0; i < id; i++) {
+    total += DEFINICIONES_METRICAS[i].numSeries *
+             celdasPorSerie(DEFINICIONES_METRICAS[i]);
+  }
+  return total;
+}
+
+constexpr uint16_t TOTAL_CELDAS = inicio(NUM_METRICAS);
+
+extern std::atomic<uint32_t> celdas[TOTAL_CELDAS];
+
+// Serie fuera de rango: la última ("otro")
+template <IdMetrica M>
+constexpr uint16_t celda(uint8_t serie) {
+  return inicio(M) +
+         (serie < DEFINICIONES_METRICAS[M].numSeries
+              ? serie
+              : DEFINICIONES_METRICAS[M].numSeries - 1) *
+             celdasPorSerie(DEFINICIONES_METRICAS[M]);
+}
+
+template <IdMetrica M>
+inline void incrementar(uint8_t serie = 0, uint32_t n = 1) {
+  static_assert(DEFINICIONES_METRICAS[M].tipo == METRICA_CONTADOR, "no es un contador");
+  celdas[celda<M>(serie)].fetch_add(n, std::memory_order_relaxed);
+}
+
+template <IdMetrica M>
+inline void fijar(uint32_t valor, uint8_t serie = 0) {
+  static_assert(DEFINICIONES_METRICAS[M].tipo == METRICA_INDICADOR, "no es un indicador");
+  celdas[celda<M>(serie)].store(valor, std::memory_order_relaxed);
+}
+
+template <IdMetrica M>
+inline void observar(uint32_t valor, uint8_t serie = 0) {
+  constexpr DefinicionMetrica d = DEFINICIONES_METRICAS[M];
+  static_assert(d.tipo == METRICA_HISTOGRAMA, "no es un histograma");
+  uint16_t base = celda<M>(serie);
+  uint8_t i = 0;
+  while (i < d.numLimites && valor > d.limites[i]) i++;
+  celdas[base + i].fetch_add(1, std::memory_order_relaxed);
+  celdas[base + d.numLimites + 1].fetch_add(valor, std::memory_order_relaxed);
+}
+
+// Series de las etiquetas comunes
+inline uint8_t serieComando(uint8_t comando) {
+  return comando >= 0x85 && comando <= 0x89 ? (uint8_t)(comando - 0x85)
+         : comando == 0x90                  ? 5
+                                            : 6;
+}
+
+inline uint8_t serieEstado(uint8_t estado) {
+  return estado >= 0x31 && estado <= 0x37 ? (uint8_t)(estado - 0x31) : 7;
+}
+
+inline uint8_t serieAlarma(uint8_t alarma) {
+  return alarma <= 2 ? alarma : 3;
+}
+
+inline uint32_t leer(uint16_t c) {
+  return celdas[c].load(std::memory_order_relaxed);
+}
+
+// Suma de todas las series de un contador o indicador
+template <IdMetrica M>
+inline uint32_t total() {
+  static_assert(DEFINICIONES_METRICAS[M].tipo != METRICA_HISTOGRAMA, "es un histograma");
+  uint32_t suma = 0;
+  for (uint8_t i = 0; i < DEFINICIONES_METRICAS[M].numSeries; i++) suma += leer(celda<M>(i));
+  return suma;
+}
+
+template <typename Salida>
+void imprimirSerie(Salida& s, const DefinicionMetrica& d, const char* sufijo,
+                   uint8_t serie, const char* le, uint32_t valor) {
+  s.print(d.nombre);
+  s.print(sufijo);
+  if (d.etiqueta != nullptr || le != nullptr) {
+    s.print("{");
+    if (d.etiqueta != nullptr) {
+      s.print(d.etiqueta);
+      s.print("=\"");
+      s.print(d.series[serie]);
+      s.print("\"");
+      if (le != nullptr) s.print(",");
+    }
+    if (le != nullptr) {
+      s.print("le=\"");
+      s.print(le);
+      s.print("\"");
+    }
+    s.print("}");
+  }
+  s.print(" ");
+  s.println(valor);
+}
+
+}  // namespace metricas
+
+// Formato de texto de Prometheus. 'Salida' necesita print(const char*),
+// print(uint32_t) y println(uint32_t), como Print de Arduino.
+template <typename Salida>
+void exportarMetricas(Salida& s) {
+  using namespace metricas;
+  static const char* const TIPOS[] = {"counter", "gauge", "histogram"};
+  for (uint8_t m = 0; m < NUM_METRICAS; m++) {
+    const DefinicionMetrica& d = DEFINICIONES_METRICAS[m];
+    s.print("# HELP ");
+    s.print(d.nombre);
+    s.print(" ");
+    s.println(d.ayuda);
+    s.print("# TYPE ");
+    s.print(d.nombre);
+    s.print(" ");
+    s.println(TIPOS[d.tipo]);
+    for (uint8_t serie = 0; serie < d.numSeries; serie++) {
+      uint16_t base = inicio(m) + serie * celdasPorSerie(d);
+      if (d.tipo != METRICA_HISTOGRAMA) {
+        imprimirSerie(s, d, "", serie, nullptr, leer(base));
+        continue;
+      }
+      // Las cubetas se guardan sueltas y se exportan acumuladas
+      uint32_t acumulado = 0;
+      char le[12];
+      for (uint8_t i = 0; i < d.numLimites; i++) {
+        acumulado += leer(base + i);
+        uint32_t v = d.limites[i];
+        int n = 0;
+        char inv[11];
+        do { inv[n++] = (char)('0' + v % 10); v /= 10; } while (v > 0);
+        for (int j = 0; j < n; j++) le[j] = inv[n - 1 - j];
+        le[n] = '\0';
+        imprimirSerie(s, d, "_bucket", serie, le, acumulado);
+      }
+      acumulado += leer(base + d.numLimites);
+      imprimirSerie(s, d, "_bucket", serie, "+Inf", acumulado);
+      imprimirSerie(s, d, "_sum", serie, nullptr, leer(base + d.numLimites + 1));
+      imprimirSerie(s, d, "_count", serie, nullptr, acumulado);
+    }
+  }
+  s.println("# EOF");
+}
+
+#endif
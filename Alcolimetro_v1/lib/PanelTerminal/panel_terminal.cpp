@@ -0,0 +1,143 @@
+#include "panel_terminal.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+// Bytes del carácter UTF-8 que empieza por b; un byte suelto inválido
+// cuenta como un carácter de un byte
+static size_t bytesCaracter(uint8_t b) {
+  return b < 0xC0 ? 1 : b < 0xE0 ? 2 : b < 0xF0 ? 3 : 4;
+}
+
+static bool mismoCaracter(const char* a, const char* b) {
+  size_t n = bytesCaracter((uint8_t)*a);
+  return n == bytesCaracter((uint8_t)*b) && memcmp(a, b, n) == 0;
+}
+
+static void rellenar(char* campo, uint8_t ancho) {
+  memset(campo, ' ', ancho);
+  campo[ancho] = '\0';
+}
+
+PanelTerminal::PanelTerminal(const CampoPanel* campos, uint8_t numCampos,
+                             const TextoPanel* fondo, uint8_t numTextos)
+  : campos(campos),
+    numCampos(numCampos < MAX_CAMPOS_PANEL ? numCampos : MAX_CAMPOS_PANEL),
+    fondo(fondo), numTextos(numTextos), filaFinal(1), completo(true),
+    enviados(0) {
+  for (uint8_t c = 0; c < this->numCampos; c++) {
+    uint8_t ancho = campos[c].ancho < ANCHO_MAX_CAMPO ? campos[c].ancho : ANCHO_MAX_CAMPO;
+    rellenar(deseado[c], ancho);
+    rellenar(visible[c], ancho);
+    if (campos[c].fila > filaFinal) filaFinal = campos[c].fila;
+  }
+  for (uint8_t i = 0; i < numTextos; i++) {
+    if (fondo[i].fila > filaFinal) filaFinal = fondo[i].fila;
+  }
+}
+
+void PanelTerminal::fijar(uint8_t campo, const char* texto) {
+  if (campo >= numCampos) return;
+  uint8_t ancho = campos[campo].ancho < ANCHO_MAX_CAMPO ? campos[campo].ancho
+                                                        : ANCHO_MAX_CAMPO;
+  char* destino = deseado[campo];
+  size_t b = 0;
+  uint8_t columna = 0;
+  while (columna < ancho && *texto != '\0') {
+    size_t n = bytesCaracter((uint8_t)*texto);
+    // Sitio para este carácter y los espacios del relleno
+    if (b + n + (ancho - columna - 1) > BYTES_MAX_CAMPO) break;
+    size_t i = 1;
+    while (i < n && texto[i] != '\0') i++;
+    if (i < n) break;  // secuencia cortada al final del texto
+    if ((uint8_t)*texto < 0x20) {
+      destino[b] = ' ';  // un control movería el cursor
+      n = 1;
+    } else {
+      memcpy(destino + b, texto, n);
+    }
+    b += n;
+    texto += n;
+    columna++;
+  }
+  while (columna < ancho) {
+    destino[b++] = ' ';
+    columna++;
+  }
+  destino[b] = '\0';
+}
+
+void PanelTerminal::fijarf(uint8_t campo, const char* formato, ...) {
+  char texto[BYTES_MAX_CAMPO + 1];
+  va_list args;
+  va_start(args, formato);
+  vsnprintf(texto, sizeof(texto), formato, args);
+  va_end(args);
+  fijar(campo, texto);
+}
+
+size_t PanelTerminal::longitud(const char* texto) {
+  return strlen(texto);
+}
+
+size_t PanelTerminal::situar(char* destino, uint8_t fila, uint8_t columna) {
+  return (size_t)sprintf(destino, "\x1b[%u;%uH", fila, columna);
+}
+
+size_t PanelTerminal::prepararBorrado(char* destino) {
+  // Atributos normales, cursor oculto y pantalla en blanco
+  static const char BORRADO[] = "\x1b[0m\x1b[?25l\x1b[2J";
+  memcpy(destino, BORRADO, sizeof(BORRADO) - 1);
+  for (uint8_t c = 0; c < numCampos; c++) {
+    rellenar(visible[c], campos[c].ancho < ANCHO_MAX_CAMPO ? campos[c].ancho
+                                                           : ANCHO_MAX_CAMPO);
+  }
+  completo = false;
+  return sizeof(BORRADO) - 1;
+}
+
+size_t PanelTerminal::prepararCierre(char* destino) {
+  size_t n = situar(destino, filaFinal + 1, 1);
+  static const char CIERRE[] = "\x1b[?25h\r\n";
+  memcpy(destino + n, CIERRE, sizeof(CIERRE) - 1);
+  return n + sizeof(CIERRE) - 1;
+}
+
+size_t PanelTerminal::siguienteTramo(uint8_t campo, uint8_t& columna, char* destino,
+                                     size_t capacidad) {
+  const char* v = visible[campo];
+  const char* d = deseado[campo];
+  uint8_t col = 0;
+  while (*d != '\0' && (col < columna || mismoCaracter(v, d))) {
+    v += bytesCaracter((uint8_t)*v);
+    d += bytesCaracter((uint8_t)*d);
+    col++;
+  }
+  if (*d == '\0') {
+    memcpy(visible[campo], deseado[campo], sizeof(visible[campo]));
+    columna = col;
+    return 0;
+  }
+
+  size_t n = situar(destino, campos[campo].fila, campos[campo].columna + col);
+  const char* desde = d;
+  const char* hasta = d;
+  uint8_t iguales = 0;
+  while (*d != '\0') {
+    size_t bd = bytesCaracter((uint8_t)*d);
+    if (mismoCaracter(v, d)) {
+      if (++iguales >= SALTO_MINIMO_PANEL) break;
+    } else {
+      if (n + (size_t)(d + bd - desde) > capacidad) break;
+      iguales = 0;
+      hasta = d + bd;
+      columna = col + 1;
+    }
+    v += bytesCaracter((uint8_t)*v);
+    d += bd;
+    col++;
+  }
+  memcpy(destino + n, desde, hasta - desde);
+  return n + (hasta - desde);
+}
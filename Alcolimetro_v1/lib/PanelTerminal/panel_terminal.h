@@ -0,0 +1,119 @@
+/*
+ * Panel de texto a pantalla completa para un terminal ANSI (VT100).
+ *
+ * El panel es una lista fija de campos, cada uno con su fila, columna y
+ * ancho en columnas, más un fondo de textos que no cambian (etiquetas,
+ * separadores). Se guarda una sombra con lo que muestra el terminal y
+ * otra con lo que debería mostrar; refrescar() compara las dos columna a
+ * columna y sólo envía los tramos que cambiaron, cada uno precedido de la
+ * secuencia que coloca el cursor. Un contador que pasa de 41 a 42 cuesta
+ * unos 10 bytes en vez de volver a escribir la línea.
+ *
+ * Los textos son UTF-8: las columnas se cuentan por carácter, no por
+ * byte, para que los acentos no desplacen el cursor. Un campo se rellena
+ * con espacios hasta su ancho y se corta si lo supera.
+ *
+ * La salida es cualquier objeto con write(const uint8_t*, size_t), como
+ * Print de Arduino; así la biblioteca también compila en el host.
+ */
+#ifndef PANEL_TERMINAL_H
+#define PANEL_TERMINAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAX_CAMPOS_PANEL 16
+#define ANCHO_MAX_CAMPO 64                   // columnas
+#define BYTES_MAX_CAMPO (ANCHO_MAX_CAMPO * 2)  // español: acentos de 2 bytes
+#define TAM_TROZO_PANEL 96
+// Colocar el cursor cuesta unos 8 bytes: un hueco de menos columnas
+// iguales entre dos cambios se reenvía en vez de saltarlo
+#define SALTO_MINIMO_PANEL 8
+
+struct CampoPanel {
+  uint8_t fila;     // 1 es la primera, como en las secuencias ANSI
+  uint8_t columna;
+  uint8_t ancho;
+};
+
+struct TextoPanel {
+  uint8_t fila;
+  uint8_t columna;
+  const char* texto;
+};
+
+class PanelTerminal {
+public:
+  PanelTerminal(const CampoPanel* campos, uint8_t numCampos,
+                const TextoPanel* fondo, uint8_t numTextos);
+
+  void fijar(uint8_t campo, const char* texto);
+  void fijarf(uint8_t campo, const char* formato, ...)
+      __attribute__((format(printf, 3, 4)));
+
+  // El terminal ya no muestra el panel (se escribió otra cosa o se acaba
+  // de conectar): el próximo refresco borra la pantalla y lo dibuja entero
+  void invalidar() { completo = true; }
+
+  // Envía los cambios pendientes y devuelve los bytes escritos
+  template <typename Salida>
+  uint32_t refrescar(Salida& s) {
+    char trozo[TAM_TROZO_PANEL];
+    uint32_t total = 0;
+    if (completo) {
+      total += enviar(s, trozo, prepararBorrado(trozo));
+      for (uint8_t i = 0; i < numTextos; i++) {
+        total += enviar(s, trozo, situar(trozo, fondo[i].fila, fondo[i].columna));
+        total += enviar(s, fondo[i].texto, longitud(fondo[i].texto));
+      }
+    }
+    for (uint8_t c = 0; c < numCampos; c++) {
+      uint8_t columna = 0;
+      size_t n;
+      while ((n = siguienteTramo(c, columna, trozo, sizeof(trozo))) > 0) {
+        total += enviar(s, trozo, n);
+      }
+    }
+    enviados += total;
+    return total;
+  }
+
+  // Deja el terminal como estaba: cursor visible y debajo del panel
+  template <typename Salida>
+  void cerrar(Salida& s) {
+    char trozo[TAM_TROZO_PANEL];
+    enviados += enviar(s, trozo, prepararCierre(trozo));
+    completo = true;
+  }
+
+  uint32_t bytesEnviados() const { return enviados; }
+
+private:
+  template <typename Salida>
+  static size_t enviar(Salida& s, const char* datos, size_t n) {
+    if (n > 0) s.write((const uint8_t*)datos, n);
+    return n;
+  }
+
+  static size_t longitud(const char* texto);
+  static size_t situar(char* destino, uint8_t fila, uint8_t columna);
+  size_t prepararBorrado(char* destino);
+  size_t prepararCierre(char* destino);
+  // Siguiente tramo distinto del campo a partir de 'columna', con su
+  // posicionamiento, y avanza 'columna'. Devuelve 0 cuando el resto ya
+  // coincide; entonces la sombra visible pasa a ser la deseada.
+  size_t siguienteTramo(uint8_t campo, uint8_t& columna, char* destino,
+                        size_t capacidad);
+
+  const CampoPanel* campos;
+  uint8_t numCampos;
+  const TextoPanel* fondo;
+  uint8_t numTextos;
+  uint8_t filaFinal;
+  bool completo;
+  uint32_t enviados;
+  char visible[MAX_CAMPOS_PANEL][BYTES_MAX_CAMPO + 1];
+  char deseado[MAX_CAMPOS_PANEL][BYTES_MAX_CAMPO + 1];
+};
+
+#endif
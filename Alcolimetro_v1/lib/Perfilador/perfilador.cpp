@@ -0,0 +1,30 @@
+#include <string.h>
+#include "perfilador.h"
+
+void limpiarTablaPerfil(TablaPerfil& tabla) {
+  memset(&tabla, 0, sizeof(tabla));
+}
+
+bool EN_IRAM_PERFIL anotarMuestra(TablaPerfil& tabla, uint32_t pc) {
+  tabla.muestras++;
+  if (pc == 0) pc = 1;  // 0 marca las entradas libres
+  // Hash multiplicativo; las instrucciones ocupan 2 o 3 bytes y el bit
+  // bajo sí distingue PCs
+  uint32_t i = (pc * 2654435761UL) >> (32 - 10);
+  static_assert(ENTRADAS_PERFIL == 1u << 10, "ajustar el desplazamiento del hash");
+  for (uint8_t sondeo = 0; sondeo < SONDEOS_PERFIL; sondeo++) {
+    EntradaPerfil& e = tabla.entradas[(i + sondeo) & (ENTRADAS_PERFIL - 1)];
+    if (e.pc == pc) {
+      e.muestras++;
+      return true;
+    }
+    if (e.pc == 0) {
+      e.pc = pc;
+      e.muestras = 1;
+      tabla.distintas++;
+      return true;
+    }
+  }
+  tabla.perdidas++;
+  return false;
+}
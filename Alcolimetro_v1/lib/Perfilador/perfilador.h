@@ -0,0 +1,100 @@
+/*
+ * Perfilador estadístico por muestreo del contador de programa.
+ *
+ * Un temporizador hardware interrumpe unas mil veces por segundo y anota
+ * el PC de cada núcleo en una tabla fija de PCs distintos con su número
+ * de muestras. Así se ve también el tiempo que se va dentro del núcleo de
+ * Arduino (HardwareSerial::write, Print::print, delay...) sin
+ * instrumentar nada.
+ *
+ * En el ESP32 el PC se lee del registro de traza PDEBUGPC de cada CPU
+ * (DPORT), y la interrupción que muestrea un núcleo corre en el otro: el
+ * núcleo medido no se interrumpe y su perfil no incluye al perfilador.
+ * La frecuencia por defecto es 997 Hz, no 1000, para no ir en fase con el
+ * tick de FreeRTOS y lo que se despierta con él.
+ *
+ * Sólo se guarda el PC, no la pila: el grafo de llamas que genera
+ * tools/perfilador/perfil.py tiene la función muestreada y las funciones
+ * en línea que la contienen, no las llamadas.
+ *
+ * Durante el perfilado loop() no entra en sueño ligero, que pararía los
+ * temporizadores. Si el gestor de energía baja la frecuencia del bus APB
+ * el periodo se alarga; el volcado da la frecuencia real medida.
+ */
+#ifndef PERFILADOR_H
+#define PERFILADOR_H
+
+#include <stdint.h>
+
+#ifdef ESP32
+#include <esp_attr.h>
+#define EN_IRAM_PERFIL IRAM_ATTR
+#else
+#define EN_IRAM_PERFIL
+#endif
+
+#define FRECUENCIA_PERFIL_HZ 997
+#define ENTRADAS_PERFIL 1024      // PCs distintos por núcleo, potencia de dos
+#define SONDEOS_PERFIL 8          // posiciones probadas antes de dar la muestra por perdida
+#define NUCLEOS_PERFIL 2
+
+struct EntradaPerfil {
+  uint32_t pc;        // 0 = libre
+  uint32_t muestras;
+};
+
+struct TablaPerfil {
+  EntradaPerfil entradas[ENTRADAS_PERFIL];
+  uint32_t muestras;
+  uint32_t perdidas;   // sin sitio en la tabla
+  uint32_t distintas;
+};
+
+void limpiarTablaPerfil(TablaPerfil& tabla);
+// Direccionamiento abierto con sondeo lineal acotado: coste fijo en la ISR
+bool EN_IRAM_PERFIL anotarMuestra(TablaPerfil& tabla, uint32_t pc);
+
+// Sólo ESP32
+bool iniciarPerfil(uint32_t frecuenciaHz = FRECUENCIA_PERFIL_HZ);
+void detenerPerfil();
+bool perfilActivo();
+const TablaPerfil& tablaPerfil(uint8_t nucleo);
+uint32_t duracionPerfilMs();
+// Ciclos de CPU medios que cuesta cada interrupción de muestreo
+uint32_t costeMuestraCiclos();
+
+// Líneas "PERFIL <núcleo> <pc hex> <muestras>" entre una cabecera y
+// "PERFIL fin". 'Salida' necesita print(const char*), print(uint32_t),
+// print(uint32_t, HEX) y println(uint32_t) como Print de Arduino.
+template <typename Salida>
+void volcarPerfil(Salida& s) {
+  uint32_t duracion = duracionPerfilMs();
+  s.print("PERFIL inicio duracion_ms=");
+  s.print(duracion);
+  s.print(" coste_ciclos=");
+  s.println(costeMuestraCiclos());
+  for (uint8_t n = 0; n < NUCLEOS_PERFIL; n++) {
+    const TablaPerfil& t = tablaPerfil(n);
+    s.print("PERFIL nucleo=");
+    s.print((uint32_t)n);
+    s.print(" muestras=");
+    s.print(t.muestras);
+    s.print(" perdidas=");
+    s.print(t.perdidas);
+    s.print(" hz=");
+    s.println(duracion > 0 ? (uint32_t)((uint64_t)t.muestras * 1000 / duracion) : 0);
+    for (uint32_t i = 0; i < ENTRADAS_PERFIL; i++) {
+      const EntradaPerfil& e = t.entradas[i];
+      if (e.pc == 0) continue;
+      s.print("PERFIL ");
+      s.print((uint32_t)n);
+      s.print(" ");
+      s.print(e.pc, 16);
+      s.print(" ");
+      s.println(e.muestras);
+    }
+  }
+  s.println("PERFIL fin");
+}
+
+#endif
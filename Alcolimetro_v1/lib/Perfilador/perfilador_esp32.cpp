@@ -0,0 +1,115 @@
+/*
+ * Muestreo en el ESP32: un temporizador por núcleo, con la interrupción
+ * asignada al núcleo contrario del que mide. Las interrupciones se
+ * asignan en el núcleo que llama a timerAttachInterrupt(), así que la del
+ * núcleo 1 se arma desde una tarea fijada al núcleo 0.
+ */
+#ifdef ESP32
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <soc/dport_reg.h>
+#include "perfilador.h"
+
+// Los temporizadores 0 y 1 quedan libres para el resto del firmware
+#define TEMPORIZADOR_PERFIL_NUCLEO_0 2
+#define TEMPORIZADOR_PERFIL_NUCLEO_1 3
+
+static TablaPerfil tablas[NUCLEOS_PERFIL];
+static hw_timer_t* temporizadores[NUCLEOS_PERFIL] = {nullptr, nullptr};
+static uint32_t periodoUs = 0;
+static uint32_t inicioMs = 0;
+static uint32_t finMs = 0;
+static volatile bool activo = false;
+// Uno por ISR: cada una corre en un núcleo y no comparten contadores
+static volatile uint32_t ciclosIsr[NUCLEOS_PERFIL] = {0, 0};
+
+// Corre en el núcleo 1 y muestrea el 0
+static void IRAM_ATTR muestrearNucleo0() {
+  uint32_t t0 = ESP.getCycleCount();
+  anotarMuestra(tablas[0], DPORT_REG_READ(DPORT_PRO_CPU_RECORD_PDEBUGPC_REG));
+  ciclosIsr[0] += ESP.getCycleCount() - t0;
+}
+
+// Corre en el núcleo 0 y muestrea el 1 (loop())
+static void IRAM_ATTR muestrearNucleo1() {
+  uint32_t t0 = ESP.getCycleCount();
+  anotarMuestra(tablas[1], DPORT_REG_READ(DPORT_APP_CPU_RECORD_PDEBUGPC_REG));
+  ciclosIsr[1] += ESP.getCycleCount() - t0;
+}
+
+static hw_timer_t* armar(uint8_t numero, void (*isr)()) {
+  hw_timer_t* t = timerBegin(numero, 80, true);  // 1 MHz con APB a 80 MHz
+  if (t == nullptr) return nullptr;
+  timerAttachInterrupt(t, isr, true);
+  timerAlarmWrite(t, periodoUs, true);
+  timerAlarmEnable(t);
+  return t;
+}
+
+static void armarEnNucleo0(void* avisar) {
+  temporizadores[1] = armar(TEMPORIZADOR_PERFIL_NUCLEO_1, muestrearNucleo1);
+  xTaskNotifyGive((TaskHandle_t)avisar);
+  vTaskDelete(nullptr);
+}
+
+bool iniciarPerfil(uint32_t frecuenciaHz) {
+  if (activo || frecuenciaHz == 0) return false;
+  for (TablaPerfil& t : tablas) limpiarTablaPerfil(t);
+  ciclosIsr[0] = ciclosIsr[1] = 0;
+  periodoUs = 1000000UL / frecuenciaHz;
+
+  // Activar la traza de PC de ambas CPU
+  DPORT_REG_WRITE(DPORT_PRO_CPU_RECORD_CTRL_REG,
+                  DPORT_PRO_CPU_PDEBUG_ENABLE | DPORT_PRO_CPU_RECORD_ENABLE);
+  DPORT_REG_WRITE(DPORT_APP_CPU_RECORD_CTRL_REG,
+                  DPORT_APP_CPU_PDEBUG_ENABLE | DPORT_APP_CPU_RECORD_ENABLE);
+
+  // setup() y loop() corren en el núcleo 1: aquí se arma el del núcleo 0
+  temporizadores[0] = armar(TEMPORIZADOR_PERFIL_NUCLEO_0, muestrearNucleo0);
+  xTaskCreatePinnedToCore(armarEnNucleo0, "perfil", 2048,
+                          xTaskGetCurrentTaskHandle(), 1, nullptr, 0);
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+
+  if (temporizadores[0] == nullptr || temporizadores[1] == nullptr) {
+    activo = true;  // para que detenerPerfil() libere lo que se armó
+    detenerPerfil();
+    return false;
+  }
+  inicioMs = millis();
+  activo = true;
+  return true;
+}
+
+void detenerPerfil() {
+  if (!activo) return;
+  for (hw_timer_t*& t : temporizadores) {
+    if (t == nullptr) continue;
+    timerAlarmDisable(t);
+    timerDetachInterrupt(t);
+    timerEnd(t);
+    t = nullptr;
+  }
+  finMs = millis();
+  activo = false;
+}
+
+bool perfilActivo() {
+  return activo;
+}
+
+const TablaPerfil& tablaPerfil(uint8_t nucleo) {
+  return tablas[nucleo < NUCLEOS_PERFIL ? nucleo : 0];
+}
+
+uint32_t duracionPerfilMs() {
+  return (activo ? millis() : finMs) - inicioMs;
+}
+
+uint32_t costeMuestraCiclos() {
+  uint32_t muestras = tablas[0].muestras + tablas[1].muestras;
+  return muestras > 0 ? (ciclosIsr[0] + ciclosIsr[1]) / muestras : 0;
+}
+
+#endif
@@ -0,0 +1,125 @@
+#include "perfiles_soplado.h"
+#include <math.h>
+#include "protocolo_ze29a.h"
+
+// z = 1.64: cota superior unilateral del 95 %
+#define Z_WILSON 1.64f
+
+AdaptadorSoplado::AdaptadorSoplado(float objetivoFallos)
+  : objetivoFallos(objetivoFallos), actual(TIEMPO_SOPLADO_MINIMO_S),
+    tiempoSensor(0), inicioCicloMs(0), cicloEnCurso(false), pruebasEnVentana(0) {
+  for (EstadisticaPerfil& p : perfiles) p = {0, 0, 0, 0};
+}
+
+uint8_t AdaptadorSoplado::indice(uint8_t tiempoS) {
+  if (tiempoS < TIEMPO_SOPLADO_MINIMO_S) tiempoS = TIEMPO_SOPLADO_MINIMO_S;
+  if (tiempoS > TIEMPO_SOPLADO_MAXIMO_S) tiempoS = TIEMPO_SOPLADO_MAXIMO_S;
+  return tiempoS - TIEMPO_SOPLADO_MINIMO_S;
+}
+
+const EstadisticaPerfil& AdaptadorSoplado::estadistica(uint8_t tiempoS) const {
+  return perfiles[indice(tiempoS)];
+}
+
+float AdaptadorSoplado::tasaFallos(uint8_t tiempoS) const {
+  const EstadisticaPerfil& p = estadistica(tiempoS);
+  return p.soplidos > 0 ? (float)p.interrupciones / p.soplidos : 0.0f;
+}
+
+float AdaptadorSoplado::cotaWilson(uint8_t tiempoS, float signo) const {
+  const EstadisticaPerfil& p = estadistica(tiempoS);
+  if (p.soplidos == 0) return signo > 0 ? 1.0f : 0.0f;
+  float n = (float)p.soplidos;
+  float f = (float)p.interrupciones / n;
+  float z2 = Z_WILSON * Z_WILSON;
+  float centro = f + z2 / (2 * n);
+  float margen = Z_WILSON * sqrtf(f * (1 - f) / n + z2 / (4 * n * n));
+  return (centro + signo * margen) / (1 + z2 / n);
+}
+
+float AdaptadorSoplado::cotaInferiorFallos(uint8_t tiempoS) const {
+  return cotaWilson(tiempoS, -1.0f);
+}
+
+float AdaptadorSoplado::cotaSuperiorFallos(uint8_t tiempoS) const {
+  return cotaWilson(tiempoS, 1.0f);
+}
+
+bool AdaptadorSoplado::confirmado(uint8_t tiempoS) const {
+  return cotaSuperiorFallos(tiempoS) <= objetivoFallos;
+}
+
+float AdaptadorSoplado::cicloMedioMs(uint8_t tiempoS) const {
+  const EstadisticaPerfil& p = estadistica(tiempoS);
+  return p.ciclos > 0 ? (float)p.sumaCicloMs / p.ciclos : 0.0f;
+}
+
+float AdaptadorSoplado::cicloMedioMs() const {
+  uint64_t suma = 0;
+  uint32_t ciclos = 0;
+  for (const EstadisticaPerfil& p : perfiles) {
+    suma += p.sumaCicloMs;
+    ciclos += p.ciclos;
+  }
+  return ciclos > 0 ? (float)suma / ciclos : 0.0f;
+}
+
+void AdaptadorSoplado::olvidar() {
+  for (EstadisticaPerfil& p : perfiles) {
+    p.soplidos /= 2;
+    p.interrupciones /= 2;
+    p.sumaCicloMs = p.ciclos > 1 ? p.sumaCicloMs / p.ciclos * (p.ciclos / 2) : p.sumaCicloMs;
+    if (p.ciclos > 1) p.ciclos /= 2;
+  }
+}
+
+uint8_t AdaptadorSoplado::elegir() {
+  if (++pruebasEnVentana >= VENTANA_PRUEBAS_SOPLADO) {
+    pruebasEnVentana = 0;
+    olvidar();
+  }
+
+  // El más corto que aún puede cumplir el objetivo
+  for (uint8_t t = TIEMPO_SOPLADO_MINIMO_S; t <= TIEMPO_SOPLADO_MAXIMO_S; t++) {
+    if (cotaInferiorFallos(t) <= objetivoFallos) {
+      actual = t;
+      return actual;
+    }
+  }
+
+  // Ninguno puede: el de menor tasa observada
+  uint8_t mejor = TIEMPO_SOPLADO_MINIMO_S;
+  for (uint8_t t = TIEMPO_SOPLADO_MINIMO_S + 1; t <= TIEMPO_SOPLADO_MAXIMO_S; t++) {
+    if (tasaFallos(t) < tasaFallos(mejor)) mejor = t;
+  }
+  actual = mejor;
+  return actual;
+}
+
+void AdaptadorSoplado::iniciarCiclo(uint32_t ahoraMs) {
+  inicioCicloMs = ahoraMs;
+  cicloEnCurso = true;
+}
+
+void AdaptadorSoplado::registrarEstado(uint8_t anterior, uint8_t nuevo) {
+  if (anterior == nuevo) return;
+  EstadisticaPerfil& p = perfiles[indice(actual)];
+  if (nuevo == STATUS_BLOWING) {
+    p.soplidos++;
+  } else if (anterior == STATUS_BLOWING &&
+             (nuevo == STATUS_BLOW_INTERRUPTED || nuevo == STATUS_WAITING_FOR_BLOW)) {
+    // Con sondeos cada 500 ms a veces no se llega a ver 0x35
+    p.interrupciones++;
+  } else if (nuevo == STATUS_CALCULATING && anterior != STATUS_BLOWING) {
+    // Soplido completo sin llegar a ver BLOWING
+    p.soplidos++;
+  }
+}
+
+void AdaptadorSoplado::registrarResultado(uint32_t ahoraMs) {
+  if (!cicloEnCurso) return;
+  cicloEnCurso = false;
+  EstadisticaPerfil& p = perfiles[indice(actual)];
+  p.ciclos++;
+  p.sumaCicloMs += ahoraMs - inicioCicloMs;
+}
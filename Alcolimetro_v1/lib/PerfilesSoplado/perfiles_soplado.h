@@ -0,0 +1,91 @@
+/*
+ * Tiempo de soplado adaptativo.
+ *
+ * Cada tiempo de soplado (1-10 s, comando 0x89) es un perfil con sus
+ * soplidos, interrupciones (0x35) y tiempos de ciclo observados. Antes de
+ * cada prueba se elige el perfil más corto que todavía puede cumplir el
+ * objetivo de tasa de interrupciones: aquel cuya cota inferior de Wilson
+ * no lo supera. Un perfil sin datos se prueba; uno que acumula fallos se
+ * descarta en cuanto su cota inferior pasa del objetivo, y se queda el
+ * más corto que lo cumple. No se supone que los soplidos largos fallen
+ * más ni menos.
+ *
+ * Cada VENTANA_PRUEBAS_SOPLADO pruebas se dividen los contadores entre
+ * dos: pesa más lo reciente y un perfil descartado, con menos muestras,
+ * vuelve a tener una oportunidad si cambian los sujetos.
+ *
+ * El ciclo de una prueba va desde que se pide el precalentamiento hasta
+ * leer el resultado, soplidos repetidos incluidos: es lo que cuesta de
+ * verdad cada perfil.
+ *
+ * El valor escrito en el sensor se guarda en caché para enviar 0x89 sólo
+ * cuando cambia.
+ */
+#ifndef PERFILES_SOPLADO_H
+#define PERFILES_SOPLADO_H
+
+#include <stdint.h>
+
+#define TIEMPO_SOPLADO_MINIMO_S 1
+#define TIEMPO_SOPLADO_MAXIMO_S 10
+#define NUM_PERFILES_SOPLADO (TIEMPO_SOPLADO_MAXIMO_S - TIEMPO_SOPLADO_MINIMO_S + 1)
+
+#define OBJETIVO_FALLOS_DEFECTO 0.10f
+#define VENTANA_PRUEBAS_SOPLADO 200
+
+struct EstadisticaPerfil {
+  uint32_t soplidos;        // entradas en BLOWING
+  uint32_t interrupciones;  // BLOWING -> BLOW_INTERRUPTED
+  uint32_t ciclos;          // pruebas completas con este perfil
+  uint64_t sumaCicloMs;
+};
+
+class AdaptadorSoplado {
+public:
+  explicit AdaptadorSoplado(float objetivoFallos = OBJETIVO_FALLOS_DEFECTO);
+
+  // Perfil para la próxima prueba; llamar justo antes de iniciarla
+  uint8_t elegir();
+  void iniciarCiclo(uint32_t ahoraMs);
+  void registrarEstado(uint8_t anterior, uint8_t actual);
+  void registrarResultado(uint32_t ahoraMs);
+
+  // Caché del valor del sensor: 0 si no se conoce
+  bool hayQueEscribir(uint8_t tiempoS) const { return tiempoSensor != tiempoS; }
+  void tiempoEnSensor(uint8_t tiempoS) { tiempoSensor = tiempoS; }
+  uint8_t tiempoConocido() const { return tiempoSensor; }
+
+  // Modo manual: la prueba se apunta al perfil dado (0 = sin cambios)
+  void usarPerfil(uint8_t tiempoS) {
+    if (tiempoS != 0) actual = tiempoS;
+  }
+
+  void fijarObjetivo(float objetivo) { objetivoFallos = objetivo; }
+  float objetivo() const { return objetivoFallos; }
+  uint8_t perfilActual() const { return actual; }
+
+  const EstadisticaPerfil& estadistica(uint8_t tiempoS) const;
+  float tasaFallos(uint8_t tiempoS) const;
+  // Intervalo de Wilson de la tasa de interrupciones
+  float cotaInferiorFallos(uint8_t tiempoS) const;
+  float cotaSuperiorFallos(uint8_t tiempoS) const;
+  // Cota superior por debajo del objetivo: cumple con confianza
+  bool confirmado(uint8_t tiempoS) const;
+  float cicloMedioMs(uint8_t tiempoS) const;
+  float cicloMedioMs() const;  // de todas las pruebas
+
+private:
+  static uint8_t indice(uint8_t tiempoS);
+  float cotaWilson(uint8_t tiempoS, float signo) const;
+  void olvidar();
+
+  float objetivoFallos;
+  EstadisticaPerfil perfiles[NUM_PERFILES_SOPLADO];
+  uint8_t actual;         // perfil elegido para la prueba en curso
+  uint8_t tiempoSensor;
+  uint32_t inicioCicloMs;
+  bool cicloEnCurso;
+  uint32_t pruebasEnVentana;
+};
+
+#endif
@@ -0,0 +1,171 @@
+#include "politica_retest.h"
+
+PlanificadorRetest::PlanificadorRetest(uint8_t margenMg, uint32_t esperaMinimaMs)
+  : margen(margenMg), esperaMinima(esperaMinimaMs),
+    bebido(UMBRAL_BEBIDO_DEFECTO), ebrio(UMBRAL_EBRIO_DEFECTO),
+    siguienteId(1), idPendiente(SIN_VINCULO), vencimientoMs(0),
+    retestIniciado(false), esperaCumplida(false), pruebaAnulada(false),
+    otroSujetoAceptado(false), idSinConfirmar(SIN_VINCULO), numRechazadas(0) {
+  for (int i = 0; i < HISTORIAL_PRUEBAS; i++) historial[i].id = SIN_VINCULO;
+  pruebaOriginal.id = SIN_VINCULO;
+}
+
+void PlanificadorRetest::fijarUmbrales(uint8_t nuevoBebido, uint8_t nuevoEbrio) {
+  bebido = nuevoBebido;
+  ebrio = nuevoEbrio;
+}
+
+static bool cerca(uint16_t valor, uint8_t umbral, uint8_t margen) {
+  int diferencia = (int)valor - (int)umbral;
+  if (diferencia < 0) diferencia = -diferencia;
+  return diferencia <= margen;
+}
+
+bool PlanificadorRetest::cercaDeUmbral(uint16_t alcohol) const {
+  return cerca(alcohol, bebido, margen) || cerca(alcohol, ebrio, margen);
+}
+
+const RegistroPrueba& PlanificadorRetest::registrar(const ResultadoPrueba& r,
+                                                    uint32_t ahoraMs,
+                                                    uint32_t idSujeto) {
+  RegistroPrueba& nuevo = historial[siguienteId % HISTORIAL_PRUEBAS];
+  nuevo.id = siguienteId++;
+  nuevo.idSujeto = idSujeto;
+  nuevo.marcaMs = ahoraMs;
+  nuevo.resultado = r;
+  nuevo.idVinculado = SIN_VINCULO;
+  nuevo.esConfirmatoria = false;
+
+  if (retestEnCurso() && !otroSujetoAceptado && !sujetoCompatible(idSujeto)) {
+    // Prueba de otro sujeto: la confirmatoria sigue pendiente
+    retestIniciado = false;
+    esperaCumplida = false;
+  }
+  if (retestEnCurso()) {
+    // Esta es la confirmatoria: enlazar en ambos sentidos
+    nuevo.esConfirmatoria = true;
+    nuevo.idVinculado = idPendiente;
+    pruebaOriginal.idVinculado = nuevo.id;
+    RegistroPrueba& enHistorial = historial[idPendiente % HISTORIAL_PRUEBAS];
+    if (enHistorial.id == idPendiente) enHistorial.idVinculado = nuevo.id;
+    if (nuevo.idSujeto == 0) nuevo.idSujeto = pruebaOriginal.idSujeto;
+    cancelar();
+  } else if (cercaDeUmbral(r.alcoholMg100ml)) {
+    if (retestPendiente()) {
+      // La pendiente no se pisa: esta queda sin confirmar
+      idSinConfirmar = nuevo.id;
+      numRechazadas++;
+    } else {
+      idPendiente = nuevo.id;
+      pruebaOriginal = nuevo;
+      vencimientoMs = ahoraMs + esperaMinima;
+      retestIniciado = false;
+    }
+  }
+  return nuevo;
+}
+
+void PlanificadorRetest::marcarRetestIniciado(bool otroSujeto) {
+  retestIniciado = true;
+  esperaCumplida = false;
+  otroSujetoAceptado = otroSujeto;
+}
+
+bool PlanificadorRetest::sujetoCompatible(uint32_t idSujeto) const {
+  return idSujeto == 0 || pruebaOriginal.idSujeto == 0 ||
+         idSujeto == pruebaOriginal.idSujeto;
+}
+
+static bool sinSoplar(uint8_t estado) {
+  return estado == STATUS_PREHEATING || estado == STATUS_WAITING_FOR_BLOW;
+}
+
+bool PlanificadorRetest::vigilarSoplido(uint8_t anterior, uint8_t actual,
+                                        uint32_t ahoraMs) {
+  if (!retestEnCurso()) return true;
+  if (sinSoplar(actual)) {
+    if (msHastaRetest(ahoraMs) == 0) esperaCumplida = true;
+    return true;
+  }
+  // Sólo cuenta el paso de sin soplar a soplando o más allá: una
+  // confirmatoria que arranca desde READ_RESULT no ha soplado todavía
+  if (!sinSoplar(anterior) || actual == STATUS_IDLE || esperaCumplida) return true;
+  retestIniciado = false;
+  pruebaAnulada = true;
+  return false;
+}
+
+bool PlanificadorRetest::descartarAnulada() {
+  bool anulada = pruebaAnulada;
+  pruebaAnulada = false;
+  return anulada;
+}
+
+uint32_t PlanificadorRetest::msHastaRetest(uint32_t ahoraMs) const {
+  int32_t restante = (int32_t)(vencimientoMs - ahoraMs);
+  return restante > 0 ? (uint32_t)restante : 0;
+}
+
+bool PlanificadorRetest::debeIniciarRetest(uint32_t ahoraMs) const {
+  if (!retestPendiente() || retestIniciado) return false;
+  return msHastaRetest(ahoraMs) <= ANTICIPO_PRECALENTAMIENTO_MS;
+}
+
+void PlanificadorRetest::cancelar() {
+  idPendiente = SIN_VINCULO;
+  retestIniciado = false;
+  esperaCumplida = false;
+  otroSujetoAceptado = false;
+}
+
+void PlanificadorRetest::exportar(EstadoRetest& estado, uint32_t ahoraMs) const {
+  estado.siguienteId = siguienteId;
+  estado.bebido = bebido;
+  estado.ebrio = ebrio;
+  estado.retestIniciado = retestIniciado;
+  estado.esperaCumplida = esperaCumplida;
+  estado.pruebaAnulada = pruebaAnulada;
+  estado.otroSujetoAceptado = otroSujetoAceptado;
+  estado.msHastaRetest = msHastaRetest(ahoraMs);
+  if (retestPendiente()) {
+    estado.original = pruebaOriginal;
+    estado.edadOriginalMs = ahoraMs - pruebaOriginal.marcaMs;
+  } else {
+    estado.original.id = SIN_VINCULO;
+    estado.edadOriginalMs = 0;
+  }
+}
+
+void PlanificadorRetest::restaurar(const EstadoRetest& estado, uint32_t ahoraMs,
+                                   bool reintentar) {
+  siguienteId = estado.siguienteId;
+  fijarUmbrales(estado.bebido, estado.ebrio);
+  cancelar();
+  // Si el reinicio perdió la prueba anulada, su resultado ya no llegará
+  pruebaAnulada = estado.pruebaAnulada && !reintentar;
+  if (estado.original.id == SIN_VINCULO) return;
+
+  pruebaOriginal = estado.original;
+  pruebaOriginal.marcaMs = ahoraMs - estado.edadOriginalMs;
+  historial[pruebaOriginal.id % HISTORIAL_PRUEBAS] = pruebaOriginal;
+  idPendiente = pruebaOriginal.id;
+  // El tiempo que estuvo reiniciándose no cuenta: la espera nunca se acorta
+  vencimientoMs = ahoraMs + estado.msHastaRetest;
+  retestIniciado = estado.retestIniciado && !reintentar;
+  esperaCumplida = retestIniciado && estado.esperaCumplida;
+  otroSujetoAceptado = retestIniciado && estado.otroSujetoAceptado;
+}
+
+const RegistroPrueba* PlanificadorRetest::buscar(uint32_t id) const {
+  if (id == SIN_VINCULO) return nullptr;
+  const RegistroPrueba& r = historial[id % HISTORIAL_PRUEBAS];
+  if (r.id == id) return &r;
+  return pruebaOriginal.id == id ? &pruebaOriginal : nullptr;
+}
+
+const RegistroPrueba& PlanificadorRetest::resultadoFinal(
+    const RegistroPrueba& r) const {
+  const RegistroPrueba* otro = buscar(r.idVinculado);
+  if (otro == nullptr) return r;
+  return otro->resultado.alcoholMg100ml < r.resultado.alcoholMg100ml ? *otro : r;
+}
@@ -0,0 +1,141 @@
+/*
+ * Política de pruebas confirmatorias.
+ *
+ * Un resultado a menos de 'margenMg' de alguno de los umbrales del sensor
+ * (bebido / ebrio, leídos con 0x90) necesita una segunda prueba. El
+ * planificador la programa respetando la espera mínima legal y arranca el
+ * precalentamiento con antelación para que el sensor esté listo justo al
+ * cumplirse. Sólo se adelanta el precalentamiento: la espera se mide hasta
+ * el soplido, y si el sensor pasa a soplar antes de cumplirse la prueba se
+ * anula y la confirmatoria se repite. Ambos resultados quedan enlazados en
+ * el historial.
+ *
+ * Se sigue una sola confirmatoria a la vez. Otro resultado cerca de un
+ * umbral mientras hay una pendiente no la sustituye: queda sin confirmar y
+ * se cuenta en confirmatoriasRechazadas().
+ */
+#ifndef POLITICA_RETEST_H
+#define POLITICA_RETEST_H
+
+#include <stdint.h>
+#include "protocolo_ze29a.h"
+
+// Umbrales por defecto del sensor hasta que se lean con 0x90
+#define UMBRAL_BEBIDO_DEFECTO 20
+#define UMBRAL_EBRIO_DEFECTO 80
+
+// Margen alrededor de cada umbral que obliga a confirmar (mg/100ml)
+#define MARGEN_RETEST_DEFECTO 5
+
+// Espera mínima entre pruebas; ajustar a la normativa local
+#define ESPERA_MINIMA_RETEST_MS (15UL * 60UL * 1000UL)
+
+// El precalentamiento del sensor dura unos 10 s
+#define ANTICIPO_PRECALENTAMIENTO_MS 10000UL
+
+#define HISTORIAL_PRUEBAS 16
+#define SIN_VINCULO 0
+
+struct RegistroPrueba {
+  uint32_t id;            // empieza en 1
+  uint32_t idVinculado;   // prueba original o confirmatoria, SIN_VINCULO si no hay
+  uint32_t idSujeto;      // 0 si no se indicó
+  uint32_t marcaMs;
+  ResultadoPrueba resultado;
+  bool esConfirmatoria;
+};
+
+// Lo necesario para retomar una confirmatoria tras un reinicio. Los
+// tiempos son relativos porque millis() vuelve a empezar.
+struct EstadoRetest {
+  uint32_t siguienteId;
+  uint8_t bebido;
+  uint8_t ebrio;
+  bool retestIniciado;
+  bool esperaCumplida;
+  bool pruebaAnulada;
+  bool otroSujetoAceptado;
+  uint32_t msHastaRetest;
+  uint32_t edadOriginalMs;   // hace cuánto se hizo la prueba original
+  RegistroPrueba original;   // id SIN_VINCULO si no hay confirmatoria pendiente
+};
+
+class PlanificadorRetest {
+public:
+  PlanificadorRetest(uint8_t margenMg = MARGEN_RETEST_DEFECTO,
+                     uint32_t esperaMinimaMs = ESPERA_MINIMA_RETEST_MS);
+
+  void fijarUmbrales(uint8_t bebido, uint8_t ebrio);
+  uint8_t umbralBebido() const { return bebido; }
+  uint8_t umbralEbrio() const { return ebrio; }
+
+  bool cercaDeUmbral(uint16_t alcoholMg100ml) const;
+
+  // Añade el resultado al historial, lo enlaza con la prueba original si
+  // era la confirmatoria pendiente y programa otra si hace falta. Una
+  // confirmatoria sin sujeto toma el de la original; la de otro sujeto no
+  // se enlaza salvo que se aceptara al iniciarla, y la confirmatoria
+  // vuelve a programarse.
+  const RegistroPrueba& registrar(const ResultadoPrueba& r, uint32_t ahoraMs,
+                                  uint32_t idSujeto);
+
+  bool retestPendiente() const { return idPendiente != SIN_VINCULO; }
+  uint32_t pruebaPendiente() const { return idPendiente; }
+  // Momento de arrancar el precalentamiento para llegar a tiempo
+  bool debeIniciarRetest(uint32_t ahoraMs) const;
+  uint32_t msHastaRetest(uint32_t ahoraMs) const;
+  // otroSujeto = true: el operador confirmó que la prueba es la
+  // confirmatoria aunque el sujeto no coincida
+  void marcarRetestIniciado(bool otroSujeto = false);
+  // El sujeto coincide con el de la original o alguno de los dos falta
+  bool sujetoCompatible(uint32_t idSujeto) const;
+  bool retestEnCurso() const { return retestPendiente() && retestIniciado; }
+  void cancelar();
+
+  // Se llama con cada estado leído del sensor. Durante la confirmatoria el
+  // soplido sólo vale si el sensor se vio aún sin soplar (precalentando o
+  // esperando el soplido) con la espera mínima cumplida; si pasa a soplar
+  // antes devuelve false, anula la prueba en curso y vuelve a programar la
+  // confirmatoria.
+  bool vigilarSoplido(uint8_t anterior, uint8_t actual, uint32_t ahoraMs);
+  // true una vez por prueba anulada: su resultado no se registra
+  bool descartarAnulada();
+
+  // Última prueba cerca de un umbral que no se pudo confirmar porque ya
+  // había otra pendiente, y cuántas van
+  uint32_t ultimaSinConfirmar() const { return idSinConfirmar; }
+  uint32_t confirmatoriasRechazadas() const { return numRechazadas; }
+
+  void exportar(EstadoRetest& estado, uint32_t ahoraMs) const;
+  // Restaura umbrales, numeración y confirmatoria pendiente. Con
+  // reintentar = true una confirmatoria ya iniciada se vuelve a programar
+  // (el reinicio la interrumpió).
+  void restaurar(const EstadoRetest& estado, uint32_t ahoraMs, bool reintentar);
+
+  // Registro por id, o nullptr si ya salió del historial
+  const RegistroPrueba* buscar(uint32_t id) const;
+  // Resultado final de una pareja: el menor de ambos, a favor del sujeto
+  const RegistroPrueba& resultadoFinal(const RegistroPrueba& r) const;
+
+private:
+  uint8_t margen;
+  uint32_t esperaMinima;
+  uint8_t bebido;
+  uint8_t ebrio;
+
+  RegistroPrueba historial[HISTORIAL_PRUEBAS];
+  // La original fuera del anillo: en la espera puede hacer más de
+  // HISTORIAL_PRUEBAS pruebas. Sigue ahí tras la confirmatoria.
+  RegistroPrueba pruebaOriginal;
+  uint32_t siguienteId;
+  uint32_t idPendiente;     // prueba que espera confirmación
+  uint32_t vencimientoMs;   // instante legal más temprano del retest
+  bool retestIniciado;
+  bool esperaCumplida;      // visto sin soplar con la espera cumplida
+  bool pruebaAnulada;       // sopló antes de tiempo; falta su resultado
+  bool otroSujetoAceptado;
+  uint32_t idSinConfirmar;
+  uint32_t numRechazadas;
+};
+
+#endif
@@ -0,0 +1,167 @@
+/*
+ * Máquina de estados del ZE29A (0x31-0x37) como tabla constante.
+ *
+ * Cada estado lleva los comandos que el sensor acepta en él, los estados
+ * a los que puede pasar (por sí mismo o con 0x87), los que se pueden
+ * pedir con 0x87 y la permanencia mínima y máxima esperada. Todas las
+ * consultas son un acceso indexado a la tabla, sin switch.
+ *
+ * Las permanencias salen del manual y de medidas con el tiempo de soplado
+ * por defecto; el firmware las usa para no consultar el estado cuando el
+ * sensor todavía no puede haber cambiado.
+ */
+#ifndef MAQUINA_ESTADOS_H
+#define MAQUINA_ESTADOS_H
+
+#include <stdint.h>
+#include "protocolo_ze29a.h"
+
+#define NUM_ESTADOS_SENSOR 7
+#define PERMANENCIA_SIN_LIMITE 0xFFFFFFFFUL
+
+// Bits de comando: 0x85-0x89 ocupan los bits 0-4 y 0x90 el bit 5
+constexpr uint8_t bitComando(uint8_t comando) {
+  return comando >= CMD_LEER_ESTADO && comando <= CMD_CONFIGURAR_TIEMPO_SOPLADO
+             ? (uint8_t)(1u << (comando - CMD_LEER_ESTADO))
+         : comando == CMD_LEER_UMBRALES ? (uint8_t)(1u << 5)
+                                        : (uint8_t)0;
+}
+
+constexpr uint8_t bitEstado(uint8_t estado) {
+  return (uint8_t)(1u << (estado - STATUS_IDLE));
+}
+
+constexpr bool estadoValido(uint8_t estado) {
+  return estado >= STATUS_IDLE && estado <= STATUS_READ_RESULT;
+}
+
+// Consultas que se aceptan siempre
+#define COMANDOS_LECTURA                                      \
+  (bitComando(CMD_LEER_ESTADO) | bitComando(CMD_LEER_TIEMPO_SOPLADO) | \
+   bitComando(CMD_LEER_UMBRALES))
+
+struct DefinicionEstado {
+  const char* descripcion;
+  uint8_t comandos;         // bitComando() de los comandos aceptados
+  uint8_t siguientes;       // bitEstado() de los estados alcanzables
+  uint8_t ordenables;       // bitEstado() de los destinos válidos de 0x87
+  uint32_t permanenciaMinimaMs;
+  uint32_t permanenciaMaximaMs;
+};
+
+constexpr DefinicionEstado TABLA_ESTADOS[NUM_ESTADOS_SENSOR] = {
+  // 0x31 IDLE
+  {"Inactivo (esperando instrucciones)",
+   COMANDOS_LECTURA | bitComando(CMD_CAMBIAR_ESTADO) |
+       bitComando(CMD_CONFIGURAR_TIEMPO_SOPLADO),
+   bitEstado(STATUS_PREHEATING), bitEstado(STATUS_PREHEATING),
+   0, PERMANENCIA_SIN_LIMITE},
+  // 0x32 PREHEATING: ~10 s
+  {"Precalentamiento", COMANDOS_LECTURA,
+   bitEstado(STATUS_WAITING_FOR_BLOW), 0,
+   8000, 15000},
+  // 0x33 WAITING_FOR_BLOW: el sensor vuelve a IDLE si nadie sopla
+  {"Esperando soplido", COMANDOS_LECTURA,
+   bitEstado(STATUS_BLOWING) | bitEstado(STATUS_IDLE), 0,
+   0, 60000},
+  // 0x34 BLOWING: el tiempo de soplado configurado (1-10 s)
+  {"Soplando", COMANDOS_LECTURA,
+   bitEstado(STATUS_CALCULATING) | bitEstado(STATUS_BLOW_INTERRUPTED), 0,
+   0, 11000},
+  // 0x35 BLOW_INTERRUPTED: vuelve a esperar soplido
+  {"Soplido interrumpido", COMANDOS_LECTURA,
+   bitEstado(STATUS_WAITING_FOR_BLOW) | bitEstado(STATUS_IDLE), 0,
+   0, 5000},
+  // 0x36 CALCULATING
+  {"Calculando resultado", COMANDOS_LECTURA,
+   bitEstado(STATUS_READ_RESULT), 0,
+   500, 5000},
+  // 0x37 READ_RESULT: se queda hasta que se pide otra prueba
+  {"Resultado listo para lectura",
+   COMANDOS_LECTURA | bitComando(CMD_LEER_RESULTADO) |
+       bitComando(CMD_CAMBIAR_ESTADO) | bitComando(CMD_CONFIGURAR_TIEMPO_SOPLADO),
+   bitEstado(STATUS_PREHEATING) | bitEstado(STATUS_IDLE),
+   bitEstado(STATUS_PREHEATING) | bitEstado(STATUS_IDLE),
+   0, PERMANENCIA_SIN_LIMITE},
+};
+
+// Definición de un estado; nullptr si el código no es un estado conocido
+constexpr const DefinicionEstado* definicionEstado(uint8_t estado) {
+  return estadoValido(estado) ? &TABLA_ESTADOS[estado - STATUS_IDLE] : nullptr;
+}
+
+// Un estado desconocido no bloquea nada: puede ser que currentStatus
+// todavía no se haya leído del sensor
+constexpr bool comandoPermitido(uint8_t estado, uint8_t comando, uint8_t dato = 0) {
+  return !estadoValido(estado) ||
+         ((TABLA_ESTADOS[estado - STATUS_IDLE].comandos & bitComando(comando)) != 0 &&
+          (comando != CMD_CAMBIAR_ESTADO ||
+           (estadoValido(dato) &&
+            (TABLA_ESTADOS[estado - STATUS_IDLE].ordenables & bitEstado(dato)) != 0)));
+}
+
+constexpr bool transicionLegal(uint8_t desde, uint8_t hacia) {
+  return estadoValido(desde) && estadoValido(hacia) &&
+         (desde == hacia ||
+          (TABLA_ESTADOS[desde - STATUS_IDLE].siguientes & bitEstado(hacia)) != 0);
+}
+
+// Lo que puede verse entre dos lecturas separadas 'msSinVer': un salto
+// directo o uno a través de estados intermedios tan cortos que el sondeo
+// no los llegó a ver (precalentando -> soplando, soplando -> resultado,
+// soplando -> esperando soplido). Cada intermedio tiene que caber por su
+// permanencia mínima.
+constexpr bool transicionObservable(uint8_t desde, uint8_t hacia, uint32_t msSinVer,
+                                    uint8_t saltos = NUM_ESTADOS_SENSOR) {
+  if (transicionLegal(desde, hacia)) return true;
+  if (saltos == 0 || !estadoValido(desde) || !estadoValido(hacia)) return false;
+  for (uint8_t medio = STATUS_IDLE; medio <= STATUS_READ_RESULT; medio++) {
+    uint32_t minima = TABLA_ESTADOS[medio - STATUS_IDLE].permanenciaMinimaMs;
+    if ((TABLA_ESTADOS[desde - STATUS_IDLE].siguientes & bitEstado(medio)) != 0 &&
+        minima <= msSinVer &&
+        transicionObservable(medio, hacia, msSinVer - minima, (uint8_t)(saltos - 1))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Un estado estable sólo cambia con un comando nuestro: no hace falta
+// sondearlo
+constexpr bool estadoEstable(uint8_t estado) {
+  return estadoValido(estado) &&
+         TABLA_ESTADOS[estado - STATUS_IDLE].permanenciaMaximaMs == PERMANENCIA_SIN_LIMITE;
+}
+
+// Cuánto falta para el próximo sondeo de estado: nunca antes de la
+// permanencia mínima del estado ni de 'intervaloMs' desde el anterior
+constexpr uint32_t esperaSondeoMs(uint8_t estado, uint32_t msEnEstado,
+                                  uint32_t msDesdeSondeo, uint32_t intervaloMs) {
+  return estadoEstable(estado) ? PERMANENCIA_SIN_LIMITE
+         : (estadoValido(estado) &&
+            msEnEstado < TABLA_ESTADOS[estado - STATUS_IDLE].permanenciaMinimaMs &&
+            TABLA_ESTADOS[estado - STATUS_IDLE].permanenciaMinimaMs - msEnEstado >
+                (msDesdeSondeo < intervaloMs ? intervaloMs - msDesdeSondeo : 0))
+             ? TABLA_ESTADOS[estado - STATUS_IDLE].permanenciaMinimaMs - msEnEstado
+         : msDesdeSondeo < intervaloMs ? intervaloMs - msDesdeSondeo
+                                       : 0;
+}
+
+constexpr bool permanenciaExcedida(uint8_t estado, uint32_t msEnEstado) {
+  return estadoValido(estado) &&
+         msEnEstado > TABLA_ESTADOS[estado - STATUS_IDLE].permanenciaMaximaMs;
+}
+
+static_assert(comandoPermitido(STATUS_IDLE, CMD_CAMBIAR_ESTADO, STATUS_PREHEATING), "");
+static_assert(!comandoPermitido(STATUS_PREHEATING, CMD_CAMBIAR_ESTADO, STATUS_IDLE), "");
+static_assert(!comandoPermitido(STATUS_BLOWING, CMD_LEER_RESULTADO), "");
+static_assert(!transicionLegal(STATUS_BLOWING, STATUS_READ_RESULT), "");
+static_assert(transicionObservable(STATUS_PREHEATING, STATUS_BLOWING, 500), "");
+static_assert(transicionObservable(STATUS_BLOWING, STATUS_READ_RESULT, 500), "");
+static_assert(!transicionObservable(STATUS_BLOWING, STATUS_READ_RESULT, 200), "");
+static_assert(transicionObservable(STATUS_BLOWING, STATUS_WAITING_FOR_BLOW, 500), "");
+static_assert(!transicionObservable(STATUS_IDLE, STATUS_BLOWING, 500), "");
+static_assert(esperaSondeoMs(STATUS_PREHEATING, 3000, 3000, 500) == 5000, "");
+static_assert(esperaSondeoMs(STATUS_BLOWING, 3000, 200, 500) == 300, "");
+
+#endif
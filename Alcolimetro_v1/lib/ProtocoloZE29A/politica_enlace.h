@@ -0,0 +1,62 @@
+/*
+ * Política de espera y reintento de las respuestas del sensor.
+ *
+ * leerRespuesta() espera la trama hasta timeoutRespuestaMs; si no llega y
+ * el comando es una consulta, reenvía la misma trama hasta 'reintentos'
+ * veces. Los comandos que cambian algo en el sensor (0x87, 0x89) no se
+ * repiten: si se perdió sólo la respuesta, el segundo envío se rechaza
+ * o vuelve a aplicar el cambio. Esos esperan de una vez lo que sumarían
+ * todos los intentos, para no abandonar antes una respuesta lenta.
+ *
+ * Los valores por defecto se pueden cambiar en build_flags. Para elegirlos,
+ * tools/ajuste_enlace simula miles de pruebas completas con pérdidas,
+ * latencias y bloqueos del sensor y compara las políticas.
+ */
+#ifndef POLITICA_ENLACE_H
+#define POLITICA_ENLACE_H
+
+#include <stdint.h>
+#include "protocolo_ze29a.h"
+
+#ifndef TIMEOUT_RESPUESTA_MS
+#define TIMEOUT_RESPUESTA_MS 3000
+#endif
+#ifndef REINTENTOS_RESPUESTA
+#define REINTENTOS_RESPUESTA 0
+#endif
+
+// enviarComando() espera la primera respuesta a baja frecuencia antes de
+// que empiece el timeout de leerRespuesta(): 500 ms y 800 ms para 0x87,
+// 0x88 y 0x89
+#define ESPERA_COMANDO_MS 500
+#define ESPERA_COMANDO_LENTO_MS 800
+
+struct PoliticaEnlace {
+  uint16_t timeoutRespuestaMs;  // por intento
+  uint8_t reintentos;           // reenvíos tras un timeout
+};
+
+#define POLITICA_ENLACE_DEFECTO {TIMEOUT_RESPUESTA_MS, REINTENTOS_RESPUESTA}
+
+// Consultas que no cambian nada en el sensor
+constexpr bool comandoReintentable(uint8_t comando) {
+  return comando == CMD_LEER_ESTADO || comando == CMD_LEER_RESULTADO ||
+         comando == CMD_LEER_TIEMPO_SOPLADO || comando == CMD_LEER_UMBRALES;
+}
+
+constexpr uint8_t intentosRespuesta(const PoliticaEnlace& p, uint8_t comando) {
+  return comandoReintentable(comando) ? (uint8_t)(1 + p.reintentos) : 1;
+}
+
+constexpr uint32_t timeoutIntentoMs(const PoliticaEnlace& p, uint8_t comando) {
+  return comandoReintentable(comando) ? p.timeoutRespuestaMs
+                                      : (uint32_t)p.timeoutRespuestaMs * (1u + p.reintentos);
+}
+
+// Tiempo máximo que se bloquea el bucle principal esperando una respuesta,
+// igual para consultas y cambios
+constexpr uint32_t esperaMaximaRespuestaMs(const PoliticaEnlace& p, uint32_t esperaComandoMs) {
+  return esperaComandoMs + (uint32_t)p.timeoutRespuestaMs * (1u + p.reintentos);
+}
+
+#endif
@@ -0,0 +1,140 @@
+/*
+ * Protocolo UART del sensor ZE29A-C2H5OH (Zhengzhou Winsen Electronics).
+ *
+ * Tramas de 9 bytes: 0xFF, dirección/comando, 6 bytes de datos y checksum.
+ * Este archivo no depende de Arduino para poder usarse en el build nativo.
+ */
+#ifndef PROTOCOLO_ZE29A_H
+#define PROTOCOLO_ZE29A_H
+
+#include <stdint.h>
+
+#define LONGITUD_TRAMA 9
+#define BYTE_INICIO 0xFF
+
+// Status codes from the sensor documentation
+#define STATUS_IDLE 0x31
+#define STATUS_PREHEATING 0x32
+#define STATUS_WAITING_FOR_BLOW 0x33
+#define STATUS_BLOWING 0x34
+#define STATUS_BLOW_INTERRUPTED 0x35
+#define STATUS_CALCULATING 0x36
+#define STATUS_READ_RESULT 0x37
+
+// Alarm status codes
+#define ALARM_NONE 0x00     // No alcohol (<20mg/100ml)
+#define ALARM_DRINKING 0x01 // Drinking (20-80mg/100ml)
+#define ALARM_DRUNK 0x02    // Drunk (>=80mg/100ml)
+
+// Comandos
+#define CMD_CAMBIAR_ESTADO 0x87
+#define CMD_LEER_ESTADO 0x85
+#define CMD_LEER_RESULTADO 0x86
+#define CMD_LEER_TIEMPO_SOPLADO 0x88
+#define CMD_CONFIGURAR_TIEMPO_SOPLADO 0x89
+#define CMD_LEER_UMBRALES 0x90
+
+// "Check value algorithm: (negative (data 1 + data 2 + ... + data 7)) + 1"
+// es decir, el complemento a dos de la suma de los bytes 1 a 7
+inline uint8_t checksumTrama(const uint8_t* trama) {
+  uint8_t suma = 0;
+  for (int i = 1; i < LONGITUD_TRAMA - 1; i++) suma += trama[i];
+  return (uint8_t)(~suma + 1);
+}
+
+inline bool checksumValido(const uint8_t* trama) {
+  return trama[LONGITUD_TRAMA - 1] == checksumTrama(trama);
+}
+
+#define DIRECCION_SENSOR 0x01
+
+// Construye un comando de 9 bytes con su checksum
+inline void construirTrama(uint8_t* trama, uint8_t comando, uint8_t dato = 0) {
+  trama[0] = BYTE_INICIO;
+  trama[1] = DIRECCION_SENSOR;
+  trama[2] = comando;
+  trama[3] = dato;
+  trama[4] = trama[5] = trama[6] = trama[7] = 0;
+  trama[8] = checksumTrama(trama);
+}
+
+// Analizador incremental de respuestas, byte a byte. Busca el byte de
+// inicio 0xFF y junta los 8 siguientes. Con exigirChecksum, una trama con
+// checksum incorrecto no se entrega: se busca otro 0xFF dentro de los
+// bytes ya recibidos y se continúa desde ahí (resincronización).
+class AnalizadorTramas {
+public:
+  explicit AnalizadorTramas(bool exigirChecksum = true)
+    : exigir(exigirChecksum), recibidos(0), descartados(0),
+      erroresChecksum(0), tramasCompletas(0), checksumOk(false) {}
+
+  void reiniciar() { recibidos = 0; }
+
+  // Devuelve true cuando hay una trama completa en trama()
+  bool alimentar(uint8_t b) {
+    if (recibidos == 0 && b != BYTE_INICIO) {
+      descartados++;
+      return false;
+    }
+    buffer[recibidos++] = b;
+    if (recibidos < LONGITUD_TRAMA) return false;
+
+    recibidos = 0;
+    checksumOk = checksumValido(buffer);
+    if (!checksumOk) {
+      erroresChecksum++;
+      if (exigir) {
+        resincronizar();
+        return false;
+      }
+    }
+    tramasCompletas++;
+    return true;
+  }
+
+  const uint8_t* trama() const { return buffer; }
+  bool tramaConChecksumValido() const { return checksumOk; }
+  int bytesPendientes() const { return recibidos; }
+  uint32_t bytesDescartados() const { return descartados; }
+  uint32_t tramasConErrorChecksum() const { return erroresChecksum; }
+  uint32_t tramas() const { return tramasCompletas; }
+
+private:
+  void resincronizar() {
+    for (int i = 1; i < LONGITUD_TRAMA; i++) {
+      if (buffer[i] == BYTE_INICIO) {
+        descartados += i;
+        recibidos = LONGITUD_TRAMA - i;
+        for (int j = 0; j < recibidos; j++) buffer[j] = buffer[i + j];
+        return;
+      }
+    }
+    descartados += LONGITUD_TRAMA;
+  }
+
+  bool exigir;
+  uint8_t buffer[LONGITUD_TRAMA];
+  int recibidos;
+  uint32_t descartados;
+  uint32_t erroresChecksum;
+  uint32_t tramasCompletas;
+  bool checksumOk;
+};
+
+// Resultado de una medición (respuesta al comando 0x86)
+struct ResultadoPrueba {
+  uint16_t alcoholMg100ml;  // bytes 2 y 3, big endian
+  uint8_t alarma;           // byte 7: ALARM_NONE / ALARM_DRINKING / ALARM_DRUNK
+};
+
+// Decodifica la respuesta a 0x86. Sólo acepta tramas completas con
+// cabecera y checksum correctos, para no disparar alarmas con basura.
+inline bool decodificarResultado(const uint8_t* trama, ResultadoPrueba& r) {
+  if (trama[0] != BYTE_INICIO || trama[1] != CMD_LEER_RESULTADO) return false;
+  if (!checksumValido(trama)) return false;
+  r.alcoholMg100ml = (uint16_t)((trama[2] << 8) | trama[3]);
+  r.alarma = trama[7];
+  return true;
+}
+
+#endif
@@ -0,0 +1,65 @@
+#include <string.h>
+#include "registro_vuelo.h"
+
+#ifdef ESP32
+#include <esp_timer.h>
+// Fuera de la RAM normal para que el reinicio tras un pánico no lo borre
+RTC_NOINIT_ATTR RegistroVuelo registroVuelo;
+
+// En IRAM: también se usa desde el gancho de pánico
+static uint32_t IRAM_ATTR marcaUs() {
+  return (uint32_t)esp_timer_get_time();
+}
+#else
+#include <chrono>
+RegistroVuelo registroVuelo;
+
+static uint32_t marcaUs() {
+  using namespace std::chrono;
+  return (uint32_t)duration_cast<microseconds>(
+      steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+void iniciarRegistroVuelo() {
+  CabeceraVuelo& c = registroVuelo.cabecera;
+  if (c.magia != MAGIA_VUELO || c.version != VERSION_VUELO ||
+      c.capacidad != EVENTOS_VUELO) {
+    memset(&registroVuelo, 0, sizeof(registroVuelo));
+    c.magia = MAGIA_VUELO;
+    c.version = VERSION_VUELO;
+    c.capacidad = EVENTOS_VUELO;
+  }
+  c.arranques++;
+}
+
+// noinline: __builtin_return_address(0) tiene que ser quien registra
+__attribute__((noinline)) void registrarVuelo(uint8_t tipo, uint8_t a, uint8_t b,
+                                              uint8_t c, uint32_t valor) {
+  // Sólo lo llama la tarea de loop(): basta con un índice sin atómicos
+  EventoVuelo& e =
+      registroVuelo.eventos[registroVuelo.cabecera.total & (EVENTOS_VUELO - 1)];
+  e.marcaUs = marcaUs();
+  e.pc = (uint32_t)(uintptr_t)__builtin_return_address(0);
+  e.valor = valor;
+  e.tipo = tipo;
+  e.a = a;
+  e.b = b;
+  e.c = c;
+  registroVuelo.cabecera.total++;
+}
+
+void EN_IRAM marcarFalloVuelo(uint32_t pc, const char* motivo) {
+  CabeceraVuelo& c = registroVuelo.cabecera;
+  c.fallo = FALLO_VUELO_PANICO;
+  c.pcFallo = pc;
+  c.marcaFalloUs = marcaUs();
+  // Sin strncpy: puede que la caché de flash no esté disponible
+  int i = 0;
+  if (motivo != nullptr) {
+    for (; i < LONGITUD_MOTIVO_VUELO - 1 && motivo[i] != '\0'; i++) {
+      c.motivo[i] = motivo[i];
+    }
+  }
+  c.motivo[i] = '\0';
+}
@@ -0,0 +1,143 @@
+/*
+ * Registro de vuelo: los últimos EVENTOS_VUELO eventos del firmware
+ * (comandos, respuestas, cambios de estado, fallos del enlace, anomalías
+ * de tiempo) en un anillo de memoria, para saber qué pasó antes de un
+ * fallo en campo.
+ *
+ * Registrar un evento es copiar 16 bytes en el anillo, sin formatear
+ * nada: no frena la consola ni el sondeo. Cada evento lleva la dirección
+ * de retorno de quien lo registró para simbolizarla en el host.
+ *
+ * En el ESP32 el anillo vive en memoria RTC sin inicializar, que
+ * sobrevive al reinicio tras un pánico, un watchdog o un brownout. El
+ * gancho de pánico sólo anota el PC y el motivo, sin tocar la flash; es
+ * el arranque siguiente el que copia el anillo a la partición "vuelo"
+ * (registro_vuelo_esp32.cpp). Así el manejador de pánico no gasta tiempo
+ * y una caída en plena operación de flash no deja el volcado a medias.
+ *
+ * La consola lo vuelca en hexadecimal ('v') y
+ * tools/registro_vuelo/decodificar.py lo decodifica y simboliza contra
+ * firmware.elf.
+ */
+#ifndef REGISTRO_VUELO_H
+#define REGISTRO_VUELO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef ESP32
+#include <esp_attr.h>
+#define EN_IRAM IRAM_ATTR
+#else
+#define EN_IRAM
+#endif
+
+#define MAGIA_VUELO 0x4F4C5556UL  // "VULO"
+#define VERSION_VUELO 1
+#define EVENTOS_VUELO 256           // potencia de dos
+#define LONGITUD_MOTIVO_VUELO 20
+
+// Tipos de evento. tools/registro_vuelo/decodificar.py tiene la misma lista.
+enum TipoEventoVuelo : uint8_t {
+  VUELO_VACIO = 0,
+  VUELO_ARRANQUE,           // a = motivo del reinicio (esp_reset_reason)
+  VUELO_COMANDO,            // a = comando, b = dato
+  VUELO_COMANDO_BLOQUEADO,  // a = comando, b = dato, c = estado del sensor
+  VUELO_RESPUESTA,          // a = comando, b = primer dato, c = checksum ok, valor = ms
+  VUELO_ESTADO,             // a = anterior, b = actual, valor = ms en el anterior
+  VUELO_RESULTADO,          // a = alarma, valor = mg/100ml
+  VUELO_FALLO_ENLACE,       // a = TipoFalloEnlace, b = comando, c = bytes parciales
+  VUELO_PERMANENCIA,        // a = estado, valor = ms en él (más de lo esperado)
+  VUELO_LATENCIA_ALARMA     // valor = ns hasta el indicador (más que la cota)
+};
+
+struct EventoVuelo {
+  uint32_t marcaUs;
+  uint32_t pc;      // dirección de retorno de registrarVuelo()
+  uint32_t valor;
+  uint8_t tipo;
+  uint8_t a;
+  uint8_t b;
+  uint8_t c;
+};
+
+// Motivos de fallo que anota el gancho
+#define FALLO_VUELO_NINGUNO 0
+#define FALLO_VUELO_PANICO 1
+
+struct CabeceraVuelo {
+  uint32_t magia;
+  uint16_t version;
+  uint16_t capacidad;
+  uint32_t total;           // eventos registrados; el siguiente va a total % capacidad
+  uint32_t arranques;
+  uint32_t fallo;           // FALLO_VUELO_*
+  uint32_t pcFallo;
+  uint32_t marcaFalloUs;
+  char motivo[LONGITUD_MOTIVO_VUELO];
+};
+
+struct RegistroVuelo {
+  CabeceraVuelo cabecera;
+  EventoVuelo eventos[EVENTOS_VUELO];
+};
+
+static_assert(sizeof(EventoVuelo) == 16, "formato del decodificador");
+static_assert(sizeof(CabeceraVuelo) == 48, "formato del decodificador");
+static_assert((EVENTOS_VUELO & (EVENTOS_VUELO - 1)) == 0, "");
+
+extern RegistroVuelo registroVuelo;
+
+// Conserva el anillo si es válido (reinicio en caliente) o lo vacía
+void iniciarRegistroVuelo();
+void registrarVuelo(uint8_t tipo, uint8_t a = 0, uint8_t b = 0, uint8_t c = 0,
+                    uint32_t valor = 0);
+// Desde el gancho de pánico: sólo escribe en el anillo
+void EN_IRAM marcarFalloVuelo(uint32_t pc, const char* motivo);
+
+// Partición de flash (sólo ESP32): ranuras de TAM_RANURA_VUELO bytes con
+// una cabecera VolcadoVuelo seguida del RegistroVuelo
+#define ETIQUETA_PARTICION_VUELO "vuelo"
+#define SUBTIPO_PARTICION_VUELO 0x40
+#define TAM_RANURA_VUELO 8192
+
+struct VolcadoVuelo {
+  uint32_t magia;            // MAGIA_VUELO
+  uint32_t numero;           // crece con cada volcado
+  uint32_t motivoReinicio;   // esp_reset_reason()
+  uint32_t crc;              // CRC-32 del RegistroVuelo que sigue
+};
+
+static_assert(sizeof(VolcadoVuelo) + sizeof(RegistroVuelo) <= TAM_RANURA_VUELO, "");
+
+// Tras un reinicio por pánico, watchdog o brownout copia el anillo a la
+// ranura siguiente a la del último volcado y devuelve true
+bool guardarVueloSiHuboFallo(uint32_t motivoReinicio);
+uint8_t ranurasVuelo();
+// false si la ranura está vacía o no cuadra el CRC
+bool leerVolcadoVuelo(uint8_t ranura, VolcadoVuelo& volcado);
+// Bytes del RegistroVuelo guardado en la ranura
+bool leerDatosVuelo(uint8_t ranura, uint32_t desplazamiento, void* destino,
+                    size_t longitud);
+
+// Volcado en hexadecimal de 32 bytes por línea, con el prefijo "VUELO :".
+// 'Salida' necesita print(const char*) y println().
+template <typename Salida>
+void volcarHexVuelo(Salida& s, const void* datos, size_t longitud) {
+  static const char DIGITOS[] = "0123456789abcdef";
+  const uint8_t* p = static_cast<const uint8_t*>(datos);
+  char linea[2 * 32 + 1];
+  for (size_t i = 0; i < longitud; i += 32) {
+    size_t n = longitud - i < 32 ? longitud - i : 32;
+    for (size_t j = 0; j < n; j++) {
+      linea[2 * j] = DIGITOS[p[i + j] >> 4];
+      linea[2 * j + 1] = DIGITOS[p[i + j] & 0x0F];
+    }
+    linea[2 * n] = '\0';
+    s.print("VUELO :");
+    s.print(linea);
+    s.println();
+  }
+}
+
+#endif
@@ -0,0 +1,115 @@
+/*
+ * Registro de vuelo en el ESP32: gancho en el manejador de pánico y copia
+ * del anillo a la partición "vuelo" (particiones.csv) al arrancar.
+ *
+ * El gancho se engancha con -Wl,--wrap=esp_panic_handler (platformio.ini):
+ * las llamadas del sistema a esp_panic_handler llegan aquí y después
+ * siguen al manejador original, que imprime el volcado y reinicia.
+ */
+#ifdef ESP32
+
+#include <esp_partition.h>
+#include <esp_system.h>
+#include <esp_private/panic_internal.h>
+#include "registro_vuelo.h"
+#include "estado_rtc.h"
+
+extern "C" void __real_esp_panic_handler(panic_info_t* info);
+
+extern "C" void IRAM_ATTR __wrap_esp_panic_handler(panic_info_t* info) {
+  marcarFalloVuelo((uint32_t)(uintptr_t)info->addr, info->reason);
+  __real_esp_panic_handler(info);
+}
+
+static const esp_partition_t* particionVuelo() {
+  static const esp_partition_t* particion = esp_partition_find_first(
+      ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)SUBTIPO_PARTICION_VUELO,
+      ETIQUETA_PARTICION_VUELO);
+  return particion;
+}
+
+uint8_t ranurasVuelo() {
+  const esp_partition_t* p = particionVuelo();
+  if (p == nullptr) return 0;
+  uint32_t ranuras = p->size / TAM_RANURA_VUELO;
+  return ranuras > 255 ? 255 : (uint8_t)ranuras;
+}
+
+bool leerDatosVuelo(uint8_t ranura, uint32_t desplazamiento, void* destino,
+                    size_t longitud) {
+  if (ranura >= ranurasVuelo()) return false;
+  return esp_partition_read(particionVuelo(),
+                            ranura * TAM_RANURA_VUELO + sizeof(VolcadoVuelo) +
+                                desplazamiento,
+                            destino, longitud) == ESP_OK;
+}
+
+bool leerVolcadoVuelo(uint8_t ranura, VolcadoVuelo& volcado) {
+  if (ranura >= ranurasVuelo()) return false;
+  if (esp_partition_read(particionVuelo(), ranura * TAM_RANURA_VUELO, &volcado,
+                         sizeof(volcado)) != ESP_OK ||
+      volcado.magia != MAGIA_VUELO) {
+    return false;
+  }
+  // El CRC se calcula por trozos para no reservar el registro entero
+  uint8_t trozo[256];
+  uint32_t crc = 0;
+  for (uint32_t i = 0; i < sizeof(RegistroVuelo); i += sizeof(trozo)) {
+    size_t n = sizeof(RegistroVuelo) - i < sizeof(trozo) ? sizeof(RegistroVuelo) - i
+                                                         : sizeof(trozo);
+    if (!leerDatosVuelo(ranura, i, trozo, n)) return false;
+    crc = crc32(trozo, n, crc);
+  }
+  return crc == volcado.crc;
+}
+
+static bool reinicioPorFallo(uint32_t motivo) {
+  switch (motivo) {
+    case ESP_RST_PANIC:
+    case ESP_RST_INT_WDT:
+    case ESP_RST_TASK_WDT:
+    case ESP_RST_WDT:
+    case ESP_RST_BROWNOUT:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool guardarVueloSiHuboFallo(uint32_t motivoReinicio) {
+  CabeceraVuelo& c = registroVuelo.cabecera;
+  if (c.fallo == FALLO_VUELO_NINGUNO && !reinicioPorFallo(motivoReinicio)) {
+    return false;
+  }
+  uint8_t ranuras = ranurasVuelo();
+  if (ranuras == 0) return false;
+
+  // La ranura siguiente a la del volcado más reciente
+  uint32_t ultimo = 0;
+  uint8_t ranura = 0;
+  for (uint8_t i = 0; i < ranuras; i++) {
+    VolcadoVuelo v;
+    if (esp_partition_read(particionVuelo(), i * TAM_RANURA_VUELO, &v,
+                           sizeof(v)) == ESP_OK &&
+        v.magia == MAGIA_VUELO && v.numero > ultimo) {
+      ultimo = v.numero;
+      ranura = (i + 1) % ranuras;
+    }
+  }
+
+  VolcadoVuelo volcado = {MAGIA_VUELO, ultimo + 1, motivoReinicio,
+                          crc32(&registroVuelo, sizeof(registroVuelo))};
+  uint32_t base = ranura * TAM_RANURA_VUELO;
+  bool ok = esp_partition_erase_range(particionVuelo(), base, TAM_RANURA_VUELO) == ESP_OK &&
+            esp_partition_write(particionVuelo(), base + sizeof(volcado),
+                                &registroVuelo, sizeof(registroVuelo)) == ESP_OK &&
+            // La cabecera al final: una ranura a medias no tiene magia
+            esp_partition_write(particionVuelo(), base, &volcado,
+                                sizeof(volcado)) == ESP_OK;
+
+  // El anillo sigue registrando; el fallo ya está guardado
+  c.fallo = FALLO_VUELO_NINGUNO;
+  return ok;
+}
+
+#endif
@@ -0,0 +1,212 @@
+#include "resumenes_flota.h"
+
+#include <math.h>
+
+#define MODO_DENSO 0
+#define MODO_DISPERSO 1
+#define BITS_REGISTRO 6
+
+static uint8_t* escribirVarint(uint8_t* p, uint64_t v) {
+  while (v >= 0x80) {
+    *p++ = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  *p++ = (uint8_t)v;
+  return p;
+}
+
+static const uint8_t* leerVarint(const uint8_t* p, const uint8_t* fin, uint64_t& v) {
+  v = 0;
+  for (uint8_t desplazamiento = 0; p < fin && desplazamiento < 64; desplazamiento += 7) {
+    uint8_t b = *p++;
+    v |= (uint64_t)(b & 0x7F) << desplazamiento;
+    if (!(b & 0x80)) return p;
+  }
+  return nullptr;
+}
+
+void ResumenCuantiles::anotarLote(const uint16_t* valores, size_t n) {
+  // Índices por bloques en un bucle sin dependencias (vectorizable) y
+  // luego los incrementos
+  uint16_t cubetas[64];
+  while (n > 0) {
+    size_t bloque = n < 64 ? n : 64;
+    for (size_t i = 0; i < bloque; i++) cubetas[i] = cubetaCuantil(valores[i]);
+    for (size_t i = 0; i < bloque; i++) contadores[cubetas[i]]++;
+    total += bloque;
+    valores += bloque;
+    n -= bloque;
+  }
+}
+
+void ResumenCuantiles::fusionar(const ResumenCuantiles& otro) {
+  for (size_t i = 0; i < CUBETAS_CUANTILES; i++) contadores[i] += otro.contadores[i];
+  total += otro.total;
+}
+
+float ResumenCuantiles::valorCubeta(uint16_t cubeta) {
+  if (cubeta < EXACTOS_CUANTILES) return cubeta;
+  uint32_t octava = (cubeta - EXACTOS_CUANTILES) >> SUBBITS_CUANTILES;
+  uint32_t sub = (cubeta - EXACTOS_CUANTILES) & ((1u << SUBBITS_CUANTILES) - 1);
+  uint32_t ancho = 1u << (octava + 1);
+  uint32_t inicio = ((1u << SUBBITS_CUANTILES) + sub) * ancho;
+  return inicio + (ancho - 1) / 2.0f;
+}
+
+float ResumenCuantiles::cuantil(float q) const {
+  if (total == 0) return 0;
+  if (q < 0) q = 0;
+  if (q > 1) q = 1;
+  uint64_t rango = (uint64_t)(q * (total - 1));
+  uint64_t acumulado = 0;
+  for (uint16_t i = 0; i < CUBETAS_CUANTILES; i++) {
+    acumulado += contadores[i];
+    if (acumulado > rango) return valorCubeta(i);
+  }
+  return valorCubeta(CUBETAS_CUANTILES - 1);
+}
+
+// tipo(1) version(1) subbits(1) numCubetas(varint) y por cada cubeta no
+// vacía: distancia a la anterior(varint) contador(varint)
+size_t ResumenCuantiles::serializar(uint8_t* destino, size_t capacidad) const {
+  if (capacidad < MAX_SERIALIZADO_CUANTILES) return 0;
+  uint8_t* p = destino;
+  *p++ = RESUMEN_CUANTILES;
+  *p++ = VERSION_RESUMENES;
+  *p++ = SUBBITS_CUANTILES;
+  uint32_t noVacias = 0;
+  for (size_t i = 0; i < CUBETAS_CUANTILES; i++) noVacias += contadores[i] != 0;
+  p = escribirVarint(p, noVacias);
+  uint32_t anterior = 0;
+  for (uint32_t i = 0; i < CUBETAS_CUANTILES; i++) {
+    if (contadores[i] == 0) continue;
+    p = escribirVarint(p, i - anterior);
+    p = escribirVarint(p, contadores[i]);
+    anterior = i;
+  }
+  return (size_t)(p - destino);
+}
+
+bool ResumenCuantiles::deserializar(const uint8_t* origen, size_t n) {
+  const uint8_t* fin = origen + n;
+  if (n < 3 || origen[0] != RESUMEN_CUANTILES || origen[1] != VERSION_RESUMENES ||
+      origen[2] != SUBBITS_CUANTILES) {
+    return false;
+  }
+  ResumenCuantiles leido;
+  uint64_t noVacias, distancia, contador;
+  const uint8_t* p = leerVarint(origen + 3, fin, noVacias);
+  if (p == nullptr || noVacias > CUBETAS_CUANTILES) return false;
+  uint64_t cubeta = 0;
+  for (uint64_t k = 0; k < noVacias; k++) {
+    if ((p = leerVarint(p, fin, distancia)) == nullptr) return false;
+    if ((p = leerVarint(p, fin, contador)) == nullptr) return false;
+    cubeta += distancia;
+    if (cubeta >= CUBETAS_CUANTILES || contador > UINT32_MAX) return false;
+    leido.contadores[cubeta] = (uint32_t)contador;
+    leido.total += contador;
+  }
+  if (p != fin) return false;
+  *this = leido;
+  return true;
+}
+
+void ContadorDistintos::fusionar(const ContadorDistintos& otro) {
+  for (size_t i = 0; i < REGISTROS_DISTINTOS; i++) {
+    registros[i] = registros[i] > otro.registros[i] ? registros[i] : otro.registros[i];
+  }
+}
+
+struct PotenciasInversas {
+  double v[64];
+  PotenciasInversas() {
+    for (int i = 0; i < 64; i++) v[i] = ldexp(1.0, -i);
+  }
+};
+
+double ContadorDistintos::estimar() const {
+  static const PotenciasInversas dosElevadoA;
+  const double m = REGISTROS_DISTINTOS;
+  double suma = 0;
+  uint32_t ceros = 0;
+  for (size_t i = 0; i < REGISTROS_DISTINTOS; i++) {
+    suma += dosElevadoA.v[registros[i]];
+    ceros += registros[i] == 0;
+  }
+  double alfa = 0.7213 / (1 + 1.079 / m);
+  double estimacion = alfa * m * m / suma;
+  // Rango bajo: conteo lineal de registros vacíos
+  if (estimacion <= 2.5 * m && ceros > 0) return m * log(m / ceros);
+  return estimacion;
+}
+
+// tipo(1) version(1) precision(1) modo(1) y, según el modo, los registros
+// empaquetados a 6 bits o los no vacíos como distancia(varint) valor(1)
+size_t ContadorDistintos::serializar(uint8_t* destino, size_t capacidad) const {
+  if (capacidad < MAX_SERIALIZADO_DISTINTOS) return 0;
+  uint8_t* p = destino;
+  *p++ = RESUMEN_DISTINTOS;
+  *p++ = VERSION_RESUMENES;
+  *p++ = PRECISION_DISTINTOS;
+  uint32_t noVacios = 0;
+  for (size_t i = 0; i < REGISTROS_DISTINTOS; i++) noVacios += registros[i] != 0;
+  // Cada registro disperso ocupa como mucho 3 bytes
+  if (noVacios * 3 + 2 < REGISTROS_DISTINTOS * BITS_REGISTRO / 8) {
+    *p++ = MODO_DISPERSO;
+    p = escribirVarint(p, noVacios);
+    uint32_t anterior = 0;
+    for (uint32_t i = 0; i < REGISTROS_DISTINTOS; i++) {
+      if (registros[i] == 0) continue;
+      p = escribirVarint(p, i - anterior);
+      *p++ = registros[i];
+      anterior = i;
+    }
+    return (size_t)(p - destino);
+  }
+  *p++ = MODO_DENSO;
+  for (size_t i = 0; i < REGISTROS_DISTINTOS; i += 4, p += 3) {
+    uint32_t cuatro = (uint32_t)registros[i] | (uint32_t)registros[i + 1] << 6 |
+                      (uint32_t)registros[i + 2] << 12 | (uint32_t)registros[i + 3] << 18;
+    p[0] = (uint8_t)cuatro;
+    p[1] = (uint8_t)(cuatro >> 8);
+    p[2] = (uint8_t)(cuatro >> 16);
+  }
+  return (size_t)(p - destino);
+}
+
+bool ContadorDistintos::deserializar(const uint8_t* origen, size_t n) {
+  const uint8_t* fin = origen + n;
+  if (n < 4 || origen[0] != RESUMEN_DISTINTOS || origen[1] != VERSION_RESUMENES ||
+      origen[2] != PRECISION_DISTINTOS) {
+    return false;
+  }
+  const uint8_t* p = origen + 4;
+  ContadorDistintos leido;
+  if (origen[3] == MODO_DENSO) {
+    if ((size_t)(fin - p) != REGISTROS_DISTINTOS * BITS_REGISTRO / 8) return false;
+    for (size_t i = 0; i < REGISTROS_DISTINTOS; i += 4, p += 3) {
+      uint32_t cuatro = (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16;
+      for (size_t k = 0; k < 4; k++) leido.registros[i + k] = (cuatro >> (6 * k)) & 0x3F;
+    }
+  } else if (origen[3] == MODO_DISPERSO) {
+    uint64_t noVacios, distancia;
+    if ((p = leerVarint(p, fin, noVacios)) == nullptr || noVacios > REGISTROS_DISTINTOS) {
+      return false;
+    }
+    uint64_t i = 0;
+    for (uint64_t k = 0; k < noVacios; k++) {
+      if ((p = leerVarint(p, fin, distancia)) == nullptr || p >= fin) return false;
+      i += distancia;
+      if (i >= REGISTROS_DISTINTOS) return false;
+      leido.registros[i] = *p++;
+    }
+  } else {
+    return false;
+  }
+  if (p != fin) return false;
+  for (size_t i = 0; i < REGISTROS_DISTINTOS; i++) {
+    if (leido.registros[i] > 64 - PRECISION_DISTINTOS + 1) return false;
+  }
+  *this = leido;
+  return true;
+}
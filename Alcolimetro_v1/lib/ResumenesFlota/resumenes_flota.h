@@ -0,0 +1,115 @@
+/*
+ * Resúmenes fusionables de resultados: cuantiles del alcohol y número de
+ * sujetos o equipos distintos.
+ *
+ * ResumenCuantiles es un DDSketch con cubetas log-lineales en vez de
+ * logarítmicas: los valores por debajo de 128 mg/100ml (donde están los
+ * umbrales) se cuentan exactos y los demás en 64 cubetas por potencia de
+ * dos, con un error relativo de como mucho 1/128. El índice sale de los
+ * bits del float del valor con una resta, sin logaritmos, y es el mismo en
+ * cualquier plataforma: dos resúmenes se fusionan sumando contadores y el
+ * resultado es idéntico al de haber anotado todo en uno.
+ *
+ * ContadorDistintos es un HyperLogLog de 2^12 registros (error típico del
+ * 1,6 %); se fusiona con el máximo registro a registro.
+ *
+ * Los dos usan memoria fija, sin reservas, y se pueden llevar en un equipo
+ * o un colector intermedio. Su forma serializada empieza por tipo y
+ * versión y sólo guarda lo que no es cero.
+ */
+#ifndef RESUMENES_FLOTA_H
+#define RESUMENES_FLOTA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define RESUMEN_CUANTILES 1
+#define RESUMEN_DISTINTOS 2
+#define VERSION_RESUMENES 1
+
+// Valores exactos hasta 2^(SUBBITS + 1); luego 2^SUBBITS cubetas por octava
+#define SUBBITS_CUANTILES 6
+#define EXACTOS_CUANTILES (2 << SUBBITS_CUANTILES)
+#define CUBETAS_CUANTILES (EXACTOS_CUANTILES + (15 - SUBBITS_CUANTILES) * (1 << SUBBITS_CUANTILES))
+
+// Cubetas de un uint16_t: exponente y SUBBITS bits de mantisa del float,
+// desplazados para que 128 caiga en la cubeta 128
+inline uint16_t cubetaCuantil(uint16_t valor) {
+  float f = valor;
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+  uint32_t logLineal = (bits >> (23 - SUBBITS_CUANTILES)) -
+                       ((127 + SUBBITS_CUANTILES + 1) << SUBBITS_CUANTILES) + EXACTOS_CUANTILES;
+  return (uint16_t)(valor < EXACTOS_CUANTILES ? valor : logLineal);
+}
+
+class ResumenCuantiles {
+public:
+  ResumenCuantiles() { vaciar(); }
+  void vaciar() { memset(this, 0, sizeof(*this)); }
+
+  void anotar(uint16_t valor) {
+    contadores[cubetaCuantil(valor)]++;
+    total++;
+  }
+  void anotarLote(const uint16_t* valores, size_t n);
+  void fusionar(const ResumenCuantiles& otro);
+
+  uint64_t cuenta() const { return total; }
+  // Valor por debajo del que queda la fracción q de las anotaciones
+  // (0 <= q <= 1); 0 si el resumen está vacío
+  float cuantil(float q) const;
+
+  // Bytes escritos, 0 si no caben en 'capacidad'
+  size_t serializar(uint8_t* destino, size_t capacidad) const;
+  // Sustituye el contenido; false si los bytes no son un resumen válido
+  bool deserializar(const uint8_t* origen, size_t n);
+
+  // Valor que representa a una cubeta: el centro de su intervalo
+  static float valorCubeta(uint16_t cubeta);
+
+private:
+  uint32_t contadores[CUBETAS_CUANTILES];
+  uint64_t total;
+};
+
+#define PRECISION_DISTINTOS 12
+#define REGISTROS_DISTINTOS (1 << PRECISION_DISTINTOS)
+
+// Mezcla de splitmix64: ids consecutivos quedan repartidos por todos los bits
+inline uint64_t hashDistintos(uint64_t x) {
+  x += 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+class ContadorDistintos {
+public:
+  ContadorDistintos() { vaciar(); }
+  void vaciar() { memset(registros, 0, sizeof(registros)); }
+
+  void anotar(uint32_t id) { anotarHash(hashDistintos(id)); }
+  void anotarHash(uint64_t h) {
+    uint32_t i = (uint32_t)(h >> (64 - PRECISION_DISTINTOS));
+    uint64_t resto = h << PRECISION_DISTINTOS | (1ULL << (PRECISION_DISTINTOS - 1));
+    uint8_t rango = (uint8_t)(__builtin_clzll(resto) + 1);
+    if (rango > registros[i]) registros[i] = rango;
+  }
+  void fusionar(const ContadorDistintos& otro);
+
+  double estimar() const;
+
+  size_t serializar(uint8_t* destino, size_t capacidad) const;
+  bool deserializar(const uint8_t* origen, size_t n);
+
+private:
+  uint8_t registros[REGISTROS_DISTINTOS];
+};
+
+// Cotas de la forma serializada, para dimensionar buffers
+#define MAX_SERIALIZADO_CUANTILES (3 + 5 + CUBETAS_CUANTILES * (2 + 5))
+#define MAX_SERIALIZADO_DISTINTOS (4 + REGISTROS_DISTINTOS * 3 / 4)
+
+#endif
@@ -0,0 +1,159 @@
+/*
+ * Ruta decodificación -> indicador y su implementación con GPIOs.
+ */
+#include "salida_alarma.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#ifdef ESP32
+#include <soc/gpio_struct.h>
+#endif
+#else
+#include <chrono>
+#define IRAM_ATTR
+#endif
+
+// Contador de alta resolución en nanosegundos. En el ESP32 se usa el
+// registro CCOUNT, que se lee en una instrucción.
+static inline uint32_t IRAM_ATTR ciclosAhora() {
+#ifdef ESP32
+  uint32_t ccount;
+  __asm__ __volatile__("esync; rsr %0, ccount" : "=a"(ccount));
+  return ccount;
+#elif defined(ARDUINO)
+  return micros();
+#else
+  return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+static inline uint32_t ciclosANs(uint32_t ciclos) {
+#ifdef ESP32
+  return (uint32_t)((uint64_t)ciclos * 1000 / getCpuFrequencyMhz());
+#elif defined(ARDUINO)
+  return ciclos * 1000;
+#else
+  return ciclos;
+#endif
+}
+
+uint32_t IRAM_ATTR marcaTramaCompleta() {
+  return ciclosAhora();
+}
+
+bool IRAM_ATTR decodificarEIndicar(const uint8_t* trama,
+                                   IndicadorAlarma& indicador,
+                                   ResultadoPrueba& resultado,
+                                   LatenciaAlarma& latencia,
+                                   uint32_t marcaTrama) {
+  if (!decodificarResultado(trama, resultado)) return false;
+  indicador.indicar(resultado.alarma);
+  uint32_t ns = ciclosANs(ciclosAhora() - marcaTrama);
+
+  latencia.ultimaNs = ns;
+  if (ns > latencia.maximaNs) latencia.maximaNs = ns;
+  if (ns > LATENCIA_MAXIMA_ALARMA_NS) latencia.excedidas++;
+  latencia.muestras++;
+  return true;
+}
+
+#ifdef ARDUINO
+
+// Patrones del zumbador: encendido, apagado, encendido... terminados en 0
+static const uint16_t PATRON_SIN_ALCOHOL[] = {100, 0};
+static const uint16_t PATRON_BEBIDO[] = {200, 200, 200, 200, 200, 0};
+static const uint16_t PATRON_EBRIO[] = {
+  100, 100, 100, 100, 100, 100, 100, 100, 100, 100,
+  100, 100, 100, 100, 100, 100, 100, 100, 100, 100,
+  1000, 0
+};
+
+IndicadorGpio::IndicadorGpio(uint8_t pinVerde, uint8_t pinAmarillo,
+                             uint8_t pinRojo, uint8_t pinZumbador)
+  : pinVerde(pinVerde), pinAmarillo(pinAmarillo), pinRojo(pinRojo),
+    pinZumbador(pinZumbador),
+    mascaraLeds((1UL << pinVerde) | (1UL << pinAmarillo) | (1UL << pinRojo)),
+    patron(nullptr), paso(0), patronPendiente(false), inicioPasoMs(0) {
+}
+
+void IndicadorGpio::iniciar() {
+  pinMode(pinVerde, OUTPUT);
+  pinMode(pinAmarillo, OUTPUT);
+  pinMode(pinRojo, OUTPUT);
+  pinMode(pinZumbador, OUTPUT);
+  apagar();
+}
+
+void IRAM_ATTR IndicadorGpio::zumbador(bool encendido) {
+#ifdef ESP32
+  if (encendido) {
+    GPIO.out_w1ts = 1UL << pinZumbador;
+  } else {
+    GPIO.out_w1tc = 1UL << pinZumbador;
+  }
+#else
+  digitalWrite(pinZumbador, encendido ? HIGH : LOW);
+#endif
+}
+
+void IRAM_ATTR IndicadorGpio::indicar(uint8_t alarma) {
+  uint8_t pin;
+  switch (alarma) {
+    case ALARM_NONE:
+      pin = pinVerde;
+      patron = PATRON_SIN_ALCOHOL;
+      break;
+    case ALARM_DRINKING:
+      pin = pinAmarillo;
+      patron = PATRON_BEBIDO;
+      break;
+    default:  // ALARM_DRUNK o desconocido: la opción conservadora
+      pin = pinRojo;
+      patron = PATRON_EBRIO;
+      break;
+  }
+#ifdef ESP32
+  GPIO.out_w1tc = mascaraLeds;
+  GPIO.out_w1ts = 1UL << pin;
+#else
+  digitalWrite(pinVerde, pin == pinVerde ? HIGH : LOW);
+  digitalWrite(pinAmarillo, pin == pinAmarillo ? HIGH : LOW);
+  digitalWrite(pinRojo, pin == pinRojo ? HIGH : LOW);
+#endif
+  zumbador(true);
+  paso = 0;
+  patronPendiente = true;
+}
+
+void IndicadorGpio::actualizar(uint32_t ahoraMs) {
+  if (patron == nullptr) return;
+  if (patronPendiente) {
+    inicioPasoMs = ahoraMs;
+    patronPendiente = false;
+  }
+  if (ahoraMs - inicioPasoMs < patron[paso]) return;
+
+  inicioPasoMs = ahoraMs;
+  paso++;
+  if (patron[paso] == 0) {
+    zumbador(false);
+    patron = nullptr;  // Los LEDs quedan encendidos hasta la próxima prueba
+    return;
+  }
+  zumbador((paso & 1) == 0);
+}
+
+void IndicadorGpio::apagar() {
+  patron = nullptr;
+  zumbador(false);
+#ifdef ESP32
+  GPIO.out_w1tc = mascaraLeds;
+#else
+  digitalWrite(pinVerde, LOW);
+  digitalWrite(pinAmarillo, LOW);
+  digitalWrite(pinRojo, LOW);
+#endif
+}
+
+#endif
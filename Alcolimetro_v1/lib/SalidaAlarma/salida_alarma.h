@@ -0,0 +1,74 @@
+/*
+ * Salida de alarma de baja latencia.
+ *
+ * La clase de alarma del resultado (byte 7 de la respuesta a 0x86) se lleva
+ * a LEDs y zumbador directamente desde la decodificación de la trama, antes
+ * de cualquier impresión por consola. El indicador se usa a través de
+ * IndicadorAlarma para poder sustituirlo por uno simulado.
+ */
+#ifndef SALIDA_ALARMA_H
+#define SALIDA_ALARMA_H
+
+#include <stdint.h>
+#include "protocolo_ze29a.h"
+
+// Cota garantizada desde la trama completa hasta el indicador encendido
+#define LATENCIA_MAXIMA_ALARMA_NS 10000
+
+class IndicadorAlarma {
+public:
+  virtual ~IndicadorAlarma() {}
+  // Se llama en la ruta de decodificación: sólo escrituras de registro,
+  // sin esperas, impresiones ni memoria dinámica
+  virtual void indicar(uint8_t alarma) = 0;
+  // Avanza los patrones temporizados del zumbador; se llama desde loop()
+  virtual void actualizar(uint32_t ahoraMs) { (void)ahoraMs; }
+  // true mientras haya un patrón en curso que necesite actualizar()
+  virtual bool ocupado() const { return false; }
+  virtual void apagar() = 0;
+};
+
+struct LatenciaAlarma {
+  uint32_t ultimaNs;
+  uint32_t maximaNs;
+  uint32_t muestras;
+  uint32_t excedidas;  // muestras por encima de LATENCIA_MAXIMA_ALARMA_NS
+};
+
+// Marca del contador de alta resolución; se toma en cuanto el analizador
+// completa la trama y se pasa a decodificarEIndicar()
+uint32_t marcaTramaCompleta();
+
+// Decodifica la respuesta a 0x86 y enciende el indicador en la misma
+// llamada, midiendo el tiempo desde marcaTrama. Devuelve false si la trama
+// no es un resultado válido; en ese caso el indicador no cambia.
+bool decodificarEIndicar(const uint8_t* trama, IndicadorAlarma& indicador,
+                         ResultadoPrueba& resultado, LatenciaAlarma& latencia,
+                         uint32_t marcaTrama);
+
+#ifdef ARDUINO
+// LEDs verde/amarillo/rojo y zumbador activo en GPIOs < 32, escritos
+// directamente en los registros W1TS/W1TC para no pasar por digitalWrite.
+class IndicadorGpio : public IndicadorAlarma {
+public:
+  IndicadorGpio(uint8_t pinVerde, uint8_t pinAmarillo, uint8_t pinRojo,
+                uint8_t pinZumbador);
+  void iniciar();
+  void indicar(uint8_t alarma) override;
+  void actualizar(uint32_t ahoraMs) override;
+  bool ocupado() const override { return patron != nullptr; }
+  void apagar() override;
+
+private:
+  void zumbador(bool encendido);
+
+  uint8_t pinVerde, pinAmarillo, pinRojo, pinZumbador;
+  uint32_t mascaraLeds;
+  const uint16_t* patron;   // duraciones en ms, encendido/apagado, fin en 0
+  uint8_t paso;
+  bool patronPendiente;     // indicar() no lee el reloj; lo fija actualizar()
+  uint32_t inicioPasoMs;
+};
+#endif
+
+#endif
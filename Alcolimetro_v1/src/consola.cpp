@@ -0,0 +1,239 @@
+#include <Arduino.h>
+#include "consola.h"
+#include "maquina_estados.h"
+#include "metricas.h"
+#include "panel_terminal.h"
+#include "subida.h"
+
+// Lo que anuncia iniciarPrueba(); el sensor no informa del tiempo restante
+#define PRECALENTAMIENTO_MS 10000UL
+
+// Ventana para los bytes por segundo de la consola
+#define VENTANA_TASA_MS 5000UL
+
+#define TAM_LINEA_MENSAJE 96
+
+SalidaConsola consola;
+
+static bool modoPanel = false;
+static uint32_t proximoRefrescoMs = 0;
+
+// Bytes que salieron por el puerto (registro y panel) y mensajes del
+// registro retenidos en modo panel
+static uint32_t bytesSerie = 0;
+static uint32_t bytesRetenidos = 0;
+
+// Línea del registro en curso y la última completa, para el panel
+static char lineaActual[TAM_LINEA_MENSAJE];
+static uint8_t largoLinea = 0;
+static char ultimoMensaje[TAM_LINEA_MENSAJE] = "";
+
+static void anotar(uint8_t c) {
+  if (c == '\r') return;
+  if (c == '\n') {
+    if (largoLinea == 0) return;
+    memcpy(ultimoMensaje, lineaActual, largoLinea);
+    ultimoMensaje[largoLinea] = '\0';
+    largoLinea = 0;
+    return;
+  }
+  if (largoLinea < TAM_LINEA_MENSAJE - 1) lineaActual[largoLinea++] = (char)c;
+}
+
+size_t SalidaConsola::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t SalidaConsola::write(const uint8_t* datos, size_t n) {
+  if (!modoPanel) {
+    size_t escritos = Serial.write(datos, n);
+    bytesSerie += escritos;
+    return escritos;
+  }
+  for (size_t i = 0; i < n; i++) anotar(datos[i]);
+  bytesRetenidos += n;
+  return n;
+}
+
+// Disposición para un terminal de 80x24
+enum CampoConsola : uint8_t {
+  P_EN_MARCHA = 0,
+  P_ESTADO,
+  P_TIEMPO,
+  P_SOPLADO,
+  P_RESULTADO,
+  P_ALARMA,
+  P_CONFIRMATORIA,
+  P_SUJETO,
+  P_ENLACE,
+  P_SUBIDA,
+  P_CONSOLA,
+  P_MENSAJE,
+  NUM_CAMPOS_CONSOLA
+};
+
+static const CampoPanel CAMPOS[NUM_CAMPOS_CONSOLA] = {
+  {1, 52, 28},   // P_EN_MARCHA
+  {3, 18, 50},   // P_ESTADO
+  {4, 18, 50},   // P_TIEMPO
+  {5, 18, 50},   // P_SOPLADO
+  {6, 18, 50},   // P_RESULTADO
+  {7, 18, 50},   // P_ALARMA
+  {8, 18, 50},   // P_CONFIRMATORIA
+  {9, 18, 50},   // P_SUJETO
+  {10, 18, 50},  // P_ENLACE
+  {11, 18, 50},  // P_SUBIDA
+  {12, 18, 50},  // P_CONSOLA
+  {14, 18, 62},  // P_MENSAJE
+};
+
+static const TextoPanel FONDO[] = {
+  {1, 2, "Alcoholímetro ZE29A"},
+  {2, 1, "================================================================================"},
+  {3, 2, "Estado sensor"},
+  {4, 2, "En el estado"},
+  {5, 2, "Soplado"},
+  {6, 2, "Último resultado"},
+  {7, 2, "Alarma"},
+  {8, 2, "Confirmatoria"},
+  {9, 2, "Sujeto"},
+  {10, 2, "Enlace sensor"},
+  {11, 2, "Cola de subida"},
+  {12, 2, "Consola"},
+  {14, 2, "Mensaje"},
+  {15, 1, "================================================================================"},
+  {16, 2, "i iniciar prueba   x cancelar confirmatoria   d salir del panel"},
+  {17, 2, "Cualquier otro comando sale del panel antes de ejecutarse."},
+};
+
+static PanelTerminal panel(CAMPOS, NUM_CAMPOS_CONSOLA, FONDO,
+                           sizeof(FONDO) / sizeof(FONDO[0]));
+
+bool panelActivo() {
+  return modoPanel;
+}
+
+void activarPanel() {
+  if (modoPanel) return;
+  Serial.flush();
+  modoPanel = true;
+  panel.invalidar();
+  proximoRefrescoMs = millis();
+}
+
+void desactivarPanel() {
+  if (!modoPanel) return;
+  panel.cerrar(Serial);
+  modoPanel = false;
+}
+
+uint32_t msHastaPanel(uint32_t ahoraMs) {
+  if (!modoPanel) return 0xFFFFFFFFUL;
+  int32_t falta = (int32_t)(proximoRefrescoMs - ahoraMs);
+  return falta > 0 ? (uint32_t)falta : 0;
+}
+
+static const char* textoAlarma(uint8_t alarma) {
+  switch (alarma) {
+    case ALARM_NONE: return "SIN ALCOHOL (<20 mg/100ml)";
+    case ALARM_DRINKING: return "BEBIDO (20-80 mg/100ml)";
+    case ALARM_DRUNK: return "EBRIO (>=80 mg/100ml)";
+    default: return "desconocida";
+  }
+}
+
+// Cuenta atrás del estado actual, si el firmware sabe cuánto dura
+static void fijarTiempo(const DatosPanel& d) {
+  uint32_t duracionMs = d.estado == STATUS_PREHEATING ? PRECALENTAMIENTO_MS
+                        : d.estado == STATUS_BLOWING  ? d.tiempoSoplado * 1000UL
+                                                      : 0;
+  uint32_t s = d.msEnEstado / 1000;
+  if (duracionMs == 0) {
+    panel.fijarf(P_TIEMPO, "%lu s", (unsigned long)s);
+  } else {
+    uint32_t faltaMs = d.msEnEstado < duracionMs ? duracionMs - d.msEnEstado : 0;
+    panel.fijarf(P_TIEMPO, "%lu s, quedan %lu s", (unsigned long)s,
+                 (unsigned long)((faltaMs + 999) / 1000));
+  }
+}
+
+static void fijarResultado(const DatosPanel& d, uint32_t ahoraMs) {
+  if (d.resultadoPendiente) {
+    panel.fijar(P_RESULTADO, "prueba terminada, leyendo...");
+  } else if (d.ultimo == nullptr) {
+    panel.fijar(P_RESULTADO, "-");
+  } else {
+    panel.fijarf(P_RESULTADO, "prueba %lu: %u mg/100ml, hace %lu s",
+                 (unsigned long)d.ultimo->secuencia, d.ultimo->resultado.alcoholMg100ml,
+                 (unsigned long)((ahoraMs - d.ultimo->marcaMs) / 1000));
+  }
+  panel.fijar(P_ALARMA, d.ultimo != nullptr ? textoAlarma(d.ultimo->resultado.alarma) : "-");
+}
+
+// Tasas de la última ventana completa
+static void fijarTasas(uint32_t ahoraMs) {
+  static uint32_t inicioMs = 0;
+  static uint32_t serieInicio = 0;
+  static uint32_t retenidosInicio = 0;
+  static bool primera = true;
+  uint32_t transcurridoMs = ahoraMs - inicioMs;
+  if (!primera && transcurridoMs < VENTANA_TASA_MS) return;
+  // Lo que envía el panel también sale por el puerto
+  uint32_t serie = bytesSerie + panel.bytesEnviados();
+  if (primera) {
+    panel.fijar(P_CONSOLA, "midiendo...");
+  } else {
+    panel.fijarf(P_CONSOLA, "%lu B/s enviados, %lu B/s de registro retenidos",
+                 (unsigned long)((serie - serieInicio) * 1000ULL / transcurridoMs),
+                 (unsigned long)((bytesRetenidos - retenidosInicio) * 1000ULL /
+                                 transcurridoMs));
+  }
+  primera = false;
+  inicioMs = ahoraMs;
+  serieInicio = serie;
+  retenidosInicio = bytesRetenidos;
+}
+
+void actualizarPanel(const DatosPanel& d, uint32_t ahoraMs) {
+  if (!modoPanel) return;
+  proximoRefrescoMs = ahoraMs + PERIODO_PANEL_MS;
+
+  uint32_t s = ahoraMs / 1000;
+  panel.fijarf(P_EN_MARCHA, "en marcha %3lu:%02lu:%02lu", (unsigned long)(s / 3600),
+               (unsigned long)(s / 60 % 60), (unsigned long)(s % 60));
+
+  const DefinicionEstado* estado = definicionEstado(d.estado);
+  panel.fijarf(P_ESTADO, "%s (0x%02X)", estado != nullptr ? estado->descripcion : "Desconocido",
+               d.estado);
+  fijarTiempo(d);
+  if (d.tiempoSoplado == 0) {
+    panel.fijarf(P_SOPLADO, "? s (%s)", d.sopladoAdaptativo ? "adaptativo" : "manual");
+  } else {
+    panel.fijarf(P_SOPLADO, "%u s (%s)", d.tiempoSoplado,
+                 d.sopladoAdaptativo ? "adaptativo" : "manual");
+  }
+  fijarResultado(d, ahoraMs);
+  if (d.idConfirmatoria == 0) {
+    panel.fijar(P_CONFIRMATORIA, "-");
+  } else {
+    panel.fijarf(P_CONFIRMATORIA, "de la prueba #%lu en %lu s",
+                 (unsigned long)d.idConfirmatoria,
+                 (unsigned long)(d.msHastaConfirmatoria / 1000));
+  }
+  if (d.idSujeto == 0) {
+    panel.fijar(P_SUJETO, "-");
+  } else {
+    panel.fijarf(P_SUJETO, "%lu", (unsigned long)d.idSujeto);
+  }
+  panel.fijarf(P_ENLACE, "%lu respuestas, %lu fallos, %lu bloqueados",
+               (unsigned long)metricas::total<M_RESPUESTAS>(),
+               (unsigned long)metricas::total<M_FALLOS_ENLACE>(),
+               (unsigned long)metricas::total<M_COMANDOS_BLOQUEADOS>());
+  panel.fijarf(P_SUBIDA, "%lu pendientes, WiFi %s",
+               (unsigned long)metricas::total<M_PENDIENTES_SUBIDA>(),
+               subidaActiva() ? "encendido" : "apagado");
+  fijarTasas(ahoraMs);
+  panel.fijar(P_MENSAJE, ultimoMensaje);
+
+  panel.refrescar(Serial);
+}
@@ -8,215 +8,382 @@
  * Sensor Pin 2 (GND) -> ESP32 GND
  * Sensor Pin 3 (TXD) -> ESP32 RX pin (GPIO16)
  * Sensor Pin 4 (RXD) -> ESP32 TX pin (GPIO17)
+ *
+ * Indicador de alarma:
+ * LED verde (sin alcohol)   -> GPIO25
+ * LED amarillo (bebido)     -> GPIO26
+ * LED rojo (ebrio)          -> GPIO27
+ * Zumbador activo           -> GPIO14
  */
 #include <Arduino.h>
 #include <HardwareSerial.h>
+#include <esp_system.h>
+#include "gestor_energia.h"
+#include "protocolo_ze29a.h"
+#include "maquina_estados.h"
+#include "politica_enlace.h"
+#include "salida_alarma.h"
+#include "politica_retest.h"
+#include "bus_eventos.h"
+#include "subida.h"
+#include "calidad_enlace.h"
+#include "metricas.h"
+#include "perfiles_soplado.h"
+#include "estado_rtc.h"
+#include "registro_vuelo.h"
+#include "perfilador.h"
+#include "entrega_resultados.h"
+#include "consola.h"
 
 HardwareSerial SensorSerial(1); // UART1: RX=16, TX=17
 
-// Status codes from the sensor documentation
-#define STATUS_IDLE 0x31
-#define STATUS_PREHEATING 0x32
-#define STATUS_WAITING_FOR_BLOW 0x33
-#define STATUS_BLOWING 0x34
-#define STATUS_BLOW_INTERRUPTED 0x35
-#define STATUS_CALCULATING 0x36
-#define STATUS_READ_RESULT 0x37
+#define PIN_LED_VERDE 25
+#define PIN_LED_AMARILLO 26
+#define PIN_LED_ROJO 27
+#define PIN_ZUMBADOR 14
 
-// Alarm status codes
-#define ALARM_NONE 0x00     // No alcohol (<20mg/100ml)
-#define ALARM_DRINKING 0x01 // Drinking (20-80mg/100ml)
-#define ALARM_DRUNK 0x02    // Drunk (>=80mg/100ml)
+// Sin entradas por consola durante este tiempo se permite dormir en loop().
+// El carácter que despierta al ESP32 del sueño ligero se pierde.
+#define INACTIVIDAD_CONSOLA_MS 30000
+
+// Intervalo de sondeo del estado durante una prueba, una vez cumplida la
+// permanencia mínima del estado según la tabla de maquina_estados.h
+#define INTERVALO_SONDEO_MS 500
 
 unsigned long lastStatusCheck = 0;
+unsigned long ultimaActividadConsola = 0;
+unsigned long entradaEstadoMs = 0;  // cuándo se vio por primera vez el estado
+unsigned long estadoVistoMs = 0;    // última lectura del estado del sensor
+unsigned long ultimoSondeoMs = 0;
+bool avisoPermanencia = false;
 byte currentStatus = STATUS_IDLE;
-bool resultAvailable = false;
+GestorEnergia gestorEnergia;
+IndicadorGpio indicadorAlarma(PIN_LED_VERDE, PIN_LED_AMARILLO, PIN_LED_ROJO,
+                              PIN_ZUMBADOR);
+LatenciaAlarma latenciaAlarma = {0, 0, 0, 0};
+PlanificadorRetest planificadorRetest;
+AdaptadorSoplado adaptadorSoplado;
+bool sopladoAdaptativo = true;  // 'c' lo desactiva, 'a' lo alterna
+byte ultimoComando = 0;
+byte ultimaTrama[9];  // para reenviarla si la consulta no obtiene respuesta
+// Última respuesta completa, pendiente de registrarTrama()
+struct TramaRecibida {
+  uint32_t marca;  // marcaTramaCompleta() al completarla el analizador
+  uint32_t esperaMs;
+  bool checksumValido;
+  bool registrar;
+};
+TramaRecibida tramaRecibida = {};
+PoliticaEnlace politicaEnlace = POLITICA_ENLACE_DEFECTO;
+uint32_t idSujeto = 0;  // sujeto de las próximas pruebas, 0 si no se indicó
+SaludPrueba saludPrueba = {};  // de la prueba en curso, va con su resultado
+
+// Secuencia de las pruebas terminadas, último resultado leído y lo que ya
+// recibió cada consumidor (ver entrega_resultados.h)
+EntregaResultados entregaResultados;
+enum ConsumidorResultado : uint8_t {
+  CONSUMIDOR_ENERGIA = 0,
+  CONSUMIDOR_VUELO,
+  CONSUMIDOR_METRICAS,
+  CONSUMIDOR_SOPLADO,
+  CONSUMIDOR_CONSOLA,
+  CONSUMIDOR_HISTORIAL,
+  CONSUMIDOR_SUBIDA,
+  NUM_CONSUMIDORES_RESULTADO
+};
+static_assert(NUM_CONSUMIDORES_RESULTADO <= MAX_CONSUMIDORES_RESULTADO,
+              "ampliar MAX_CONSUMIDORES_RESULTADO");
+
+// Sobrevive a los reinicios que no son un encendido (ver estado_rtc.h)
+RTC_NOINIT_ATTR EstadoRtc estadoRtc;
+uint8_t reanudaciones = 0;
+
+// Suscriptores de los eventos del sensor (definidos más abajo)
+struct ResultadoPendiente {
+  static void alRecibir(const EventoEstado& e);
+};
+struct Consola {
+  static void alRecibir(const EventoEstado& e);
+  static void alRecibir(const EventoResultado& e);
+};
+struct ContabilidadEnergia {
+  static void alRecibir(const EventoResultado& e);
+};
+struct Retest {
+  static void alRecibir(const EventoEstado& e);
+  static void alRecibir(const EventoResultado& e);
+  static void alRecibir(const EventoConfiguracion& e);
+};
+struct RegistroMetricas {
+  static void alRecibir(const EventoEstado& e);
+  static void alRecibir(const EventoResultado& e);
+  static void alRecibir(const EventoFalloEnlace& e);
+};
+struct AdaptacionSoplado {
+  static void alRecibir(const EventoEstado& e);
+  static void alRecibir(const EventoResultado& e);
+  static void alRecibir(const EventoConfiguracion& e);
+};
+struct SaludSensor {
+  static void alRecibir(const EventoEstado& e);
+  static void alRecibir(const EventoFalloEnlace& e);
+};
+struct CajaNegra {
+  static void alRecibir(const EventoEstado& e);
+  static void alRecibir(const EventoResultado& e);
+  static void alRecibir(const EventoFalloEnlace& e);
+};
+struct Subida {
+  static constexpr bool diferido = true;  // escribe en flash
+  static void alRecibir(const EventoPruebaRegistrada& e);
+  static void alRecibir(const EventoConfiguracion& e);
+};
+
+// Temas del bus: los suscriptores reciben en el orden en que se listan
+using TemaEstado = Tema<EventoEstado, ResultadoPendiente, CajaNegra,
+                        RegistroMetricas, SaludSensor, AdaptacionSoplado, Retest, Consola>;
+using TemaResultado = Tema<EventoResultado, ContabilidadEnergia, CajaNegra,
+                           RegistroMetricas, AdaptacionSoplado, Consola, Retest>;
+using TemaPrueba = Tema<EventoPruebaRegistrada, Subida>;
+using TemaFalloEnlace = Tema<EventoFalloEnlace, CajaNegra, RegistroMetricas, SaludSensor>;
+using TemaConfiguracion =
+    Tema<EventoConfiguracion, Retest, AdaptacionSoplado, Subida>;
 
 // Function prototypes
 void imprimirRespuesta(byte* response, int len);
-void verificarEstado();
+void verificarEstado(bool registrar = true);
+void imprimirRegistroPrueba(const RegistroPrueba& registro);
+void imprimirResultado(const ResultadoPrueba& resultado);
+bool configurarTiempoSoplado(byte nuevoTiempo);
 
 void esperarEstado(byte estadoDeseado, int timeoutMs) {
   unsigned long t0 = millis();
   while (millis() - t0 < timeoutMs) {
     verificarEstado();
     if (currentStatus == estadoDeseado) return;
-    delay(500);
+    // Sin tráfico pendiente: se puede dormir, salvo con la consola en uso
+    // porque el sueño ligero pierde el byte que despierta al chip
+    if (millis() - ultimaActividadConsola >= INACTIVIDAD_CONSOLA_MS) {
+      gestorEnergia.esperar(500);
+    } else {
+      gestorEnergia.esperarUart(SensorSerial, 500);
+    }
   }
-  Serial.println("Timeout esperando estado deseado.");
+  consola.println("Timeout esperando estado deseado.");
 }
 
-void enviarComando(byte* cmd, int len) {
-  // Vaciar el buffer de recepción antes de enviar
+// Vaciar el buffer de recepción y escribir la trama con flush para
+// garantizar la transmisión
+void transmitir(const byte* cmd, int len) {
   while (SensorSerial.available()) {
     SensorSerial.read();
   }
-  
-  // Enviar comando con flush para garantizar transmisión
+  metricas::incrementar<M_COMANDOS_ENVIADOS>(metricas::serieComando(cmd[2]));
+  registrarVuelo(VUELO_COMANDO, cmd[2], cmd[3]);
   SensorSerial.write(cmd, len);
   SensorSerial.flush();
-  delay(500); // Aumentar delay para dar más tiempo al sensor para responder
 }
 
-byte calcularChecksum(byte* data, int len) {
-  int sum = 0;
-  for (int i = 0; i < len; i++) {
-    sum += data[i];
+// Devuelve false sin tocar el UART si la tabla de estados dice que el
+// sensor no acepta el comando en el estado actual
+bool enviarComando(byte* cmd, int len, int esperaMs = ESPERA_COMANDO_MS) {
+  if (!comandoPermitido(currentStatus, cmd[2], cmd[3])) {
+    metricas::incrementar<M_COMANDOS_BLOQUEADOS>(metricas::serieComando(cmd[2]));
+    registrarVuelo(VUELO_COMANDO_BLOQUEADO, cmd[2], cmd[3], currentStatus);
+    consola.print("Comando 0x");
+    consola.print(cmd[2], HEX);
+    consola.print(" no permitido en el estado 0x");
+    consola.println(currentStatus, HEX);
+    return false;
   }
-  return (byte)((-sum) + 1);
+
+  ultimoComando = cmd[2];
+  memcpy(ultimaTrama, cmd, len < 9 ? len : 9);
+  transmitir(cmd, len);
+  // Dar tiempo al sensor para responder, a baja frecuencia y volviendo en
+  // cuanto llega el primer byte
+  gestorEnergia.esperarUart(SensorSerial, esperaMs);
+  return true;
+}
+
+void publicarFallo(TipoFalloEnlace tipo, int bytesParciales = 0) {
+  EventoFalloEnlace e = {tipo, ultimoComando, (uint8_t)bytesParciales,
+                         (uint32_t)millis()};
+  TemaFalloEnlace::publicar(e);
+}
+
+void actualizarEstado(byte nuevoEstado) {
+  EventoEstado e = {currentStatus, nuevoEstado, (uint32_t)millis()};
+  unsigned long sinVerMs = millis() - estadoVistoMs;
+  estadoVistoMs = millis();
+  if (nuevoEstado != currentStatus) {
+    // El sondeo se salta los estados cortos: sólo es inesperado lo que no
+    // cabe en el tiempo desde la lectura anterior
+    if (!transicionObservable(currentStatus, nuevoEstado, sinVerMs)) {
+      consola.print("Transición inesperada 0x");
+      consola.print(currentStatus, HEX);
+      consola.print(" -> 0x");
+      consola.println(nuevoEstado, HEX);
+    }
+    entradaEstadoMs = millis();
+    avisoPermanencia = false;
+  }
+  currentStatus = nuevoEstado;
+  TemaEstado::publicar(e);
 }
 
-bool leerRespuesta(byte* buffer, int expectedLen) {
+void registrarRespuesta(byte* buffer, int len) {
+  consola.print("Bytes leídos: ");
+  consola.println(len);
+  imprimirRespuesta(buffer, len);
+}
+
+// Métricas, registro de vuelo, consola y fallo de checksum de la trama
+// recibida
+void registrarTrama(byte* buffer, int len) {
+  gestorEnergia.terminarEsperaUart();
+  metricas::incrementar<M_RESPUESTAS>(metricas::serieComando(ultimoComando));
+  registrarVuelo(VUELO_RESPUESTA, buffer[1], buffer[2],
+                 tramaRecibida.checksumValido, tramaRecibida.esperaMs);
+  if (tramaRecibida.registrar) {
+    registrarRespuesta(buffer, len);
+    if (!tramaRecibida.checksumValido) {
+      consola.println("Aviso: checksum de la respuesta inválido");
+    }
+  }
+  if (!tramaRecibida.checksumValido) publicarFallo(FALLO_CHECKSUM);
+}
+
+// Un intento: espera la trama completa hasta timeoutMs
+bool leerIntento(byte* buffer, int expectedLen, bool registrar, bool aplazar,
+                 uint32_t timeoutMs) {
   unsigned long startTime = millis();
-  int bytesRead = 0;
-  bool startByteFound = false;
+  // Busca el byte de inicio 0xFF y junta la trama; se acepta aunque el
+  // checksum no cuadre, avisando por consola
+  AnalizadorTramas analizador(false);
   
-  // Timeout aumentado a 3 segundos
-  while (millis() - startTime < 3000) {
-    if (SensorSerial.available()) {
-      byte currentByte = SensorSerial.read();
-      
-      // Esperamos el byte de inicio 0xFF
-      if (!startByteFound) {
-        if (currentByte == 0xFF) {
-          buffer[0] = currentByte;
-          bytesRead = 1;
-          startByteFound = true;
-        }
-        continue;
-      }
-      
-      // Si ya encontramos el byte de inicio, seguimos llenando el buffer
-      buffer[bytesRead++] = currentByte;
-      
-      // Si tenemos todos los bytes esperados, terminamos
-      if (bytesRead >= expectedLen) {
-        Serial.print("Bytes leídos: ");
-        Serial.println(bytesRead);
-        imprimirRespuesta(buffer, expectedLen);
+  gestorEnergia.empezarEsperaUart();
+  while (millis() - startTime < timeoutMs) {
+    while (SensorSerial.available()) {
+      if (analizador.alimentar(SensorSerial.read())) {
+        tramaRecibida.marca = marcaTramaCompleta();
+        memcpy(buffer, analizador.trama(), expectedLen);
+        tramaRecibida.esperaMs = millis() - startTime;
+        tramaRecibida.checksumValido = analizador.tramaConChecksumValido();
+        tramaRecibida.registrar = registrar;
+        if (!aplazar) registrarTrama(buffer, expectedLen);
         return true;
       }
     }
-    delay(10);  // Pequeña pausa para no saturar el CPU
+    // Pequeña pausa para no saturar el CPU; vuelve al llegar otro byte
+    gestorEnergia.esperarUart(SensorSerial, 10);
   }
+  gestorEnergia.terminarEsperaUart();
   
-  Serial.println("Timeout esperando respuesta completa");
+  consola.println("Timeout esperando respuesta completa");
+  int bytesRead = analizador.bytesPendientes();
+  publicarFallo(FALLO_TIMEOUT, bytesRead);
   if (bytesRead > 0) {
-    Serial.print("Bytes parciales recibidos: ");
-    Serial.println(bytesRead);
+    memcpy(buffer, analizador.trama(), bytesRead);
+    consola.print("Bytes parciales recibidos: ");
+    consola.println(bytesRead);
     imprimirRespuesta(buffer, bytesRead);
   }
   return false;
 }
 
+// Con registrar = false la respuesta no se imprime. Con aplazar = true el
+// llamador usa la trama antes de nada (p. ej. enciende el indicador de
+// alarma) y después llama a registrarTrama(). Sin respuesta en el plazo de
+// la política, las consultas se reenvían (ver politica_enlace.h).
+bool leerRespuesta(byte* buffer, int expectedLen, bool registrar = true,
+                   bool aplazar = false) {
+  uint8_t intentos = intentosRespuesta(politicaEnlace, ultimoComando);
+  uint32_t timeoutMs = timeoutIntentoMs(politicaEnlace, ultimoComando);
+  for (uint8_t intento = 1;; intento++) {
+    if (leerIntento(buffer, expectedLen, registrar, aplazar, timeoutMs)) return true;
+    if (intento >= intentos) return false;
+    consola.print("Reenviando la consulta 0x");
+    consola.println(ultimoComando, HEX);
+    transmitir(ultimaTrama, 9);
+  }
+}
+
 void imprimirRespuesta(byte* response, int len) {
-  Serial.print("Respuesta: ");
+  consola.print("Respuesta: ");
   for (int i = 0; i < len; i++) {
-    Serial.print("0x");
-    if (response[i] < 0x10) Serial.print("0");
-    Serial.print(response[i], HEX);
-    Serial.print(" ");
+    consola.print("0x");
+    if (response[i] < 0x10) consola.print("0");
+    consola.print(response[i], HEX);
+    consola.print(" ");
   }
-  Serial.println();
+  consola.println();
 }
 
 void cambiarEstado(byte nuevoEstado) {
-  Serial.print("Intentando cambiar estado a 0x");
-  Serial.println(nuevoEstado, HEX);
+  consola.print("Intentando cambiar estado a 0x");
+  consola.println(nuevoEstado, HEX);
 
-  // Construir el comando (según el manual)
-  byte cmd[9] = {0xFF, 0x01, 0x87, nuevoEstado, 0x00, 0x00, 0x00, 0x00, 0x00};
-  
-  // Calcular checksum según el método documentado exactamente:
-  // "Check value algorithm: (negative (data 1 + data 2 + ... + data 7)) + 1"
-  int sum = 0;
-  for (int i = 1; i < 8; i++) {  // Empezamos desde el byte 1 (dirección)
-    sum += cmd[i];
-  }
-  cmd[8] = (byte)(~(sum & 0xFF) + 1);  // Checksum según la fórmula del manual
-  //cmd[8] = (byte)((-sum) + 1);
+  // Construir el comando (según el manual), con su checksum
+  byte cmd[9];
+  construirTrama(cmd, CMD_CAMBIAR_ESTADO, nuevoEstado);
 
   // Mostrar el comando para depuración
-  Serial.print("Comando enviado: ");
+  consola.print("Comando enviado: ");
   for (int i = 0; i < 9; i++) {
-    Serial.print("0x");
-    if (cmd[i] < 0x10) Serial.print("0");
-    Serial.print(cmd[i], HEX);
-    Serial.print(" ");
+    consola.print("0x");
+    if (cmd[i] < 0x10) consola.print("0");
+    consola.print(cmd[i], HEX);
+    consola.print(" ");
   }
-  Serial.println();
+  consola.println();
 
-  // Vaciar ambos buffers antes de enviar
-  while (SensorSerial.available()) {
-    SensorSerial.read();
-  }
-  
-  SensorSerial.write(cmd, 9);
-  
-  SensorSerial.flush();  // Asegurar que todos los bytes se envíen
-  delay(800);  // Dar tiempo suficiente para que el sensor procese
+  // Dar tiempo suficiente para que el sensor procese
+  if (!enviarComando(cmd, 9, ESPERA_COMANDO_LENTO_MS)) return;
 
   // Leer la respuesta
   byte response[9];
   if (leerRespuesta(response, 9)) {
     if (response[0] == 0xFF && response[1] == 0x87) {
       if (response[2] == 0x01) {
-        Serial.print("Cambio de estado exitoso a 0x");
-        Serial.println(nuevoEstado, HEX);
+        consola.print("Cambio de estado exitoso a 0x");
+        consola.println(nuevoEstado, HEX);
+        actualizarEstado(nuevoEstado);
       } else {
-        Serial.print("Cambio de estado rechazado: 0x");
-        Serial.println(response[2], HEX);
+        consola.print("Cambio de estado rechazado: 0x");
+        consola.println(response[2], HEX);
+        publicarFallo(FALLO_RECHAZO);
       }
     } else {
-      Serial.println("Respuesta incorrecta al cambiar estado");
+      consola.println("Respuesta incorrecta al cambiar estado");
+      publicarFallo(FALLO_RESPUESTA_INVALIDA);
     }
   } else {
-    Serial.println("Sin respuesta al cambiar estado");
+    consola.println("Sin respuesta al cambiar estado");
     // Verificar datos parciales (esto se mantiene igual)
   }
 }
 
-void verificarEstado() {
+// Con registrar = false (sondeo automático) no se vuelca la trama ni se
+// publica el estado si no ha cambiado
+void verificarEstado(bool registrar) {
   byte cmdEstado[] = {0xFF, 0x01, 0x85, 0x00, 0x00, 0x00, 0x00, 0x00, 0x7A};
   byte response[9];
   
-  enviarComando(cmdEstado, 9);
-  if (leerRespuesta(response, 9)) {
+  ultimoSondeoMs = millis();
+  if (!enviarComando(cmdEstado, 9)) return;
+  if (leerRespuesta(response, 9, registrar)) {
     if (response[0] == 0xFF && response[1] == 0x85) {
-      currentStatus = response[2];
-      
-      // Print human-readable status
-      Serial.print("Estado: ");
-      switch (currentStatus) {
-        case STATUS_IDLE:
-          Serial.println("Inactivo (esperando instrucciones)");
-          break;
-        case STATUS_PREHEATING:
-          Serial.println("Precalentamiento");
-          break;
-        case STATUS_WAITING_FOR_BLOW:
-          Serial.println("Esperando soplido");
-          break;
-        case STATUS_BLOWING:
-          Serial.println("Soplando");
-          break;
-        case STATUS_BLOW_INTERRUPTED:
-          Serial.println("Soplido interrumpido");
-          break;
-        case STATUS_CALCULATING:
-          Serial.println("Calculando resultado");
-          break;
-        case STATUS_READ_RESULT:
-          Serial.println("Resultado listo para lectura");
-          resultAvailable = true;
-          break;
-        default:
-          Serial.print("Desconocido: 0x");
-          Serial.println(currentStatus, HEX);
+      if (registrar || response[2] != currentStatus) {
+        actualizarEstado(response[2]);
+      } else {
+        estadoVistoMs = millis();
       }
+    } else {
+      publicarFallo(FALLO_RESPUESTA_INVALIDA);
     }
   } else {
-    Serial.println("Error al leer el estado");
+    consola.println("Error al leer el estado");
   }
 }
 
@@ -224,110 +391,477 @@ void leerResultado() {
   byte cmdLeerResultado[] = {0xFF, 0x01, 0x86, 0x00, 0x00, 0x00, 0x00, 0x00, 0x79};
   byte response[9];
   
-  enviarComando(cmdLeerResultado, 9);
-  if (leerRespuesta(response, 9)) {
-    if (response[0] == 0xFF && response[1] == 0x86) {
-      // Calculate alcohol content
-      int alcoholContent = (response[2] << 8) | response[3];
-      float alcoholMg100ml = alcoholContent;
-      byte alarmStatus = response[7];
-      
-      Serial.print("Contenido de alcohol: ");
-      Serial.print(alcoholMg100ml);
-      Serial.println(" mg/100ml");
-      
-      Serial.print("Estado de alarma: ");
-      switch (alarmStatus) {
-        case ALARM_NONE:
-          Serial.println("Sin alcohol (<20mg/100ml)");
-          break;
-        case ALARM_DRINKING:
-          Serial.println("Bebido (20-80mg/100ml)");
-          break;
-        case ALARM_DRUNK:
-          Serial.println("Ebrio (>=80mg/100ml)");
-          break;
-        default:
-          Serial.print("Desconocido: 0x");
-          Serial.println(alarmStatus, HEX);
+  if (!enviarComando(cmdLeerResultado, 9)) return;
+  if (leerRespuesta(response, 9, true, true)) {
+    // Encender el indicador antes de cualquier impresión, métrica o registro
+    ResultadoPrueba resultado;
+    bool indicado = decodificarEIndicar(response, indicadorAlarma, resultado,
+                                        latenciaAlarma, tramaRecibida.marca);
+    registrarTrama(response, 9);
+
+    if (indicado) {
+      const ResultadoEntregado& leido =
+          entregaResultados.guardar(resultado, (uint32_t)millis());
+      EventoResultado e = {leido.resultado, leido.marcaMs, leido.secuencia};
+      TemaResultado::publicar(e);
+      metricas::fijar<M_LATENCIA_ALARMA_NS>(latenciaAlarma.ultimaNs);
+
+      consola.print("Latencia hasta indicador: ");
+      consola.print(latenciaAlarma.ultimaNs);
+      consola.print(" ns (máx ");
+      consola.print(latenciaAlarma.maximaNs);
+      consola.println(" ns)");
+      if (latenciaAlarma.ultimaNs > LATENCIA_MAXIMA_ALARMA_NS) {
+        registrarVuelo(VUELO_LATENCIA_ALARMA, 0, 0, 0, latenciaAlarma.ultimaNs);
+        consola.println("Aviso: latencia de alarma por encima de la cota");
       }
+    } else if (response[0] == 0xFF && response[1] == 0x86) {
+      // registrarTrama() ya publicó el FALLO_CHECKSUM de esta trama
+      consola.println("Checksum inválido: resultado descartado");
     } else {
-      Serial.println("Respuesta inválida al leer resultado");
+      consola.println("Respuesta inválida al leer resultado");
+      publicarFallo(FALLO_RESPUESTA_INVALIDA);
     }
   } else {
-    Serial.println("Error al leer el resultado");
+    consola.println("Error al leer el resultado");
+  }
+}
+
+// El UART sólo se usa la primera vez: el resultado de una prueba ya leída
+// sale de la caché y no vuelve a publicarse en el bus
+void solicitarResultado() {
+  if (entregaResultados.pendienteDeLeer()) {
+    if (comandoPermitido(currentStatus, CMD_LEER_RESULTADO)) {
+      leerResultado();
+      return;
+    }
+    // El sensor salió de READ_RESULT sin que se leyera
+    entregaResultados.descartarPendiente();
+  }
+  const ResultadoEntregado* ultimo = entregaResultados.ultimo();
+  if (ultimo == nullptr) {
+    consola.println("No hay resultado disponible para leer");
+    return;
   }
+  metricas::incrementar<M_RESULTADOS_CACHE>();
+  consola.print("Resultado de la prueba ");
+  consola.print(ultimo->secuencia);
+  consola.print(" (ya leído hace ");
+  consola.print(((uint32_t)millis() - ultimo->marcaMs) / 1000);
+  consola.println(" s)");
+  imprimirResultado(ultimo->resultado);
 }
 
-void iniciarPrueba() {
-  Serial.println("\n------------------------------");
-  Serial.println("Iniciando prueba de alcohol");
-  Serial.println("------------------------------");
+void imprimirRegistroPrueba(const RegistroPrueba& registro) {
+  consola.print("Prueba #");
+  consola.print(registro.id);
+  if (registro.esConfirmatoria) {
+    consola.print(" (confirmatoria de #");
+    consola.print(registro.idVinculado);
+    consola.print(")");
+  }
+  consola.print(": ");
+  consola.print(registro.resultado.alcoholMg100ml);
+  consola.println(" mg/100ml");
+
+  if (registro.esConfirmatoria) {
+    const RegistroPrueba& final = planificadorRetest.resultadoFinal(registro);
+    consola.print("Resultado final (menor de ambas, prueba #");
+    consola.print(final.id);
+    consola.print("): ");
+    consola.print(final.resultado.alcoholMg100ml);
+    consola.println(" mg/100ml");
+  } else if (planificadorRetest.pruebaPendiente() == registro.id) {
+    consola.print("Resultado cerca de un umbral (");
+    consola.print(planificadorRetest.umbralBebido());
+    consola.print("/");
+    consola.print(planificadorRetest.umbralEbrio());
+    consola.print(" mg/100ml): prueba confirmatoria programada en ");
+    consola.print(planificadorRetest.msHastaRetest(millis()) / 1000);
+    consola.println(" s");
+  } else if (planificadorRetest.ultimaSinConfirmar() == registro.id) {
+    consola.print("Resultado cerca de un umbral, pero la prueba #");
+    consola.print(planificadorRetest.pruebaPendiente());
+    consola.println(" ya espera su confirmatoria: éste queda sin confirmar");
+  }
+}
+
+// Suscriptores del bus
+
+// Sólo al entrar en READ_RESULT: volver a consultar el estado no debe
+// leer otra vez un resultado ya registrado
+void ResultadoPendiente::alRecibir(const EventoEstado& e) {
+  if (e.actual == STATUS_READ_RESULT && e.anterior != STATUS_READ_RESULT) {
+    entregaResultados.pruebaCompletada();
+  }
+}
+
+void Consola::alRecibir(const EventoEstado& e) {
+  consola.print("Estado: ");
+  const DefinicionEstado* estado = definicionEstado(e.actual);
+  if (estado != nullptr) {
+    consola.println(estado->descripcion);
+  } else {
+    consola.print("Desconocido: 0x");
+    consola.println(e.actual, HEX);
+  }
+}
+
+void Consola::alRecibir(const EventoResultado& e) {
+  if (!entregaResultados.primeraEntrega(CONSUMIDOR_CONSOLA, e.secuencia)) return;
+  imprimirResultado(e.resultado);
+}
+
+void imprimirResultado(const ResultadoPrueba& resultado) {
+  float alcoholMg100ml = resultado.alcoholMg100ml;
+  consola.print("Contenido de alcohol: ");
+  consola.print(alcoholMg100ml);
+  consola.println(" mg/100ml");
+
+  consola.print("Estado de alarma: ");
+  switch (resultado.alarma) {
+    case ALARM_NONE:
+      consola.println("Sin alcohol (<20mg/100ml)");
+      break;
+    case ALARM_DRINKING:
+      consola.println("Bebido (20-80mg/100ml)");
+      break;
+    case ALARM_DRUNK:
+      consola.println("Ebrio (>=80mg/100ml)");
+      break;
+    default:
+      consola.print("Desconocido: 0x");
+      consola.println(resultado.alarma, HEX);
+  }
+}
+
+void RegistroMetricas::alRecibir(const EventoEstado& e) {
+  static bool leido = false;
+  static uint32_t desdeMs = 0;
+  metricas::fijar<M_ESTADO_SENSOR>(e.actual);
+  // La permanencia cuenta desde la primera lectura del estado, no desde el
+  // arranque; el estado anterior a esa lectura no se llegó a observar
+  if (!leido) {
+    leido = true;
+    desdeMs = e.marcaMs;
+    return;
+  }
+  if (e.anterior == e.actual) return;
+  metricas::observar<M_PERMANENCIA_ESTADO_MS>(e.marcaMs - desdeMs,
+                                              metricas::serieEstado(e.anterior));
+  desdeMs = e.marcaMs;
+}
+
+void RegistroMetricas::alRecibir(const EventoResultado& e) {
+  if (!entregaResultados.primeraEntrega(CONSUMIDOR_METRICAS, e.secuencia)) return;
+  metricas::incrementar<M_RESULTADOS>(metricas::serieAlarma(e.resultado.alarma));
+}
+
+void RegistroMetricas::alRecibir(const EventoFalloEnlace& e) {
+  metricas::incrementar<M_FALLOS_ENLACE>(e.tipo);
+}
+
+// Una prueba empieza al entrar en PREHEATING; el precalentamiento sólo
+// cuenta si se vio la entrada
+void SaludSensor::alRecibir(const EventoEstado& e) {
+  static uint32_t inicioPrecalentamientoMs = 0;
+  static bool precalentamientoVisto = false;
+  if (e.anterior == e.actual) return;
+  if (e.actual == STATUS_PREHEATING) {
+    saludPrueba.soplidosInterrumpidos = 0;
+    saludPrueba.precalentamientoMs = 0;
+    inicioPrecalentamientoMs = e.marcaMs;
+    precalentamientoVisto = true;
+  } else if (e.anterior == STATUS_PREHEATING && precalentamientoVisto) {
+    uint32_t ms = e.marcaMs - inicioPrecalentamientoMs;
+    saludPrueba.precalentamientoMs = (uint16_t)(ms < UINT16_MAX ? ms : UINT16_MAX);
+    precalentamientoVisto = false;
+  }
+  if (e.actual == STATUS_BLOW_INTERRUPTED && saludPrueba.soplidosInterrumpidos < UINT8_MAX) {
+    saludPrueba.soplidosInterrumpidos++;
+  }
+}
+
+void SaludSensor::alRecibir(const EventoFalloEnlace& e) {
+  if (e.tipo == FALLO_TIMEOUT && saludPrueba.timeoutsEnlace < UINT8_MAX) {
+    saludPrueba.timeoutsEnlace++;
+  }
+}
+
+void AdaptacionSoplado::alRecibir(const EventoEstado& e) {
+  adaptadorSoplado.registrarEstado(e.anterior, e.actual);
+}
+
+void AdaptacionSoplado::alRecibir(const EventoResultado& e) {
+  if (!entregaResultados.primeraEntrega(CONSUMIDOR_SOPLADO, e.secuencia)) return;
+  adaptadorSoplado.registrarResultado(e.marcaMs);
+}
+
+void AdaptacionSoplado::alRecibir(const EventoConfiguracion& e) {
+  if (e.parametro == CONFIG_TIEMPO_SOPLADO) adaptadorSoplado.tiempoEnSensor(e.valor);
+}
+
+void CajaNegra::alRecibir(const EventoEstado& e) {
+  static uint32_t desdeMs = 0;
+  if (e.anterior == e.actual) return;
+  registrarVuelo(VUELO_ESTADO, e.anterior, e.actual, 0, e.marcaMs - desdeMs);
+  desdeMs = e.marcaMs;
+}
+
+void CajaNegra::alRecibir(const EventoResultado& e) {
+  if (!entregaResultados.primeraEntrega(CONSUMIDOR_VUELO, e.secuencia)) return;
+  registrarVuelo(VUELO_RESULTADO, e.resultado.alarma, 0, 0,
+                 e.resultado.alcoholMg100ml);
+}
+
+void CajaNegra::alRecibir(const EventoFalloEnlace& e) {
+  registrarVuelo(VUELO_FALLO_ENLACE, e.tipo, e.comando, e.bytesParciales);
+}
+
+void ContabilidadEnergia::alRecibir(const EventoResultado& e) {
+  if (!entregaResultados.primeraEntrega(CONSUMIDOR_ENERGIA, e.secuencia)) return;
+  gestorEnergia.marcarFinPrueba();
+}
+
+// Durante la confirmatoria sólo el precalentamiento puede adelantarse
+void Retest::alRecibir(const EventoEstado& e) {
+  bool enCurso = planificadorRetest.retestEnCurso();
+  if (!planificadorRetest.vigilarSoplido(e.anterior, e.actual, e.marcaMs)) {
+    consola.println("Soplido antes de cumplirse la espera mínima: la prueba no vale "
+                    "como confirmatoria y se repetirá");
+    return;
+  }
+  if (enCurso && e.actual == STATUS_WAITING_FOR_BLOW && e.anterior != e.actual) {
+    uint32_t ms = planificadorRetest.msHastaRetest(e.marcaMs);
+    if (ms > 0) {
+      consola.print("No sople todavía: faltan ");
+      consola.print((ms + 999) / 1000);
+      consola.println(" s de la espera mínima");
+    }
+  }
+}
+
+void Retest::alRecibir(const EventoResultado& e) {
+  if (!entregaResultados.primeraEntrega(CONSUMIDOR_HISTORIAL, e.secuencia)) return;
+  if (planificadorRetest.descartarAnulada()) {
+    consola.println("Resultado no registrado: se sopló antes de la espera mínima");
+    return;
+  }
+  const RegistroPrueba& registro =
+      planificadorRetest.registrar(e.resultado, e.marcaMs, idSujeto);
+  imprimirRegistroPrueba(registro);
+  EventoPruebaRegistrada prueba = {
+    registro.resultado, registro.id, registro.idVinculado, registro.idSujeto,
+    registro.esConfirmatoria, planificadorRetest.pruebaPendiente() != registro.id,
+    registro.marcaMs, e.secuencia, saludPrueba
+  };
+  saludPrueba.timeoutsEnlace = 0;
+  TemaPrueba::publicar(prueba);
+}
+
+void Subida::alRecibir(const EventoPruebaRegistrada& e) {
+  if (!entregaResultados.primeraEntrega(CONSUMIDOR_SUBIDA, e.secuenciaResultado)) return;
+  encolarPrueba(e);
+}
+
+void Subida::alRecibir(const EventoConfiguracion& e) {
+  encolarConfiguracion(e);
+}
+
+void Retest::alRecibir(const EventoConfiguracion& e) {
+  if (e.parametro == CONFIG_UMBRALES) {
+    planificadorRetest.fijarUmbrales(e.valor, e.valor2);
+  }
+}
+
+// Tiempo de soplado de la próxima prueba. En modo adaptativo se elige el
+// perfil y sólo se escribe 0x89 si el sensor tiene otro valor; en manual
+// las estadísticas se apuntan al valor que tenga el sensor.
+void prepararTiempoSoplado() {
+  if (!sopladoAdaptativo) {
+    adaptadorSoplado.usarPerfil(adaptadorSoplado.tiempoConocido());
+    return;
+  }
+  byte tiempo = adaptadorSoplado.elegir();
+  if (adaptadorSoplado.hayQueEscribir(tiempo)) configurarTiempoSoplado(tiempo);
+}
+
+// Con sensorCaliente = true (prueba confirmatoria) y el sensor aún en
+// READ_RESULT se pasa directamente a precalentamiento sin esperar a IDLE
+void iniciarPrueba(bool sensorCaliente = false) {
+  consola.println("\n------------------------------");
+  consola.println("Iniciando prueba de alcohol");
+  consola.println("------------------------------");
   
   // Verificar estado actual antes de cambiar
   byte cmdEstado[] = {0xFF, 0x01, 0x85, 0x00, 0x00, 0x00, 0x00, 0x00, 0x7A};
-  enviarComando(cmdEstado, 9);
-  
   byte response[9];
-  if (leerRespuesta(response, 9)) {
+  if (enviarComando(cmdEstado, 9) && leerRespuesta(response, 9)) {
     if (response[0] == 0xFF && response[1] == 0x85) {
-      currentStatus = response[2];
-      Serial.print("Estado actual antes de iniciar: 0x");
-      Serial.println(currentStatus, HEX);
+      actualizarEstado(response[2]);
     }
   }
   
-  // Solo podemos cambiar a precalentamiento desde estado inactivo o desde lectura de resultado
-  if (currentStatus == STATUS_IDLE || currentStatus == STATUS_READ_RESULT) {
+  // La tabla de estados dice desde dónde se puede pedir el precalentamiento
+  if (comandoPermitido(currentStatus, CMD_CAMBIAR_ESTADO, STATUS_PREHEATING)) {
     // Cambiar a estado de preheat (0x32)
-    esperarEstado(STATUS_IDLE, 10000);
+    if (!(sensorCaliente && currentStatus == STATUS_READ_RESULT)) {
+      esperarEstado(STATUS_IDLE, 10000);
+    }
 
+    indicadorAlarma.apagar();
+    entregaResultados.descartarPendiente();  // El resultado anterior queda descartado
+    prepararTiempoSoplado();
+    adaptadorSoplado.iniciarCiclo(millis());
     cambiarEstado(STATUS_PREHEATING);
-    Serial.println("Iniciando precalentamiento del sensor (10 segundos)...");
+    gestorEnergia.marcarInicioPrueba();
+    consola.println("Iniciando precalentamiento del sensor (10 segundos)...");
     // El sensor cambiará automáticamente a STATUS_WAITING_FOR_BLOW después del precalentamiento
   } else {
-    Serial.println("No se puede iniciar prueba desde el estado actual.");
-    Serial.println("El sensor debe estar en estado IDLE (0x31) o READ_RESULT (0x37).");
+    consola.println("No se puede iniciar prueba desde el estado actual.");
+    consola.println("El sensor debe estar en estado IDLE (0x31) o READ_RESULT (0x37).");
   }
 }
 
-void consultarUmbrales() {
+// Prueba pedida con 'i'. Un resultado sin leer se lee antes, que
+// iniciarPrueba() lo descartaría. Con la espera cumplida cuenta como la
+// confirmatoria si el sujeto coincide o falta; si no, lo decide el operador.
+void iniciarPruebaManual() {
+  if (entregaResultados.pendienteDeLeer() &&
+      comandoPermitido(currentStatus, CMD_LEER_RESULTADO)) {
+    leerResultado();
+    if (entregaResultados.pendienteDeLeer()) {
+      consola.println("No se pudo leer el resultado anterior ('r' para reintentar)");
+      return;
+    }
+  }
+  if (planificadorRetest.debeIniciarRetest(millis())) {
+    bool mismoSujeto = planificadorRetest.sujetoCompatible(idSujeto);
+    bool confirmatoria = mismoSujeto;
+    if (!mismoSujeto) {
+      const RegistroPrueba* original =
+          planificadorRetest.buscar(planificadorRetest.pruebaPendiente());
+      consola.print("¿Es la confirmatoria de #");
+      consola.print(planificadorRetest.pruebaPendiente());
+      consola.print(" (sujeto ");
+      consola.print(original != nullptr ? original->idSujeto : 0);
+      consola.print(") aunque el sujeto es ");
+      consola.print(idSujeto);
+      consola.println("? (s/n)");
+      gestorEnergia.empezarEsperaUart();
+      while (!Serial.available()) {
+        gestorEnergia.esperarUart(Serial, 100);
+      }
+      gestorEnergia.terminarEsperaUart();
+      String input = Serial.readStringUntil('\n');
+      input.trim();
+      confirmatoria = input.equalsIgnoreCase("s");
+    }
+    if (confirmatoria) planificadorRetest.marcarRetestIniciado(!mismoSujeto);
+  }
+  iniciarPrueba();
+}
+
+// Devuelve true y los umbrales si el sensor respondió
+bool consultarUmbrales(byte* bebido = nullptr, byte* ebrio = nullptr) {
   byte cmdUmbral[] = {0xFF, 0x01, 0x90, 0x00, 0x00, 0x00, 0x00, 0x00, 0x6F};
-  enviarComando(cmdUmbral, 9);
+  if (!enviarComando(cmdUmbral, 9)) return false;
   byte response[9];
   if (leerRespuesta(response, 9)) {
     if (response[0] == 0xFF && response[1] == 0x90) {
-      Serial.print("Umbral de bebido: ");
-      Serial.print(response[2]);
-      Serial.println(" mg/100ml");
-      Serial.print("Umbral de ebriedad: ");
-      Serial.print(response[3]);
-      Serial.println(" mg/100ml");
+      consola.print("Umbral de bebido: ");
+      consola.print(response[2]);
+      consola.println(" mg/100ml");
+      consola.print("Umbral de ebriedad: ");
+      consola.print(response[3]);
+      consola.println(" mg/100ml");
+      EventoConfiguracion e = {CONFIG_UMBRALES, response[2], response[3],
+                               (uint32_t)millis()};
+      TemaConfiguracion::publicar(e);
+      if (bebido != nullptr) *bebido = response[2];
+      if (ebrio != nullptr) *ebrio = response[3];
+      return true;
     }
   }
+  return false;
 }
 
+void imprimirCalidadEnlace(const char* modo, uint16_t tasaHz,
+                           CalidadEnlace& calidad) {
+  // Una línea clave=valor por medida para procesarla desde el PC
+  consola.print("LINK modo=");
+  consola.print(modo);
+  consola.print(" tasa_hz=");
+  consola.print(tasaHz);
+  consola.print(" enviadas=");
+  consola.print(calidad.enviadas());
+  consola.print(" ok=");
+  consola.print(calidad.respuestasCorrectas());
+  consola.print(" perdidas=");
+  consola.print(calidad.tramasPerdidas());
+  consola.print(" checksum=");
+  consola.print(calidad.tramasConErrorChecksum());
+  consola.print(" invalidas=");
+  consola.print(calidad.respuestasInvalidas());
+  consola.print(" bytes_fuera=");
+  consola.print(calidad.bytesFuera());
+  consola.print(" rtt_p50_us=");
+  consola.print(calidad.percentilUs(50));
+  consola.print(" rtt_p95_us=");
+  consola.print(calidad.percentilUs(95));
+  consola.print(" rtt_p99_us=");
+  consola.print(calidad.percentilUs(99));
+  consola.print(" rtt_max_us=");
+  consola.println(calidad.maximoUs());
+}
+
+// Prueba de comunicación: N consultas de estado a una tasa fija y después
+// un barrido de tasas. Con los valores por defecto dura menos de un minuto.
 void probarComunicacion() {
-  Serial.println("Probando comunicación...");
-  // Test de comando simple - consultar estado
-  byte cmdTest[] = {0xFF, 0x01, 0x85, 0x00, 0x00, 0x00, 0x00, 0x00, 0x7A};
-  Serial.println("Enviando comando de estado:");
-  for (int i = 0; i < 9; i++) {
-    Serial.print("0x");
-    if (cmdTest[i] < 0x10) Serial.print("0");
-    Serial.print(cmdTest[i], HEX);
-    Serial.print(" ");
+  static CalidadEnlace calidad;  // 4 KB de muestras, fuera de la pila
+  uint16_t consultas = CONSULTAS_ENLACE_DEFECTO;
+  uint16_t tasaHz = TASA_ENLACE_DEFECTO_HZ;
+
+  consola.print("Consultas y tasa en Hz (Enter para ");
+  consola.print(consultas);
+  consola.print(" ");
+  consola.print(tasaHz);
+  consola.println("):");
+  gestorEnergia.empezarEsperaUart();
+  while (!Serial.available()) {
+    gestorEnergia.esperarUart(Serial, 100);
+  }
+  gestorEnergia.terminarEsperaUart();
+  String input = Serial.readStringUntil('\n');
+  input.trim();
+  if (input.length() > 0) {
+    int espacio = input.indexOf(' ');
+    long n = input.toInt();
+    long tasa = espacio > 0 ? input.substring(espacio + 1).toInt() : tasaHz;
+    if (n > 0 && n <= MAX_MUESTRAS_ENLACE) consultas = (uint16_t)n;
+    if (tasa > 0 && tasa <= 100) tasaHz = (uint16_t)tasa;
+  }
+
+  consola.println("Probando comunicación...");
+  auto reloj = []() { return (uint32_t)micros(); };
+  medirEnlace(SensorSerial, reloj, consultas, tasaHz, calidad);
+  imprimirCalidadEnlace("fija", tasaHz, calidad);
+
+  uint16_t maxima = barrerTasas(SensorSerial, reloj, calidad,
+                                [](uint16_t tasa, CalidadEnlace& c) {
+                                  imprimirCalidadEnlace("barrido", tasa, c);
+                                });
+  consola.print("LINK modo=resumen tasa_max_sin_perdidas_hz=");
+  consola.println(maxima);
+
+  // Las consultas pueden haber dejado bytes a medias en el buffer
+  while (SensorSerial.available()) {
+    SensorSerial.read();
   }
-  Serial.println();
-  
-  enviarComando(cmdTest, 9);
-  delay(100);
-  Serial.print("Bytes disponibles después del comando: ");
-  Serial.println(SensorSerial.available());
 }
 
 void resetComunicacion() {
-  Serial.println("Reseteando comunicación...");
+  consola.println("Reseteando comunicación...");
   SensorSerial.end();
   delay(1000);
   SensorSerial.begin(9600, SERIAL_8N1, 16, 17);
@@ -339,159 +873,437 @@ void resetComunicacion() {
   }
 }
 
-// Función para leer el tiempo de soplado configurado (comando 0x88)
-void leerTiempoSoplado() {
-  Serial.println("Leyendo tiempo de soplado configurado...");
-  
-  // Construir el comando 0x88 (Read blow time) exactamente como indica la documentación
-  byte cmd[9] = {0xFF, 0x01, 0x88, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+// Función para leer el tiempo de soplado configurado (comando 0x88).
+// Devuelve los segundos o -1 si no hubo respuesta válida.
+int leerTiempoSoplado() {
+  consola.println("Leyendo tiempo de soplado configurado...");
   
-  // Calcular checksum según la documentación exactamente:
-  // "Check value algorithm: (negative (data 1 + data 2 + ... + data 7)) + 1"
-  int sum = 0;
-  for (int i = 1; i < 8; i++) {
-    sum += cmd[i];
-  }
-  cmd[8] = (byte)((~sum) + 1);  // Negación bit a bit + 1
+  // Construir el comando 0x88 (Read blow time) con su checksum
+  byte cmd[9];
+  construirTrama(cmd, CMD_LEER_TIEMPO_SOPLADO);
   
   // Mostrar comando para depuración
-  Serial.print("Comando enviado: ");
+  consola.print("Comando enviado: ");
   for (int i = 0; i < 9; i++) {
-    Serial.print("0x");
-    if (cmd[i] < 0x10) Serial.print("0");
-    Serial.print(cmd[i], HEX);
-    Serial.print(" ");
-  }
-  Serial.println();
-  
-  // Vaciar buffer de recepción antes de enviar
-  while (SensorSerial.available()) {
-    SensorSerial.read();
+    consola.print("0x");
+    if (cmd[i] < 0x10) consola.print("0");
+    consola.print(cmd[i], HEX);
+    consola.print(" ");
   }
+  consola.println();
   
-  // Enviar comando
-  SensorSerial.write(cmd, 9);
-  SensorSerial.flush();
-  delay(800);
+  if (!enviarComando(cmd, 9, ESPERA_COMANDO_LENTO_MS)) return -1;
   
   // Leer respuesta
   byte response[9] = {0};
   if (leerRespuesta(response, 9)) {
     if (response[0] == 0xFF && response[1] == 0x88) {
       byte tiempoSoplado = response[2];
-      Serial.print("Tiempo de soplado actual: ");
-      Serial.print(tiempoSoplado);
-      Serial.println(" segundos");
+      consola.print("Tiempo de soplado actual: ");
+      consola.print(tiempoSoplado);
+      consola.println(" segundos");
+      EventoConfiguracion e = {CONFIG_TIEMPO_SOPLADO, tiempoSoplado, 0,
+                               (uint32_t)millis()};
+      TemaConfiguracion::publicar(e);
+      return tiempoSoplado;
     } else {
-      Serial.println("Respuesta incorrecta al leer tiempo de soplado");
+      consola.println("Respuesta incorrecta al leer tiempo de soplado");
       imprimirRespuesta(response, 9);
     }
   } else {
-    Serial.println("Sin respuesta al leer tiempo de soplado");
+    consola.println("Sin respuesta al leer tiempo de soplado");
   }
+  return -1;
 }
 
-// Función para configurar el tiempo de soplado (comando 0x89)
-void configurarTiempoSoplado(byte nuevoTiempo) {
+// Función para configurar el tiempo de soplado (comando 0x89). Devuelve
+// true si el sensor lo aceptó.
+bool configurarTiempoSoplado(byte nuevoTiempo) {
   if (nuevoTiempo < 1 || nuevoTiempo > 10) {
-    Serial.println("Error: Tiempo fuera de rango (1-10s)");
-    return;
+    consola.println("Error: Tiempo fuera de rango (1-10s)");
+    return false;
   }
   
-  Serial.print("Configurando tiempo de soplado a ");
-  Serial.print(nuevoTiempo);
-  Serial.println(" segundos...");
-  
-  // Construir el comando exactamente según la documentación
-  byte cmd[9] = {0xFF, 0x01, 0x89, nuevoTiempo, 0x00, 0x00, 0x00, 0x00, 0x00};
+  consola.print("Configurando tiempo de soplado a ");
+  consola.print(nuevoTiempo);
+  consola.println(" segundos...");
   
-  // Calcular checksum según la documentación exactamente:
-  // "Check value algorithm: (negative (data 1 + data 2 + ... + data 7)) + 1"
-  int sum = 0;
-  for (int i = 1; i < 8; i++) {
-    sum += cmd[i];
-  }
-  cmd[8] = (byte)((~sum) + 1);  // Negación bit a bit + 1
+  // Construir el comando 0x89 con su checksum
+  byte cmd[9];
+  construirTrama(cmd, CMD_CONFIGURAR_TIEMPO_SOPLADO, nuevoTiempo);
   
   // Mostrar comando para depuración
-  Serial.print("Enviando: ");
+  consola.print("Enviando: ");
   for (int i = 0; i < 9; i++) {
-    Serial.print("0x");
-    if (cmd[i] < 0x10) Serial.print("0");
-    Serial.print(cmd[i], HEX);
-    Serial.print(" ");
+    consola.print("0x");
+    if (cmd[i] < 0x10) consola.print("0");
+    consola.print(cmd[i], HEX);
+    consola.print(" ");
   }
-  Serial.println();
+  consola.println();
   
-  // Vaciar buffer de recepción antes de enviar
-  while (SensorSerial.available()) {
-    SensorSerial.read();
-  }
-  
-  // Enviar comando
-  SensorSerial.write(cmd, 9);
-  SensorSerial.flush();
-  delay(800);
+  if (!enviarComando(cmd, 9, ESPERA_COMANDO_LENTO_MS)) return false;
   
   // Leer respuesta
   byte response[9] = {0};
   if (leerRespuesta(response, 9)) {
     if (response[0] == 0xFF && response[1] == 0x89) {
       if (response[2] == 0x01) {
-        Serial.println("¡Configuración de tiempo de soplado exitosa!");
+        consola.println("¡Configuración de tiempo de soplado exitosa!");
+        EventoConfiguracion e = {CONFIG_TIEMPO_SOPLADO, nuevoTiempo, 0,
+                                 (uint32_t)millis()};
+        TemaConfiguracion::publicar(e);
+        return true;
       } else {
-        Serial.println("Configuración de tiempo de soplado rechazada.");
+        consola.println("Configuración de tiempo de soplado rechazada.");
+        publicarFallo(FALLO_RECHAZO);
       }
     } else {
-      Serial.println("Respuesta incorrecta al configurar tiempo de soplado");
+      consola.println("Respuesta incorrecta al configurar tiempo de soplado");
       imprimirRespuesta(response, 9);
     }
   } else {
-    Serial.println("Sin respuesta al configurar tiempo de soplado");
+    consola.println("Sin respuesta al configurar tiempo de soplado");
+  }
+  return false;
+}
+
+// Órdenes de configuración bajadas del colector (subida.h). Se aplican con
+// el sensor parado y sin confirmatoria pendiente, por los mismos comandos
+// que la consola, y cada una se confirma con lo que el sensor devuelve al
+// leerla de vuelta.
+void aplicarOrdenConfiguracion() {
+  if (!comandoPermitido(currentStatus, CMD_CONFIGURAR_TIEMPO_SOPLADO) ||
+      planificadorRetest.retestPendiente()) {
+    return;
+  }
+  OrdenConfiguracion orden;
+  if (!tomarOrdenConfiguracion(orden)) return;
+  for (uint8_t i = 0; i < orden.numComandos; i++) {
+    const ComandoOrden& c = orden.comandos[i];
+    uint8_t estado = CONFIRMACION_INVALIDA;
+    uint16_t leido = 0;
+    switch (c.comando) {
+      case COMANDO_TIEMPO_SOPLADO: {
+        if (c.valor < 1 || c.valor > 10) break;
+        bool aceptado = configurarTiempoSoplado(c.valor);
+        int actual = leerTiempoSoplado();
+        if (actual < 0) {
+          estado = CONFIRMACION_SIN_RESPUESTA;
+          break;
+        }
+        leido = (uint16_t)actual;
+        estado = actual == c.valor ? CONFIRMACION_APLICADA
+                 : aceptado        ? CONFIRMACION_DISCREPANCIA
+                                   : CONFIRMACION_RECHAZADA;
+        // Como con 'c': un valor impuesto no lo pisa la adaptación
+        if (estado == CONFIRMACION_APLICADA) sopladoAdaptativo = false;
+        break;
+      }
+      case COMANDO_LEER_UMBRALES: {
+        byte bebido, ebrio;
+        if (consultarUmbrales(&bebido, &ebrio)) {
+          leido = (uint16_t)(bebido | ebrio << 8);
+          estado = CONFIRMACION_APLICADA;
+        } else {
+          estado = CONFIRMACION_SIN_RESPUESTA;
+        }
+        break;
+      }
+      case COMANDO_SOPLADO_ADAPTATIVO:
+        if (c.valor > 1) break;
+        sopladoAdaptativo = c.valor == 1;
+        leido = sopladoAdaptativo;
+        estado = CONFIRMACION_APLICADA;
+        break;
+    }
+    confirmarComando(c, estado, leido);
+    consola.print("Orden ");
+    consola.print(c.idOrden);
+    consola.print(": comando ");
+    consola.print(c.comando);
+    consola.print(" valor ");
+    consola.print(c.valor);
+    consola.print(" -> estado ");
+    consola.println(estado);
+  }
+}
+
+void imprimirEnergia() {
+  static const char* nombres[NUM_ESTADOS_ENERGIA] = {
+    "Activo (240 MHz)", "Reducido (80 MHz)", "Sueño ligero"
+  };
+  consola.println("Consumo estimado:");
+  for (int i = 0; i < NUM_ESTADOS_ENERGIA; i++) {
+    consola.print("  ");
+    consola.print(nombres[i]);
+    consola.print(": ");
+    consola.print((unsigned long)(gestorEnergia.tiempoEnUs((EstadoEnergia)i) / 1000));
+    consola.println(" ms");
+  }
+  consola.print("Ciclo de trabajo: ");
+  consola.print(gestorEnergia.cicloTrabajo() * 100.0f);
+  consola.println(" %");
+  consola.print("Energía total: ");
+  consola.print(gestorEnergia.energiaTotalMj());
+  consola.println(" mJ");
+  consola.print("Energía última prueba: ");
+  consola.print(gestorEnergia.energiaUltimaPruebaMj());
+  consola.println(" mJ");
+  consola.print("Energía media por prueba: ");
+  consola.print(gestorEnergia.energiaMediaPruebaMj());
+  consola.print(" mJ (");
+  consola.print(gestorEnergia.pruebasContabilizadas());
+  consola.println(" pruebas)");
+  consola.print("Despertares por consola: ");
+  consola.println(gestorEnergia.despertaresUart());
+}
+
+// Se llama una vez por vuelta de loop(), con los eventos diferidos ya
+// entregados: lo que figura como leído ya está en la cola de subida
+void guardarEstadoRtc() {
+  EstadoRtc e;
+  memset(&e, 0, sizeof(e));
+  if (millis() >= ESTABLE_TRAS_MS) reanudaciones = 0;
+  e.reanudaciones = reanudaciones;
+  e.estadoSensor = currentStatus;
+  e.entrega = entregaResultados;
+  e.sopladoAdaptativo = sopladoAdaptativo;
+  e.tiempoSoplado = adaptadorSoplado.tiempoConocido();
+  e.idSujeto = idSujeto;
+  planificadorRetest.exportar(e.retest, millis());
+  e.secuenciaOriginal = secuenciaPrueba(planificadorRetest.pruebaPendiente());
+  sellarEstadoRtc(e);
+  memcpy(&estadoRtc, &e, sizeof(e));
+}
+
+// Al encender la memoria RTC tiene basura y el sensor también arranca de
+// cero; en los demás reinicios vale lo guardado si el CRC cuadra
+bool hayEstadoRtc() {
+  esp_reset_reason_t motivo = esp_reset_reason();
+  if (motivo == ESP_RST_POWERON || motivo == ESP_RST_UNKNOWN) return false;
+  if (!estadoRtcValido(estadoRtc)) return false;
+  if (estadoRtc.reanudaciones >= MAX_REANUDACIONES) {
+    consola.println("Demasiados reinicios seguidos: se descarta el estado guardado");
+    invalidarEstadoRtc(estadoRtc);
+    return false;
   }
+  return true;
+}
+
+// Arranque en caliente: se restaura lo guardado y se concilia con el
+// estado real del sensor, que es el que manda. Si el sensor ya tiene el
+// resultado, la transición a READ_RESULT hace que loop() lo lea.
+void reanudarDesdeRtc() {
+  reanudaciones = estadoRtc.reanudaciones + 1;
+  consola.print("\nReinicio en caliente (motivo ");
+  consola.print((int)esp_reset_reason());
+  consola.println("): retomando la prueba");
+
+  idSujeto = estadoRtc.idSujeto;
+  sopladoAdaptativo = estadoRtc.sopladoAdaptativo;
+  adaptadorSoplado.tiempoEnSensor(estadoRtc.tiempoSoplado);
+  currentStatus = estadoRtc.estadoSensor;
+  entregaResultados = estadoRtc.entrega;
+  entradaEstadoMs = millis();
+
+  verificarEstado();
+
+  // En reposo con una prueba a medias: el sensor la abandonó mientras
+  // el ESP32 se reiniciaba
+  bool interrumpida = currentStatus == STATUS_IDLE &&
+                      estadoRtc.estadoSensor != STATUS_IDLE &&
+                      estadoRtc.estadoSensor != STATUS_READ_RESULT;
+  planificadorRetest.restaurar(estadoRtc.retest, millis(), interrumpida);
+  const RegistroPrueba* original =
+      planificadorRetest.buscar(planificadorRetest.pruebaPendiente());
+  if (original != nullptr) {
+    recordarPrueba(original->id, estadoRtc.secuenciaOriginal, original->marcaMs,
+                   original->resultado);
+    consola.print("Prueba confirmatoria de #");
+    consola.print(original->id);
+    consola.print(" pendiente en ");
+    consola.print(planificadorRetest.msHastaRetest(millis()) / 1000);
+    consola.println(" s");
+  }
+
+  if (interrumpida) {
+    consola.println("La prueba en curso se perdió: el sensor volvió a reposo");
+  } else if (entregaResultados.pendienteDeLeer()) {
+    consola.println("Resultado pendiente de leer en el sensor");
+  }
+}
+
+// Volcados guardados en la partición y, al final, el anillo actual con
+// número 0. tools/registro_vuelo/decodificar.py lee esta salida.
+void imprimirRegistroVuelo() {
+  uint8_t ranuras = ranurasVuelo();
+  if (ranuras == 0) consola.println("Sin partición \"vuelo\": sólo el anillo actual");
+  for (uint8_t i = 0; i < ranuras; i++) {
+    VolcadoVuelo volcado;
+    if (!leerVolcadoVuelo(i, volcado)) continue;
+    consola.print("VUELO volcado numero=");
+    consola.print(volcado.numero);
+    consola.print(" reinicio=");
+    consola.println(volcado.motivoReinicio);
+    uint8_t trozo[32];
+    for (uint32_t d = 0; d < sizeof(RegistroVuelo); d += sizeof(trozo)) {
+      size_t n = sizeof(RegistroVuelo) - d < sizeof(trozo) ? sizeof(RegistroVuelo) - d
+                                                           : sizeof(trozo);
+      if (!leerDatosVuelo(i, d, trozo, n)) break;
+      volcarHexVuelo(Serial, trozo, n);
+    }
+  }
+  consola.print("VUELO volcado numero=0 reinicio=");
+  consola.println((int)esp_reset_reason());
+  volcarHexVuelo(Serial, &registroVuelo, sizeof(registroVuelo));
+  consola.println("VUELO fin");
+}
+
+void imprimirPerfilesSoplado() {
+  consola.print("Tiempo de soplado ");
+  consola.print(sopladoAdaptativo ? "adaptativo" : "manual");
+  consola.print(", objetivo de interrupciones ");
+  consola.print(adaptadorSoplado.objetivo() * 100.0f);
+  consola.println(" %");
+  for (byte t = TIEMPO_SOPLADO_MINIMO_S; t <= TIEMPO_SOPLADO_MAXIMO_S; t++) {
+    const EstadisticaPerfil& p = adaptadorSoplado.estadistica(t);
+    if (p.soplidos == 0 && p.ciclos == 0) continue;
+    consola.print(t == adaptadorSoplado.perfilActual() ? " * " : "   ");
+    consola.print(t);
+    consola.print(" s: soplidos ");
+    consola.print(p.soplidos);
+    consola.print(", interrumpidos ");
+    consola.print(adaptadorSoplado.tasaFallos(t) * 100.0f);
+    consola.print(" % [");
+    consola.print(adaptadorSoplado.cotaInferiorFallos(t) * 100.0f);
+    consola.print(" - ");
+    consola.print(adaptadorSoplado.cotaSuperiorFallos(t) * 100.0f);
+    consola.print("]");
+    if (adaptadorSoplado.confirmado(t)) consola.print(" cumple");
+    consola.print(", ciclo medio ");
+    consola.print(adaptadorSoplado.cicloMedioMs(t) / 1000.0f);
+    consola.print(" s (");
+    consola.print(p.ciclos);
+    consola.println(" pruebas)");
+  }
+  consola.print("Ciclo medio de todas las pruebas: ");
+  consola.print(adaptadorSoplado.cicloMedioMs() / 1000.0f);
+  consola.println(" s");
+}
+
+DatosPanel datosPanel() {
+  DatosPanel d;
+  d.estado = currentStatus;
+  d.msEnEstado = millis() - entradaEstadoMs;
+  d.tiempoSoplado = adaptadorSoplado.tiempoConocido();
+  d.sopladoAdaptativo = sopladoAdaptativo;
+  d.resultadoPendiente = entregaResultados.pendienteDeLeer();
+  d.ultimo = entregaResultados.ultimo();
+  d.idConfirmatoria =
+      planificadorRetest.retestPendiente() ? planificadorRetest.pruebaPendiente() : 0;
+  d.msHastaConfirmatoria = planificadorRetest.msHastaRetest(millis());
+  d.idSujeto = idSujeto;
+  return d;
 }
 
 void setup() {
   Serial.begin(115200);
+  // Lo primero: el anillo de antes del reinicio se guarda en flash antes
+  // de que lo pisen los eventos de este arranque
+  iniciarRegistroVuelo();
+  bool falloGuardado = guardarVueloSiHuboFallo(esp_reset_reason());
+  registrarVuelo(VUELO_ARRANQUE, (uint8_t)esp_reset_reason());
+  gestorEnergia.iniciar(gestorEnergia.ahoraUs());
   
   // Iniciar puerto serial para el sensor con buffer más grande
   SensorSerial.begin(9600, SERIAL_8N1, 16, 17);
   SensorSerial.setRxBufferSize(256); // Aumentar buffer de recepción
+  indicadorAlarma.iniciar();
+  iniciarSubida();
+
+  // Tras un reinicio en caliente el sensor ya está estable y puede haber
+  // una prueba en marcha: no se espera
+  bool enCaliente = hayEstadoRtc();
+  if (!enCaliente) {
+    delay(5000); // Dar más tiempo para que todo se estabilice
+  }
   
-  delay(5000); // Dar más tiempo para que todo se estabilice
-  
-  Serial.println("\n\nSensor de Alcohol ZE29A-C2H5OH");
-  Serial.println("--------------------------------");
-  Serial.println("Comandos disponibles:");
-  Serial.println(" i - Iniciar nueva prueba");
-  Serial.println(" s - Verificar estado");
-  Serial.println(" r - Leer resultado");
-  Serial.println(" q - Consultar umbrales");
-  Serial.println(" t - Probar comunicación");
-  Serial.println(" b - Leer tiempo de soplado");
-  Serial.println(" c - Configurar tiempo de soplado");
-  Serial.println(" z - Reset comunicación");
-  delay(1000);
-  
-  // Verificar comunicación básica antes de iniciar
-  verificarEstado();
+  consola.println("\n\nSensor de Alcohol ZE29A-C2H5OH");
+  consola.println("--------------------------------");
+  consola.println("Comandos disponibles:");
+  consola.println(" i - Iniciar nueva prueba");
+  consola.println(" s - Verificar estado");
+  consola.println(" r - Leer resultado");
+  consola.println(" q - Consultar umbrales");
+  consola.println(" t - Probar comunicación (calidad del enlace)");
+  consola.println(" b - Leer tiempo de soplado");
+  consola.println(" c - Configurar tiempo de soplado");
+  consola.println(" z - Reset comunicación");
+  consola.println(" e - Consumo de energía");
+  consola.println(" x - Cancelar prueba confirmatoria");
+  consola.println(" n - Indicar número de sujeto");
+  consola.println(" m - Métricas (formato Prometheus)");
+  consola.println(" p - Perfiles de tiempo de soplado");
+  consola.println(" a - Alternar tiempo de soplado adaptativo/manual");
+  consola.println(" u - Estado de la subida de resultados");
+  consola.println(" v - Registro de vuelo (volcado hexadecimal)");
+  consola.println(" g - Perfilador: iniciar / detener y volcar muestras");
+  consola.println(" d - Panel a pantalla completa (terminal ANSI) / volver al registro");
+  if (falloGuardado) {
+    consola.println("El último reinicio fue por un fallo: registro de vuelo guardado ('v')");
+  }
+
+  if (enCaliente) {
+    reanudarDesdeRtc();
+  } else {
+    delay(1000);
+
+    // Verificar comunicación básica antes de iniciar
+    verificarEstado();
+  }
+
+  // La decisión de confirmatoria usa los umbrales del sensor, no los
+  // compilados ni los guardados antes del reinicio
+  if (!consultarUmbrales()) {
+    consola.println("No se pudieron leer los umbrales: se usan los últimos conocidos");
+  }
 }
 
 void loop() {
+  indicadorAlarma.actualizar(millis());
+
+  // Entregar los eventos pendientes a los suscriptores diferidos
+  TemaEstado::despachar();
+  TemaResultado::despachar();
+  TemaPrueba::despachar();
+  TemaFalloEnlace::despachar();
+  TemaConfiguracion::despachar();
+  guardarEstadoRtc();
+
   // Procesar comandos desde la consola serial
   if (Serial.available()) {
+    ultimaActividadConsola = millis();
     char cmd = Serial.read();
+    // En el panel sólo se atienden 'i', 'x' y 'd'; el resto de comandos
+    // escribe o pregunta por consola y vuelve antes al registro
+    if (panelActivo() && cmd != 'i' && cmd != 'x' && cmd != 'd' && cmd != '\r' &&
+        cmd != '\n') {
+      desactivarPanel();
+    }
     switch (cmd) {
       case 'i': // Iniciar prueba
-        iniciarPrueba();
+        iniciarPruebaManual();
         break;
-      case 'r': // Leer resultado
-        if (currentStatus == STATUS_READ_RESULT) {
-          leerResultado();
-        } else {
-          Serial.println("No hay resultado disponible para leer");
+      case 'x': // Cancelar prueba confirmatoria
+        if (planificadorRetest.retestPendiente()) {
+          planificadorRetest.cancelar();
+          consola.println("Prueba confirmatoria cancelada");
         }
         break;
+      case 'r': // Leer resultado
+        solicitarResultado();
+        break;
       case 's': // Consultar estado
         verificarEstado();
         break;
@@ -505,21 +1317,79 @@ void loop() {
         leerTiempoSoplado();
         break;
       case 'c': // Configurar tiempo de soplado
-        Serial.println("Introduzca el nuevo tiempo de soplado (1-10 segundos):");
+        consola.println("Introduzca el nuevo tiempo de soplado (1-10 segundos):");
         // Esperar entrada del usuario
+        gestorEnergia.empezarEsperaUart();
         while (!Serial.available()) {
-          delay(100);
+          gestorEnergia.esperarUart(Serial, 100);
         }
+        gestorEnergia.terminarEsperaUart();
         // Leer nuevo tiempo de soplado
         if (Serial.available()) {
           String input = Serial.readStringUntil('\n');
           byte nuevoTiempo = input.toInt();
           configurarTiempoSoplado(nuevoTiempo);
+          // Un valor puesto a mano no lo pisa la adaptación
+          if (sopladoAdaptativo) {
+            sopladoAdaptativo = false;
+            consola.println("Tiempo de soplado adaptativo desactivado ('a' para activarlo)");
+          }
         }
         break;
       case 'z': // Reset comunicación
         resetComunicacion();
         break;
+      case 'e': // Consumo de energía
+        imprimirEnergia();
+        break;
+      case 'n': // Número de sujeto de las próximas pruebas
+        consola.println("Introduzca el número de sujeto (0 para ninguno):");
+        gestorEnergia.empezarEsperaUart();
+        while (!Serial.available()) {
+          gestorEnergia.esperarUart(Serial, 100);
+        }
+        gestorEnergia.terminarEsperaUart();
+        if (Serial.available()) {
+          String input = Serial.readStringUntil('\n');
+          idSujeto = (uint32_t)input.toInt();
+          consola.print("Sujeto: ");
+          consola.println(idSujeto);
+        }
+        break;
+      case 'p': // Perfiles de tiempo de soplado
+        imprimirPerfilesSoplado();
+        break;
+      case 'a': // Alternar tiempo de soplado adaptativo
+        sopladoAdaptativo = !sopladoAdaptativo;
+        consola.print("Tiempo de soplado ");
+        consola.println(sopladoAdaptativo ? "adaptativo" : "manual");
+        break;
+      case 'm': // Métricas
+        exportarMetricas(Serial);
+        break;
+      case 'g': // Perfilador por muestreo del PC
+        if (perfilActivo()) {
+          detenerPerfil();
+          volcarPerfil(Serial);
+        } else if (iniciarPerfil()) {
+          consola.println("Perfilador en marcha ('g' para detenerlo y volcar)");
+        } else {
+          consola.println("No se pudo iniciar el perfilador");
+        }
+        break;
+      case 'v': // Registro de vuelo
+        imprimirRegistroVuelo();
+        break;
+      case 'u': // Estado de la subida
+        imprimirSubida();
+        break;
+      case 'd': // Panel a pantalla completa
+        if (panelActivo()) {
+          desactivarPanel();
+        } else {
+          activarPanel();
+        }
+        break;
     }
     
     // Limpiar buffer serial
@@ -528,15 +1398,80 @@ void loop() {
     }
   }
   
+  // Sondeo del estado durante una prueba: la tabla da la permanencia
+  // mínima de cada estado y antes de cumplirla no se pregunta. Los estados
+  // estables (IDLE, READ_RESULT) sólo cambian con un comando y no se sondean.
+  uint32_t enEstado = millis() - entradaEstadoMs;
+  uint32_t esperaSondeo = esperaSondeoMs(currentStatus, enEstado,
+                                         millis() - ultimoSondeoMs,
+                                         INTERVALO_SONDEO_MS);
+  if (esperaSondeo == 0) {
+    verificarEstado(false);
+    if (!avisoPermanencia && permanenciaExcedida(currentStatus, millis() - entradaEstadoMs)) {
+      avisoPermanencia = true;
+      registrarVuelo(VUELO_PERMANENCIA, currentStatus, 0, 0, millis() - entradaEstadoMs);
+      consola.print("Aviso: el sensor lleva más de lo esperado en el estado 0x");
+      consola.println(currentStatus, HEX);
+    }
+  }
+
   // Verificar estado periódicamente con menos frecuencia 
   // para no saturar la comunicación
   if (millis() - lastStatusCheck >= 3000) {
     lastStatusCheck = millis();
     
-    // Si hay resultado disponible para leer
-    if (currentStatus == STATUS_READ_RESULT && resultAvailable) {
+    // Si hay resultado disponible para leer; si la lectura falla se
+    // reintenta en la siguiente vuelta
+    if (currentStatus == STATUS_READ_RESULT && entregaResultados.pendienteDeLeer()) {
       leerResultado();
-      resultAvailable = false;
     }
   }
+
+  // Prueba confirmatoria: el precalentamiento arranca con antelación para
+  // que el sensor esté listo al cumplirse la espera mínima. Nunca con otro
+  // resultado sin leer, que iniciarPrueba() descartaría. Si el sujeto
+  // indicado ya es otro, la decide el operador con 'i' o 'x'.
+  static bool avisoOtroSujeto = false;
+  if (!planificadorRetest.debeIniciarRetest(millis())) {
+    avisoOtroSujeto = false;
+  } else if (!entregaResultados.pendienteDeLeer() &&
+             comandoPermitido(currentStatus, CMD_CAMBIAR_ESTADO, STATUS_PREHEATING)) {
+    if (planificadorRetest.sujetoCompatible(idSujeto)) {
+      consola.print("Iniciando prueba confirmatoria de #");
+      consola.println(planificadorRetest.pruebaPendiente());
+      planificadorRetest.marcarRetestIniciado();
+      iniciarPrueba(true);
+    } else if (!avisoOtroSujeto) {
+      avisoOtroSujeto = true;
+      consola.print("Confirmatoria de #");
+      consola.print(planificadorRetest.pruebaPendiente());
+      consola.println(" lista, pero el sujeto indicado es otro ('i' para iniciarla, 'x' para cancelarla)");
+    }
+  }
+
+  servicioSubida(millis());
+  aplicarOrdenConfiguracion();
+
+  if (msHastaPanel(millis()) == 0) actualizarPanel(datosPanel(), millis());
+
+  // Nada pendiente hasta la próxima verificación: esperar a baja frecuencia
+  // atento a la consola, o dormir si lleva tiempo sin usarse. Con el WiFi
+  // encendido no se duerme y se vuelve pronto a atender la subida.
+  unsigned long restante = 3000 - (millis() - lastStatusCheck);
+  if (restante > 3000) restante = 0;
+  esperaSondeo = esperaSondeoMs(currentStatus, millis() - entradaEstadoMs,
+                                millis() - ultimoSondeoMs, INTERVALO_SONDEO_MS);
+  if (esperaSondeo < restante) restante = esperaSondeo;
+  // Con el zumbador o la subida en marcha, pasos que no llegan a dormir
+  if ((indicadorAlarma.ocupado() || subidaActiva()) && restante > ESPERA_MINIMA_SUENO_MS) {
+    restante = ESPERA_MINIMA_SUENO_MS;
+  }
+  if (msHastaPanel(millis()) < restante) restante = msHastaPanel(millis());
+  // El sueño ligero para los temporizadores del perfilador
+  if (millis() - ultimaActividadConsola >= INACTIVIDAD_CONSOLA_MS && !subidaActiva() &&
+      !perfilActivo()) {
+    gestorEnergia.esperar(restante);
+  } else {
+    gestorEnergia.esperarUart(Serial, restante);
+  }
 }
\ No newline at end of file
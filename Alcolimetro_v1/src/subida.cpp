@@ -0,0 +1,256 @@
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <Preferences.h>
+#include <WiFi.h>
+#include "subida.h"
+#include "consola.h"
+#include "cola_persistente.h"
+#include "enlace_subida.h"
+#include "transporte_tcp.h"
+#include "metricas.h"
+
+#ifndef COLECTOR_PUERTO
+#define COLECTOR_PUERTO 5020
+#endif
+#ifndef COLECTOR_HOST
+#define COLECTOR_HOST ""
+#endif
+
+#define RUTA_COLA_SUBIDA "/littlefs/subida.bin"
+#define CAPACIDAD_COLA_SUBIDA 1024  // 48 KB en flash
+
+#define VERSION_FIRMWARE 1
+
+// Con el siguiente reintento más lejos que esto se apaga el WiFi
+#define APAGAR_WIFI_SI_ESPERA_MS 10000
+
+// Intercambio con el colector aunque no haya nada que subir, para recoger
+// órdenes de configuración
+#define PERIODO_SINCRONIZACION_MS (15UL * 60 * 1000)
+
+// La reserva de secuencias va en NVS, que no se borra al reformatear LittleFS
+class ReservaSecuenciasNvs : public ReservaSecuencias {
+public:
+  uint32_t leer() override {
+    if (!nvs.begin("subida", true)) return 0;
+    uint32_t tope = nvs.getUInt("tope", 0);
+    nvs.end();
+    return tope;
+  }
+  bool guardar(uint32_t tope) override {
+    if (!nvs.begin("subida", false)) return false;
+    bool ok = nvs.putUInt("tope", tope) == sizeof(tope);
+    nvs.end();
+    return ok;
+  }
+
+private:
+  Preferences nvs;
+};
+
+static ReservaSecuenciasNvs reservaSecuencias;
+static ColaPersistente colaSubida;
+static TransporteTcp transporteSubida(COLECTOR_HOST, COLECTOR_PUERTO);
+static EnlaceSubida* enlaceSubida = nullptr;
+
+static uint32_t idDispositivo() {
+  // Los 3 bytes bajos de la MAC son el fabricante, iguales en todos
+  return (uint32_t)(ESP.getEfuseMac() >> 16);
+}
+
+void iniciarSubida() {
+  if (!LittleFS.begin(true)) {
+    consola.println("Error al montar LittleFS: resultados sin cola de subida");
+    return;
+  }
+  if (!colaSubida.abrir(RUTA_COLA_SUBIDA, CAPACIDAD_COLA_SUBIDA, &reservaSecuencias)) {
+    consola.println("Error al abrir la cola de subida");
+    return;
+  }
+  static ConfigSubida config = CONFIG_SUBIDA_DEFECTO(idDispositivo());
+  static EnlaceSubida enlace(colaSubida, transporteSubida, config);
+  enlaceSubida = &enlace;
+}
+
+// Últimas pruebas encoladas, para enlazar la confirmatoria con su
+// original por secuencia (los id de prueba no sobreviven a un reinicio)
+struct PruebaEncolada {
+  uint32_t idPrueba;
+  uint32_t secuencia;
+  uint32_t marcaMs;
+  ResultadoPrueba resultado;
+};
+static PruebaEncolada ultimasPruebas[4];
+static uint8_t siguientePrueba = 0;
+
+// Configuración vigente: cada evento trae sólo un parámetro
+static RegistroConfiguracion configuracion = {0, 0, 0, 0, 0, 0, VERSION_FIRMWARE};
+
+static const PruebaEncolada* buscarPrueba(uint32_t idPrueba) {
+  for (const PruebaEncolada& p : ultimasPruebas) {
+    if (p.secuencia != 0 && p.idPrueba == idPrueba) return &p;
+  }
+  return nullptr;
+}
+
+uint32_t secuenciaPrueba(uint32_t idPrueba) {
+  const PruebaEncolada* p = buscarPrueba(idPrueba);
+  return p != nullptr ? p->secuencia : 0;
+}
+
+void recordarPrueba(uint32_t idPrueba, uint32_t secuencia, uint32_t marcaMs,
+                    const ResultadoPrueba& resultado) {
+  if (secuencia == 0 || buscarPrueba(idPrueba) != nullptr) return;
+  ultimasPruebas[siguientePrueba] = {idPrueba, secuencia, marcaMs, resultado};
+  siguientePrueba = (siguientePrueba + 1) % 4;
+}
+
+template <typename R>
+static uint32_t encolar(R& r) {
+  uint32_t secuencia = colaSubida.encolar(r);
+  if (secuencia == 0) {
+    consola.println("Error al guardar el registro en la cola de subida");
+  }
+  return secuencia;
+}
+
+void encolarPrueba(const EventoPruebaRegistrada& prueba) {
+  const PruebaEncolada* original =
+      prueba.confirmatoria ? buscarPrueba(prueba.idVinculado) : nullptr;
+
+  RegistroResultado r = {};
+  r.idDispositivo = idDispositivo();
+  r.marcaMs = prueba.marcaMs;
+  r.idSujeto = prueba.idSujeto;
+  r.secuenciaVinculada = original != nullptr ? original->secuencia : 0;
+  r.alcoholMg100ml = prueba.resultado.alcoholMg100ml;
+  r.alarma = prueba.resultado.alarma;
+  r.banderas = prueba.confirmatoria ? BANDERA_CONFIRMATORIA : 0;
+  r.timeoutsEnlace = prueba.salud.timeoutsEnlace;
+  r.soplidosInterrumpidos = prueba.salud.soplidosInterrumpidos;
+  r.precalentamientoMs = prueba.salud.precalentamientoMs;
+  if (encolar(r) == 0) return;
+
+  PruebaEncolada& p = ultimasPruebas[siguientePrueba];
+  siguientePrueba = (siguientePrueba + 1) % 4;
+  p = {prueba.idPrueba, r.secuencia, prueba.marcaMs, prueba.resultado};
+
+  if (!prueba.cierraSesion) return;
+  // El resultado final de la sesión es el menor de la pareja
+  RegistroSesion sesion = {};
+  sesion.idDispositivo = r.idDispositivo;
+  sesion.inicioMs = original != nullptr ? original->marcaMs : r.marcaMs;
+  sesion.finMs = r.marcaMs;
+  sesion.idSujeto = r.idSujeto;
+  sesion.numPruebas = original != nullptr ? 2 : 1;
+  sesion.secuenciaFinal = r.secuencia;
+  sesion.alcoholFinalMg100ml = r.alcoholMg100ml;
+  sesion.alarmaFinal = r.alarma;
+  if (original != nullptr &&
+      original->resultado.alcoholMg100ml < r.alcoholMg100ml) {
+    sesion.secuenciaFinal = original->secuencia;
+    sesion.alcoholFinalMg100ml = original->resultado.alcoholMg100ml;
+    sesion.alarmaFinal = original->resultado.alarma;
+  }
+  encolar(sesion);
+}
+
+void encolarConfiguracion(const EventoConfiguracion& config) {
+  if (config.parametro == CONFIG_TIEMPO_SOPLADO) {
+    if (configuracion.tiempoSopladoS == config.valor) return;
+    configuracion.tiempoSopladoS = config.valor;
+  } else {
+    if (configuracion.umbralBebido == config.valor &&
+        configuracion.umbralEbrio == config.valor2) {
+      return;
+    }
+    configuracion.umbralBebido = config.valor;
+    configuracion.umbralEbrio = config.valor2;
+  }
+  configuracion.idDispositivo = idDispositivo();
+  configuracion.marcaMs = config.marcaMs;
+  encolar(configuracion);
+}
+
+bool tomarOrdenConfiguracion(OrdenConfiguracion& orden) {
+  return enlaceSubida != nullptr && enlaceSubida->tomarOrden(orden);
+}
+
+void confirmarComando(const ComandoOrden& comando, uint8_t estado, uint16_t valorLeido) {
+  RegistroConfirmacion r = {};
+  r.idDispositivo = idDispositivo();
+  r.marcaMs = millis();
+  r.idOrden = comando.idOrden;
+  r.comando = comando.comando;
+  r.valorPedido = comando.valor;
+  r.estado = estado;
+  r.valorLeido = valorLeido;
+  encolar(r);
+}
+
+static void apagarWifi() {
+  if (WiFi.getMode() == WIFI_OFF) return;
+  transporteSubida.desconectar();
+  WiFi.disconnect(true);
+  WiFi.mode(WIFI_OFF);
+}
+
+void servicioSubida(uint32_t ahoraMs) {
+  metricas::fijar<M_PENDIENTES_SUBIDA>(colaSubida.pendientes());
+  static uint32_t invalidosContados = 0;
+  metricas::incrementar<M_REGISTROS_INVALIDOS_SUBIDA>(
+      0, colaSubida.invalidos() - invalidosContados);
+  invalidosContados = colaSubida.invalidos();
+#ifdef WIFI_SSID
+  if (enlaceSubida == nullptr) return;
+  if (!enlaceSubida->esperandoAck() &&
+      ahoraMs - enlaceSubida->ultimaSincronizacionMs() >= PERIODO_SINCRONIZACION_MS) {
+    enlaceSubida->sincronizar();
+  }
+  bool hayTrabajo = (colaSubida.pendientes() > 0 || enlaceSubida->sincronizacionPendiente()) &&
+                    (enlaceSubida->esperandoAck() ||
+                     enlaceSubida->msHastaReintento(ahoraMs) < APAGAR_WIFI_SI_ESPERA_MS);
+  if (!hayTrabajo) {
+    apagarWifi();
+    return;
+  }
+  if (WiFi.getMode() == WIFI_OFF) {
+    WiFi.mode(WIFI_STA);
+    WiFi.begin(WIFI_SSID, WIFI_CLAVE);
+  }
+  // Sin WiFi todavía conectar() falla y el enlace programa el reintento
+  enlaceSubida->servicio(ahoraMs);
+#else
+  (void)ahoraMs;
+#endif
+}
+
+bool subidaActiva() {
+  return WiFi.getMode() != WIFI_OFF;
+}
+
+void imprimirSubida() {
+  if (enlaceSubida == nullptr) {
+    consola.println("Subida no disponible");
+    return;
+  }
+  consola.print("Registros pendientes de subir: ");
+  consola.println(colaSubida.pendientes());
+  consola.print("Confirmados por el colector: ");
+  consola.println(enlaceSubida->registrosConfirmados());
+  consola.print("Lotes enviados: ");
+  consola.print(enlaceSubida->lotesEnviados());
+  consola.print(", fallos: ");
+  consola.println(enlaceSubida->fallos());
+  consola.print("Descartados por cola llena: ");
+  consola.println(colaSubida.descartados());
+  consola.print("Descartados por ranura dañada: ");
+  consola.println(colaSubida.invalidos());
+#ifdef WIFI_SSID
+  consola.print("Próximo intento en: ");
+  consola.print(enlaceSubida->msHastaReintento(millis()) / 1000);
+  consola.println(" s");
+#else
+  consola.println("WiFi no configurado (WIFI_SSID): los registros quedan en cola");
+#endif
+}
@@ -0,0 +1,465 @@
+/*
+ * Ajuste por Monte Carlo de la política de espera y reintento del enlace
+ * con el sensor (politica_enlace.h), en el host.
+ *
+ * Cada sesión es una prueba completa hecha como la hace el firmware:
+ * 0x85 y esperarEstado() desde iniciarPrueba(), 0x87 para precalentar,
+ * sondeo del estado con la tabla de maquina_estados.h hasta READ_RESULT
+ * y lectura del resultado en el tic de 3 s de loop(), que se repite en el
+ * tic siguiente si falla. El sensor tiene tiempos aleatorios de
+ * precalentamiento, espera del soplido, soplidos interrumpidos y cálculo.
+ * El enlace pierde tramas sueltas y en ráfagas, tiene latencia log-normal
+ * y a veces el sensor tarda mucho en contestar.
+ *
+ * Una sesión falla si 0x87 se queda sin respuesta (el firmware cree que
+ * el sensor sigue en reposo, que no se sondea, y la prueba se pierde) o
+ * si no hay resultado en PLAZO_SESION_MS. En los dos casos el operador
+ * espera un resultado que no llega: cada fallo cuesta el plazo entero.
+ *
+ * Para cada combinación de timeout, reintentos e intervalo de sondeo se
+ * simulan las mismas sesiones del sensor (números aleatorios comunes),
+ * repartidas entre todos los núcleos. Por política se informa del ciclo
+ * medio y p95 de las pruebas que terminan, la probabilidad de fallo, el
+ * tiempo esperado hasta tener un resultado repitiendo la prueba tras cada
+ * fallo, los comandos enviados y el tiempo que el bucle principal pasa
+ * bloqueado esperando respuestas. La lista sale ordenada por tiempo
+ * esperado.
+ *
+ *   pio run -e ajuste_enlace
+ *   .pio/build/ajuste_enlace/program -n 20000 -p 0.02 -b 0.02
+ */
+#include <algorithm>
+#include <atomic>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "maquina_estados.h"
+#include "politica_enlace.h"
+
+#define PLAZO_SESION_MS 120000.0
+#define TIC_RESULTADO_MS 3000.0      // lastStatusCheck en loop()
+#define ESPERA_ESTADO_MS 500.0       // esperarEstado()
+#define PLAZO_ESPERA_ESTADO_MS 10000.0
+#define TRAMA_MS 9.4                 // 9 bytes a 9600 baudios
+#define SESIONES_POR_TAREA 500
+
+struct Escenario {
+  // Enlace
+  double perdida;              // por trama, ida o vuelta
+  double latenciaMedianaMs;    // proceso del sensor, sin las tramas
+  double sigmaLatencia;
+  double probBloqueo;          // el sensor tarda en contestar
+  double bloqueoMinMs;
+  double bloqueoMaxMs;
+  double rafagasPorMinuto;
+  double rafagaMediaMs;
+  double perdidaEnRafaga;
+  // Sensor y usuario
+  double precalentamientoMinMs;
+  double precalentamientoMaxMs;
+  double esperaSoplidoMedianaMs;
+  double sopladoMs;
+  double probInterrupcion;
+  double calculoMinMs;
+  double calculoMaxMs;
+};
+
+static Escenario escenario = {
+  0.02, 10, 0.6, 0.02, 200, 1500, 0.5, 2000, 0.8,
+  8500, 12000, 4000, 5000, 0.15, 800, 2500,
+};
+
+struct Politica {
+  PoliticaEnlace enlace;
+  uint16_t intervaloSondeoMs;   // INTERVALO_SONDEO_MS
+};
+
+// Fases del sensor desde que acepta 0x87; la última es READ_RESULT
+struct Fase {
+  double finMs;
+  uint8_t estado;
+};
+
+class Sensor {
+public:
+  void generar(std::mt19937_64& rng) {
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    std::lognormal_distribution<double> espera(log(escenario.esperaSoplidoMedianaMs), 0.7);
+    double t = 0;
+    numFases = 0;
+    t += escenario.precalentamientoMinMs +
+         u(rng) * (escenario.precalentamientoMaxMs - escenario.precalentamientoMinMs);
+    anadir(t, STATUS_PREHEATING);
+    for (int soplido = 0;; soplido++) {
+      t += std::min(espera(rng), 55000.0);
+      anadir(t, STATUS_WAITING_FOR_BLOW);
+      if (soplido < 3 && u(rng) < escenario.probInterrupcion) {
+        t += escenario.sopladoMs * (0.2 + 0.7 * u(rng));
+        anadir(t, STATUS_BLOWING);
+        t += 1000 + 2000 * u(rng);
+        anadir(t, STATUS_BLOW_INTERRUPTED);
+        continue;
+      }
+      t += escenario.sopladoMs;
+      anadir(t, STATUS_BLOWING);
+      break;
+    }
+    t += escenario.calculoMinMs + u(rng) * (escenario.calculoMaxMs - escenario.calculoMinMs);
+    anadir(t, STATUS_CALCULATING);
+    inicioMs = -1;
+  }
+
+  void iniciar(double ahoraMs) {
+    if (inicioMs < 0) inicioMs = ahoraMs;
+  }
+
+  uint8_t estadoEn(double ahoraMs) const {
+    if (inicioMs < 0 || ahoraMs < inicioMs) return STATUS_IDLE;
+    double t = ahoraMs - inicioMs;
+    for (uint8_t i = 0; i < numFases; i++) {
+      if (t < fases[i].finMs) return fases[i].estado;
+    }
+    return STATUS_READ_RESULT;
+  }
+
+private:
+  void anadir(double finMs, uint8_t estado) {
+    if (numFases < sizeof(fases) / sizeof(fases[0])) fases[numFases++] = {finMs, estado};
+  }
+
+  Fase fases[16];
+  uint8_t numFases = 0;
+  double inicioMs = -1;
+};
+
+// Una trama enviada: si el sensor la procesó, cuándo, y si la respuesta
+// llega y cuándo
+struct Intercambio {
+  bool procesada;
+  double procesoMs;
+  bool llega;
+  double llegadaMs;
+};
+
+// Pérdidas sueltas y ráfagas de Poisson (modelo de Gilbert simplificado)
+class Enlace {
+public:
+  explicit Enlace(std::mt19937_64& rng) : rng(rng) { siguienteRafaga(0); }
+
+  Intercambio enviar(double envioMs) {
+    std::lognormal_distribution<double> proceso(log(escenario.latenciaMedianaMs),
+                                                escenario.sigmaLatencia);
+    Intercambio r = {false, 0, false, 0};
+    if (perdida(envioMs)) return r;
+    r.procesada = true;
+    r.procesoMs = envioMs + TRAMA_MS + proceso(rng);
+    if (uniforme(rng) < escenario.probBloqueo) {
+      r.procesoMs += escenario.bloqueoMinMs +
+                     uniforme(rng) * (escenario.bloqueoMaxMs - escenario.bloqueoMinMs);
+    }
+    r.llegadaMs = r.procesoMs + TRAMA_MS;
+    r.llega = !perdida(r.procesoMs);
+    return r;
+  }
+
+private:
+  bool perdida(double ahoraMs) {
+    while (ahoraMs >= finRafagaMs) siguienteRafaga(finRafagaMs);
+    double p = ahoraMs >= inicioRafagaMs ? escenario.perdidaEnRafaga : escenario.perdida;
+    return uniforme(rng) < p;
+  }
+
+  void siguienteRafaga(double desdeMs) {
+    if (escenario.rafagasPorMinuto <= 0) {
+      inicioRafagaMs = finRafagaMs = INFINITY;
+      return;
+    }
+    std::exponential_distribution<double> entre(escenario.rafagasPorMinuto / 60000.0);
+    std::exponential_distribution<double> duracion(1.0 / escenario.rafagaMediaMs);
+    inicioRafagaMs = desdeMs + entre(rng);
+    finRafagaMs = inicioRafagaMs + duracion(rng);
+  }
+
+  std::mt19937_64& rng;
+  std::uniform_real_distribution<double> uniforme{0.0, 1.0};
+  double inicioRafagaMs = 0;
+  double finRafagaMs = 0;
+};
+
+enum CausaFallo : uint8_t { SIN_FALLO = 0, FALLO_ARRANQUE, FALLO_PLAZO };
+
+struct ResultadoSesion {
+  double cicloMs;       // sólo si causa == SIN_FALLO
+  CausaFallo causa;
+  uint32_t comandos;
+  double bloqueoMs;
+};
+
+// El firmware de una prueba, con el reloj simulado
+class Sesion {
+public:
+  Sesion(const Politica& politica, Sensor& sensor, Enlace& enlace)
+    : politica(politica), sensor(sensor), enlace(enlace) {}
+
+  ResultadoSesion ejecutar(double faseTicMs) {
+    // iniciarPrueba()
+    uint8_t estado;
+    if (consultar(CMD_LEER_ESTADO, &estado)) fijarEstado(estado);
+    for (double t0 = ahora; ahora - t0 < PLAZO_ESPERA_ESTADO_MS;) {
+      if (consultar(CMD_LEER_ESTADO, &estado)) fijarEstado(estado);
+      if (estadoFirmware == STATUS_IDLE) break;
+      ahora += ESPERA_ESTADO_MS;
+    }
+    if (!consultar(CMD_CAMBIAR_ESTADO, nullptr)) return fallo(FALLO_ARRANQUE);
+    fijarEstado(STATUS_PREHEATING);
+
+    // loop()
+    double proximoTic = ahora + faseTicMs;
+    bool pendiente = false;
+    while (ahora < PLAZO_SESION_MS) {
+      uint32_t espera = esperaSondeoMs(estadoFirmware, (uint32_t)(ahora - entradaMs),
+                                       (uint32_t)(ahora - ultimoSondeoMs),
+                                       politica.intervaloSondeoMs);
+      if (espera == 0) {
+        ultimoSondeoMs = ahora;
+        if (consultar(CMD_LEER_ESTADO, &estado) && estado != estadoFirmware) {
+          if (estado == STATUS_READ_RESULT) pendiente = true;
+          fijarEstado(estado);
+        }
+        continue;
+      }
+      if (ahora >= proximoTic) {
+        proximoTic = ahora + TIC_RESULTADO_MS;
+        if (estadoFirmware == STATUS_READ_RESULT && pendiente &&
+            consultar(CMD_LEER_RESULTADO, nullptr)) {
+          return {ahora, SIN_FALLO, comandos, bloqueoMs};
+        }
+        continue;
+      }
+      ahora = std::min(ahora + espera, proximoTic);
+    }
+    return fallo(FALLO_PLAZO);
+  }
+
+private:
+  ResultadoSesion fallo(CausaFallo causa) { return {0, causa, comandos, bloqueoMs}; }
+
+  void fijarEstado(uint8_t estado) {
+    if (estado != estadoFirmware) entradaMs = ahora;
+    estadoFirmware = estado;
+  }
+
+  // enviarComando() y leerRespuesta(): el primer intento espera además
+  // la espera del comando; cada reenvío vacía el buffer de recepción, así
+  // que vale la primera respuesta (de cualquier intento) que llegue
+  // dentro de la ventana del intento en curso
+  bool consultar(uint8_t comando, uint8_t* estado) {
+    double esperaComando =
+        comando == CMD_CAMBIAR_ESTADO ? ESPERA_COMANDO_LENTO_MS : ESPERA_COMANDO_MS;
+    uint8_t intentos = intentosRespuesta(politica.enlace, comando);
+    double timeout = timeoutIntentoMs(politica.enlace, comando);
+    Intercambio enviados[8];
+    double inicio = ahora;
+    double ventanaDesde = ahora;
+    double ventanaHasta = ahora + esperaComando + timeout;
+    for (uint8_t k = 0; k < intentos && k < 8; k++) {
+      enviados[k] = enlace.enviar(ventanaDesde);
+      comandos++;
+      if (comando == CMD_CAMBIAR_ESTADO && enviados[k].procesada) {
+        sensor.iniciar(enviados[k].procesoMs);
+      }
+      const Intercambio* primero = nullptr;
+      for (uint8_t j = 0; j <= k; j++) {
+        const Intercambio& e = enviados[j];
+        if (e.llega && e.llegadaMs >= ventanaDesde && e.llegadaMs <= ventanaHasta &&
+            (primero == nullptr || e.llegadaMs < primero->llegadaMs)) {
+          primero = &e;
+        }
+      }
+      if (primero != nullptr) {
+        ahora = primero->llegadaMs;
+        bloqueoMs += ahora - inicio;
+        if (estado != nullptr) *estado = sensor.estadoEn(primero->procesoMs);
+        return true;
+      }
+      ventanaDesde = ventanaHasta;
+      ventanaHasta += timeout;
+    }
+    ahora = ventanaDesde;
+    bloqueoMs += ahora - inicio;
+    return false;
+  }
+
+  const Politica& politica;
+  Sensor& sensor;
+  Enlace& enlace;
+  double ahora = 0;
+  uint8_t estadoFirmware = STATUS_IDLE;
+  double entradaMs = 0;
+  double ultimoSondeoMs = 0;
+  uint32_t comandos = 0;
+  double bloqueoMs = 0;
+};
+
+// Generador reproducible por sesión y uso
+static std::mt19937_64 generador(uint64_t semilla, uint64_t sesion, uint64_t uso) {
+  std::seed_seq s{(uint32_t)semilla, (uint32_t)(semilla >> 32), (uint32_t)sesion,
+                  (uint32_t)(sesion >> 32), (uint32_t)uso};
+  return std::mt19937_64(s);
+}
+
+static ResultadoSesion simular(const Politica& politica, uint64_t semilla, uint32_t sesion) {
+  // Sensor y fase del tic iguales en todas las políticas
+  std::mt19937_64 rngSensor = generador(semilla, sesion, 1);
+  Sensor sensor;
+  sensor.generar(rngSensor);
+  double faseTic = std::uniform_real_distribution<double>(0, TIC_RESULTADO_MS)(rngSensor);
+  std::mt19937_64 rngEnlace = generador(semilla, sesion, 2);
+  Enlace enlace(rngEnlace);
+  Sesion s(politica, sensor, enlace);
+  return s.ejecutar(faseTic);
+}
+
+struct Resumen {
+  Politica politica;
+  uint32_t sesiones;
+  uint32_t fallos;
+  uint32_t fallosArranque;
+  double cicloMedioMs;
+  double cicloP95Ms;
+  double tiempoEsperadoMs;
+  double comandosMedios;
+  double bloqueoMedioMs;
+};
+
+static Resumen resumir(const Politica& p, const std::vector<ResultadoSesion>& r) {
+  Resumen s = {p, (uint32_t)r.size(), 0, 0, 0, 0, 0, 0, 0};
+  std::vector<double> ciclos;
+  ciclos.reserve(r.size());
+  for (const ResultadoSesion& x : r) {
+    s.comandosMedios += x.comandos;
+    s.bloqueoMedioMs += x.bloqueoMs;
+    if (x.causa != SIN_FALLO) {
+      s.fallos++;
+      if (x.causa == FALLO_ARRANQUE) s.fallosArranque++;
+    } else {
+      ciclos.push_back(x.cicloMs);
+      s.cicloMedioMs += x.cicloMs;
+    }
+  }
+  s.comandosMedios /= r.size();
+  s.bloqueoMedioMs /= r.size();
+  if (!ciclos.empty()) {
+    s.cicloMedioMs /= ciclos.size();
+    std::sort(ciclos.begin(), ciclos.end());
+    s.cicloP95Ms = ciclos[ciclos.size() * 95 / 100];
+  }
+  // Intentos fallidos hasta el primero bueno: geométrica de media f/(1-f)
+  double f = (double)s.fallos / s.sesiones;
+  s.tiempoEsperadoMs = f < 1 ? s.cicloMedioMs + f / (1 - f) * PLAZO_SESION_MS : INFINITY;
+  return s;
+}
+
+static void imprimir(const char* prefijo, const Resumen& s) {
+  double f = (double)s.fallos / s.sesiones;
+  printf("%stimeout_ms=%u reintentos=%u sondeo_ms=%u tiempo_esperado_ms=%.0f "
+         "ciclo_medio_ms=%.0f ciclo_p95_ms=%.0f fallo=%.4f+-%.4f fallo_arranque=%.4f "
+         "comandos=%.1f bloqueo_medio_ms=%.0f bloqueo_max_ms=%u\n",
+         prefijo, s.politica.enlace.timeoutRespuestaMs, s.politica.enlace.reintentos,
+         s.politica.intervaloSondeoMs, s.tiempoEsperadoMs, s.cicloMedioMs, s.cicloP95Ms, f,
+         1.96 * sqrt(f * (1 - f) / s.sesiones), (double)s.fallosArranque / s.sesiones,
+         s.comandosMedios, s.bloqueoMedioMs,
+         esperaMaximaRespuestaMs(s.politica.enlace, ESPERA_COMANDO_MS));
+}
+
+int main(int argc, char** argv) {
+  uint32_t sesiones = 20000;
+  uint64_t semilla = 1;
+  unsigned hilos = std::thread::hardware_concurrency();
+  int c;
+  while ((c = getopt(argc, argv, "n:p:l:b:r:d:i:s:j:")) != -1) {
+    switch (c) {
+      case 'n': sesiones = (uint32_t)atoi(optarg); break;
+      case 'p': escenario.perdida = atof(optarg); break;
+      case 'l': escenario.latenciaMedianaMs = atof(optarg); break;
+      case 'b': escenario.probBloqueo = atof(optarg); break;
+      case 'r': escenario.rafagasPorMinuto = atof(optarg); break;
+      case 'd': escenario.rafagaMediaMs = atof(optarg); break;
+      case 'i': escenario.probInterrupcion = atof(optarg); break;
+      case 's': semilla = strtoull(optarg, nullptr, 10); break;
+      case 'j': hilos = (unsigned)atoi(optarg); break;
+      default:
+        fprintf(stderr,
+                "uso: %s [-n sesiones] [-p pérdida_por_trama] [-l latencia_mediana_ms] "
+                "[-b prob_bloqueo] [-r ráfagas_por_minuto] [-d ráfaga_media_ms] "
+                "[-i prob_interrupción] [-s semilla] [-j hilos]\n",
+                argv[0]);
+        return 2;
+    }
+  }
+  if (sesiones == 0) sesiones = 1;
+  if (hilos == 0) hilos = 1;
+
+  const uint16_t timeouts[] = {100, 150, 250, 500, 1000, 3000};
+  const uint8_t reintentos[] = {0, 1, 2, 3};
+  const uint16_t sondeos[] = {250, 500, 1000};
+  std::vector<Politica> politicas;
+  for (uint16_t t : timeouts) {
+    for (uint8_t r : reintentos) {
+      for (uint16_t s : sondeos) politicas.push_back({{t, r}, s});
+    }
+  }
+  const Politica defecto = {POLITICA_ENLACE_DEFECTO, 500};
+
+  // Tareas de SESIONES_POR_TAREA sesiones de una política; cada una
+  // escribe en su tramo del vector de la política
+  std::vector<std::vector<ResultadoSesion>> resultados(
+      politicas.size(), std::vector<ResultadoSesion>(sesiones));
+  uint32_t tareasPorPolitica = (sesiones + SESIONES_POR_TAREA - 1) / SESIONES_POR_TAREA;
+  uint32_t totalTareas = tareasPorPolitica * (uint32_t)politicas.size();
+  std::atomic<uint32_t> siguiente{0};
+  std::vector<std::thread> trabajadores;
+  for (unsigned h = 0; h < hilos; h++) {
+    trabajadores.emplace_back([&] {
+      for (uint32_t t; (t = siguiente.fetch_add(1)) < totalTareas;) {
+        uint32_t p = t / tareasPorPolitica;
+        uint32_t desde = (t % tareasPorPolitica) * SESIONES_POR_TAREA;
+        uint32_t hasta = std::min(desde + SESIONES_POR_TAREA, sesiones);
+        for (uint32_t i = desde; i < hasta; i++) {
+          resultados[p][i] = simular(politicas[p], semilla, i);
+        }
+      }
+    });
+  }
+  for (std::thread& t : trabajadores) t.join();
+
+  std::vector<Resumen> resumenes;
+  const Resumen* actual = nullptr;
+  for (size_t p = 0; p < politicas.size(); p++) {
+    resumenes.push_back(resumir(politicas[p], resultados[p]));
+  }
+  std::sort(resumenes.begin(), resumenes.end(), [](const Resumen& a, const Resumen& b) {
+    return a.tiempoEsperadoMs < b.tiempoEsperadoMs;
+  });
+  for (const Resumen& s : resumenes) {
+    if (s.politica.enlace.timeoutRespuestaMs == defecto.enlace.timeoutRespuestaMs &&
+        s.politica.enlace.reintentos == defecto.enlace.reintentos &&
+        s.politica.intervaloSondeoMs == defecto.intervaloSondeoMs) {
+      actual = &s;
+    }
+  }
+
+  printf("sesiones=%u hilos=%u perdida=%.3f latencia_mediana_ms=%.0f bloqueo=%.3f "
+         "rafagas_min=%.2f rafaga_media_ms=%.0f\n",
+         sesiones, hilos, escenario.perdida, escenario.latenciaMedianaMs,
+         escenario.probBloqueo, escenario.rafagasPorMinuto, escenario.rafagaMediaMs);
+  for (const Resumen& s : resumenes) imprimir("", s);
+  printf("\n");
+  imprimir("recomendada ", resumenes.front());
+  if (actual != nullptr) imprimir("actual ", *actual);
+  return 0;
+}
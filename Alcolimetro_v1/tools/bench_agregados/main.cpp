@@ -0,0 +1,154 @@
+/*
+ * Benchmark de lib/AgregadosFlota en el host.
+ *
+ * Genera 'dias' de pruebas de una flota repartida en sitios (de media una
+ * prueba por equipo cada 'intervalo' minutos, en orden de llegada
+ * desordenado dentro de cada hora y con un 1 % de repetidos) y mide la
+ * anotación y las consultas de intervalos al azar de los tres ámbitos,
+ * desde una hora hasta todo el periodo. Cada consulta se compara con la
+ * suma directa de los resultados en bruto.
+ *
+ *   pio run -e bench_agregados && .pio/build/bench_agregados/program -n 1000 -d 60
+ */
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+#include "agregados_flota.h"
+
+struct Prueba {
+  uint32_t idDispositivo;
+  uint32_t secuencia;
+  int64_t instante;
+  uint16_t alcoholMg100ml;
+  uint8_t alarma;
+};
+
+// 1 de enero de 2026
+#define INICIO_BENCH 1767225600LL
+
+static double percentil(std::vector<double> v, double p) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[(size_t)(p * (v.size() - 1))];
+}
+
+int main(int argc, char** argv) {
+  uint32_t numEquipos = 1000;
+  uint32_t numSitios = 50;
+  uint32_t dias = 60;
+  double intervaloMin = 20;
+  uint32_t consultas = 20000;
+  uint64_t semilla = 1;
+  int c;
+  while ((c = getopt(argc, argv, "n:S:d:i:c:s:")) != -1) {
+    switch (c) {
+      case 'n': numEquipos = (uint32_t)atoi(optarg); break;
+      case 'S': numSitios = (uint32_t)atoi(optarg); break;
+      case 'd': dias = (uint32_t)atoi(optarg); break;
+      case 'i': intervaloMin = atof(optarg); break;
+      case 'c': consultas = (uint32_t)atoi(optarg); break;
+      case 's': semilla = strtoull(optarg, nullptr, 10); break;
+      default:
+        fprintf(stderr, "uso: %s [-n equipos] [-S sitios] [-d dias] [-i intervalo_min] "
+                        "[-c consultas] [-s semilla]\n", argv[0]);
+        return 2;
+    }
+  }
+  if (numEquipos == 0 || numSitios == 0 || dias == 0 || intervaloMin <= 0) {
+    fprintf(stderr, "parámetros no válidos\n");
+    return 2;
+  }
+
+  std::mt19937_64 rng(semilla);
+  std::uniform_real_distribution<double> u(0, 1);
+  std::vector<uint32_t> siguiente(numEquipos, 0);
+  std::vector<Prueba> pruebas;
+  int64_t fin = INICIO_BENCH + (int64_t)dias * 86400;
+  double porHora = 60 / intervaloMin;
+  for (int64_t hora = INICIO_BENCH; hora < fin; hora += 3600) {
+    size_t desde = pruebas.size();
+    for (uint32_t e = 0; e < numEquipos; e++) {
+      uint32_t n = std::poisson_distribution<uint32_t>(porHora)(rng);
+      for (uint32_t k = 0; k < n; k++) {
+        Prueba p;
+        p.idDispositivo = e;
+        p.secuencia = siguiente[e]++;
+        p.instante = hora + (int64_t)(u(rng) * 3600);
+        p.alcoholMg100ml = (uint16_t)(u(rng) < 0.1 ? rng() % 150 : 0);
+        p.alarma = p.alcoholMg100ml >= 80 ? 2 : (p.alcoholMg100ml >= 20 ? 1 : 0);
+        pruebas.push_back(p);
+      }
+    }
+    // Equipos distintos intercalados, cada uno en su orden de secuencia
+    std::stable_sort(pruebas.begin() + desde, pruebas.end(),
+                     [](const Prueba& a, const Prueba& b) {
+                       return a.secuencia < b.secuencia;
+                     });
+  }
+
+  AgregadosFlota agregados(UINT32_MAX, UINT32_MAX);
+  uint64_t repetidos = 0;
+  auto inicio = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < pruebas.size(); i++) {
+    const Prueba& p = pruebas[i];
+    agregados.anotar(p.idDispositivo, p.idDispositivo % numSitios, p.secuencia, p.instante,
+                     p.alcoholMg100ml, p.alarma);
+    // El equipo reenvía lo anterior cuando se pierde un ACK
+    if (i > 0 && u(rng) < 0.01) {
+      const Prueba& q = pruebas[i - 1];
+      if (!agregados.anotar(q.idDispositivo, q.idDispositivo % numSitios, q.secuencia,
+                            q.instante, q.alcoholMg100ml, q.alarma)) {
+        repetidos++;
+      }
+    }
+  }
+  double segundos = std::chrono::duration<double>(std::chrono::steady_clock::now() - inicio).count();
+  printf("bench=agregados anotar_ops_s=%.0f ns_op=%.2f\n", pruebas.size() / segundos,
+         segundos * 1e9 / pruebas.size());
+  printf("pruebas=%zu repetidos_descartados=%llu series=%zu cubetas=%zu\n", pruebas.size(),
+         (unsigned long long)repetidos, agregados.series(), agregados.cubetas());
+
+  std::vector<double> microsegundos;
+  uint32_t errores = 0;
+  size_t volatil = 0;  // evita que se descarten las consultas
+  for (uint32_t i = 0; i < consultas; i++) {
+    AmbitoAgregado ambito = (AmbitoAgregado)(rng() % 3);
+    uint32_t id = ambito == AMBITO_SITIO ? (uint32_t)(rng() % numSitios)
+                                         : (uint32_t)(rng() % numEquipos);
+    int64_t horas = (int64_t)dias * 24;
+    int64_t h0 = (int64_t)(rng() % horas);
+    int64_t h1 = h0 + 1 + (int64_t)(rng() % (horas - h0));
+    int64_t desde = INICIO_BENCH + h0 * 3600, hasta = INICIO_BENCH + h1 * 3600;
+
+    auto t0 = std::chrono::steady_clock::now();
+    Agregado r = agregados.consultar(ambito, id, desde, hasta);
+    auto t1 = std::chrono::steady_clock::now();
+    microsegundos.push_back(std::chrono::duration<double, std::micro>(t1 - t0).count());
+    volatil += r.pruebas;
+
+    // Las primeras, contra los resultados en bruto
+    if (i >= 200) continue;
+    Agregado esperado = {};
+    for (const Prueba& p : pruebas) {
+      if (p.instante < desde || p.instante >= hasta) continue;
+      if (ambito == AMBITO_EQUIPO && p.idDispositivo != id) continue;
+      if (ambito == AMBITO_SITIO && p.idDispositivo % numSitios != id) continue;
+      Agregado a = {1, {0, 0, 0}, p.alcoholMg100ml, p.alcoholMg100ml};
+      a.porAlarma[p.alarma] = 1;
+      esperado.sumar(a);
+    }
+    if (esperado.pruebas != r.pruebas || esperado.sumaMg != r.sumaMg ||
+        esperado.maxMg != r.maxMg || esperado.porAlarma[2] != r.porAlarma[2]) {
+      errores++;
+    }
+  }
+  printf("consultas=%u consulta_us_p50=%.2f consulta_us_p99=%.2f consulta_us_max=%.2f "
+         "errores=%u pruebas_sumadas=%zu\n",
+         consultas, percentil(microsegundos, 0.5), percentil(microsegundos, 0.99),
+         percentil(microsegundos, 1), errores, volatil);
+  return errores == 0 ? 0 : 1;
+}
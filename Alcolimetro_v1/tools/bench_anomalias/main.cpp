@@ -0,0 +1,176 @@
+/*
+ * Benchmark y prueba de detección de lib/AnomaliasFlota en el host, con
+ * una flota sintética.
+ *
+ * Cada equipo hace una prueba cada 'intervalo' minutos con su propio
+ * nivel normal: timeouts de Poisson, soplidos interrumpidos, un 10 % de
+ * sujetos con alcohol y un precalentamiento de unos 10 s. A mitad de la
+ * serie una fracción de los equipos se degrada en una de las cuatro
+ * métricas (más timeouts, más interrupciones, un desplazamiento del
+ * alcohol medido a los sobrios o un precalentamiento más largo). Los equipos se recorren en
+ * un orden distinto al de alta, como llegan los lotes al colector.
+ *
+ * Se mide sólo DetectorAnomalias::observar ("bench=anomalias ops_s=<n>
+ * ns_op=<n>", como tools/bench_protocolo), la memoria por equipo, los
+ * equipos sanos marcados y, por tipo de degradación, cuántos se detectan
+ * y con qué retraso en pruebas y minutos.
+ *
+ *   pio run -e bench_anomalias && .pio/build/bench_anomalias/program -n 100000
+ */
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+#include "anomalias_flota.h"
+
+struct Equipo {
+  uint32_t id;
+  double timeouts;          // media por prueba
+  double interrupcion;      // por soplido
+  double precalentamientoMs;
+  int8_t degradacion;       // métrica que se degrada, -1 si ninguna
+  int32_t detectadoEn;      // prueba de la primera alarma, -1 si ninguna
+};
+
+static uint32_t poisson(std::mt19937_64& rng, double media) {
+  return std::poisson_distribution<uint32_t>(media)(rng);
+}
+
+// Una prueba del equipo; 'degradado' desde la mitad de la serie
+static ObservacionPrueba generar(const Equipo& e, bool degradado, std::mt19937_64& rng) {
+  std::uniform_real_distribution<double> u(0, 1);
+  double timeouts = e.timeouts, interrupcion = e.interrupcion;
+  double precalentamiento = e.precalentamientoMs, desplazamiento = 0;
+  if (degradado) {
+    switch (e.degradacion) {
+      case SALUD_TIMEOUTS: timeouts += 0.6; break;
+      case SALUD_INTERRUPCIONES: interrupcion += 0.3; break;
+      case SALUD_ALCOHOL: desplazamiento = 6; break;
+      case SALUD_PRECALENTAMIENTO: precalentamiento += 1500; break;
+    }
+  }
+  ObservacionPrueba o = {};
+  o.presentes = (1u << NUM_METRICAS_SALUD) - 1;
+  double alcohol = u(rng) < 0.1 ? std::lognormal_distribution<double>(3.3, 0.8)(rng) : 0;
+  alcohol += desplazamiento;
+  // Como el colector: el alcohol sólo cuenta en las pruebas sin alarma
+  if (alcohol >= 20) o.presentes &= (uint8_t)~(1u << SALUD_ALCOHOL);
+  o.valores[SALUD_ALCOHOL] = (float)alcohol;
+  o.valores[SALUD_TIMEOUTS] = (float)poisson(rng, timeouts);
+  uint32_t interrumpidos = 0;
+  while (interrumpidos < 3 && u(rng) < interrupcion) interrumpidos++;
+  o.valores[SALUD_INTERRUPCIONES] = (float)interrumpidos;
+  o.valores[SALUD_PRECALENTAMIENTO] =
+      (float)std::normal_distribution<double>(precalentamiento, 250)(rng);
+  return o;
+}
+
+static double percentil(std::vector<double> v, double p) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[(size_t)(p * (v.size() - 1))];
+}
+
+int main(int argc, char** argv) {
+  uint32_t numEquipos = 100000;
+  uint32_t pruebas = 200;
+  double fraccionDegradada = 0.01;
+  double intervaloMin = 5;
+  uint64_t semilla = 1;
+  int c;
+  while ((c = getopt(argc, argv, "n:t:d:i:s:")) != -1) {
+    switch (c) {
+      case 'n': numEquipos = (uint32_t)atoi(optarg); break;
+      case 't': pruebas = (uint32_t)atoi(optarg); break;
+      case 'd': fraccionDegradada = atof(optarg); break;
+      case 'i': intervaloMin = atof(optarg); break;
+      case 's': semilla = strtoull(optarg, nullptr, 10); break;
+      default:
+        fprintf(stderr, "uso: %s [-n equipos] [-t pruebas_por_equipo] [-d fraccion_degradada] "
+                        "[-i intervalo_min] [-s semilla]\n", argv[0]);
+        return 2;
+    }
+  }
+  if (numEquipos == 0 || pruebas < 2 * CALENTAMIENTO_ANOMALIA) {
+    fprintf(stderr, "hacen falta equipos y al menos %u pruebas\n", 2 * CALENTAMIENTO_ANOMALIA);
+    return 2;
+  }
+
+  std::mt19937_64 rng(semilla);
+  std::uniform_real_distribution<double> u(0, 1);
+  std::vector<Equipo> equipos(numEquipos);
+  for (uint32_t i = 0; i < numEquipos; i++) {
+    Equipo& e = equipos[i];
+    e.id = (uint32_t)(rng() >> 40) << 8 | (i & 0xFF);  // como los de la MAC
+    e.timeouts = 0.02 + 0.1 * u(rng);
+    e.interrupcion = 0.05 + 0.15 * u(rng);
+    e.precalentamientoMs = 9500 + 1500 * u(rng);
+    e.degradacion = u(rng) < fraccionDegradada ? (int8_t)(rng() % NUM_METRICAS_SALUD) : -1;
+    e.detectadoEn = -1;
+  }
+  std::vector<uint32_t> orden(numEquipos);
+  for (uint32_t i = 0; i < numEquipos; i++) orden[i] = i;
+  std::shuffle(orden.begin(), orden.end(), rng);
+
+  DetectorAnomalias detector(numEquipos);
+  std::vector<ObservacionPrueba> ronda(numEquipos);
+  Anomalia nuevas[NUM_METRICAS_SALUD];
+  uint32_t inicioDegradacion = pruebas / 2;
+  uint64_t alarmasFalsas = 0;
+  double segundos = 0;
+  for (uint32_t t = 0; t < pruebas; t++) {
+    for (uint32_t i = 0; i < numEquipos; i++) {
+      ronda[i] = generar(equipos[orden[i]], t >= inicioDegradacion, rng);
+    }
+    auto inicio = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < numEquipos; i++) {
+      Equipo& e = equipos[orden[i]];
+      uint8_t n = detector.observar(e.id, ronda[i], nuevas);
+      if (n == 0) continue;
+      bool acierto = false;
+      for (uint8_t k = 0; k < n; k++) acierto |= nuevas[k].metrica == e.degradacion;
+      if (acierto && t >= inicioDegradacion && e.detectadoEn < 0) {
+        e.detectadoEn = (int32_t)t;
+      } else if (!acierto) {
+        alarmasFalsas += n;
+      }
+    }
+    segundos += std::chrono::duration<double>(std::chrono::steady_clock::now() - inicio).count();
+  }
+
+  uint64_t operaciones = (uint64_t)numEquipos * pruebas;
+  printf("bench=anomalias ops_s=%.0f ns_op=%.2f\n", operaciones / segundos,
+         segundos * 1e9 / operaciones);
+  printf("equipos=%u pruebas=%u bytes_por_equipo=%zu intervalo_min=%.1f\n", numEquipos, pruebas,
+         detector.bytesPorEquipo(), intervaloMin);
+
+  uint32_t sanos = 0, sanosMarcados = 0;
+  for (const Equipo& e : equipos) {
+    if (e.degradacion >= 0) continue;
+    sanos++;
+    if (detector.alarmas(e.id) != 0) sanosMarcados++;
+  }
+  // Alarmas en métricas que no se degradaron, por equipo y día vigilado
+  double dias = (double)numEquipos * (pruebas - CALENTAMIENTO_ANOMALIA) * intervaloMin / 1440;
+  printf("sanos=%u sanos_en_alarma_al_final=%u alarmas_falsas=%llu "
+         "alarmas_falsas_por_equipo_dia=%.5f\n",
+         sanos, sanosMarcados, (unsigned long long)alarmasFalsas, alarmasFalsas / dias);
+  for (uint8_t m = 0; m < NUM_METRICAS_SALUD; m++) {
+    std::vector<double> retrasos;
+    uint32_t total = 0;
+    for (const Equipo& e : equipos) {
+      if (e.degradacion != m) continue;
+      total++;
+      if (e.detectadoEn >= 0) retrasos.push_back(e.detectadoEn - inicioDegradacion + 1);
+    }
+    printf("degradacion=%s equipos=%u detectados=%.3f retraso_mediano_pruebas=%.0f "
+           "retraso_p95_pruebas=%.0f retraso_p95_min=%.0f\n",
+           PARAMETROS_SALUD[m].nombre, total, total > 0 ? (double)retrasos.size() / total : 0,
+           percentil(retrasos, 0.5), percentil(retrasos, 0.95),
+           percentil(retrasos, 0.95) * intervaloMin);
+  }
+  return 0;
+}
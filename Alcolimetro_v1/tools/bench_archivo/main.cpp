@@ -0,0 +1,282 @@
+/*
+ * Benchmark de lib/ArchivoColumnar en el host.
+ *
+ * Genera 'dias' de resultados de una flota como los guarda el colector
+ * (equipos que suben en cualquier orden, instantes casi ordenados con
+ * algún equipo que vuelve tras días sin cobertura, alcohol casi siempre a
+ * 0), los archiva en trozos del tamaño de un segmento del índice y
+ * compara el tamaño con el CSV y con filas de anchura fija, columna a
+ * columna. Cada trozo se decodifica y se compara con lo generado.
+ *
+ * Mide el desempaquetado de un bloque por anchura de bits frente a la
+ * lectura secuencial de memoria, y recorridos del archivo desde la caché
+ * de páginas (toda la historia, un día, un equipo y un sitio de una
+ * semana), comprobando cada total con el exacto.
+ *
+ *   pio run -e bench_archivo && .pio/build/bench_archivo/program -d 90
+ */
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "archivo_columnar.h"
+
+static const char* const NOMBRES_COLUMNA[NUM_COLUMNAS] = {
+    "equipo", "secuencia", "marca", "sujeto", "vinculada", "alcohol", "alarma",
+    "banderas", "timeouts", "interrumpidos", "precalentamiento", "recibido", "instante"};
+
+static double segundosDesde(std::chrono::steady_clock::time_point t0) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+static bool iguales(const FilaArchivo& a, const FilaArchivo& b) {
+  return a.idDispositivo == b.idDispositivo && a.secuencia == b.secuencia &&
+         a.marcaMs == b.marcaMs && a.idSujeto == b.idSujeto &&
+         a.secuenciaVinculada == b.secuenciaVinculada && a.alcoholMg100ml == b.alcoholMg100ml &&
+         a.alarma == b.alarma && a.banderas == b.banderas &&
+         a.timeoutsEnlace == b.timeoutsEnlace &&
+         a.soplidosInterrumpidos == b.soplidosInterrumpidos &&
+         a.precalentamientoMs == b.precalentamientoMs && a.recibido == b.recibido &&
+         a.instante == b.instante;
+}
+
+static void sumar(Agregado& a, const FilaArchivo& f) {
+  a.pruebas++;
+  a.porAlarma[f.alarma < 3 ? f.alarma : 2]++;
+  a.sumaMg += f.alcoholMg100ml;
+  if (f.alcoholMg100ml > a.maxMg) a.maxMg = f.alcoholMg100ml;
+}
+
+static bool mismoAgregado(const Agregado& a, const Agregado& b) {
+  return a.pruebas == b.pruebas && a.sumaMg == b.sumaMg && a.maxMg == b.maxMg &&
+         a.porAlarma[0] == b.porAlarma[0] && a.porAlarma[1] == b.porAlarma[1] &&
+         a.porAlarma[2] == b.porAlarma[2];
+}
+
+struct Recorrido {
+  const char* nombre;
+  int64_t desde;
+  int64_t hasta;
+  uint32_t equipo;       // 0: todos
+  uint32_t sitio;        // equipos con id % 10 == sitio - 1; 0: todos
+  Agregado exacto;
+
+  bool acepta(const FilaArchivo& f) const {
+    return f.instante >= desde && f.instante < hasta &&
+           (equipo == 0 || f.idDispositivo == equipo) &&
+           (sitio == 0 || f.idDispositivo % 10 == sitio - 1);
+  }
+};
+
+int main(int argc, char** argv) {
+  uint32_t numEquipos = 1000;
+  uint32_t pruebasDia = 30;
+  uint32_t dias = 90;
+  uint32_t numSujetos = 200000;
+  const char* ruta = "/tmp/bench_archivo.archivo";
+  uint64_t semilla = 1;
+  int c;
+  while ((c = getopt(argc, argv, "n:p:d:S:o:s:")) != -1) {
+    switch (c) {
+      case 'n': numEquipos = (uint32_t)atoi(optarg); break;
+      case 'p': pruebasDia = (uint32_t)atoi(optarg); break;
+      case 'd': dias = (uint32_t)atoi(optarg); break;
+      case 'S': numSujetos = (uint32_t)atoi(optarg); break;
+      case 'o': ruta = optarg; break;
+      case 's': semilla = strtoull(optarg, nullptr, 10); break;
+      default:
+        fprintf(stderr, "uso: %s [-n equipos] [-p pruebas_dia] [-d dias] [-S sujetos] "
+                        "[-o fichero] [-s semilla]\n",
+                argv[0]);
+        return 2;
+    }
+  }
+  if (numEquipos < 10 || pruebasDia == 0 || dias < 8 || numSujetos == 0) {
+    fprintf(stderr, "parámetros no válidos\n");
+    return 2;
+  }
+
+  const int64_t INICIO = 1767225600;
+  const int64_t DIA = 86400;
+  Recorrido recorridos[] = {
+      {"todo", 0, INT64_MAX, 0, 0, {}},
+      {"dia", INICIO + (dias / 2) * DIA, INICIO + (dias / 2 + 1) * DIA, 0, 0, {}},
+      {"equipo", 0, INT64_MAX, 7, 0, {}},
+      {"sitio_semana", INICIO + DIA, INICIO + 8 * DIA, 0, 4, {}},
+  };
+
+  unlink(ruta);
+  ArchivoColumnar archivo;
+  if (!archivo.abrir(ruta, UINT64_MAX)) {
+    perror(ruta);
+    return 1;
+  }
+
+  std::mt19937_64 rng(semilla);
+  std::uniform_real_distribution<double> u(0, 1);
+  std::lognormal_distribution<double> alcoholPositivo(3.3, 0.8);
+  std::vector<uint32_t> secuencias(numEquipos, 0), marcas(numEquipos);
+  for (uint32_t& m : marcas) m = (uint32_t)rng();
+  std::vector<FilaArchivo> trozo, leidas;
+  std::vector<uint8_t> bytes;
+  trozo.reserve(MAX_FILAS_TROZO);
+  uint64_t bytesColumna[NUM_COLUMNAS] = {0};
+  uint64_t filas = 0, bytesCsv = 0, bytesArchivo = 0, codificadosDiferentes = 0;
+  double segundosCodificar = 0, segundosDecodificar = 0;
+  uint64_t total = (uint64_t)dias * pruebasDia * numEquipos;
+  double paso = (double)DIA / (pruebasDia * numEquipos);
+  char linea[256];
+
+  for (uint64_t i = 0; i < total; i++) {
+    FilaArchivo f;
+    memset(&f, 0, sizeof(f));
+    f.idDispositivo = 1 + (uint32_t)(rng() % numEquipos);
+    uint32_t e = f.idDispositivo - 1;
+    f.secuencia = secuencias[e]++;
+    marcas[e] += (uint32_t)(DIA * 1000 / pruebasDia) + (uint32_t)(rng() % 600000);
+    f.marcaMs = marcas[e];
+    f.idSujeto = 1 + (uint32_t)(numSujetos * u(rng) * u(rng));
+    double a = u(rng) < 0.1 ? alcoholPositivo(rng) : 0;
+    f.alcoholMg100ml = (uint16_t)std::min(a, 65535.0);
+    f.alarma = f.alcoholMg100ml >= 80 ? 2 : (f.alcoholMg100ml >= 20 ? 1 : 0);
+    if (f.alarma > 0 && u(rng) < 0.5) f.secuenciaVinculada = f.secuencia;
+    f.banderas = u(rng) < 0.02 ? 1 : 0;
+    f.timeoutsEnlace = u(rng) < 0.05 ? (uint8_t)(1 + rng() % 3) : 0;
+    f.soplidosInterrumpidos = u(rng) < 0.08 ? 1 : 0;
+    f.precalentamientoMs = (uint16_t)(9800 + rng() % 800);
+    f.recibido = INICIO + (int64_t)(i * paso);
+    // Casi todo llega al minuto; algún lote tras horas o días sin cobertura
+    double r = u(rng);
+    int64_t retraso = r < 0.9 ? (int64_t)(rng() % 60)
+                              : (r < 0.99 ? (int64_t)(rng() % 3600) : (int64_t)(rng() % (3 * DIA)));
+    f.instante = f.recibido - retraso;
+    bytesCsv += (uint64_t)snprintf(linea, sizeof(linea),
+                                   "%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%lld,%lld\n",
+                                   f.idDispositivo, f.secuencia, f.marcaMs, f.idSujeto,
+                                   f.secuenciaVinculada, f.alcoholMg100ml, f.alarma, f.banderas,
+                                   f.timeoutsEnlace, f.soplidosInterrumpidos,
+                                   f.precalentamientoMs, (long long)f.recibido,
+                                   (long long)f.instante);
+    for (Recorrido& rc : recorridos) {
+      if (rc.acepta(f)) sumar(rc.exacto, f);
+    }
+    trozo.push_back(f);
+    if (trozo.size() < MAX_FILAS_TROZO && i + 1 < total) continue;
+
+    auto t0 = std::chrono::steady_clock::now();
+    codificarTrozo(trozo.data(), (uint32_t)trozo.size(), archivo.finArchivado(), bytesCsv, bytes);
+    segundosCodificar += segundosDesde(t0);
+    CabeceraTrozo cabecera;
+    memcpy(&cabecera, bytes.data(), sizeof(cabecera));
+    for (uint8_t k = 0; k < NUM_COLUMNAS; k++) {
+      bytesColumna[k] += cabecera.posicionColumna[k + 1] - cabecera.posicionColumna[k];
+    }
+    leidas.clear();
+    t0 = std::chrono::steady_clock::now();
+    bool bien = decodificarTrozo(bytes.data(), bytes.size(), leidas);
+    segundosDecodificar += segundosDesde(t0);
+    bien &= leidas.size() == trozo.size();
+    for (size_t k = 0; bien && k < trozo.size(); k++) bien = iguales(trozo[k], leidas[k]);
+    codificadosDiferentes += !bien;
+    if (!archivo.anexar(trozo.data(), (uint32_t)trozo.size(), bytesCsv)) {
+      perror(ruta);
+      return 1;
+    }
+    filas += trozo.size();
+    bytesArchivo += bytes.size();
+    trozo.clear();
+  }
+
+  uint64_t bytesFijos = filas * sizeof(FilaArchivo);
+  printf("bench=archivo_columnar filas=%llu trozos=%zu bytes_csv=%llu bytes_fijos=%llu "
+         "bytes_archivo=%llu bytes_fila=%.2f razon_csv=%.1f razon_fijos=%.1f\n",
+         (unsigned long long)filas, archivo.numTrozos(), (unsigned long long)bytesCsv,
+         (unsigned long long)bytesFijos, (unsigned long long)archivo.bytesArchivo(),
+         (double)bytesArchivo / filas, (double)bytesCsv / bytesArchivo,
+         (double)bytesFijos / bytesArchivo);
+  printf("bits_fila");
+  for (uint8_t k = 0; k < NUM_COLUMNAS; k++) {
+    printf(" %s=%.2f", NOMBRES_COLUMNA[k], bytesColumna[k] * 8.0 / filas);
+  }
+  printf("\n");
+  printf("codificar_ns_fila=%.1f decodificar_ns_fila=%.1f trozos_diferentes=%llu\n",
+         segundosCodificar * 1e9 / filas, segundosDecodificar * 1e9 / filas,
+         (unsigned long long)codificadosDiferentes);
+
+  // Núcleo por anchura sobre 1 M valores (4 MB de salida, en caché L2/L3)
+  const uint32_t BLOQUES = 8192, REPETICIONES = 20;
+  std::vector<uint32_t> valores(VALORES_POR_BLOQUE), salida(BLOQUES * VALORES_POR_BLOQUE);
+  volatile uint32_t sumidero = 0;
+  for (unsigned bits : {1u, 2u, 4u, 8u, 12u, 16u, 24u, 32u}) {
+    std::vector<uint32_t> empaquetado(BLOQUES * 4 * (size_t)bits, 0);
+    for (uint32_t k = 0; k < BLOQUES; k++) {
+      for (uint32_t& v : valores) v = (uint32_t)(rng() & (bits == 32 ? ~0u : (1u << bits) - 1));
+      empaquetarBloque(valores.data(), bits, empaquetado.data() + (size_t)k * 4 * bits);
+    }
+    auto t0 = std::chrono::steady_clock::now();
+    for (uint32_t r = 0; r < REPETICIONES; r++) {
+      for (uint32_t k = 0; k < BLOQUES; k++) {
+        desempaquetarBloque(empaquetado.data() + (size_t)k * 4 * bits, bits, r,
+                            salida.data() + (size_t)k * VALORES_POR_BLOQUE);
+      }
+      sumidero = sumidero + salida[r];
+    }
+    double s = segundosDesde(t0);
+    double valoresTotales = (double)BLOQUES * VALORES_POR_BLOQUE * REPETICIONES;
+    printf("desempaquetar bits=%u gvalores_s=%.2f gb_s_entrada=%.2f gb_s_salida=%.2f\n", bits,
+           valoresTotales / s / 1e9, valoresTotales * bits / 8 / s / 1e9,
+           valoresTotales * 4 / s / 1e9);
+  }
+
+  // Referencia: lectura secuencial de 256 MB
+  std::vector<uint64_t> memoria(32u << 20, 1);
+  uint64_t suma = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int r = 0; r < 4; r++) {
+    for (uint64_t v : memoria) suma += v;
+  }
+  double gbMemoria = 4.0 * memoria.size() * 8 / segundosDesde(t0) / 1e9;
+  sumidero = sumidero + (uint32_t)suma;
+  printf("lectura_memoria_gb_s=%.2f\n", gbMemoria);
+
+  // Recorridos desde el fichero, con la misma instancia que lo escribió
+  uint32_t errores = codificadosDiferentes > 0 ? 1 : 0;
+  for (const Recorrido& rc : recorridos) {
+    std::function<bool(uint32_t)> filtro;
+    if (rc.equipo != 0) {
+      filtro = [&rc](uint32_t id) { return id == rc.equipo; };
+    } else if (rc.sitio != 0) {
+      filtro = [&rc](uint32_t id) { return id % 10 == rc.sitio - 1; };
+    }
+    Agregado a = {};
+    EstadisticasRecorrido e;
+    archivo.agregar(rc.desde, rc.hasta, filtro, a, &e);  // caché de páginas caliente
+    a = Agregado();
+    t0 = std::chrono::steady_clock::now();
+    bool bien = archivo.agregar(rc.desde, rc.hasta, filtro, a, &e);
+    double s = segundosDesde(t0);
+    bien &= mismoAgregado(a, rc.exacto);
+    errores += !bien;
+    printf("recorrido=%s pruebas=%u media_mg=%.2f max_mg=%u coincide=%d ms=%.2f "
+           "trozos=%u descartados_zona=%u filas_leidas=%llu mfilas_s=%.0f gb_s_leidos=%.2f "
+           "gb_s_fijos=%.2f\n",
+           rc.nombre, a.pruebas, a.mediaMg(), a.maxMg, bien ? 1 : 0, s * 1e3, e.trozos,
+           e.descartadosZona, (unsigned long long)e.filasLeidas, e.filasLeidas / s / 1e6,
+           e.bytesLeidos / s / 1e9, e.filasLeidas * (double)sizeof(FilaArchivo) / s / 1e9);
+  }
+
+  // Reapertura
+  ArchivoColumnar reabierto;
+  t0 = std::chrono::steady_clock::now();
+  bool abierto = reabierto.abrir(ruta, bytesCsv);
+  printf("reapertura_ms=%.2f abierto=%d trozos=%zu filas=%llu fin_archivado=%llu\n",
+         segundosDesde(t0) * 1e3, abierto ? 1 : 0, reabierto.numTrozos(),
+         (unsigned long long)reabierto.filas(), (unsigned long long)reabierto.finArchivado());
+  unlink(ruta);
+  return errores == 0 && abierto && reabierto.filas() == filas ? 0 : 1;
+}
@@ -0,0 +1,205 @@
+/*
+ * Benchmarks y pruebas de esfuerzo de las colas de lib/ColasAnillo en el
+ * host, con hilos reales.
+ *
+ * Rendimiento: elementos por segundo de un productor a un consumidor
+ * (SPSC) y de varios productores a uno (MPSC), con una cola con mutex
+ * como referencia. Latencia: ida y vuelta entre dos hilos por un par de
+ * colas SPSC, en percentiles. Cada línea de rendimiento sigue el formato
+ * "bench=<nombre> ops_s=<n> ns_op=<n>" de tools/bench_protocolo.
+ *
+ * Esfuerzo: colas de capacidad mínima con más productores que núcleos,
+ * para pasar continuamente por llena y vacía. Se comprueba que cada
+ * elemento llega una vez y en el orden de su productor; ante cualquier
+ * fallo el programa termina con código 1.
+ *
+ *   pio run -e bench_colas && .pio/build/bench_colas/program
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+#include "colas_anillo.h"
+
+struct Mensaje {
+  uint32_t productor;
+  uint32_t secuencia;
+};
+
+static int errores = 0;
+
+static void fallo(const char* prueba, const char* detalle, uint32_t a, uint32_t b) {
+  printf("ERROR %s: %s (%u, %u)\n", prueba, detalle, a, b);
+  errores++;
+}
+
+static double segundosDesde(std::chrono::steady_clock::time_point inicio) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - inicio).count();
+}
+
+static void informar(const char* nombre, uint64_t operaciones, double s) {
+  printf("bench=%s ops_s=%.0f ns_op=%.2f\n", nombre, operaciones / s,
+         s * 1e9 / operaciones);
+}
+
+// Un productor envía 0..total-1 y el consumidor comprueba la secuencia
+template <typename Cola>
+static void spsc(const char* nombre, uint32_t total) {
+  static Cola cola;
+  auto inicio = std::chrono::steady_clock::now();
+  std::thread productor([&] {
+    for (uint32_t i = 0; i < total; i++) {
+      while (!cola.meter(Mensaje{0, i})) std::this_thread::yield();
+    }
+  });
+  Mensaje m;
+  for (uint32_t esperado = 0; esperado < total; esperado++) {
+    while (!cola.sacar(m)) std::this_thread::yield();
+    if (m.secuencia != esperado) {
+      fallo(nombre, "secuencia desordenada", m.secuencia, esperado);
+      break;
+    }
+  }
+  productor.join();
+  informar(nombre, total, segundosDesde(inicio));
+}
+
+// Varios productores; el orden sólo se garantiza dentro de cada uno
+template <typename Cola>
+static void mpsc(const char* nombre, uint32_t productores, uint32_t porProductor,
+                 bool ceder) {
+  static Cola cola;
+  std::vector<uint32_t> siguiente(productores, 0);
+  std::vector<std::thread> hilos;
+  auto inicio = std::chrono::steady_clock::now();
+  for (uint32_t p = 0; p < productores; p++) {
+    hilos.emplace_back([&, p] {
+      for (uint32_t i = 0; i < porProductor; i++) {
+        while (!cola.meter(Mensaje{p, i})) std::this_thread::yield();
+        // Ceder de vez en cuando cambia el entrelazado entre productores
+        if (ceder && (i & 63) == (p & 63)) std::this_thread::yield();
+      }
+    });
+  }
+  uint64_t total = (uint64_t)productores * porProductor;
+  Mensaje m;
+  for (uint64_t recibidos = 0; recibidos < total; recibidos++) {
+    while (!cola.sacar(m)) std::this_thread::yield();
+    if (m.productor >= productores) {
+      fallo(nombre, "productor desconocido", m.productor, productores);
+      break;
+    }
+    if (m.secuencia != siguiente[m.productor]) {
+      fallo(nombre, "perdido, duplicado o desordenado", m.secuencia,
+            siguiente[m.productor]);
+      break;
+    }
+    siguiente[m.productor]++;
+  }
+  for (std::thread& h : hilos) h.join();
+  if (!cola.vacia()) fallo(nombre, "quedan elementos", (uint32_t)cola.tamano(), 0);
+  informar(nombre, total, segundosDesde(inicio));
+}
+
+// Referencia: deque protegida con un mutex, con la misma interfaz
+template <size_t N>
+class ColaMutex {
+public:
+  bool meter(const Mensaje& m) {
+    std::lock_guard<std::mutex> cerrojo(mutex);
+    if (elementos.size() == N) return false;
+    elementos.push_back(m);
+    return true;
+  }
+  bool sacar(Mensaje& m) {
+    std::lock_guard<std::mutex> cerrojo(mutex);
+    if (elementos.empty()) return false;
+    m = elementos.front();
+    elementos.pop_front();
+    return true;
+  }
+  bool vacia() {
+    std::lock_guard<std::mutex> cerrojo(mutex);
+    return elementos.empty();
+  }
+  size_t tamano() {
+    std::lock_guard<std::mutex> cerrojo(mutex);
+    return elementos.size();
+  }
+
+private:
+  std::mutex mutex;
+  std::deque<Mensaje> elementos;
+};
+
+// Espera activa que cede el núcleo tras un rato: con menos núcleos que
+// hilos una espera pura no avanzaría hasta el siguiente cambio de tarea
+static void esperar(uint32_t& vueltas) {
+  if (++vueltas >= 1000) {
+    std::this_thread::yield();
+    vueltas = 0;
+  }
+}
+
+// Ida y vuelta de un mensaje entre dos hilos
+static void latencia(uint32_t rondas) {
+  static ColaSpsc<uint32_t, 16> ida;
+  static ColaSpsc<uint32_t, 16> vuelta;
+  std::thread eco([&] {
+    uint32_t v;
+    uint32_t vueltas = 0;
+    for (uint32_t i = 0; i < rondas; i++) {
+      while (!ida.sacar(v)) esperar(vueltas);
+      vuelta.meter(v);
+    }
+  });
+  std::vector<uint32_t> ns(rondas);
+  for (uint32_t i = 0; i < rondas; i++) {
+    auto t0 = std::chrono::steady_clock::now();
+    ida.meter(i);
+    uint32_t v;
+    uint32_t vueltas = 0;
+    while (!vuelta.sacar(v)) esperar(vueltas);
+    ns[i] = (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - t0).count();
+    if (v != i) fallo("latencia", "eco equivocado", v, i);
+  }
+  eco.join();
+  std::sort(ns.begin(), ns.end());
+  printf("bench=spsc_ida_vuelta p50_ns=%u p99_ns=%u p999_ns=%u max_ns=%u\n",
+         ns[rondas / 2], ns[rondas * 99 / 100], ns[rondas * 999 / 1000], ns.back());
+}
+
+int main() {
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+  unsigned nucleos = std::thread::hardware_concurrency();
+  printf("nucleos=%u\n", nucleos);
+
+  spsc<ColaSpsc<Mensaje, 1024>>("spsc_1024", 20000000);
+  spsc<ColaMutex<1024>>("referencia_mutex_spsc", 2000000);
+  if (nucleos < 2) {
+    // Cada ida y vuelta incluye los cambios de hilo del sistema
+    printf("aviso: un solo núcleo, la latencia no es la de la cola\n");
+  }
+  latencia(200000);
+
+  mpsc<ColaMpsc<Mensaje, 1024>>("mpsc_2p", 2, 5000000, false);
+  mpsc<ColaMpsc<Mensaje, 1024>>("mpsc_4p", 4, 2500000, false);
+  mpsc<ColaMutex<1024>>("referencia_mutex_4p", 4, 500000, false);
+
+  // Esfuerzo: capacidad mínima y más productores que núcleos
+  spsc<ColaSpsc<Mensaje, 2>>("esfuerzo_spsc_2", 2000000);
+  mpsc<ColaMpsc<Mensaje, 2>>("esfuerzo_mpsc_2", 8, 100000, true);
+  mpsc<ColaMpsc<Mensaje, 4>>("esfuerzo_mpsc_4", 2 * nucleos + 1, 100000, true);
+
+  if (errores > 0) {
+    printf("%d errores\n", errores);
+    return 1;
+  }
+  printf("sin errores\n");
+  return 0;
+}
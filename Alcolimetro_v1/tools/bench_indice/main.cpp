@@ -0,0 +1,190 @@
+/*
+ * Benchmark de lib/IndiceSujetos en el host.
+ *
+ * Escribe 'dias' de resultados de una flota en un CSV con el formato del
+ * colector (cada sujeto sopla con una frecuencia lognormal: unos pocos
+ * casi a diario y la mayoría de vez en cuando), los indexa como el
+ * colector y mide la búsqueda de todas las pruebas de sujetos al azar,
+ * leyendo las líneas del CSV como la consulta "sujeto". Cada búsqueda se
+ * compara con el número real de pruebas del sujeto; una búsqueda por
+ * recorrido completo del CSV sirve de referencia. Las lecturas salen de
+ * la caché de páginas: con el disco frío cuenta además una lectura por
+ * bloque.
+ *
+ *   pio run -e bench_indice && .pio/build/bench_indice/program -n 1000 -d 365
+ */
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "indice_sujetos.h"
+
+static double percentil(std::vector<double> v, double p) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[(size_t)(p * (v.size() - 1))];
+}
+
+int main(int argc, char** argv) {
+  uint32_t numEquipos = 1000;
+  uint32_t pruebasDia = 30;
+  uint32_t dias = 365;
+  uint32_t numSujetos = 200000;
+  size_t presupuestoMb = 64;
+  uint32_t consultas = 2000;
+  const char* ruta = "/tmp/bench_indice.csv";
+  uint64_t semilla = 1;
+  int c;
+  while ((c = getopt(argc, argv, "n:p:d:S:m:c:o:s:")) != -1) {
+    switch (c) {
+      case 'n': numEquipos = (uint32_t)atoi(optarg); break;
+      case 'p': pruebasDia = (uint32_t)atoi(optarg); break;
+      case 'd': dias = (uint32_t)atoi(optarg); break;
+      case 'S': numSujetos = (uint32_t)atoi(optarg); break;
+      case 'm': presupuestoMb = (size_t)atoi(optarg); break;
+      case 'c': consultas = (uint32_t)atoi(optarg); break;
+      case 'o': ruta = optarg; break;
+      case 's': semilla = strtoull(optarg, nullptr, 10); break;
+      default:
+        fprintf(stderr, "uso: %s [-n equipos] [-p pruebas_dia] [-d dias] [-S sujetos] "
+                        "[-m presupuesto_mb] [-c consultas] [-o fichero.csv] [-s semilla]\n",
+                argv[0]);
+        return 2;
+    }
+  }
+  if (numEquipos == 0 || pruebasDia == 0 || dias == 0 || numSujetos == 0) {
+    fprintf(stderr, "parámetros no válidos\n");
+    return 2;
+  }
+
+  // Sujeto de cada prueba por inversión de la acumulada de frecuencias
+  std::mt19937_64 rng(semilla);
+  std::lognormal_distribution<double> frecuencia(0, 1);
+  std::vector<double> acumulada(numSujetos);
+  double suma = 0;
+  for (uint32_t i = 0; i < numSujetos; i++) acumulada[i] = suma += frecuencia(rng);
+  std::uniform_real_distribution<double> u(0, suma);
+
+  std::string rutaIndice = std::string(ruta) + ".indice";
+  unlink(ruta);
+  unlink(rutaIndice.c_str());
+  FILE* csv = fopen(ruta, "w");
+  if (csv == nullptr) {
+    perror(ruta);
+    return 1;
+  }
+  IndiceSujetos indice(presupuestoMb << 20);
+  if (!indice.abrir(rutaIndice.c_str(), 0)) {
+    perror(rutaIndice.c_str());
+    return 1;
+  }
+
+  std::vector<uint32_t> pruebasDeSujeto(numSujetos + 1, 0);
+  std::vector<uint32_t> secuencias(numEquipos, 0);
+  uint64_t registros = 0;
+  double segundosIndice = 0;
+  long long instante = 1767225600;
+  uint64_t posicion = 0;
+  char linea[256];
+  for (uint32_t d = 0; d < dias; d++) {
+    for (uint32_t k = 0; k < pruebasDia; k++) {
+      for (uint32_t e = 0; e < numEquipos; e++) {
+        uint32_t sujeto = 1 + (uint32_t)(std::lower_bound(acumulada.begin(), acumulada.end(),
+                                                          u(rng)) - acumulada.begin());
+        sujeto = std::min(sujeto, numSujetos);
+        uint16_t alcohol = (uint16_t)(rng() % 10 == 0 ? rng() % 150 : 0);
+        int n = snprintf(linea, sizeof(linea), "%u,%u,%u,%u,0,%u,%u,0,0,0,10200,%lld,%lld\n",
+                         e + 1, secuencias[e]++, k * 60000, sujeto, alcohol,
+                         alcohol >= 80 ? 2 : (alcohol >= 20 ? 1 : 0), instante, instante);
+        fwrite(linea, 1, (size_t)n, csv);
+        auto t0 = std::chrono::steady_clock::now();
+        if (!indice.anotar(sujeto, posicion, posicion + n)) {
+          perror("indice");
+          return 1;
+        }
+        segundosIndice += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0)
+                              .count();
+        posicion += (uint64_t)n;
+        pruebasDeSujeto[sujeto]++;
+        registros++;
+        instante += 86400 / pruebasDia / numEquipos + 1;
+      }
+    }
+  }
+  fflush(csv);
+  printf("bench=indice_sujetos registros=%llu bytes_csv=%llu anotar_ns=%.1f segmentos=%zu "
+         "activos=%zu memoria_indice=%zu presupuesto=%zu\n",
+         (unsigned long long)registros, (unsigned long long)posicion,
+         segundosIndice * 1e9 / registros, indice.segmentosSellados(), indice.registrosActivos(),
+         indice.bytesEnMemoria(), presupuestoMb << 20);
+
+  int lectura = open(ruta, O_RDONLY);
+  std::vector<double> microsegundos, descartados, bloques, encontradas;
+  std::vector<uint64_t> posiciones;
+  uint32_t errores = 0;
+  size_t lineasLeidas = 0;
+  for (uint32_t i = 0; i < consultas; i++) {
+    uint32_t sujeto = 1 + (uint32_t)(rng() % numSujetos);
+    posiciones.clear();
+    EstadisticasBusqueda e;
+    auto t0 = std::chrono::steady_clock::now();
+    indice.buscar(sujeto, posiciones, &e);
+    for (uint64_t p : posiciones) {
+      if (pread(lectura, linea, sizeof(linea), (off_t)p) > 0) lineasLeidas++;
+    }
+    microsegundos.push_back(
+        std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count());
+    descartados.push_back(e.segmentos > 0 ? (double)e.descartadosBloom / e.segmentos : 0);
+    bloques.push_back(e.bloquesLeidos);
+    encontradas.push_back((double)posiciones.size());
+    // Posiciones en orden y del sujeto
+    bool bien = posiciones.size() == pruebasDeSujeto[sujeto] &&
+                std::is_sorted(posiciones.begin(), posiciones.end());
+    if (bien && !posiciones.empty()) {
+      unsigned leido = 0;
+      pread(lectura, linea, sizeof(linea), (off_t)posiciones[posiciones.size() / 2]);
+      bien = sscanf(linea, "%*u,%*u,%*u,%u", &leido) == 1 && leido == sujeto;
+    }
+    errores += !bien;
+  }
+  printf("consultas=%u busqueda_us_p50=%.1f busqueda_us_p99=%.1f busqueda_us_max=%.1f "
+         "pruebas_p50=%.0f pruebas_p99=%.0f bloques_p50=%.0f bloques_p99=%.0f "
+         "fraccion_descartada_bloom=%.3f errores=%u lineas_leidas=%zu\n",
+         consultas, percentil(microsegundos, 0.5), percentil(microsegundos, 0.99),
+         percentil(microsegundos, 1), percentil(encontradas, 0.5), percentil(encontradas, 0.99),
+         percentil(bloques, 0.5), percentil(bloques, 0.99), percentil(descartados, 0.5),
+         errores, lineasLeidas);
+
+  // Referencia: el mismo resultado recorriendo todo el CSV
+  auto t0 = std::chrono::steady_clock::now();
+  FILE* f = fopen(ruta, "r");
+  uint32_t buscado = 1, encontrados = 0;
+  unsigned sujeto;
+  while (fgets(linea, sizeof(linea), f) != nullptr) {
+    if (sscanf(linea, "%*u,%*u,%*u,%u", &sujeto) == 1 && sujeto == buscado) encontrados++;
+  }
+  fclose(f);
+  printf("recorrido_completo_ms=%.0f coincide=%d\n",
+         std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count(),
+         encontrados == pruebasDeSujeto[buscado] ? 1 : 0);
+
+  // Reapertura: los segmentos sellados se cargan y el resto se reanota
+  IndiceSujetos reabierto(presupuestoMb << 20);
+  t0 = std::chrono::steady_clock::now();
+  bool abierto = reabierto.abrir(rutaIndice.c_str(), posicion);
+  printf("reapertura_ms=%.1f abierto=%d fin_sellado=%llu segmentos=%zu\n",
+         std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count(),
+         abierto ? 1 : 0, (unsigned long long)reabierto.finSellado(),
+         reabierto.segmentosSellados());
+  close(lectura);
+  fclose(csv);
+  unlink(ruta);
+  unlink(rutaIndice.c_str());
+  return errores == 0 && abierto ? 0 : 1;
+}
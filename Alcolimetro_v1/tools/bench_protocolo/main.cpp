@@ -0,0 +1,135 @@
+/*
+ * Microbenchmarks del protocolo ZE29A en el host.
+ *
+ * Mide tramas construidas y decodificadas por segundo y el coste de
+ * resincronizar sobre flujos con basura, con las tramas insertadas que se
+ * recuperan y las falsas que se emiten. Cada línea de salida es
+ * "bench=<nombre> ops_s=<n> ns_op=<n>" para que registrar.sh la guarde y
+ * compare con el commit anterior.
+ *
+ *   pio run -e bench_protocolo && .pio/build/bench_protocolo/program
+ */
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "protocolo_ze29a.h"
+
+static volatile uint32_t sumidero;  // evita que el compilador elimine el trabajo
+
+template <typename F>
+static void medir(const char* nombre, uint64_t operaciones, F&& cuerpo) {
+  cuerpo();  // calentar caches
+  auto inicio = std::chrono::steady_clock::now();
+  cuerpo();
+  double s = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - inicio).count();
+  printf("bench=%s ops_s=%.0f ns_op=%.2f\n", nombre, operaciones / s,
+         s * 1e9 / operaciones);
+}
+
+// Respuesta válida a 0x86 con el valor y la alarma dados
+static void tramaResultado(uint8_t* t, uint16_t alcohol, uint8_t alarma) {
+  t[0] = BYTE_INICIO;
+  t[1] = CMD_LEER_RESULTADO;
+  t[2] = (uint8_t)(alcohol >> 8);
+  t[3] = (uint8_t)alcohol;
+  t[4] = t[5] = t[6] = 0;
+  t[7] = alarma;
+  t[8] = checksumTrama(t);
+}
+
+int main() {
+  const uint64_t N = 10000000;
+  uint8_t trama[LONGITUD_TRAMA];
+
+  medir("construir_trama", N, [&] {
+    uint32_t acc = 0;
+    for (uint64_t i = 0; i < N; i++) {
+      construirTrama(trama, CMD_CAMBIAR_ESTADO, (uint8_t)i);
+      acc += trama[8];
+    }
+    sumidero = acc;
+  });
+
+  medir("checksum", N, [&] {
+    uint32_t acc = 0;
+    for (uint64_t i = 0; i < N; i++) {
+      trama[3] = (uint8_t)i;
+      acc += checksumValido(trama);
+    }
+    sumidero = acc;
+  });
+
+  // Flujo de tramas válidas consecutivas
+  std::mt19937 rng(1234);
+  const size_t TRAMAS = 100000;
+  std::vector<uint8_t> limpio(TRAMAS * LONGITUD_TRAMA);
+  for (size_t i = 0; i < TRAMAS; i++) {
+    tramaResultado(&limpio[i * LONGITUD_TRAMA], rng() % 300, rng() % 3);
+  }
+  const int REPETICIONES = 100;
+  medir("decodificar_trama", (uint64_t)TRAMAS * REPETICIONES, [&] {
+    uint32_t acc = 0;
+    for (int rep = 0; rep < REPETICIONES; rep++) {
+      AnalizadorTramas analizador(true);
+      ResultadoPrueba r;
+      for (uint8_t b : limpio) {
+        if (analizador.alimentar(b) && decodificarResultado(analizador.trama(), r)) {
+          acc += r.alcoholMg100ml;
+        }
+      }
+    }
+    sumidero = acc;
+  });
+
+  // Basura con tramas válidas intercaladas: 0xFF frecuentes fuerzan
+  // cabeceras falsas y resincronizaciones
+  std::vector<uint8_t> ruidoso;
+  std::vector<bool> finInsertada;  // true en el último byte de cada trama insertada
+  size_t insertadas = 0;
+  while (ruidoso.size() < limpio.size()) {
+    if (rng() % 4 == 0) {
+      uint8_t t[LONGITUD_TRAMA];
+      tramaResultado(t, rng() % 300, rng() % 3);
+      ruidoso.insert(ruidoso.end(), t, t + LONGITUD_TRAMA);
+      finInsertada.resize(ruidoso.size());
+      finInsertada.back() = true;
+      insertadas++;
+    } else {
+      for (int i = 0; i < 16; i++) {
+        ruidoso.push_back(rng() % 8 == 0 ? BYTE_INICIO : (uint8_t)rng());
+      }
+    }
+  }
+  finInsertada.resize(ruidoso.size());
+  medir("resincronizar_byte", (uint64_t)ruidoso.size() * REPETICIONES, [&] {
+    uint32_t acc = 0;
+    for (int rep = 0; rep < REPETICIONES; rep++) {
+      AnalizadorTramas analizador(true);
+      for (uint8_t b : ruidoso) acc += analizador.alimentar(b);
+    }
+    sumidero = acc;
+  });
+
+  // Fuera de la medida: una trama emitida sólo cuenta como recuperada si
+  // termina donde termina una insertada y coincide con ella; el resto son
+  // bytes de basura cuyo checksum cuadra por casualidad
+  uint32_t recuperadas = 0, falsosPositivos = 0;
+  AnalizadorTramas analizador(true);
+  for (size_t i = 0; i < ruidoso.size(); i++) {
+    if (!analizador.alimentar(ruidoso[i])) continue;
+    bool coincide = finInsertada[i] &&
+                    memcmp(analizador.trama(), &ruidoso[i + 1 - LONGITUD_TRAMA],
+                           LONGITUD_TRAMA) == 0;
+    if (coincide) {
+      recuperadas++;
+    } else {
+      falsosPositivos++;
+    }
+  }
+  printf("bench=tramas_recuperadas insertadas=%zu recuperadas=%u falsos_positivos=%u\n",
+         insertadas, recuperadas, falsosPositivos);
+  return 0;
+}
@@ -0,0 +1,25 @@
+#!/bin/sh
+# Ejecuta el benchmark del protocolo, guarda el resultado con el commit
+# actual y avisa si alguna medida empeora más de un 10 % respecto a la
+# última registrada.
+#
+#   tools/bench_protocolo/registrar.sh
+set -e
+cd "$(dirname "$0")/../.."
+
+pio run -e bench_protocolo
+commit=$(git rev-parse --short HEAD)
+historial=.pio/bench/historial_protocolo.csv
+mkdir -p "$(dirname "$historial")"
+
+.pio/build/bench_protocolo/program | grep 'ns_op=' | while read -r linea; do
+  nombre=$(echo "$linea" | sed 's/.*bench=\([^ ]*\).*/\1/')
+  ns=$(echo "$linea" | sed 's/.*ns_op=\([^ ]*\).*/\1/')
+  anterior=$(grep ",$nombre," "$historial" 2>/dev/null | tail -n 1 | cut -d, -f3)
+  echo "$commit,$nombre,$ns" >> "$historial"
+  if [ -n "$anterior" ] && awk "BEGIN { exit !($ns > $anterior * 1.10) }"; then
+    echo "REGRESION $nombre: $anterior -> $ns ns/op"
+  else
+    echo "$nombre: $ns ns/op"
+  fi
+done
@@ -0,0 +1,146 @@
+/*
+ * Benchmark y precisión de lib/ResumenesFlota en el host.
+ *
+ * Genera 'n' resultados como los de la flota (la mayoría a 0, un 10 % con
+ * alcohol lognormal y alguno por encima del rango habitual) y compara
+ * p50/p95/p99 del resumen con los exactos, los de 'trozos' resúmenes
+ * fusionados tras pasar por su forma serializada con los del resumen
+ * único, y el número de sujetos distintos estimado con el real para
+ * varias cardinalidades. Mide la anotación de uno en uno y por lotes, la
+ * consulta de un cuantil, la fusión y los tamaños serializados.
+ *
+ *   pio run -e bench_resumenes && .pio/build/bench_resumenes/program -n 10000000
+ */
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+#include "resumenes_flota.h"
+
+static double nsPorOperacion(std::chrono::steady_clock::time_point inicio, uint64_t n) {
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - inicio)
+             .count() / n;
+}
+
+int main(int argc, char** argv) {
+  uint32_t n = 10000000;
+  uint32_t trozos = 64;
+  uint64_t semilla = 1;
+  int c;
+  while ((c = getopt(argc, argv, "n:t:s:")) != -1) {
+    switch (c) {
+      case 'n': n = (uint32_t)atoi(optarg); break;
+      case 't': trozos = (uint32_t)atoi(optarg); break;
+      case 's': semilla = strtoull(optarg, nullptr, 10); break;
+      default:
+        fprintf(stderr, "uso: %s [-n resultados] [-t trozos] [-s semilla]\n", argv[0]);
+        return 2;
+    }
+  }
+  if (n < 100 || trozos == 0) {
+    fprintf(stderr, "hacen falta al menos 100 resultados y un trozo\n");
+    return 2;
+  }
+
+  std::mt19937_64 rng(semilla);
+  std::uniform_real_distribution<double> u(0, 1);
+  std::lognormal_distribution<double> lognormal(3.3, 0.8);
+  std::vector<uint16_t> valores(n);
+  for (uint32_t i = 0; i < n; i++) {
+    double v = u(rng) < 0.1 ? lognormal(rng) : 0;
+    if (u(rng) < 0.001) v = 1000 + 60000 * u(rng);  // fuera de escala o lectura errónea
+    valores[i] = (uint16_t)std::min(v, 65535.0);
+  }
+
+  static ResumenCuantiles uno, lote;
+  auto t = std::chrono::steady_clock::now();
+  for (uint16_t v : valores) uno.anotar(v);
+  double nsUno = nsPorOperacion(t, n);
+  t = std::chrono::steady_clock::now();
+  lote.anotarLote(valores.data(), n);
+  double nsLote = nsPorOperacion(t, n);
+  printf("bench=resumen_cuantiles anotar_ns=%.2f anotar_lote_ns=%.2f ops_s_lote=%.0f\n", nsUno,
+         nsLote, 1e9 / nsLote);
+
+  // Exactos, para el error relativo del resumen
+  std::vector<uint16_t> ordenados = valores;
+  std::sort(ordenados.begin(), ordenados.end());
+  const float CUANTILES[] = {0.5f, 0.9f, 0.95f, 0.99f, 0.999f};
+  double errorMaximo = 0;
+  for (float q : CUANTILES) {
+    float exacto = ordenados[(size_t)(q * (n - 1))];
+    float estimado = uno.cuantil(q);
+    double error = exacto > 0 ? fabs(estimado - exacto) / exacto : fabs(estimado);
+    errorMaximo = std::max(errorMaximo, error);
+    printf("cuantil=%.3f exacto_mg=%.0f resumen_mg=%.1f error_relativo=%.4f\n", q, exacto,
+           estimado, error);
+  }
+
+  const uint32_t CONSULTAS = 100000;
+  volatile float sumidero = 0;
+  t = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < CONSULTAS; i++) sumidero = sumidero + uno.cuantil(0.99f);
+  printf("consulta_p99_ns=%.0f\n", nsPorOperacion(t, CONSULTAS));
+
+  // Trozos anotados por separado, serializados, leídos y fusionados
+  static ResumenCuantiles trozo, leido, fusionado;
+  static uint8_t buffer[MAX_SERIALIZADO_CUANTILES];
+  size_t bytesMaximo = 0;
+  bool iguales = true;
+  double nsFusion = 0;
+  for (uint32_t k = 0; k < trozos; k++) {
+    size_t desde = (size_t)n * k / trozos, hasta = (size_t)n * (k + 1) / trozos;
+    trozo.vaciar();
+    trozo.anotarLote(valores.data() + desde, hasta - desde);
+    size_t bytes = trozo.serializar(buffer, sizeof(buffer));
+    bytesMaximo = std::max(bytesMaximo, bytes);
+    iguales &= leido.deserializar(buffer, bytes);
+    t = std::chrono::steady_clock::now();
+    fusionado.fusionar(leido);
+    nsFusion += nsPorOperacion(t, 1);
+  }
+  for (float q : CUANTILES) iguales &= fusionado.cuantil(q) == uno.cuantil(q);
+  iguales &= fusionado.cuenta() == uno.cuenta();
+  printf("trozos=%u fusion_identica=%d fusion_ns=%.0f bytes_serializados_max=%zu "
+         "bytes_en_memoria=%zu\n",
+         trozos, iguales ? 1 : 0, nsFusion / trozos, bytesMaximo, sizeof(ResumenCuantiles));
+
+  // Distintos: sujetos con repeticiones, repartidos entre 'trozos' colectores
+  static ContadorDistintos total, parte, leidoDistintos;
+  static uint8_t bufferDistintos[MAX_SERIALIZADO_DISTINTOS];
+  double errorDistintosMaximo = 0;
+  for (uint32_t poblacion : {100u, 1000u, 10000u, 100000u, 1000000u}) {
+    std::vector<bool> visto(poblacion, false);
+    uint32_t reales = 0;
+    size_t bytesParte = 0;
+    total.vaciar();
+    for (uint32_t k = 0; k < trozos; k++) {
+      parte.vaciar();
+      for (uint32_t i = 0; i < poblacion * 2 / trozos + 1; i++) {
+        uint32_t sujeto = (uint32_t)(rng() % poblacion);
+        if (!visto[sujeto]) reales++;
+        visto[sujeto] = true;
+        parte.anotar(sujeto);
+      }
+      bytesParte = parte.serializar(bufferDistintos, sizeof(bufferDistintos));
+      iguales &= leidoDistintos.deserializar(bufferDistintos, bytesParte);
+      total.fusionar(leidoDistintos);
+    }
+    double estimado = total.estimar();
+    double error = fabs(estimado - reales) / reales;
+    errorDistintosMaximo = std::max(errorDistintosMaximo, error);
+    printf("distintos_reales=%u estimados=%.0f error_relativo=%.4f bytes_serializados_trozo=%zu\n",
+           reales, estimado, error, bytesParte);
+  }
+  t = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < CONSULTAS / 100; i++) sumidero = sumidero + (float)total.estimar();
+  printf("consulta_distintos_ns=%.0f bytes_en_memoria=%zu\n", nsPorOperacion(t, CONSULTAS / 100),
+         sizeof(ContadorDistintos));
+  printf("error_cuantiles_max=%.4f error_distintos_max=%.4f\n", errorMaximo,
+         errorDistintosMaximo);
+  return iguales ? 0 : 1;
+}
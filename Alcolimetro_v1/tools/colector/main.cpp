@@ -0,0 +1,995 @@
+/*
+ * Colector de resultados (Linux).
+ *
+ * Acepta conexiones TCP de los equipos, recibe lotes de registros, los
+ * guarda en un CSV por tipo (resultados, sesiones, configuración y
+ * confirmaciones) y confirma con un ACK acumulativo. La entrega desde el
+ * equipo es al menos una vez, así que los duplicados (secuencias ya
+ * confirmadas) se descartan aquí. Los tipos de registro desconocidos se confirman y se
+ * cuentan sin guardarlos.
+ *
+ * Con cada resultado se alimenta lib/AnomaliasFlota. Cuando una métrica de
+ * salud de un equipo entra en alarma se anota en el CSV de anomalías y se
+ * avisa por la salida, también con -q. Los resultados de versión 1 no
+ * traen timeouts ni interrupciones y sólo se vigilan las demás métricas.
+ *
+ * También se mantienen agregados por hora, día y mes de cada equipo, cada
+ * sitio (-e con líneas "idDispositivo,idSitio") y la flota
+ * (lib/AgregadosFlota). La hora de cada prueba sale de marcaEnvioMs del
+ * lote; los registros de antes de un reinicio del equipo se quedan con la
+ * hora de llegada. Al arrancar se reconstruyen desde el CSV de resultados.
+ * Por la entrada estándar se consultan, una por línea:
+ *
+ *   flota <desde> <hasta>
+ *   sitio <id> <desde> <hasta>
+ *   equipo <id> <desde> <hasta>
+ *
+ * con segundos UTC; la respuesta es una línea "consulta=...". Delante de
+ * "flota" o "sitio", "cuantiles" da p50/p95/p99 del alcohol y los sujetos
+ * y equipos distintos por días enteros (lib/ResumenesFlota), y "exportar"
+ * los mismos resúmenes serializados en hexadecimal para fusionarlos con
+ * los de otros colectores en tools/fusion_resumenes.
+ *
+ * "sujeto <id>" devuelve todas las pruebas del sujeto, una línea
+ * "prueba=..." por resultado del CSV, con lib/IndiceSujetos: índice en
+ * memoria de los resultados recientes y, en <resultados>.indice, tablas
+ * ordenadas con filtro de Bloom de los segmentos anteriores. -m limita la
+ * memoria del índice en MB.
+ *
+ * Cada segmento que sella el índice se convierte además en un trozo
+ * columnar comprimido de <resultados>.archivo (lib/ArchivoColumnar), el
+ * historial frío. "archivo flota|sitio <id>|equipo <id> <desde> <hasta>"
+ * da los mismos totales que los agregados pero recorriendo el archivo,
+ * sin retención: sirve para intervalos más antiguos que los agregados.
+ *
+ * "configurar flota|sitio <id>|equipo <id>" seguido de "soplado <s>",
+ * "umbrales" y/o "adaptativo 0|1" lanza un despliegue de configuración:
+ * los comandos pendientes de cada equipo bajan en un mensaje ORDEN antes
+ * de cada ACK (protocolo_subida.h), así que llegan en el siguiente
+ * intercambio del equipo, y su confirmación sube como un registro más y
+ * se guarda en el CSV de confirmaciones (-c). Un equipo del ámbito que
+ * aparece después del lanzamiento también lo recibe. "despliegue <orden>"
+ * da el avance y una línea "equipo=..." por cada equipo que aún no lo ha
+ * aplicado bien. Los despliegues viven en memoria: tras reiniciar el
+ * colector hay que volver a lanzar los que no hubieran terminado.
+ *
+ *   pio run -e colector && .pio/build/colector/program -p 5020 -o resultados.csv
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <functional>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "agregados_flota.h"
+#include "anomalias_flota.h"
+#include "archivo_columnar.h"
+#include "indice_sujetos.h"
+#include "protocolo_subida.h"
+#include "protocolo_ze29a.h"
+#include "resumenes_flota.h"
+
+struct Cliente {
+  int fd;
+  AnalizadorMensajes analizador;
+};
+
+struct Opciones {
+  uint16_t puerto = 5020;
+  const char* salida = "resultados.csv";
+  const char* salidaSesiones = "sesiones.csv";
+  const char* salidaConfiguracion = "configuracion.csv";
+  const char* salidaAnomalias = "anomalias.csv";
+  const char* salidaConfirmaciones = "confirmaciones.csv";
+  const char* sitios = nullptr;
+  size_t presupuestoIndice = PRESUPUESTO_INDICE_DEFECTO;
+  double perdidaAck = 0;   // probabilidad de no responder un lote (pruebas)
+  bool silencioso = false;
+};
+
+// Secuencia siguiente a la última guardada, por equipo
+static std::map<uint32_t, uint32_t> confirmadoHasta;
+static FILE* csv = nullptr;
+static FILE* csvSesiones = nullptr;
+static FILE* csvConfiguracion = nullptr;
+static FILE* csvAnomalias = nullptr;
+static FILE* csvConfirmaciones = nullptr;
+static int csvLectura = -1;
+static const char* rutaResultados = nullptr;
+static IndiceSujetos* indice = nullptr;
+static ArchivoColumnar archivo;
+
+// Resultados escritos en el lote en curso; se indexan cuando ya están en
+// el fichero
+struct PendienteIndice {
+  uint32_t sujeto;
+  uint64_t posicion;
+  uint64_t fin;
+};
+static std::vector<PendienteIndice> pendientesIndice;
+static DetectorAnomalias detector;
+static AgregadosFlota agregados;
+static std::unordered_map<uint32_t, uint32_t> sitioDe;
+static std::set<uint32_t> equiposConocidos;
+
+// Despliegue de configuración y su avance en cada equipo; 'respondidos'
+// y 'errores' tienen un bit por comando, y estado y valorLeido son los
+// del último error o, si no lo hubo, de la última confirmación
+struct AvanceEquipo {
+  uint32_t envios;
+  time_t primerEnvio;
+  time_t terminado;
+  uint16_t respondidos;
+  uint16_t errores;
+  uint8_t estado;
+  uint16_t valorLeido;
+};
+
+struct Despliegue {
+  AmbitoAgregado ambito;
+  uint32_t id;
+  time_t inicio;
+  time_t terminado;
+  std::vector<ComandoOrden> comandos;
+  std::map<uint32_t, AvanceEquipo> equipos;
+
+  bool alcanza(uint32_t equipo) const;
+  bool completo(const AvanceEquipo& a) const {
+    return a.respondidos == (1u << comandos.size()) - 1;
+  }
+};
+static std::map<uint32_t, Despliegue> despliegues;  // por idOrden
+static uint32_t ultimaOrden = 0;
+
+static const char* const NOMBRES_CONFIRMACION[] = {"aplicada", "discrepancia", "rechazada",
+                                                   "sin_respuesta", "invalida"};
+
+// Resúmenes por día de cada sitio y de la flota; ocupan unos 11 KB cada uno
+#define RETENCION_DIAS_RESUMENES 62
+#define SEGUNDOS_DIA 86400
+
+struct ResumenDia {
+  ResumenCuantiles alcohol;
+  ContadorDistintos sujetos;
+  ContadorDistintos equipos;
+
+  void fusionar(const ResumenDia& o) {
+    alcohol.fusionar(o.alcohol);
+    sujetos.fusionar(o.sujetos);
+    equipos.fusionar(o.equipos);
+  }
+};
+static std::map<uint64_t, std::map<uint32_t, ResumenDia>> resumenes;  // ámbito << 32 | id
+static uint64_t registrosGuardados = 0;
+static uint64_t duplicados = 0;
+static uint64_t desconocidos = 0;
+
+// Una marca más antigua que esto respecto al envío es de antes de un
+// reinicio (millis() volvió a empezar)
+#define EDAD_MAXIMA_MARCA_MS (30UL * 24 * 3600 * 1000)
+
+struct Recepcion {
+  time_t recibido;
+  int64_t recibidoMs;
+  bool conMarcaEnvio;
+  uint32_t marcaEnvioMs;
+};
+
+// Hora de la prueba en el reloj del colector, en segundos
+static int64_t instantePrueba(const Recepcion& rx, uint32_t marcaMs) {
+  uint32_t edadMs = rx.marcaEnvioMs - marcaMs;
+  if (!rx.conMarcaEnvio || edadMs > EDAD_MAXIMA_MARCA_MS) return rx.recibido;
+  return (rx.recibidoMs - edadMs) / 1000;
+}
+
+static uint32_t sitioDeEquipo(uint32_t id) {
+  auto i = sitioDe.find(id);
+  return i != sitioDe.end() ? i->second : SITIO_DESCONOCIDO;
+}
+
+bool Despliegue::alcanza(uint32_t equipo) const {
+  switch (ambito) {
+    case AMBITO_FLOTA: return true;
+    case AMBITO_SITIO: return sitioDeEquipo(equipo) == id;
+    default: return equipo == id;
+  }
+}
+
+static uint64_t claveResumen(AmbitoAgregado ambito, uint32_t id) {
+  return (uint64_t)ambito << 32 | (ambito == AMBITO_FLOTA ? 0 : id);
+}
+
+// Los repetidos ya contados no llegan a los resúmenes
+static void agregarResultado(uint32_t id, uint32_t secuencia, int64_t instante,
+                             uint32_t idSujeto, uint16_t alcoholMg100ml, uint8_t alarma) {
+  uint32_t sitio = sitioDeEquipo(id);
+  if (!agregados.anotar(id, sitio, secuencia, instante, alcoholMg100ml, alarma)) return;
+  uint32_t dia = instante > 0 ? (uint32_t)(instante / SEGUNDOS_DIA) : 0;
+  for (uint64_t clave : {claveResumen(AMBITO_SITIO, sitio), claveResumen(AMBITO_FLOTA, 0)}) {
+    ResumenDia& r = resumenes[clave][dia];
+    r.alcohol.anotar(alcoholMg100ml);
+    if (idSujeto != 0) r.sujetos.anotar(idSujeto);
+    r.equipos.anotar(id);
+  }
+}
+
+static void podarResumenes(int64_t ahora) {
+  uint32_t dia = (uint32_t)(ahora / SEGUNDOS_DIA);
+  if (dia <= RETENCION_DIAS_RESUMENES) return;
+  for (auto& porDia : resumenes) {
+    porDia.second.erase(porDia.second.begin(),
+                        porDia.second.lower_bound(dia - RETENCION_DIAS_RESUMENES));
+  }
+}
+
+static void vigilarSalud(uint32_t id, const RegistroResultado& r, uint8_t version,
+                         time_t recibido) {
+  ObservacionPrueba o = {};
+  if (version >= 2) {
+    o.valores[SALUD_TIMEOUTS] = r.timeoutsEnlace;
+    o.valores[SALUD_INTERRUPCIONES] = r.soplidosInterrumpidos;
+    o.presentes |= 1u << SALUD_TIMEOUTS | 1u << SALUD_INTERRUPCIONES;
+  }
+  if (r.alarma == 0) {
+    o.valores[SALUD_ALCOHOL] = r.alcoholMg100ml;
+    o.presentes |= 1u << SALUD_ALCOHOL;
+  }
+  if (r.precalentamientoMs > 0) {
+    o.valores[SALUD_PRECALENTAMIENTO] = r.precalentamientoMs;
+    o.presentes |= 1u << SALUD_PRECALENTAMIENTO;
+  }
+  Anomalia nuevas[NUM_METRICAS_SALUD];
+  uint8_t n = detector.observar(id, o, nuevas);
+  for (uint8_t i = 0; i < n; i++) {
+    const Anomalia& a = nuevas[i];
+    const char* metrica = PARAMETROS_SALUD[a.metrica].nombre;
+    fprintf(csvAnomalias, "%u,%u,%s,%.1f,%.2f,%.2f,%.2f,%ld\n", id, r.secuencia, metrica,
+            a.valor, a.media, a.desviacion, a.cusum, (long)recibido);
+    printf("anomalia equipo=%u secuencia=%u metrica=%s valor=%.1f media=%.2f "
+           "desviacion=%.2f equipos_en_alarma=%zu\n",
+           id, r.secuencia, metrica, a.valor, a.media, a.desviacion,
+           detector.equiposEnAlarma());
+  }
+  if (n > 0) fflush(stdout);
+}
+
+static void anotarConfirmacion(uint32_t id, const RegistroConfirmacion& r, time_t recibido) {
+  auto d = despliegues.find(r.idOrden);
+  if (d == despliegues.end()) return;
+  Despliegue& des = d->second;
+  for (size_t i = 0; i < des.comandos.size(); i++) {
+    if (des.comandos[i].comando != r.comando) continue;
+    AvanceEquipo& a = des.equipos[id];
+    a.respondidos |= (uint16_t)(1u << i);
+    if (r.estado != CONFIRMACION_APLICADA) a.errores |= (uint16_t)(1u << i);
+    if (r.estado != CONFIRMACION_APLICADA || a.errores == 0) {
+      a.estado = r.estado;
+      a.valorLeido = r.valorLeido;
+    }
+    if (des.completo(a) && a.terminado == 0) a.terminado = recibido;
+  }
+  if (des.terminado != 0) return;
+  uint32_t errores = 0;
+  for (const auto& e : des.equipos) {
+    if (!des.completo(e.second)) return;
+    errores += e.second.errores != 0;
+  }
+  des.terminado = recibido;
+  printf("despliegue orden=%u completo=1 equipos=%zu errores=%u segundos=%ld\n", r.idOrden,
+         des.equipos.size(), errores, (long)(recibido - des.inicio));
+  fflush(stdout);
+}
+
+// Comandos aún sin confirmar del equipo, de todos los despliegues que le
+// alcanzan. Los de un mismo despliegue van siempre juntos: el equipo
+// descarta los idOrden que ya ha visto.
+static void enviarOrden(int fd, uint32_t idDispositivo, time_t ahora) {
+  OrdenConfiguracion orden;
+  orden.numComandos = 0;
+  for (auto& d : despliegues) {
+    Despliegue& des = d.second;
+    if (!des.alcanza(idDispositivo)) continue;
+    auto nuevo = des.equipos.try_emplace(idDispositivo);
+    if (nuevo.second) des.terminado = 0;
+    AvanceEquipo& a = nuevo.first->second;
+    uint8_t n = 0;
+    for (size_t i = 0; i < des.comandos.size(); i++) n += !(a.respondidos >> i & 1);
+    if (n == 0) continue;
+    if (orden.numComandos + n > MAX_COMANDOS_ORDEN) break;
+    for (size_t i = 0; i < des.comandos.size(); i++) {
+      if (!(a.respondidos >> i & 1)) orden.comandos[orden.numComandos++] = des.comandos[i];
+    }
+    a.envios++;
+    if (a.primerEnvio == 0) a.primerEnvio = ahora;
+  }
+  if (orden.numComandos == 0) return;
+  uint8_t mensaje[SUBIDA_CABECERA + 5 + MAX_COMANDOS_ORDEN * 6 + SUBIDA_CRC];
+  uint16_t longitud = codificarOrden(mensaje + SUBIDA_CABECERA, idDispositivo, orden);
+  size_t n = cerrarMensaje(mensaje, MENSAJE_ORDEN, longitud);
+  send(fd, mensaje, n, MSG_NOSIGNAL);
+}
+
+static void responderAck(int fd, uint32_t idDispositivo) {
+  uint8_t mensaje[SUBIDA_CABECERA + 8 + SUBIDA_CRC];
+  escribirU32(mensaje + SUBIDA_CABECERA, idDispositivo);
+  escribirU32(mensaje + SUBIDA_CABECERA + 4, confirmadoHasta[idDispositivo]);
+  size_t n = cerrarMensaje(mensaje, MENSAJE_ACK, 8);
+  send(fd, mensaje, n, MSG_NOSIGNAL);
+}
+
+// Guarda un registro codificado; false si está mal formado
+static bool guardarRegistro(uint32_t id, const uint8_t* registro, size_t n,
+                            const Recepcion& rx) {
+  time_t recibido = rx.recibido;
+  switch (tipoRegistro(registro)) {
+    case REGISTRO_RESULTADO: {
+      RegistroResultado r;
+      if (!decodificarRegistro(registro, n, r)) return false;
+      int64_t instante = instantePrueba(rx, r.marcaMs);
+      uint64_t posicion = (uint64_t)ftell(csv);
+      fprintf(csv, "%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%ld,%lld\n", id, r.secuencia, r.marcaMs,
+              r.idSujeto, r.secuenciaVinculada, r.alcoholMg100ml, r.alarma,
+              r.banderas, r.timeoutsEnlace, r.soplidosInterrumpidos,
+              r.precalentamientoMs, (long)recibido, (long long)instante);
+      pendientesIndice.push_back({r.idSujeto, posicion, (uint64_t)ftell(csv)});
+      vigilarSalud(id, r, versionRegistro(registro), recibido);
+      agregarResultado(id, r.secuencia, instante, r.idSujeto, r.alcoholMg100ml, r.alarma);
+      return true;
+    }
+    case REGISTRO_SESION: {
+      RegistroSesion r;
+      if (!decodificarRegistro(registro, n, r)) return false;
+      fprintf(csvSesiones, "%u,%u,%u,%u,%u,%u,%u,%u,%u,%ld\n", id, r.secuencia,
+              r.inicioMs, r.finMs, r.idSujeto, r.numPruebas, r.secuenciaFinal,
+              r.alcoholFinalMg100ml, r.alarmaFinal, (long)recibido);
+      return true;
+    }
+    case REGISTRO_CONFIGURACION: {
+      RegistroConfiguracion r;
+      if (!decodificarRegistro(registro, n, r)) return false;
+      fprintf(csvConfiguracion, "%u,%u,%u,%u,%u,%u,%u,%ld\n", id, r.secuencia,
+              r.marcaMs, r.tiempoSopladoS, r.umbralBebido, r.umbralEbrio,
+              r.versionFirmware, (long)recibido);
+      return true;
+    }
+    case REGISTRO_CONFIRMACION: {
+      RegistroConfirmacion r;
+      if (!decodificarRegistro(registro, n, r)) return false;
+      fprintf(csvConfirmaciones, "%u,%u,%u,%u,%u,%u,%u,%u,%ld\n", id, r.secuencia, r.marcaMs,
+              r.idOrden, r.comando, r.valorPedido, r.estado, r.valorLeido, (long)recibido);
+      anotarConfirmacion(id, r, recibido);
+      return true;
+    }
+    default:
+      desconocidos++;
+      return true;
+  }
+}
+
+// Línea del CSV de resultados en cualquiera de sus formatos: sin sujeto
+// (7 campos), sin salud del sensor (9), sin instante (12) o completa (13).
+// Sin instante vale la hora de llegada.
+static bool leerFilaCsv(const char* linea, FilaArchivo& f) {
+  unsigned v[11] = {0};
+  long long recibido = 0, instante = 0;
+  int campos = 1;
+  for (const char* p = linea; *p != '\0'; p++) campos += *p == ',';
+  bool bien;
+  switch (campos) {
+    case 13:
+      bien = sscanf(linea, "%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%lld,%lld", &v[0], &v[1], &v[2],
+                    &v[3], &v[4], &v[5], &v[6], &v[7], &v[8], &v[9], &v[10], &recibido,
+                    &instante) == 13;
+      break;
+    case 12:
+      bien = sscanf(linea, "%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%lld", &v[0], &v[1], &v[2], &v[3],
+                    &v[4], &v[5], &v[6], &v[7], &v[8], &v[9], &v[10], &recibido) == 12;
+      instante = recibido;
+      break;
+    case 9:
+      bien = sscanf(linea, "%u,%u,%u,%u,%u,%u,%u,%u,%lld", &v[0], &v[1], &v[2], &v[3], &v[4],
+                    &v[5], &v[6], &v[7], &recibido) == 9;
+      instante = recibido;
+      break;
+    case 7:
+      bien = sscanf(linea, "%u,%u,%u,%u,%u,%u,%lld", &v[0], &v[1], &v[2], &v[5], &v[6], &v[7],
+                    &recibido) == 7;
+      instante = recibido;
+      break;
+    default:
+      return false;
+  }
+  f.idDispositivo = v[0];
+  f.secuencia = v[1];
+  f.marcaMs = v[2];
+  f.idSujeto = v[3];
+  f.secuenciaVinculada = v[4];
+  f.alcoholMg100ml = (uint16_t)v[5];
+  f.alarma = (uint8_t)v[6];
+  f.banderas = (uint8_t)v[7];
+  f.timeoutsEnlace = (uint8_t)v[8];
+  f.soplidosInterrumpidos = (uint8_t)v[9];
+  f.precalentamientoMs = (uint16_t)v[10];
+  f.recibido = recibido;
+  f.instante = instante;
+  return bien;
+}
+
+// Convierte al archivo lo que el índice ya ha sellado, en trozos de como
+// mucho MAX_FILAS_TROZO resultados
+static void archivarSellados() {
+  uint64_t hasta = indice->finSellado();
+  if (archivo.finArchivado() >= hasta) return;
+  FILE* f = fopen(rutaResultados, "r");
+  if (f == nullptr || fseeko(f, (off_t)archivo.finArchivado(), SEEK_SET) != 0) {
+    perror("archivo");
+    if (f != nullptr) fclose(f);
+    return;
+  }
+  std::vector<FilaArchivo> filas;
+  filas.reserve(MAX_FILAS_TROZO);
+  char linea[256];
+  uint64_t posicion = archivo.finArchivado();
+  while (posicion < hasta && fgets(linea, sizeof(linea), f) != nullptr) {
+    posicion = (uint64_t)ftello(f);
+    FilaArchivo fila;
+    if (leerFilaCsv(linea, fila)) filas.push_back(fila);
+    if (filas.size() < MAX_FILAS_TROZO && posicion < hasta) continue;
+    if (!filas.empty() && !archivo.anexar(filas.data(), (uint32_t)filas.size(), posicion)) {
+      perror("archivo");
+      break;
+    }
+    filas.clear();
+  }
+  fclose(f);
+}
+
+static void procesarLote(int fd, const AnalizadorMensajes& a, const Opciones& op,
+                         std::mt19937& rng) {
+  if (a.longitudCarga() < 5) return;
+  const uint8_t* carga = a.carga();
+  const uint8_t* fin = carga + a.longitudCarga();
+  uint32_t id = leerU32(carga);
+  uint8_t n = carga[4];
+  equiposConocidos.insert(id);
+
+  uint32_t& hasta = confirmadoHasta[id];
+  struct timespec ahora;
+  clock_gettime(CLOCK_REALTIME, &ahora);
+  Recepcion rx = {ahora.tv_sec, (int64_t)ahora.tv_sec * 1000 + ahora.tv_nsec / 1000000,
+                  false, 0};
+  // marcaEnvioMs va justo detrás del último registro
+  const uint8_t* q = carga + 5;
+  uint8_t recorridos = 0;
+  while (recorridos < n && fin - q >= OFFSET_SECUENCIA + 4) {
+    size_t longitud = longitudRegistro(q);
+    if (longitud < OFFSET_SECUENCIA + 4 || longitud > (size_t)(fin - q)) break;
+    q += longitud;
+    recorridos++;
+  }
+  if (recorridos == n && fin - q == 4) {
+    rx.conMarcaEnvio = true;
+    rx.marcaEnvioMs = leerU32(q);
+  }
+
+  const uint8_t* p = carga + 5;
+  for (uint8_t i = 0; i < n; i++) {
+    if (fin - p < OFFSET_SECUENCIA + 4) break;
+    size_t longitud = longitudRegistro(p);
+    if (longitud < OFFSET_SECUENCIA + 4 || longitud > (size_t)(fin - p)) break;
+    uint32_t secuencia = leerU32(p + OFFSET_SECUENCIA);
+    if (secuencia < hasta) {
+      duplicados++;
+    } else {
+      // Uno mal formado corta el lote: se confirma sólo lo anterior
+      if (!guardarRegistro(id, p, longitud, rx)) break;
+      hasta = secuencia + 1;
+      registrosGuardados++;
+    }
+    p += longitud;
+  }
+  // Guardado antes de confirmar: si el colector cae, el equipo reenvía
+  fflush(csv);
+  fflush(csvSesiones);
+  fflush(csvConfiguracion);
+  fflush(csvAnomalias);
+  fflush(csvConfirmaciones);
+  for (const PendienteIndice& p : pendientesIndice) {
+    if (!indice->anotar(p.sujeto, p.posicion, p.fin)) perror("indice");
+  }
+  pendientesIndice.clear();
+  archivarSellados();
+  agregados.podar(rx.recibido);
+  podarResumenes(rx.recibido);
+
+  if (op.perdidaAck > 0 &&
+      std::uniform_real_distribution<double>(0, 1)(rng) < op.perdidaAck) {
+    return;
+  }
+  // La orden va antes del ACK: el equipo la tiene al dar el lote por subido
+  enviarOrden(fd, id, rx.recibido);
+  responderAck(fd, id);
+  if (!op.silencioso) {
+    printf("equipo=%u registros=%u confirmado_hasta=%u guardados=%llu "
+           "duplicados=%llu desconocidos=%llu\n",
+           id, n, hasta, (unsigned long long)registrosGuardados,
+           (unsigned long long)duplicados, (unsigned long long)desconocidos);
+  }
+}
+
+// Lo ya guardado no se vuelve a guardar aunque el colector se reinicie: la
+// secuencia es única por equipo en todos los tipos de registro
+static void anotarConfirmado(uint32_t id, uint32_t secuencia) {
+  uint32_t& hasta = confirmadoHasta[id];
+  if (secuencia >= hasta) hasta = secuencia + 1;
+}
+
+// Sesiones, configuración y confirmaciones de una ejecución anterior: sólo
+// cuentan para lo confirmado a cada equipo
+static void cargarConfirmados(const char* ruta) {
+  FILE* f = fopen(ruta, "r");
+  if (f == nullptr) return;
+  char linea[256];
+  unsigned id, secuencia;
+  while (fgets(linea, sizeof(linea), f) != nullptr) {
+    if (sscanf(linea, "%u,%u", &id, &secuencia) == 2) anotarConfirmado(id, secuencia);
+  }
+  fclose(f);
+}
+
+// Resultados ya guardados por una ejecución anterior: se indexan los que
+// no cubre el índice y se agregan todos menos las líneas sin la hora
+// estimada (colectores anteriores)
+static void cargarResultados(const char* ruta) {
+  FILE* f = fopen(ruta, "r");
+  if (f == nullptr) return;
+  char linea[256];
+  unsigned id, secuencia, sujeto, alcohol, alarma;
+  long long instante;
+  size_t cargados = 0, indexados = 0;
+  uint64_t posicion = 0;
+  while (fgets(linea, sizeof(linea), f) != nullptr) {
+    uint64_t fin = (uint64_t)ftell(f);
+    if (posicion >= indice->finSellado() && sscanf(linea, "%*u,%*u,%*u,%u", &sujeto) == 1) {
+      indice->anotar(sujeto, posicion, fin);
+      indexados++;
+    }
+    posicion = fin;
+    if (sscanf(linea, "%u,%u", &id, &secuencia) == 2) anotarConfirmado(id, secuencia);
+    if (sscanf(linea, "%u,%u,%*u,%u,%*u,%u,%u,%*u,%*u,%*u,%*u,%*d,%lld", &id, &secuencia,
+               &sujeto, &alcohol, &alarma, &instante) != 6) {
+      continue;
+    }
+    agregarResultado(id, secuencia, instante, sujeto, (uint16_t)alcohol, (uint8_t)alarma);
+    equiposConocidos.insert(id);
+    cargados++;
+  }
+  fclose(f);
+  agregados.podar(time(nullptr));
+  podarResumenes(time(nullptr));
+  archivarSellados();
+  printf("agregados_cargados=%zu cubetas=%zu indexados=%zu segmentos_sellados=%zu "
+         "trozos_archivo=%zu filas_archivo=%llu bytes_archivo=%llu\n",
+         cargados, agregados.cubetas(), indexados, indice->segmentosSellados(),
+         archivo.numTrozos(), (unsigned long long)archivo.filas(),
+         (unsigned long long)archivo.bytesArchivo());
+}
+
+static bool cargarSitios(const char* ruta) {
+  FILE* f = fopen(ruta, "r");
+  if (f == nullptr) return false;
+  unsigned id, sitio;
+  while (fscanf(f, " %u,%u", &id, &sitio) == 2) {
+    sitioDe[id] = sitio;
+    equiposConocidos.insert(id);
+  }
+  fclose(f);
+  return true;
+}
+
+static const char* const NOMBRES_AMBITO[] = {"flota", "sitio", "equipo"};
+
+static bool leerAmbito(const char* texto, AmbitoAgregado& a, unsigned& id, long long& desde,
+                       long long& hasta) {
+  char ambito[16];
+  id = 0;
+  if (sscanf(texto, "flota %lld %lld", &desde, &hasta) == 2) {
+    a = AMBITO_FLOTA;
+    return true;
+  }
+  if (sscanf(texto, "%15s %u %lld %lld", ambito, &id, &desde, &hasta) != 4) return false;
+  if (strcmp(ambito, "sitio") == 0) {
+    a = AMBITO_SITIO;
+  } else if (strcmp(ambito, "equipo") == 0) {
+    a = AMBITO_EQUIPO;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+static double microsegundosDesde(const struct timespec& t0) {
+  struct timespec t1;
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  return (t1.tv_sec - t0.tv_sec) * 1e6 + (t1.tv_nsec - t0.tv_nsec) / 1e3;
+}
+
+static void imprimirHex(const char* clave, const uint8_t* datos, size_t n) {
+  printf(" %s=", clave);
+  for (size_t i = 0; i < n; i++) printf("%02x", datos[i]);
+}
+
+// Días enteros que tocan [desde, hasta)
+static void responderResumen(AmbitoAgregado a, unsigned id, long long desde, long long hasta,
+                             bool exportar) {
+  struct timespec t0;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  static ResumenDia total;
+  total = ResumenDia();
+  auto serie = resumenes.find(claveResumen(a, id));
+  if (serie != resumenes.end() && hasta > desde && desde >= 0) {
+    uint32_t d0 = (uint32_t)(desde / SEGUNDOS_DIA);
+    uint32_t d1 = (uint32_t)((hasta + SEGUNDOS_DIA - 1) / SEGUNDOS_DIA);
+    for (auto d = serie->second.lower_bound(d0); d != serie->second.end() && d->first < d1; ++d) {
+      total.fusionar(d->second);
+    }
+  }
+  if (exportar) {
+    static uint8_t buffer[MAX_SERIALIZADO_CUANTILES];
+    printf("consulta=exportar ambito=%s id=%u desde=%lld hasta=%lld", NOMBRES_AMBITO[a], id,
+           desde, hasta);
+    imprimirHex("alcohol", buffer, total.alcohol.serializar(buffer, sizeof(buffer)));
+    imprimirHex("sujetos", buffer, total.sujetos.serializar(buffer, sizeof(buffer)));
+    imprimirHex("equipos", buffer, total.equipos.serializar(buffer, sizeof(buffer)));
+    printf("\n");
+  } else {
+    float p50 = total.alcohol.cuantil(0.5f), p95 = total.alcohol.cuantil(0.95f);
+    float p99 = total.alcohol.cuantil(0.99f);
+    double sujetos = total.sujetos.estimar(), equipos = total.equipos.estimar();
+    printf("consulta=cuantiles ambito=%s id=%u desde=%lld hasta=%lld pruebas=%llu "
+           "p50_mg=%.1f p95_mg=%.1f p99_mg=%.1f sujetos=%.0f equipos=%.0f us=%.1f\n",
+           NOMBRES_AMBITO[a], id, desde, hasta, (unsigned long long)total.alcohol.cuenta(),
+           p50, p95, p99, sujetos, equipos, microsegundosDesde(t0));
+  }
+  fflush(stdout);
+}
+
+static void responderSujeto(uint32_t sujeto) {
+  struct timespec t0;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  std::vector<uint64_t> posiciones;
+  EstadisticasBusqueda e;
+  indice->buscar(sujeto, posiciones, &e);
+  char linea[256];
+  for (uint64_t posicion : posiciones) {
+    ssize_t n = pread(csvLectura, linea, sizeof(linea) - 1, (off_t)posicion);
+    if (n <= 0) continue;
+    linea[n] = '\0';
+    char* fin = strchr(linea, '\n');
+    if (fin != nullptr) *fin = '\0';
+    printf("prueba=%s\n", linea);
+  }
+  printf("consulta=sujeto id=%u pruebas=%zu segmentos=%u descartados_bloom=%u "
+         "bloques_leidos=%u memoria_indice=%zu us=%.1f\n",
+         sujeto, posiciones.size(), e.segmentos, e.descartadosBloom, e.bloquesLeidos,
+         indice->bytesEnMemoria(), microsegundosDesde(t0));
+  fflush(stdout);
+}
+
+static void responderArchivo(AmbitoAgregado a, unsigned id, long long desde, long long hasta) {
+  struct timespec t0;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  std::function<bool(uint32_t)> equipo;
+  if (a == AMBITO_SITIO) {
+    equipo = [id](uint32_t e) { return sitioDeEquipo(e) == id; };
+  } else if (a == AMBITO_EQUIPO) {
+    equipo = [id](uint32_t e) { return e == id; };
+  }
+  Agregado r = {};
+  EstadisticasRecorrido e;
+  bool bien = archivo.agregar(desde, hasta, equipo, r, &e);
+  printf("consulta=archivo ambito=%s id=%u desde=%lld hasta=%lld pruebas=%u ninguna=%u "
+         "bebido=%u ebrio=%u media_mg=%.1f max_mg=%u trozos=%u descartados_zona=%u "
+         "filas_leidas=%llu bytes_leidos=%llu completo=%d us=%.1f\n",
+         NOMBRES_AMBITO[a], id, desde, hasta, r.pruebas, r.porAlarma[ALARM_NONE],
+         r.porAlarma[ALARM_DRINKING], r.porAlarma[ALARM_DRUNK], r.mediaMg(), r.maxMg, e.trozos,
+         e.descartadosZona, (unsigned long long)e.filasLeidas,
+         (unsigned long long)e.bytesLeidos, bien ? 1 : 0, microsegundosDesde(t0));
+  fflush(stdout);
+}
+
+// "configurar <ámbito> <comandos>"; el ámbito va sin intervalo
+static void responderConfigurar(const char* texto) {
+  Despliegue d = {};
+  unsigned id = 0;
+  int usado = 0;
+  if (sscanf(texto, "flota%n", &usado) == 0 && usado > 0) {
+    d.ambito = AMBITO_FLOTA;
+  } else if (sscanf(texto, "sitio %u%n", &id, &usado) == 1) {
+    d.ambito = AMBITO_SITIO;
+  } else if (sscanf(texto, "equipo %u%n", &id, &usado) == 1) {
+    d.ambito = AMBITO_EQUIPO;
+  } else {
+    printf("consulta=invalida\n");
+    fflush(stdout);
+    return;
+  }
+  d.id = id;
+  // Un idOrden no se repite aunque el colector se reinicie
+  uint32_t orden = ultimaOrden + 1;
+  if ((uint32_t)time(nullptr) > orden) orden = (uint32_t)time(nullptr);
+  const char* p = texto + usado;
+  unsigned valor;
+  int m = 0;
+  bool bien = true;
+  while (bien && *p != '\0') {
+    m = 0;
+    if (sscanf(p, " soplado %u%n", &valor, &m) == 1 && valor >= 1 && valor <= 10) {
+      d.comandos.push_back({orden, COMANDO_TIEMPO_SOPLADO, (uint8_t)valor});
+    } else if (sscanf(p, " adaptativo %u%n", &valor, &m) == 1 && valor <= 1) {
+      d.comandos.push_back({orden, COMANDO_SOPLADO_ADAPTATIVO, (uint8_t)valor});
+    } else if (sscanf(p, " umbrales%n", &m) == 0 && m > 0) {
+      d.comandos.push_back({orden, COMANDO_LEER_UMBRALES, 0});
+    } else {
+      m = 0;
+      while (p[m] == ' ') m++;
+      bien = p[m] == '\0';
+    }
+    p += m;
+  }
+  if (!bien || d.comandos.empty() || d.comandos.size() > MAX_COMANDOS_ORDEN) {
+    printf("consulta=invalida\n");
+    fflush(stdout);
+    return;
+  }
+  ultimaOrden = orden;
+  d.inicio = time(nullptr);
+  for (uint32_t e : equiposConocidos) {
+    if (d.alcanza(e)) d.equipos[e] = AvanceEquipo();
+  }
+  if (d.ambito == AMBITO_EQUIPO) d.equipos[id];
+  Despliegue& nuevo = despliegues[orden] = d;
+  printf("consulta=configurar orden=%u ambito=%s id=%u comandos=%zu objetivo=%zu\n", orden,
+         NOMBRES_AMBITO[nuevo.ambito], nuevo.id, nuevo.comandos.size(), nuevo.equipos.size());
+  fflush(stdout);
+}
+
+static void responderDespliegue(uint32_t orden) {
+  auto d = despliegues.find(orden);
+  if (d == despliegues.end()) {
+    printf("consulta=despliegue orden=%u existe=0\n", orden);
+    fflush(stdout);
+    return;
+  }
+  const Despliegue& des = d->second;
+  uint32_t confirmados = 0, errores = 0, enviados = 0;
+  for (const auto& e : des.equipos) {
+    const AvanceEquipo& a = e.second;
+    enviados += a.envios > 0;
+    if (des.completo(a) && a.errores == 0) {
+      confirmados++;
+      continue;
+    }
+    errores += a.errores != 0;
+    uint8_t estado = a.estado <= CONFIRMACION_INVALIDA ? a.estado : CONFIRMACION_INVALIDA;
+    printf("equipo=%u envios=%u respondidos=%u errores=%u estado=%s valor_leido=%u\n",
+           e.first, a.envios, __builtin_popcount(a.respondidos), __builtin_popcount(a.errores),
+           a.respondidos != 0 ? NOMBRES_CONFIRMACION[estado] : "-", a.valorLeido);
+  }
+  time_t fin = des.terminado != 0 ? des.terminado : time(nullptr);
+  printf("consulta=despliegue orden=%u ambito=%s id=%u objetivo=%zu enviados=%u "
+         "confirmados=%u errores=%u pendientes=%zu completo=%d segundos=%ld\n",
+         orden, NOMBRES_AMBITO[des.ambito], des.id, des.equipos.size(), enviados, confirmados,
+         errores, des.equipos.size() - confirmados - errores, des.terminado != 0 ? 1 : 0,
+         (long)(fin - des.inicio));
+  fflush(stdout);
+}
+
+static void responderConsulta(const char* linea) {
+  unsigned id;
+  long long desde, hasta;
+  AmbitoAgregado a;
+  if (sscanf(linea, "sujeto %u", &id) == 1) {
+    responderSujeto(id);
+    return;
+  }
+  if (strncmp(linea, "configurar ", 11) == 0) {
+    responderConfigurar(linea + 11);
+    return;
+  }
+  if (sscanf(linea, "despliegue %u", &id) == 1) {
+    responderDespliegue(id);
+    return;
+  }
+  if (strncmp(linea, "archivo ", 8) == 0 && leerAmbito(linea + 8, a, id, desde, hasta)) {
+    responderArchivo(a, id, desde, hasta);
+    return;
+  }
+  bool exportar = strncmp(linea, "exportar ", 9) == 0;
+  if (exportar || strncmp(linea, "cuantiles ", 10) == 0) {
+    if (leerAmbito(linea + (exportar ? 9 : 10), a, id, desde, hasta) && a != AMBITO_EQUIPO) {
+      responderResumen(a, id, desde, hasta, exportar);
+      return;
+    }
+  } else if (leerAmbito(linea, a, id, desde, hasta)) {
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    Agregado r = agregados.consultar(a, id, desde, hasta);
+    double us = microsegundosDesde(t0);
+    printf("consulta=%s id=%u desde=%lld hasta=%lld pruebas=%u ninguna=%u bebido=%u "
+           "ebrio=%u media_mg=%.1f max_mg=%u us=%.1f\n",
+           NOMBRES_AMBITO[a], id, desde, hasta, r.pruebas, r.porAlarma[ALARM_NONE],
+           r.porAlarma[ALARM_DRINKING], r.porAlarma[ALARM_DRUNK], r.mediaMg(), r.maxMg, us);
+    fflush(stdout);
+    return;
+  }
+  printf("consulta=invalida\n");
+  fflush(stdout);
+}
+
+// Devuelve false cuando se cierra la entrada estándar
+static bool leerConsultas() {
+  static std::string pendiente;
+  char bytes[512];
+  ssize_t n = read(STDIN_FILENO, bytes, sizeof(bytes));
+  if (n <= 0) return false;
+  pendiente.append(bytes, (size_t)n);
+  size_t fin;
+  while ((fin = pendiente.find('\n')) != std::string::npos) {
+    pendiente[fin] = '\0';
+    responderConsulta(pendiente.c_str());
+    pendiente.erase(0, fin + 1);
+  }
+  return true;
+}
+
+static int abrirServidor(uint16_t puerto) {
+  int fd = socket(AF_INET6, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  int uno = 1, cero = 0;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &uno, sizeof(uno));
+  setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &cero, sizeof(cero));
+  struct sockaddr_in6 dir;
+  memset(&dir, 0, sizeof(dir));
+  dir.sin6_family = AF_INET6;
+  dir.sin6_addr = in6addr_any;
+  dir.sin6_port = htons(puerto);
+  if (bind(fd, (struct sockaddr*)&dir, sizeof(dir)) != 0 || listen(fd, 64) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int main(int argc, char** argv) {
+  Opciones op;
+  int c;
+  while ((c = getopt(argc, argv, "p:o:s:k:a:c:e:m:l:q")) != -1) {
+    switch (c) {
+      case 'p': op.puerto = (uint16_t)atoi(optarg); break;
+      case 'o': op.salida = optarg; break;
+      case 's': op.salidaSesiones = optarg; break;
+      case 'k': op.salidaConfiguracion = optarg; break;
+      case 'a': op.salidaAnomalias = optarg; break;
+      case 'c': op.salidaConfirmaciones = optarg; break;
+      case 'e': op.sitios = optarg; break;
+      case 'm': op.presupuestoIndice = (size_t)atoi(optarg) << 20; break;
+      case 'l': op.perdidaAck = atof(optarg); break;
+      case 'q': op.silencioso = true; break;
+      default:
+        fprintf(stderr, "uso: %s [-p puerto] [-o resultados.csv] [-s sesiones.csv] "
+                        "[-k configuracion.csv] [-a anomalias.csv] [-c confirmaciones.csv] "
+                        "[-e sitios.csv] "
+                        "[-m presupuesto_indice_mb] [-l perdida_ack] [-q]\n",
+                argv[0]);
+        return 2;
+    }
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  if (op.sitios != nullptr && !cargarSitios(op.sitios)) {
+    perror(op.sitios);
+    return 1;
+  }
+  csv = fopen(op.salida, "a");
+  csvSesiones = fopen(op.salidaSesiones, "a");
+  csvConfiguracion = fopen(op.salidaConfiguracion, "a");
+  csvAnomalias = fopen(op.salidaAnomalias, "a");
+  csvConfirmaciones = fopen(op.salidaConfirmaciones, "a");
+  if (csv == nullptr || csvSesiones == nullptr || csvConfiguracion == nullptr ||
+      csvAnomalias == nullptr || csvConfirmaciones == nullptr) {
+    perror("salida");
+    return 1;
+  }
+  fseek(csv, 0, SEEK_END);
+  csvLectura = open(op.salida, O_RDONLY);
+  rutaResultados = op.salida;
+  std::string rutaIndice = std::string(op.salida) + ".indice";
+  indice = new IndiceSujetos(op.presupuestoIndice);
+  if (csvLectura < 0 || !indice->abrir(rutaIndice.c_str(), (uint64_t)ftell(csv))) {
+    perror(rutaIndice.c_str());
+    return 1;
+  }
+  std::string rutaArchivo = std::string(op.salida) + ".archivo";
+  if (!archivo.abrir(rutaArchivo.c_str(), (uint64_t)ftell(csv))) {
+    perror(rutaArchivo.c_str());
+    return 1;
+  }
+  cargarResultados(op.salida);
+  cargarConfirmados(op.salidaSesiones);
+  cargarConfirmados(op.salidaConfiguracion);
+  cargarConfirmados(op.salidaConfirmaciones);
+  printf("equipos_confirmados=%zu\n", confirmadoHasta.size());
+  int servidor = abrirServidor(op.puerto);
+  if (servidor < 0) {
+    perror("servidor");
+    return 1;
+  }
+  printf("Colector escuchando en el puerto %u\n", op.puerto);
+
+  std::mt19937 rng(std::random_device{}());
+  std::vector<Cliente*> clientes;
+  std::vector<struct pollfd> fds;
+  uint8_t bytes[4096];
+  bool consultas = true;
+
+  for (;;) {
+    fds.clear();
+    fds.push_back({servidor, POLLIN, 0});
+    if (consultas) fds.push_back({STDIN_FILENO, POLLIN, 0});
+    size_t primero = fds.size();
+    for (Cliente* cl : clientes) fds.push_back({cl->fd, POLLIN, 0});
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR) continue;
+      perror("poll");
+      return 1;
+    }
+
+    if (fds[0].revents & POLLIN) {
+      int fd = accept(servidor, nullptr, nullptr);
+      if (fd >= 0) clientes.push_back(new Cliente{fd, AnalizadorMensajes()});
+    }
+
+    if (consultas && (fds[1].revents & (POLLIN | POLLHUP | POLLERR))) {
+      consultas = leerConsultas();
+    }
+
+    for (size_t i = primero; i < fds.size(); i++) {
+      if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+      Cliente* cl = clientes[i - primero];
+      ssize_t n = recv(cl->fd, bytes, sizeof(bytes), 0);
+      if (n <= 0) {
+        close(cl->fd);
+        cl->fd = -1;
+        continue;
+      }
+      for (ssize_t j = 0; j < n; j++) {
+        if (cl->analizador.alimentar(bytes[j]) &&
+            cl->analizador.tipo() == MENSAJE_LOTE) {
+          procesarLote(cl->fd, cl->analizador, op, rng);
+        }
+      }
+    }
+
+    for (size_t i = 0; i < clientes.size();) {
+      if (clientes[i]->fd < 0) {
+        delete clientes[i];
+        clientes.erase(clientes.begin() + i);
+      } else {
+        i++;
+      }
+    }
+  }
+}
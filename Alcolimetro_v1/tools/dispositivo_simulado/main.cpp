@@ -0,0 +1,227 @@
+/*
+ * Equipo simulado para probar la subida contra el colector en Linux.
+ *
+ * Usa la misma cola persistente y el mismo enlace que el firmware. Encola
+ * el acumulado de un día (resultados, sus sesiones y la configuración),
+ * con las marcas en el pasado como si el equipo hubiera estado sin
+ * cobertura, y mide cuánto tarda en subirlo.
+ * Con -c se alternan periodos con y sin conexión para ver la espera
+ * exponencial y la reanudación. Con -g el sensor se degrada desde la mitad
+ * del día (precalentamiento más largo y más timeouts), para ver la alarma
+ * de salud en el colector.
+ *
+ * Con -t el equipo sigue en línea esos segundos tras subirlo todo y se
+ * sincroniza con el colector cada -y ms, como el firmware con
+ * PERIODO_SINCRONIZACION_MS: aplica las órdenes de configuración que
+ * reciba sobre un sensor simulado, las verifica leyéndolas de vuelta y
+ * sube las confirmaciones. Con -x el sensor rechaza el tiempo de soplado.
+ *
+ *   pio run -e dispositivo_simulado
+ *   .pio/build/dispositivo_simulado/program -h 127.0.0.1 -p 5020 -n 500
+ */
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include "cola_persistente.h"
+#include "enlace_subida.h"
+#include "transporte_tcp.h"
+
+static uint32_t ahoraMs() {
+  using namespace std::chrono;
+  return (uint32_t)duration_cast<milliseconds>(
+      steady_clock::now().time_since_epoch()).count();
+}
+
+// Transporte que sólo deja conectar durante la primera mitad de cada
+// periodo, simulando cobertura intermitente
+// Lo que el firmware lee y escribe en el ZE29A para una orden
+struct SensorSimulado {
+  uint8_t tiempoSopladoS;
+  uint8_t umbralBebido;
+  uint8_t umbralEbrio;
+  bool adaptativo;
+  bool rechazaTiempo;
+};
+
+// Aplica un comando como aplicarOrdenConfiguracion() en el firmware
+static uint8_t aplicarComando(SensorSimulado& s, const ComandoOrden& c, uint16_t& leido) {
+  leido = 0;
+  switch (c.comando) {
+    case COMANDO_TIEMPO_SOPLADO:
+      if (c.valor < 1 || c.valor > 10) return CONFIRMACION_INVALIDA;
+      if (!s.rechazaTiempo) s.tiempoSopladoS = c.valor;
+      leido = s.tiempoSopladoS;
+      if (leido != c.valor) return CONFIRMACION_RECHAZADA;
+      s.adaptativo = false;
+      return CONFIRMACION_APLICADA;
+    case COMANDO_LEER_UMBRALES:
+      leido = (uint16_t)(s.umbralBebido | s.umbralEbrio << 8);
+      return CONFIRMACION_APLICADA;
+    case COMANDO_SOPLADO_ADAPTATIVO:
+      if (c.valor > 1) return CONFIRMACION_INVALIDA;
+      s.adaptativo = c.valor == 1;
+      leido = s.adaptativo;
+      return CONFIRMACION_APLICADA;
+    default:
+      return CONFIRMACION_INVALIDA;
+  }
+}
+
+class TransporteIntermitente : public Transporte {
+public:
+  TransporteIntermitente(Transporte& real, uint32_t periodoMs)
+    : real(real), periodo(periodoMs) {}
+  bool hayCobertura() const { return periodo == 0 || ahoraMs() % periodo < periodo / 2; }
+  bool conectar() override { return hayCobertura() && real.conectar(); }
+  bool conectado() override {
+    if (!hayCobertura()) real.desconectar();
+    return real.conectado();
+  }
+  void desconectar() override { real.desconectar(); }
+  bool enviar(const uint8_t* d, size_t n) override {
+    return hayCobertura() && real.enviar(d, n);
+  }
+  int recibir(uint8_t* d, size_t n) override {
+    return hayCobertura() ? real.recibir(d, n) : -1;
+  }
+
+private:
+  Transporte& real;
+  uint32_t periodo;
+};
+
+int main(int argc, char** argv) {
+  const char* host = "127.0.0.1";
+  uint16_t puerto = 5020;
+  uint32_t resultados = 500;
+  uint32_t id = 1;
+  uint32_t periodo = 0;
+  bool degradado = false;
+  uint32_t enLineaS = 0;
+  uint32_t periodoSincronizacion = 1000;
+  SensorSimulado sensorSimulado = {5, 20, 80, true, false};
+  int c;
+  while ((c = getopt(argc, argv, "h:p:n:i:c:gt:y:x")) != -1) {
+    switch (c) {
+      case 'h': host = optarg; break;
+      case 'p': puerto = (uint16_t)atoi(optarg); break;
+      case 'n': resultados = (uint32_t)atoi(optarg); break;
+      case 'i': id = (uint32_t)atoi(optarg); break;
+      case 'c': periodo = (uint32_t)atoi(optarg); break;
+      case 'g': degradado = true; break;
+      case 't': enLineaS = (uint32_t)atoi(optarg); break;
+      case 'y': periodoSincronizacion = (uint32_t)atoi(optarg); break;
+      case 'x': sensorSimulado.rechazaTiempo = true; break;
+      default:
+        fprintf(stderr, "uso: %s [-h host] [-p puerto] [-n resultados] "
+                        "[-i id] [-c periodo_cobertura_ms] [-g] [-t segundos_en_linea] "
+                        "[-y periodo_sincronizacion_ms] [-x]\n", argv[0]);
+        return 2;
+    }
+  }
+
+  std::string ruta = "/tmp/cola_equipo_" + std::to_string(id) + ".bin";
+  std::string rutaReserva = "/tmp/cola_equipo_" + std::to_string(id) + ".sec";
+  ReservaSecuenciasArchivo reserva(rutaReserva.c_str());
+  ColaPersistente cola;
+  if (!cola.abrir(ruta.c_str(), 4096, &reserva)) {
+    perror(ruta.c_str());
+    return 1;
+  }
+
+  std::mt19937 rng(id);
+  // Una prueba por minuto y 15 min más por confirmatoria, hasta ahora
+  uint32_t marcaMs = ahoraMs() - resultados * 60000 * 5 / 4;
+  RegistroConfiguracion sensor = {0, id, marcaMs, 5, 20, 80, 1};
+  cola.encolar(sensor);
+  for (uint32_t i = 0; i < resultados; i++) {
+    RegistroResultado r = {};
+    r.idDispositivo = id;
+    r.marcaMs = marcaMs += 60000;
+    r.idSujeto = 1 + rng() % 1000;
+    r.alcoholMg100ml = (uint16_t)(rng() % 10 == 0 ? rng() % 150 : 0);
+    r.alarma = r.alcoholMg100ml >= 80 ? 2 : (r.alcoholMg100ml >= 20 ? 1 : 0);
+    bool averiado = degradado && i >= resultados / 2;
+    r.timeoutsEnlace = (uint8_t)(rng() % (averiado ? 3 : 20) == 0);
+    r.soplidosInterrumpidos = (uint8_t)(rng() % 8 == 0);
+    r.precalentamientoMs = (uint16_t)(10000 + rng() % 500 + (averiado ? 2000 : 0));
+    cola.encolar(r);
+
+    RegistroSesion sesion = {};
+    sesion.idDispositivo = id;
+    sesion.inicioMs = sesion.finMs = r.marcaMs;
+    sesion.idSujeto = r.idSujeto;
+    sesion.numPruebas = 1;
+    sesion.secuenciaFinal = r.secuencia;
+    sesion.alcoholFinalMg100ml = r.alcoholMg100ml;
+    sesion.alarmaFinal = r.alarma;
+    // Cerca de un umbral: prueba confirmatoria enlazada a la original
+    if (r.alcoholMg100ml >= 15 && r.alcoholMg100ml <= 25) {
+      RegistroResultado confirmatoria = r;
+      confirmatoria.marcaMs = marcaMs += 15 * 60000;
+      confirmatoria.secuenciaVinculada = r.secuencia;
+      confirmatoria.alcoholMg100ml = (uint16_t)(r.alcoholMg100ml - rng() % 6);
+      confirmatoria.alarma = confirmatoria.alcoholMg100ml >= 20 ? 1 : 0;
+      confirmatoria.banderas = BANDERA_CONFIRMATORIA;
+      cola.encolar(confirmatoria);
+      sesion.finMs = confirmatoria.marcaMs;
+      sesion.numPruebas = 2;
+      sesion.secuenciaFinal = confirmatoria.secuencia;
+      sesion.alcoholFinalMg100ml = confirmatoria.alcoholMg100ml;
+      sesion.alarmaFinal = confirmatoria.alarma;
+    }
+    cola.encolar(sesion);
+  }
+  printf("pendientes=%u\n", cola.pendientes());
+
+  TransporteTcp tcp(host, puerto);
+  TransporteIntermitente transporte(tcp, periodo);
+  ConfigSubida config = CONFIG_SUBIDA_DEFECTO(id);
+  config.reintentoMinimoMs = 100;
+  config.reintentoMaximoMs = 5000;
+  EnlaceSubida enlace(cola, transporte, config);
+
+  uint32_t inicio = ahoraMs();
+  while (cola.pendientes() > 0) {
+    enlace.servicio(ahoraMs());
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+  }
+  printf("subidos=%u lotes=%u fallos=%u tiempo_ms=%u\n",
+         enlace.registrosConfirmados(), enlace.lotesEnviados(),
+         enlace.fallos(), ahoraMs() - inicio);
+  if (enLineaS == 0) return 0;
+
+  uint32_t comandos = 0, aplicados = 0;
+  uint32_t finEnLinea = ahoraMs() + enLineaS * 1000;
+  while ((int32_t)(finEnLinea - ahoraMs()) > 0 || cola.pendientes() > 0) {
+    uint32_t t = ahoraMs();
+    if (!enlace.esperandoAck() && t - enlace.ultimaSincronizacionMs() >= periodoSincronizacion) {
+      enlace.sincronizar();
+    }
+    enlace.servicio(t);
+    OrdenConfiguracion orden;
+    if (enlace.tomarOrden(orden)) {
+      for (uint8_t i = 0; i < orden.numComandos; i++) {
+        RegistroConfirmacion r = {};
+        r.idDispositivo = id;
+        r.marcaMs = ahoraMs();
+        r.idOrden = orden.comandos[i].idOrden;
+        r.comando = orden.comandos[i].comando;
+        r.valorPedido = orden.comandos[i].valor;
+        r.estado = aplicarComando(sensorSimulado, orden.comandos[i], r.valorLeido);
+        cola.encolar(r);
+        comandos++;
+        aplicados += r.estado == CONFIRMACION_APLICADA;
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  printf("comandos=%u aplicados=%u tiempo_soplado=%u adaptativo=%d lotes=%u\n", comandos,
+         aplicados, sensorSimulado.tiempoSopladoS, sensorSimulado.adaptativo ? 1 : 0,
+         enlace.lotesEnviados());
+  return 0;
+}
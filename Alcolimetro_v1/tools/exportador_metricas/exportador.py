@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+"""
+Puente entre la consola serie del alcoholímetro y Prometheus.
+
+Cada GET /metrics envía el comando 'm' por el puerto serie, lee hasta la
+línea "# EOF" y devuelve el volcado tal cual. Ignora las líneas de log que
+el firmware imprima antes del volcado. Si el equipo está en sueño ligero
+el carácter que lo despierta se pierde, así que se reintenta una vez.
+
+    pip install pyserial
+    python3 tools/exportador_metricas/exportador.py /dev/ttyUSB0 --puerto 9105
+
+y en prometheus.yml un job con el destino localhost:9105.
+"""
+import argparse
+import http.server
+import threading
+
+import serial
+
+LINEA_FIN = "# EOF"
+
+
+class Consola:
+    def __init__(self, dispositivo, baudios):
+        self.serie = serial.Serial(dispositivo, baudios, timeout=2)
+        self.cerrojo = threading.Lock()
+
+    def volcar(self):
+        with self.cerrojo:
+            self.serie.reset_input_buffer()
+            self.serie.write(b"m")
+            lineas = []
+            dentro = False
+            while True:
+                linea = self.serie.readline().decode("utf-8", "replace").rstrip("\r\n")
+                if not linea and not self.serie.in_waiting:
+                    raise TimeoutError("sin respuesta del equipo")
+                if linea.startswith("# HELP"):
+                    dentro = True
+                if linea == LINEA_FIN:
+                    return "\n".join(lineas) + "\n"
+                if dentro:
+                    lineas.append(linea)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[1])
+    parser.add_argument("dispositivo")
+    parser.add_argument("--baudios", type=int, default=115200)
+    parser.add_argument("--puerto", type=int, default=9105)
+    args = parser.parse_args()
+    consola = Consola(args.dispositivo, args.baudios)
+
+    class Manejador(http.server.BaseHTTPRequestHandler):
+        def do_GET(self):
+            if self.path != "/metrics":
+                self.send_error(404)
+                return
+            try:
+                try:
+                    cuerpo = consola.volcar()
+                except TimeoutError:
+                    cuerpo = consola.volcar()
+            except TimeoutError as e:
+                self.send_error(504, str(e))
+                return
+            cuerpo = cuerpo.encode("utf-8")
+            self.send_response(200)
+            self.send_header("Content-Type", "text/plain; version=0.0.4")
+            self.send_header("Content-Length", str(len(cuerpo)))
+            self.end_headers()
+            self.wfile.write(cuerpo)
+
+    http.server.HTTPServer(("", args.puerto), Manejador).serve_forever()
+
+
+if __name__ == "__main__":
+    main()
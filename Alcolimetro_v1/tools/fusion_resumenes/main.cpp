@@ -0,0 +1,87 @@
+/*
+ * Fusión central de los resúmenes que exportan los colectores.
+ *
+ * Lee de la entrada estándar (o de los ficheros indicados) las líneas
+ * "consulta=exportar ..." de uno o varios colectores, fusiona sus
+ * resúmenes de alcohol, sujetos y equipos y da los cuantiles y los
+ * distintos del conjunto, como si todo hubiera pasado por un colector.
+ *
+ *   pio run -e fusion_resumenes
+ *   cat norte.txt sur.txt | .pio/build/fusion_resumenes/program
+ */
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "resumenes_flota.h"
+
+static int valorHex(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// Valor hexadecimal de " clave=" en la línea; false si no está o no es hex
+static bool leerCampoHex(const char* linea, const char* clave, std::vector<uint8_t>& bytes) {
+  char patron[32];
+  snprintf(patron, sizeof(patron), " %s=", clave);
+  const char* p = strstr(linea, patron);
+  if (p == nullptr) return false;
+  p += strlen(patron);
+  bytes.clear();
+  for (int alto; (alto = valorHex(p[0])) >= 0; p += 2) {
+    int bajo = valorHex(p[1]);
+    if (bajo < 0) return false;
+    bytes.push_back((uint8_t)(alto << 4 | bajo));
+  }
+  return *p == '\0' || *p == ' ' || *p == '\n';
+}
+
+static void fusionarFichero(FILE* f, ResumenCuantiles& alcohol, ContadorDistintos& sujetos,
+                            ContadorDistintos& equipos, uint32_t& fusionados,
+                            uint32_t& invalidos) {
+  static ResumenCuantiles a;
+  static ContadorDistintos s, e;
+  std::vector<uint8_t> bytes;
+  static char linea[65536];
+  while (fgets(linea, sizeof(linea), f) != nullptr) {
+    if (strncmp(linea, "consulta=exportar", 17) != 0) continue;
+    bool valido = leerCampoHex(linea, "alcohol", bytes) &&
+                  a.deserializar(bytes.data(), bytes.size()) &&
+                  leerCampoHex(linea, "sujetos", bytes) &&
+                  s.deserializar(bytes.data(), bytes.size()) &&
+                  leerCampoHex(linea, "equipos", bytes) &&
+                  e.deserializar(bytes.data(), bytes.size());
+    if (!valido) {
+      invalidos++;
+      continue;
+    }
+    alcohol.fusionar(a);
+    sujetos.fusionar(s);
+    equipos.fusionar(e);
+    fusionados++;
+  }
+}
+
+int main(int argc, char** argv) {
+  static ResumenCuantiles alcohol;
+  static ContadorDistintos sujetos, equipos;
+  uint32_t fusionados = 0, invalidos = 0;
+  if (argc < 2) {
+    fusionarFichero(stdin, alcohol, sujetos, equipos, fusionados, invalidos);
+  }
+  for (int i = 1; i < argc; i++) {
+    FILE* f = fopen(argv[i], "r");
+    if (f == nullptr) {
+      perror(argv[i]);
+      return 1;
+    }
+    fusionarFichero(f, alcohol, sujetos, equipos, fusionados, invalidos);
+    fclose(f);
+  }
+  printf("resumenes=%u invalidos=%u pruebas=%llu p50_mg=%.1f p95_mg=%.1f p99_mg=%.1f "
+         "sujetos=%.0f equipos=%.0f\n",
+         fusionados, invalidos, (unsigned long long)alcohol.cuenta(), alcohol.cuantil(0.5f),
+         alcohol.cuantil(0.95f), alcohol.cuantil(0.99f), sujetos.estimar(), equipos.estimar());
+  return invalidos == 0 ? 0 : 1;
+}
@@ -0,0 +1,74 @@
+/*
+ * Arnés de fuzzing del analizador de respuestas ZE29A.
+ *
+ * Con libFuzzer (clang, -fsanitize=fuzzer) se usa LLVMFuzzerTestOneInput;
+ * sin él se compila un main que genera entradas aleatorias y muestra las
+ * entradas por segundo, para medir el rendimiento con gcc.
+ *
+ *   pio run -e fuzz_protocolo && .pio/build/fuzz_protocolo/program -max_len=256
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include "protocolo_ze29a.h"
+
+static void comprobar(bool condicion) {
+  if (!condicion) abort();
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* datos, size_t n) {
+  AnalizadorTramas estricto(true);
+  AnalizadorTramas permisivo(false);
+  uint32_t tramasEstricto = 0;
+
+  for (size_t i = 0; i < n; i++) {
+    if (estricto.alimentar(datos[i])) {
+      const uint8_t* t = estricto.trama();
+      comprobar(t[0] == BYTE_INICIO);
+      comprobar(checksumValido(t));
+      ResultadoPrueba r;
+      if (decodificarResultado(t, r)) {
+        comprobar(r.alcoholMg100ml == ((t[2] << 8) | t[3]));
+      }
+      tramasEstricto++;
+    }
+    if (permisivo.alimentar(datos[i])) {
+      comprobar(permisivo.trama()[0] == BYTE_INICIO);
+    }
+    comprobar(estricto.bytesPendientes() < LONGITUD_TRAMA);
+  }
+
+  // Cada byte de entrada acaba descartado, en una trama o pendiente
+  comprobar(estricto.tramas() == tramasEstricto);
+  comprobar(estricto.bytesDescartados() +
+            (uint64_t)estricto.tramas() * LONGITUD_TRAMA +
+            estricto.bytesPendientes() == n);
+  return 0;
+}
+
+#ifdef FUZZ_SIN_LIBFUZZER
+#include <chrono>
+#include <random>
+#include <stdio.h>
+
+int main(int argc, char** argv) {
+  uint64_t entradas = argc > 1 ? strtoull(argv[1], nullptr, 10) : 10000000;
+  std::mt19937 rng(42);
+  uint8_t buffer[64];
+
+  auto inicio = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < entradas; i++) {
+    size_t n = rng() % sizeof(buffer);
+    for (size_t j = 0; j < n; j++) {
+      uint32_t v = rng();
+      buffer[j] = (v & 7) == 0 ? BYTE_INICIO : (uint8_t)(v >> 8);
+    }
+    LLVMFuzzerTestOneInput(buffer, n);
+  }
+  double s = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - inicio).count();
+  printf("fuzz entradas=%llu entradas_s=%.0f\n",
+         (unsigned long long)entradas, entradas / s);
+  return 0;
+}
+#endif
@@ -0,0 +1,5 @@
+# Compila y enlaza el arnés con clang, necesario para -fsanitize=fuzzer
+Import("env")
+
+env.Replace(CC="clang", CXX="clang++", LINK="clang++")
+env.Append(LINKFLAGS=["-fsanitize=fuzzer,address,undefined"])
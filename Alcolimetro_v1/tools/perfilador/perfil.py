@@ -0,0 +1,250 @@
+#!/usr/bin/env python3
+"""
+Simboliza las muestras del perfilador del alcoholímetro y dibuja el grafo.
+
+Lee la salida del comando 'g' (líneas "PERFIL ...") de un fichero de
+captura o del puerto serie, resuelve los PCs contra firmware.elf con
+addr2line y escribe:
+
+  - una tabla por núcleo con las funciones que más muestras acumulan,
+  - las pilas plegadas (formato de flamegraph.pl y speedscope) con -p,
+  - un grafo de llamas SVG autocontenido con -s.
+
+Cada pila es "núcleo;función;...;función en línea": el firmware sólo
+muestrea el PC, así que la profundidad sale de la expansión en línea.
+
+    python3 tools/perfilador/perfil.py captura.txt -s perfil.svg
+    python3 tools/perfilador/perfil.py --serie /dev/ttyUSB0 --segundos 30 \\
+        --elf .pio/build/esp32doit-devkit-v1/firmware.elf -s perfil.svg
+"""
+import argparse
+import collections
+import html
+import os
+import subprocess
+import sys
+import time
+
+ELF_DEFECTO = ".pio/build/esp32doit-devkit-v1/firmware.elf"
+ADDR2LINE_DEFECTO = "xtensa-esp32-elf-addr2line"
+
+# Mapa de memoria del ESP32 para lo que addr2line no resuelve
+ZONAS = [
+    (0x40000000, 0x40070000, "[ROM]"),
+    (0x40070000, 0x400C0000, "[IRAM]"),
+    (0x400D0000, 0x40400000, "[flash]"),
+]
+
+
+# PC ficticio para las muestras que no cupieron en la tabla del firmware
+PC_PERDIDAS = -1
+
+
+def leer_muestras(lineas):
+    """Devuelve ({núcleo: {pc: muestras}}, [líneas de cabecera])."""
+    muestras = collections.defaultdict(dict)
+    cabecera = []
+    for linea in lineas:
+        linea = linea.strip()
+        if not linea.startswith("PERFIL "):
+            continue
+        campos = linea.split()[1:]
+        if campos[0] in ("inicio", "fin") or "=" in campos[0]:
+            if campos[0] != "fin":
+                cabecera.append(" ".join(campos))
+            valores = dict(c.split("=") for c in campos if "=" in c)
+            if int(valores.get("perdidas", 0)) > 0:
+                muestras[int(valores["nucleo"])][PC_PERDIDAS] = int(valores["perdidas"])
+            continue
+        nucleo, pc, n = int(campos[0]), int(campos[1], 16), int(campos[2])
+        muestras[nucleo][pc] = muestras[nucleo].get(pc, 0) + n
+    return muestras, cabecera
+
+
+def leer_serie(dispositivo, baudios, segundos):
+    import serial
+    puerto = serial.Serial(dispositivo, baudios, timeout=3)
+    puerto.reset_input_buffer()
+    puerto.write(b"g")
+    print("Perfilando %d s..." % segundos, file=sys.stderr)
+    time.sleep(segundos)
+    puerto.reset_input_buffer()
+    puerto.write(b"g")
+    lineas = []
+    while True:
+        linea = puerto.readline().decode("utf-8", "replace")
+        if not linea:
+            raise TimeoutError("sin respuesta del equipo")
+        lineas.append(linea)
+        if linea.strip() == "PERFIL fin":
+            return lineas
+
+
+def zona(pc):
+    if pc == PC_PERDIDAS:
+        return "[sin sitio en la tabla]"
+    for inicio, fin, nombre in ZONAS:
+        if inicio <= pc < fin:
+            return nombre
+    return "[0x%08x]" % pc
+
+
+def simbolizar(pcs, elf, addr2line):
+    """Devuelve {pc: [función exterior, ..., función muestreada]}."""
+    marcos = {pc: [zona(pc)] for pc in pcs}
+    if not elf or not pcs:
+        return marcos
+    pendientes = sorted(pc for pc in pcs if pc != PC_PERDIDAS)
+    try:
+        salida = subprocess.run(
+            [addr2line, "-pfiaC", "-e", elf] + ["0x%08x" % pc for pc in pendientes],
+            capture_output=True, text=True, check=True).stdout
+    except (OSError, subprocess.CalledProcessError) as e:
+        print("addr2line no disponible (%s): PCs sin simbolizar" % e, file=sys.stderr)
+        return marcos
+    # "0x...: f at fichero:línea" y después " (inlined by) g at ..." desde
+    # la función más interna hacia fuera
+    actual = None
+    for linea in salida.splitlines():
+        if linea.startswith("0x"):
+            direccion, _, texto = linea.partition(": ")
+            actual = int(direccion, 16)
+            funcion = texto.split(" at ")[0]
+            marcos[actual] = [zona(actual) if funcion.startswith("??") else funcion]
+        elif actual is not None and "(inlined by)" in linea:
+            funcion = linea.split("(inlined by)")[1].strip().split(" at ")[0]
+            marcos[actual].insert(0, funcion)
+    return marcos
+
+
+def plegar(muestras, marcos):
+    pilas = collections.Counter()
+    for nucleo, tabla in muestras.items():
+        for pc, n in tabla.items():
+            pila = ["nucleo%d" % nucleo] + marcos[pc]
+            pilas[";".join(f.replace(";", ":") for f in pila)] += n
+    return pilas
+
+
+def imprimir_tabla(muestras, marcos, limite):
+    for nucleo in sorted(muestras):
+        tabla = muestras[nucleo]
+        total = sum(tabla.values())
+        if total == 0:
+            continue
+        propias = collections.Counter()
+        for pc, n in tabla.items():
+            propias[marcos[pc][-1]] += n
+        print("Núcleo %d: %d muestras" % (nucleo, total))
+        for funcion, n in propias.most_common(limite):
+            print("  %6.2f %%  %7d  %s" % (100.0 * n / total, n, funcion))
+        print()
+
+
+# Grafo de llamas mínimo, sin dependencias: un rectángulo por marco con
+# ancho proporcional a sus muestras y el nombre completo en el título
+ALTO_MARCO = 16
+ANCHO_SVG = 1200
+
+
+def arbol(pilas):
+    raiz = {"n": 0, "hijos": {}}
+    for pila, n in pilas.items():
+        raiz["n"] += n
+        nodo = raiz
+        for marco in pila.split(";"):
+            nodo = nodo["hijos"].setdefault(marco, {"n": 0, "hijos": {}})
+            nodo["n"] += n
+    return raiz
+
+
+def profundidad(nodo):
+    return 1 + max((profundidad(h) for h in nodo["hijos"].values()), default=0)
+
+
+def color(nombre):
+    h = sum(ord(c) for c in nombre)
+    return "rgb(%d,%d,%d)" % (205 + h % 50, 80 + (h * 7) % 120, 40 + (h * 13) % 40)
+
+
+def dibujar(pilas, ruta, titulo):
+    raiz = arbol(pilas)
+    total = raiz["n"] or 1
+    niveles = profundidad(raiz)
+    alto = (niveles + 2) * ALTO_MARCO
+    partes = [
+        '<svg xmlns="http://www.w3.org/2000/svg" width="%d" height="%d" '
+        'font-family="monospace" font-size="11">' % (ANCHO_SVG, alto),
+        '<text x="4" y="12">%s</text>' % html.escape(titulo),
+    ]
+
+    def rect(nombre, nodo, x, nivel):
+        ancho = ANCHO_SVG * nodo["n"] / total
+        if ancho < 0.5:
+            return
+        y = alto - (nivel + 1) * ALTO_MARCO
+        etiqueta = html.escape("%s (%d muestras, %.2f %%)" % (nombre, nodo["n"], 100.0 * nodo["n"] / total))
+        partes.append('<g><title>%s</title><rect x="%.2f" y="%d" width="%.2f" height="%d" '
+                      'fill="%s" stroke="white" stroke-width="0.5"/>' %
+                      (etiqueta, x, y, ancho, ALTO_MARCO - 1, color(nombre)))
+        caben = int(ancho / 7)
+        if caben >= 3:
+            texto = nombre if len(nombre) <= caben else nombre[:caben - 2] + ".."
+            partes.append('<text x="%.2f" y="%d">%s</text>' % (x + 2, y + 11, html.escape(texto)))
+        partes.append("</g>")
+        for hijo, sub in sorted(nodo["hijos"].items()):
+            rect(hijo, sub, x, nivel + 1)
+            x += ANCHO_SVG * sub["n"] / total
+
+    x = 0.0
+    for nombre, nodo in sorted(raiz["hijos"].items()):
+        rect(nombre, nodo, x, 0)
+        x += ANCHO_SVG * nodo["n"] / total
+    partes.append("</svg>")
+    with open(ruta, "w", encoding="utf-8") as f:
+        f.write("\n".join(partes))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[1])
+    parser.add_argument("captura", nargs="?", help="fichero con la salida de 'g'")
+    parser.add_argument("--serie", help="perfilar leyendo del puerto serie")
+    parser.add_argument("--baudios", type=int, default=115200)
+    parser.add_argument("--segundos", type=int, default=10)
+    parser.add_argument("--elf", default=ELF_DEFECTO if os.path.exists(ELF_DEFECTO) else None)
+    parser.add_argument("--addr2line", default=ADDR2LINE_DEFECTO)
+    parser.add_argument("-p", "--plegadas", help="escribir las pilas plegadas")
+    parser.add_argument("-s", "--svg", help="escribir el grafo de llamas")
+    parser.add_argument("-n", "--limite", type=int, default=20)
+    args = parser.parse_args()
+
+    if args.serie:
+        lineas = leer_serie(args.serie, args.baudios, args.segundos)
+    elif args.captura:
+        with open(args.captura, encoding="utf-8", errors="replace") as f:
+            lineas = f.readlines()
+    else:
+        parser.error("indicar un fichero de captura o --serie")
+
+    muestras, cabecera = leer_muestras(lineas)
+    if not muestras:
+        sys.exit("no hay líneas PERFIL en la entrada")
+    for linea in cabecera:
+        print(linea)
+    print()
+
+    pcs = {pc for tabla in muestras.values() for pc in tabla}
+    marcos = simbolizar(pcs, args.elf, args.addr2line)
+    imprimir_tabla(muestras, marcos, args.limite)
+
+    pilas = plegar(muestras, marcos)
+    if args.plegadas:
+        with open(args.plegadas, "w", encoding="utf-8") as f:
+            for pila, n in sorted(pilas.items()):
+                f.write("%s %d\n" % (pila, n))
+    if args.svg:
+        dibujar(pilas, args.svg, " ".join(cabecera[:1]))
+
+
+if __name__ == "__main__":
+    main()
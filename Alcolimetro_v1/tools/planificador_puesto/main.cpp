@@ -0,0 +1,677 @@
+/*
+ * Planificador de capacidad de un puesto de control por simulación de
+ * eventos discretos, en el host.
+ *
+ * Los sujetos llegan según un proceso de Poisson a una cola común y pasan
+ * al primer alcoholímetro que puede atenderlos. Cada alcoholímetro tiene
+ * uno o varios cabezales ZE29A y un solo operador: mientras un sujeto
+ * sopla en un cabezal, otro puede precalentarse para el siguiente de la
+ * cola. Cada prueba recorre las fases del sensor (precalentamiento,
+ * espera del soplido, soplado, soplidos interrumpidos que vuelven a la
+ * espera, cálculo y lectura del resultado). Una fracción de las pruebas
+ * necesita confirmatoria: el mismo alcoholímetro la hace en cuanto pasa
+ * la espera mínima (politica_retest.h) y tiene prioridad sobre la cola,
+ * con el precalentamiento adelantado como en el firmware.
+ *
+ * Las duraciones de las fases salen del histograma de permanencia por
+ * estado (alcoholimetro_permanencia_estado_ms) de uno o varios volcados
+ * de métricas del campo ('m' o tools/exportador_metricas); los volcados se
+ * suman. Dentro de cada cubeta el tiempo se reparte uniforme y la cubeta
+ * +Inf se modela como una cola exponencial con la media que deja la suma.
+ * La probabilidad de interrupción es la proporción de salidas de 0x35
+ * frente a 0x34. Sin volcado, o para los estados sin observaciones, se
+ * usa el mismo modelo que tools/ajuste_enlace.
+ *
+ * Para cada combinación de alcoholímetros y cabezales se simulan varias
+ * réplicas independientes en paralelo y se informa de la carga ofrecida,
+ * la ocupación de alcoholímetros y cabezales, la espera hasta poder
+ * soplar (media, p95 con su intervalo entre réplicas y p99), la cola vista
+ * por los que llegan y el retraso de las confirmatorias sobre su hora. La
+ * recomendada es la de menos alcoholímetros, y luego menos cabezales, que
+ * cumple el objetivo de p95.
+ *
+ *   pio run -e planificador_puesto
+ *   .pio/build/planificador_puesto/program -l 90 -m volcado1.txt -m volcado2.txt
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <math.h>
+#include <queue>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "metricas.h"
+#include "politica_retest.h"
+#include "protocolo_ze29a.h"
+
+#define MAX_ALCOHOLIMETROS 64
+#define MAX_CABEZALES 8
+#define MAX_INTERRUPCIONES 3
+#define TIC_RESULTADO_MS 3000.0       // lastStatusCheck en loop()
+#define CALENTAMIENTO 0.05            // fracción inicial de sujetos sin contar
+#define CUBETA_ESPERA_MS 1000.0
+#define CUBETAS_ESPERA 7200           // hasta 2 h; el resto en la última
+#define CUBETAS_COLA 1024
+// Saturado si la última prueba acaba mucho después de la última llegada
+#define LLEGADAS_SATURADO 0.99
+
+// xoshiro256**: el generador es una parte apreciable del coste por sujeto
+class Generador {
+public:
+  explicit Generador(uint64_t semilla) {
+    for (uint64_t& x : s) {
+      semilla += 0x9E3779B97F4A7C15ULL;
+      uint64_t z = semilla;
+      z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+      z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+      x = z ^ (z >> 31);
+    }
+  }
+
+  uint64_t siguiente() {
+    uint64_t r = rotar(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotar(s[3], 45);
+    return r;
+  }
+
+  // En [0, 1)
+  double uniforme() { return (siguiente() >> 11) * 0x1.0p-53; }
+  double exponencial(double media) { return -media * log(1.0 - uniforme()); }
+  double normal() {
+    double u = 1.0 - uniforme();
+    return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * uniforme());
+  }
+
+private:
+  static uint64_t rotar(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+  uint64_t s[4];
+};
+
+enum TipoDistribucion : uint8_t { DIST_UNIFORME = 0, DIST_LOGNORMAL, DIST_CUBETAS };
+
+// Duración de una fase en ms
+struct Distribucion {
+  TipoDistribucion tipo;
+  double a, b;            // uniforme: [a, b]; lognormal: mediana y sigma
+  double tope;            // lognormal: máximo
+  const char* origen;
+  // Cubetas: límites del histograma del firmware y la +Inf
+  static constexpr uint8_t N = numLimites(LIMITES_PERMANENCIA_MS) + 1;
+  double acumulado[N];    // fracción acumulada
+  double mediaCola;       // de lo que supera el último límite
+
+  double muestra(Generador& g) const {
+    switch (tipo) {
+      case DIST_UNIFORME: return a + g.uniforme() * (b - a);
+      case DIST_LOGNORMAL: return std::min(a * exp(b * g.normal()), tope);
+      default: break;
+    }
+    double u = g.uniforme();
+    uint8_t i = 0;
+    while (i < N - 1 && u >= acumulado[i]) i++;
+    if (i == N - 1) return LIMITES_PERMANENCIA_MS[N - 2] + g.exponencial(mediaCola);
+    double desde = i == 0 ? 0 : LIMITES_PERMANENCIA_MS[i - 1];
+    return desde + g.uniforme() * (LIMITES_PERMANENCIA_MS[i] - desde);
+  }
+
+  double media() const {
+    switch (tipo) {
+      case DIST_UNIFORME: return (a + b) / 2;
+      case DIST_LOGNORMAL: return a * exp(b * b / 2);  // sin el tope
+      default: break;
+    }
+    double m = 0, anterior = 0;
+    for (uint8_t i = 0; i < N - 1; i++) {
+      double desde = i == 0 ? 0 : LIMITES_PERMANENCIA_MS[i - 1];
+      m += (acumulado[i] - anterior) * (desde + LIMITES_PERMANENCIA_MS[i]) / 2;
+      anterior = acumulado[i];
+    }
+    return m + (1 - anterior) * (LIMITES_PERMANENCIA_MS[N - 2] + mediaCola);
+  }
+};
+
+static Distribucion uniforme(double a, double b) {
+  Distribucion d = {};
+  d.tipo = DIST_UNIFORME;
+  d.a = a;
+  d.b = b;
+  d.origen = "defecto";
+  return d;
+}
+
+static Distribucion lognormal(double mediana, double sigma, double tope) {
+  Distribucion d = {};
+  d.tipo = DIST_LOGNORMAL;
+  d.a = mediana;
+  d.b = sigma;
+  d.tope = tope;
+  d.origen = "defecto";
+  return d;
+}
+
+// Fases de una prueba, por estado del sensor; el soplado interrumpido se
+// modela como un soplado y la permanencia en 0x35
+struct ModeloFases {
+  Distribucion precalentamiento;
+  Distribucion esperaSoplido;
+  Distribucion soplado;
+  Distribucion interrumpido;
+  Distribucion calculo;
+  Distribucion lectura;
+  double probInterrupcion;
+  const char* origenInterrupcion;
+};
+
+// Lo de tools/ajuste_enlace: precalentamiento de 8,5 a 12 s, espera del
+// soplido log-normal de mediana 4 s, 5 s de soplado y la lectura en el
+// tic de 3 s de loop()
+static ModeloFases modelo = {
+  uniforme(8500, 12000), lognormal(4000, 0.7, 55000), uniforme(5000, 5000),
+  uniforme(1000, 3000),  uniforme(800, 2500),         uniforme(0, TIC_RESULTADO_MS),
+  0.15, "defecto",
+};
+
+// Histograma de un estado sumado sobre los volcados
+struct Histograma {
+  double cubetas[Distribucion::N];  // acumuladas, como en el volcado
+  double suma;
+};
+
+static Histograma histogramas[numSeries(SERIES_ESTADO)];
+
+static bool leerVolcado(const char* ruta) {
+  FILE* f = fopen(ruta, "r");
+  if (f == nullptr) {
+    perror(ruta);
+    return false;
+  }
+  const char* nombre = DEFINICIONES_METRICAS[M_PERMANENCIA_ESTADO_MS].nombre;
+  size_t largo = strlen(nombre);
+  char linea[256];
+  uint32_t leidas = 0;
+  while (fgets(linea, sizeof(linea), f) != nullptr) {
+    if (strncmp(linea, nombre, largo) != 0) continue;
+    const char* resto = linea + largo;
+    char serie[16], le[16];
+    double valor;
+    int s;
+    if (sscanf(resto, "_bucket{estado=\"%15[^\"]\",le=\"%15[^\"]\"} %lf", serie, le,
+               &valor) == 3) {
+      for (s = 0; s < numSeries(SERIES_ESTADO) && strcmp(SERIES_ESTADO[s], serie) != 0; s++) {}
+      if (s == numSeries(SERIES_ESTADO)) continue;
+      uint8_t i = 0;
+      if (strcmp(le, "+Inf") == 0) {
+        i = Distribucion::N - 1;
+      } else {
+        while (i < Distribucion::N - 1 && LIMITES_PERMANENCIA_MS[i] != (uint32_t)atol(le)) i++;
+        if (i == Distribucion::N - 1) continue;  // límites de otra versión
+      }
+      histogramas[s].cubetas[i] += valor;
+      leidas++;
+    } else if (sscanf(resto, "_sum{estado=\"%15[^\"]\"} %lf", serie, &valor) == 2) {
+      for (s = 0; s < numSeries(SERIES_ESTADO) && strcmp(SERIES_ESTADO[s], serie) != 0; s++) {}
+      if (s < numSeries(SERIES_ESTADO)) histogramas[s].suma += valor;
+    }
+  }
+  fclose(f);
+  if (leidas == 0) fprintf(stderr, "%s: sin el histograma %s\n", ruta, nombre);
+  return leidas > 0;
+}
+
+// Sustituye la fase por lo observado si hay al menos una observación
+static void ajustar(Distribucion& d, uint8_t estado, const char* origen) {
+  const Histograma& h = histogramas[metricas::serieEstado(estado)];
+  double total = h.cubetas[Distribucion::N - 1];
+  if (total <= 0) return;
+  Distribucion e = {};
+  e.tipo = DIST_CUBETAS;
+  e.origen = origen;
+  double resto = h.suma;
+  double anterior = 0;
+  for (uint8_t i = 0; i < Distribucion::N - 1; i++) {
+    double desde = i == 0 ? 0 : LIMITES_PERMANENCIA_MS[i - 1];
+    resto -= (h.cubetas[i] - anterior) * (desde + LIMITES_PERMANENCIA_MS[i]) / 2;
+    anterior = h.cubetas[i];
+    e.acumulado[i] = h.cubetas[i] / total;
+  }
+  e.acumulado[Distribucion::N - 1] = 1;
+  // Lo que la suma deja para la cola, por encima del último límite
+  double enCola = total - anterior;
+  double ultimo = LIMITES_PERMANENCIA_MS[Distribucion::N - 2];
+  e.mediaCola = enCola > 0 && resto / enCola > ultimo ? resto / enCola - ultimo : ultimo / 2;
+  d = e;
+}
+
+static void ajustarModelo(const char* origen) {
+  ajustar(modelo.precalentamiento, STATUS_PREHEATING, origen);
+  ajustar(modelo.esperaSoplido, STATUS_WAITING_FOR_BLOW, origen);
+  ajustar(modelo.soplado, STATUS_BLOWING, origen);
+  ajustar(modelo.interrumpido, STATUS_BLOW_INTERRUPTED, origen);
+  ajustar(modelo.calculo, STATUS_CALCULATING, origen);
+  ajustar(modelo.lectura, STATUS_READ_RESULT, origen);
+  // Cada soplado acaba en cálculo o interrumpido
+  double soplados = histogramas[metricas::serieEstado(STATUS_BLOWING)].cubetas[Distribucion::N - 1];
+  double interrumpidos =
+      histogramas[metricas::serieEstado(STATUS_BLOW_INTERRUPTED)].cubetas[Distribucion::N - 1];
+  if (soplados > 0) {
+    modelo.probInterrupcion = std::min(interrumpidos / soplados, 0.95);
+    modelo.origenInterrupcion = origen;
+  }
+}
+
+// Desde que el sujeto se pone delante del cabezal preparado hasta que el
+// firmware lee el resultado
+static double duracionPrueba(Generador& g) {
+  double t = 0;
+  for (uint8_t i = 0;; i++) {
+    t += modelo.esperaSoplido.muestra(g) + modelo.soplado.muestra(g);
+    if (i == MAX_INTERRUPCIONES || g.uniforme() >= modelo.probInterrupcion) break;
+    t += modelo.interrumpido.muestra(g);
+  }
+  return t + modelo.calculo.muestra(g) + modelo.lectura.muestra(g);
+}
+
+struct Escenario {
+  double llegadasPorHora;
+  double probConfirmatoria;
+  double esperaConfirmatoriaMs;
+  bool anticipar;            // precalentar en cuanto el cabezal queda libre
+};
+
+static Escenario escenario = {60, 0.05, ESPERA_MINIMA_RETEST_MS, false};
+
+struct Configuracion {
+  uint8_t alcoholimetros;
+  uint8_t cabezales;
+};
+
+struct Alcoholimetro {
+  double libreMs;                     // el operador acaba la prueba en curso
+  double cabezalLibreMs[MAX_CABEZALES];
+  std::deque<double> confirmatorias;  // horas, en orden; van por delante
+};
+
+// Estadísticas de una réplica
+struct Replica {
+  uint64_t sujetos;
+  uint64_t pruebas;
+  uint64_t confirmatorias;
+  double horizonteMs;
+  double llegadasMs;           // de la primera a la última llegada contada
+  double ocupadoMs;            // alcoholímetros con sujeto o precalentando
+  double cabezalOcupadoMs;
+  double esperaTotalMs;
+  std::vector<uint32_t> esperas;          // cubetas de CUBETA_ESPERA_MS
+  std::vector<uint32_t> retrasos;         // confirmatorias, sobre su hora
+  std::vector<uint32_t> colas;            // longitud vista al llegar
+  uint32_t colaMaxima;
+  double esperaP95Ms;
+};
+
+static void anotarEspera(std::vector<uint32_t>& cubetas, double ms) {
+  size_t i = (size_t)(ms / CUBETA_ESPERA_MS);
+  cubetas[std::min(i, cubetas.size() - 1)]++;
+}
+
+// Percentil interpolado dentro de la cubeta
+static double percentil(const std::vector<uint32_t>& cubetas, double p, double anchoMs) {
+  uint64_t total = 0;
+  for (uint32_t c : cubetas) total += c;
+  if (total == 0) return 0;
+  double objetivo = p * total;
+  uint64_t acumulado = 0;
+  for (size_t i = 0; i < cubetas.size(); i++) {
+    if (acumulado + cubetas[i] >= objetivo) {
+      return (i + (objetivo - acumulado) / std::max(cubetas[i], 1u)) * anchoMs;
+    }
+    acumulado += cubetas[i];
+  }
+  return cubetas.size() * anchoMs;
+}
+
+class Simulacion {
+public:
+  Simulacion(const Configuracion& c, uint64_t semilla) : config(c), g(semilla) {
+    for (uint8_t d = 0; d < c.alcoholimetros; d++) {
+      Alcoholimetro& a = puestos[d];
+      a.libreMs = 0;
+      for (uint8_t h = 0; h < c.cabezales; h++) a.cabezalLibreMs[h] = 0;
+    }
+  }
+
+  Replica ejecutar(uint64_t sujetos) {
+    Replica r = {};
+    r.esperas.assign(CUBETAS_ESPERA, 0);
+    r.retrasos.assign(CUBETAS_ESPERA, 0);
+    r.colas.assign(CUBETAS_COLA, 0);
+    uint64_t calentamiento = (uint64_t)(sujetos * CALENTAMIENTO);
+    double mediaLlegadaMs = 3600000.0 / escenario.llegadasPorHora;
+    double llegadaMs = 0;
+    double inicioMedidaMs = 0;
+    // Sujetos en cola, por el momento en que pasan a un alcoholímetro
+    std::priority_queue<double, std::vector<double>, std::greater<double>> enCola;
+
+    for (uint64_t n = 0; n < sujetos; n++) {
+      llegadaMs += g.exponencial(mediaLlegadaMs);
+      bool contar = n >= calentamiento;
+      if (n == calentamiento) inicioMedidaMs = llegadaMs;
+      medir = contar ? &r : nullptr;
+
+      while (!enCola.empty() && enCola.top() <= llegadaMs) enCola.pop();
+      if (contar) {
+        size_t cola = enCola.size();
+        r.colas[std::min(cola, (size_t)CUBETAS_COLA - 1)]++;
+        r.colaMaxima = std::max(r.colaMaxima, (uint32_t)cola);
+      }
+
+      double precalentamiento = modelo.precalentamiento.muestra(g);
+      double prueba = duracionPrueba(g);
+      uint8_t mejor = 0, cabezal = 0;
+      double inicioMejor = INFINITY;
+      for (uint8_t d = 0; d < config.alcoholimetros; d++) {
+        uint8_t h = 0;
+        double inicio = inicioPosible(d, llegadaMs, precalentamiento, h);
+        // Las confirmatorias que vencen antes pasan por delante
+        while (!puestos[d].confirmatorias.empty() && puestos[d].confirmatorias.front() <= inicio) {
+          servirConfirmatoria(d);
+          inicio = inicioPosible(d, llegadaMs, precalentamiento, h);
+        }
+        if (inicio < inicioMejor) {
+          inicioMejor = inicio;
+          mejor = d;
+          cabezal = h;
+        }
+      }
+      double preparacion = escenario.anticipar
+                               ? puestos[mejor].cabezalLibreMs[cabezal]
+                               : std::max(llegadaMs, puestos[mejor].cabezalLibreMs[cabezal]);
+      double finMs = ocupar(mejor, cabezal, llegadaMs, preparacion, precalentamiento,
+                            inicioMejor, prueba);
+      if (inicioMejor > llegadaMs) enCola.push(inicioMejor);
+      if (contar) {
+        r.sujetos++;
+        r.esperaTotalMs += inicioMejor - llegadaMs;
+        anotarEspera(r.esperas, inicioMejor - llegadaMs);
+      }
+      if (g.uniforme() < escenario.probConfirmatoria) {
+        puestos[mejor].confirmatorias.push_back(finMs + escenario.esperaConfirmatoriaMs);
+      }
+    }
+    // Hasta que acaba la última prueba: saturado, la cola sigue mucho
+    // después de la última llegada
+    double finMs = llegadaMs;
+    for (uint8_t d = 0; d < config.alcoholimetros; d++) finMs = std::max(finMs, puestos[d].libreMs);
+    r.horizonteMs = finMs - inicioMedidaMs;
+    r.llegadasMs = llegadaMs - inicioMedidaMs;
+    return r;
+  }
+
+private:
+  // Cuándo podría empezar a soplar un sujeto que está en la cola desde
+  // llegadaMs, y en qué cabezal
+  double inicioPosible(uint8_t d, double llegadaMs, double precalentamiento,
+                       uint8_t& cabezal) const {
+    const Alcoholimetro& a = puestos[d];
+    double mejor = INFINITY;
+    for (uint8_t h = 0; h < config.cabezales; h++) {
+      double preparacion = escenario.anticipar ? a.cabezalLibreMs[h]
+                                               : std::max(llegadaMs, a.cabezalLibreMs[h]);
+      double inicio = std::max({a.libreMs, preparacion + precalentamiento, llegadaMs});
+      if (inicio < mejor) {
+        mejor = inicio;
+        cabezal = h;
+      }
+    }
+    return mejor;
+  }
+
+  // El firmware arranca el precalentamiento ANTICIPO_PRECALENTAMIENTO_MS
+  // antes de la hora
+  void servirConfirmatoria(uint8_t d) {
+    Alcoholimetro& a = puestos[d];
+    double horaMs = a.confirmatorias.front();
+    a.confirmatorias.pop_front();
+    double precalentamiento = modelo.precalentamiento.muestra(g);
+    double aviso = std::max(horaMs - ANTICIPO_PRECALENTAMIENTO_MS, 0.0);
+    uint8_t cabezal = 0;
+    double inicio = std::max(inicioPosible(d, aviso, precalentamiento, cabezal), horaMs);
+    double preparacion = escenario.anticipar ? a.cabezalLibreMs[cabezal]
+                                             : std::max(aviso, a.cabezalLibreMs[cabezal]);
+    ocupar(d, cabezal, aviso, preparacion, precalentamiento, inicio, duracionPrueba(g));
+    if (medir != nullptr) {
+      medir->confirmatorias++;
+      anotarEspera(medir->retrasos, inicio - horaMs);
+    }
+  }
+
+  // El alcoholímetro cuenta como ocupado desde que el sujeto espera por
+  // él (precalentamiento incluido) y el cabezal, el precalentamiento y la
+  // prueba; un cabezal precalentado por adelantado sin nadie esperando no
+  double ocupar(uint8_t d, uint8_t cabezal, double llegadaMs, double preparacion,
+                double precalentamiento, double inicio, double prueba) {
+    Alcoholimetro& a = puestos[d];
+    double finMs = inicio + prueba;
+    if (medir != nullptr) {
+      medir->pruebas++;
+      medir->ocupadoMs += finMs - std::min(inicio, std::max({a.libreMs, preparacion, llegadaMs}));
+      medir->cabezalOcupadoMs += prueba + precalentamiento;
+    }
+    a.libreMs = finMs;
+    a.cabezalLibreMs[cabezal] = finMs;
+    return finMs;
+  }
+
+  Configuracion config;
+  Generador g;
+  Alcoholimetro puestos[MAX_ALCOHOLIMETROS];
+  Replica* medir = nullptr;
+};
+
+struct Resumen {
+  Configuracion config;
+  double carga;              // llegadas por el tiempo medio de prueba, por alcoholímetro
+  double ocupacion;
+  double ocupacionCabezal;
+  double esperaMediaMs;
+  double esperaP95Ms;
+  double intervaloP95Ms;     // semiancho del 95% entre réplicas
+  double esperaP99Ms;
+  double colaMedia;
+  double colaP95;
+  uint32_t colaMaxima;
+  double confirmatoriasPorHora;
+  double retrasoP95Ms;
+  bool saturado;
+};
+
+static Resumen resumir(const Configuracion& c, std::vector<Replica>& replicas) {
+  Resumen s = {};
+  s.config = c;
+  Replica total = {};
+  total.esperas.assign(CUBETAS_ESPERA, 0);
+  total.retrasos.assign(CUBETAS_ESPERA, 0);
+  total.colas.assign(CUBETAS_COLA, 0);
+  double sumaP95 = 0, sumaCuadrados = 0;
+  for (Replica& r : replicas) {
+    r.esperaP95Ms = percentil(r.esperas, 0.95, CUBETA_ESPERA_MS);
+    sumaP95 += r.esperaP95Ms;
+    sumaCuadrados += r.esperaP95Ms * r.esperaP95Ms;
+    total.sujetos += r.sujetos;
+    total.pruebas += r.pruebas;
+    total.confirmatorias += r.confirmatorias;
+    total.horizonteMs += r.horizonteMs;
+    total.llegadasMs += r.llegadasMs;
+    total.ocupadoMs += r.ocupadoMs;
+    total.cabezalOcupadoMs += r.cabezalOcupadoMs;
+    total.esperaTotalMs += r.esperaTotalMs;
+    total.colaMaxima = std::max(total.colaMaxima, r.colaMaxima);
+    for (size_t i = 0; i < CUBETAS_ESPERA; i++) {
+      total.esperas[i] += r.esperas[i];
+      total.retrasos[i] += r.retrasos[i];
+    }
+    for (size_t i = 0; i < CUBETAS_COLA; i++) total.colas[i] += r.colas[i];
+  }
+  size_t n = replicas.size();
+  double mediaP95 = sumaP95 / n;
+  s.intervaloP95Ms =
+      n > 1 ? 1.96 * sqrt(std::max(sumaCuadrados / n - mediaP95 * mediaP95, 0.0) * n / (n - 1) / n)
+            : 0;
+  s.esperaP95Ms = percentil(total.esperas, 0.95, CUBETA_ESPERA_MS);
+  s.esperaP99Ms = percentil(total.esperas, 0.99, CUBETA_ESPERA_MS);
+  s.esperaMediaMs = total.esperaTotalMs / total.sujetos;
+  double pruebaMs = modelo.esperaSoplido.media() + modelo.soplado.media() +
+                    modelo.calculo.media() + modelo.lectura.media();
+  pruebaMs += (modelo.probInterrupcion / (1 - modelo.probInterrupcion)) *
+              (modelo.esperaSoplido.media() + modelo.soplado.media() +
+               modelo.interrumpido.media());
+  s.carga = escenario.llegadasPorHora * (1 + escenario.probConfirmatoria) * pruebaMs /
+            3600000.0 / c.alcoholimetros;
+  s.ocupacion = total.ocupadoMs / (total.horizonteMs * c.alcoholimetros);
+  s.ocupacionCabezal = total.cabezalOcupadoMs / (total.horizonteMs * c.alcoholimetros * c.cabezales);
+  // Ley de Little sobre el tiempo medido
+  s.colaMedia = total.esperaTotalMs / total.horizonteMs;
+  s.colaP95 = percentil(total.colas, 0.95, 1);
+  s.colaMaxima = total.colaMaxima;
+  s.confirmatoriasPorHora = total.confirmatorias * 3600000.0 / total.horizonteMs;
+  s.retrasoP95Ms = percentil(total.retrasos, 0.95, CUBETA_ESPERA_MS);
+  s.saturado = total.llegadasMs < LLEGADAS_SATURADO * total.horizonteMs;
+  return s;
+}
+
+static void imprimir(const char* prefijo, const Resumen& s) {
+  printf("%salcoholimetros=%u cabezales=%u carga=%.3f ocupacion=%.3f ocupacion_cabezal=%.3f "
+         "espera_media_s=%.1f espera_p95_s=%.1f+-%.1f espera_p99_s=%.1f cola_media=%.2f "
+         "cola_p95=%.0f cola_max=%u confirmatorias_hora=%.1f retraso_confirmatoria_p95_s=%.1f%s\n",
+         prefijo, s.config.alcoholimetros, s.config.cabezales, s.carga, s.ocupacion,
+         s.ocupacionCabezal, s.esperaMediaMs / 1000, s.esperaP95Ms / 1000,
+         s.intervaloP95Ms / 1000, s.esperaP99Ms / 1000, s.colaMedia, s.colaP95, s.colaMaxima,
+         s.confirmatoriasPorHora, s.retrasoP95Ms / 1000, s.saturado ? " saturado" : "");
+}
+
+static void imprimirFase(const char* nombre, const Distribucion& d) {
+  printf("fase=%s media_s=%.2f origen=%s\n", nombre, d.media() / 1000, d.origen);
+}
+
+int main(int argc, char** argv) {
+  uint64_t sujetos = 1000000;
+  unsigned replicas = 8;
+  uint8_t maxAlcoholimetros = 6;
+  uint8_t maxCabezales = 2;
+  double objetivoP95S = 120;
+  uint64_t semilla = 1;
+  double probInterrupcion = -1;
+  unsigned hilos = std::thread::hardware_concurrency();
+  std::vector<const char*> volcados;
+  int c;
+  while ((c = getopt(argc, argv, "l:m:A:H:n:R:c:e:i:ao:s:j:")) != -1) {
+    switch (c) {
+      case 'l': escenario.llegadasPorHora = atof(optarg); break;
+      case 'm': volcados.push_back(optarg); break;
+      case 'A': maxAlcoholimetros = (uint8_t)std::clamp(atoi(optarg), 1, MAX_ALCOHOLIMETROS); break;
+      case 'H': maxCabezales = (uint8_t)std::clamp(atoi(optarg), 1, MAX_CABEZALES); break;
+      case 'n': sujetos = strtoull(optarg, nullptr, 10); break;
+      case 'R': replicas = (unsigned)atoi(optarg); break;
+      case 'c': escenario.probConfirmatoria = atof(optarg); break;
+      case 'e': escenario.esperaConfirmatoriaMs = atof(optarg) * 1000; break;
+      case 'i': probInterrupcion = atof(optarg); break;
+      case 'a': escenario.anticipar = true; break;
+      case 'o': objetivoP95S = atof(optarg); break;
+      case 's': semilla = strtoull(optarg, nullptr, 10); break;
+      case 'j': hilos = (unsigned)atoi(optarg); break;
+      default:
+        fprintf(stderr,
+                "uso: %s [-l llegadas_por_hora] [-m volcado_metricas]... "
+                "[-A max_alcoholimetros] [-H max_cabezales] [-n sujetos_por_replica] "
+                "[-R replicas] [-c prob_confirmatoria] [-e espera_confirmatoria_s] "
+                "[-i prob_interrupcion] [-a] [-o objetivo_p95_s] [-s semilla] [-j hilos]\n",
+                argv[0]);
+        return 2;
+    }
+  }
+  if (escenario.llegadasPorHora <= 0 || sujetos < 100) {
+    fprintf(stderr, "hacen falta llegadas > 0 y al menos 100 sujetos\n");
+    return 2;
+  }
+  if (replicas == 0) replicas = 1;
+  if (hilos == 0) hilos = 1;
+  for (const char* v : volcados) {
+    if (!leerVolcado(v)) return 1;
+  }
+  if (!volcados.empty()) ajustarModelo("campo");
+  if (probInterrupcion >= 0) {
+    modelo.probInterrupcion = probInterrupcion;
+    modelo.origenInterrupcion = "opcion";
+  }
+
+  std::vector<Configuracion> configuraciones;
+  for (uint8_t a = 1; a <= maxAlcoholimetros; a++) {
+    for (uint8_t h = 1; h <= maxCabezales; h++) configuraciones.push_back({a, h});
+  }
+
+  // Una tarea por réplica de cada configuración; todas las configuraciones
+  // usan las mismas semillas
+  std::vector<std::vector<Replica>> resultados(configuraciones.size(),
+                                               std::vector<Replica>(replicas));
+  uint32_t totalTareas = (uint32_t)configuraciones.size() * replicas;
+  std::atomic<uint32_t> siguiente{0};
+  std::vector<std::thread> trabajadores;
+  auto inicio = std::chrono::steady_clock::now();
+  for (unsigned h = 0; h < hilos; h++) {
+    trabajadores.emplace_back([&] {
+      for (uint32_t t; (t = siguiente.fetch_add(1)) < totalTareas;) {
+        uint32_t k = t / replicas;
+        uint32_t r = t % replicas;
+        Simulacion s(configuraciones[k], semilla * 1000003ULL + r);
+        resultados[k][r] = s.ejecutar(sujetos);
+      }
+    });
+  }
+  for (std::thread& t : trabajadores) t.join();
+  double segundos =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - inicio).count();
+
+  printf("llegadas_hora=%.1f sujetos=%llu replicas=%u confirmatorias=%.3f espera_confirmatoria_s=%.0f "
+         "anticipar=%d hilos=%u sujetos_por_s=%.0f\n",
+         escenario.llegadasPorHora, (unsigned long long)sujetos, replicas,
+         escenario.probConfirmatoria, escenario.esperaConfirmatoriaMs / 1000,
+         escenario.anticipar, hilos, (double)sujetos * totalTareas / segundos);
+  imprimirFase("precalentamiento", modelo.precalentamiento);
+  imprimirFase("espera_soplido", modelo.esperaSoplido);
+  imprimirFase("soplado", modelo.soplado);
+  imprimirFase("interrumpido", modelo.interrumpido);
+  imprimirFase("calculo", modelo.calculo);
+  imprimirFase("lectura", modelo.lectura);
+  printf("prob_interrupcion=%.3f origen=%s\n\n", modelo.probInterrupcion,
+         modelo.origenInterrupcion);
+
+  const Resumen* recomendada = nullptr;
+  std::vector<Resumen> resumenes;
+  for (size_t k = 0; k < configuraciones.size(); k++) {
+    resumenes.push_back(resumir(configuraciones[k], resultados[k]));
+  }
+  for (const Resumen& s : resumenes) {
+    imprimir("", s);
+    if (recomendada == nullptr && !s.saturado && s.esperaP95Ms <= objetivoP95S * 1000) {
+      recomendada = &s;
+    }
+  }
+  printf("\n");
+  if (recomendada != nullptr) {
+    imprimir("recomendada ", *recomendada);
+  } else {
+    printf("ninguna configuracion cumple espera_p95_s<=%.0f; probar con -A o -H mayores\n",
+           objetivoP95S);
+  }
+  return 0;
+}
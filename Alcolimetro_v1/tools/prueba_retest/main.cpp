@@ -0,0 +1,101 @@
+/*
+ * Prueba en el host de lib/PoliticaRetest.
+ *
+ * Programa una confirmatoria y hace más de HISTORIAL_PRUEBAS pruebas
+ * durante la espera, y comprueba:
+ *
+ *   - la original sigue pendiente, se encuentra por su id y pasa intacta
+ *     por exportar() / restaurar()
+ *   - la confirmatoria queda enlazada en ambos sentidos con la original
+ *   - una prueba de otro sujeto no cuenta como confirmatoria salvo que el
+ *     operador lo aceptara, y nunca pierde su sujeto
+ *
+ * Sale con 1 si algo falla.
+ *
+ *   pio run -e prueba_retest && .pio/build/prueba_retest/program
+ */
+#include <stdio.h>
+#include "politica_retest.h"
+
+#define ESPERA_MS 60000UL
+
+static uint32_t fallos = 0;
+
+static void comprobar(bool condicion, const char* que) {
+  if (condicion) return;
+  fprintf(stderr, "fallo: %s\n", que);
+  fallos++;
+}
+
+static ResultadoPrueba resultado(uint16_t alcohol) {
+  ResultadoPrueba r = {};
+  r.alcoholMg100ml = alcohol;
+  r.alarma = alcohol >= UMBRAL_EBRIO_DEFECTO ? 2 : (alcohol >= UMBRAL_BEBIDO_DEFECTO ? 1 : 0);
+  return r;
+}
+
+// Arranca la confirmatoria con la espera cumplida, como el firmware
+static void iniciarConfirmatoria(PlanificadorRetest& p, uint32_t ahoraMs, bool otroSujeto) {
+  p.marcarRetestIniciado(otroSujeto);
+  p.vigilarSoplido(STATUS_IDLE, STATUS_PREHEATING, ahoraMs);
+  p.vigilarSoplido(STATUS_PREHEATING, STATUS_WAITING_FOR_BLOW, ahoraMs);
+}
+
+static void historialLleno() {
+  PlanificadorRetest p(5, ESPERA_MS);
+  const ResultadoPrueba cerca = resultado(UMBRAL_BEBIDO_DEFECTO);
+  uint32_t idOriginal = p.registrar(cerca, 1000, 7).id;
+  comprobar(p.pruebaPendiente() == idOriginal, "confirmatoria programada");
+
+  // Más pruebas que huecos en el historial antes de cumplir la espera
+  for (uint32_t i = 0; i < 3 * HISTORIAL_PRUEBAS; i++) {
+    p.registrar(resultado(0), 2000 + i * 100, 100 + i);
+  }
+  const RegistroPrueba* original = p.buscar(idOriginal);
+  comprobar(original != nullptr && original->idSujeto == 7, "original tras llenar el historial");
+
+  EstadoRetest estado;
+  p.exportar(estado, 30000);
+  comprobar(estado.original.id == idOriginal, "original exportada");
+  PlanificadorRetest q(5, ESPERA_MS);
+  q.restaurar(estado, 500, false);
+  comprobar(q.pruebaPendiente() == idOriginal, "original restaurada");
+
+  uint32_t ahoraMs = 500 + ESPERA_MS;
+  iniciarConfirmatoria(q, ahoraMs, false);
+  const RegistroPrueba& confirmatoria = q.registrar(resultado(0), ahoraMs + 5000, 0);
+  comprobar(confirmatoria.esConfirmatoria && confirmatoria.idVinculado == idOriginal,
+            "confirmatoria enlazada con la original");
+  comprobar(confirmatoria.idSujeto == 7, "confirmatoria sin sujeto toma el de la original");
+  original = q.buscar(idOriginal);
+  comprobar(original != nullptr && original->idVinculado == confirmatoria.id,
+            "original enlazada con la confirmatoria");
+  comprobar(&q.resultadoFinal(confirmatoria) == &confirmatoria, "resultado final de la pareja");
+  comprobar(!q.retestPendiente(), "sin confirmatoria pendiente");
+}
+
+static void otroSujeto() {
+  const ResultadoPrueba cerca = resultado(UMBRAL_EBRIO_DEFECTO);
+  uint32_t ahoraMs = 1000 + ESPERA_MS;
+
+  PlanificadorRetest p(5, ESPERA_MS);
+  uint32_t idOriginal = p.registrar(cerca, 1000, 7).id;
+  iniciarConfirmatoria(p, ahoraMs, false);
+  const RegistroPrueba& ajena = p.registrar(resultado(0), ahoraMs, 9);
+  comprobar(!ajena.esConfirmatoria && ajena.idSujeto == 9, "otro sujeto no confirma");
+  comprobar(p.pruebaPendiente() == idOriginal && p.debeIniciarRetest(ahoraMs),
+            "la confirmatoria vuelve a programarse");
+
+  iniciarConfirmatoria(p, ahoraMs, true);
+  const RegistroPrueba& aceptada = p.registrar(resultado(0), ahoraMs + 1000, 9);
+  comprobar(aceptada.esConfirmatoria && aceptada.idVinculado == idOriginal,
+            "otro sujeto aceptado por el operador");
+  comprobar(aceptada.idSujeto == 9, "el sujeto de la confirmatoria no se pisa");
+}
+
+int main() {
+  historialLleno();
+  otroSujeto();
+  printf("prueba=retest historial=%u fallos=%u\n", HISTORIAL_PRUEBAS, fallos);
+  return fallos == 0 ? 0 : 1;
+}
@@ -0,0 +1,166 @@
+/*
+ * Prueba en el host de la ruta decodificación -> indicador de
+ * lib/SalidaAlarma.
+ *
+ * Pasa byte a byte por AnalizadorTramas respuestas a 0x86 de las tres
+ * clases de alarma y tramas no válidas y, como leerResultado(), lleva cada
+ * trama completa a decodificarEIndicar() con un IndicadorAlarma simulado.
+ * Comprueba:
+ *
+ *   - el indicador recibe la alarma de la trama, una vez por trama válida,
+ *     y no cambia con las no válidas
+ *   - la ruta no reserva memoria dinámica
+ *   - la latencia medida por decodificarEIndicar() y la medida fuera, ambas
+ *     desde que el analizador completa la trama hasta que el indicador
+ *     simulado recibe la alarma, no pasan de
+ *     LATENCIA_MAXIMA_ALARMA_NS en el percentil 99,9 (el proceso del host
+ *     puede ser desalojado en cualquier llamada, así que el máximo sólo se
+ *     informa)
+ *
+ * La CPU del host es más rápida que la del ESP32, así que cumplir la cota
+ * aquí es necesario pero no suficiente; en el equipo la comprueba el
+ * contador CCOUNT de cada prueba. Sale con 1 si algo falla.
+ *
+ *   pio run -e prueba_salida_alarma && .pio/build/prueba_salida_alarma/program -n 200000
+ */
+#include <algorithm>
+#include <chrono>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+#include "salida_alarma.h"
+
+static uint64_t reservas = 0;
+
+void* operator new(size_t n) {
+  reservas++;
+  void* p = malloc(n != 0 ? n : 1);
+  if (p == nullptr) throw std::bad_alloc();
+  return p;
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+static inline uint64_t ahoraNs() {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class IndicadorSimulado : public IndicadorAlarma {
+public:
+  void indicar(uint8_t alarma) override {
+    indicadoNs = ahoraNs();
+    ultima = alarma;
+    llamadas++;
+  }
+  void apagar() override { ultima = 0xFF; }
+
+  uint64_t indicadoNs = 0;
+  uint8_t ultima = 0xFF;
+  uint32_t llamadas = 0;
+};
+
+// Respuesta válida a 0x86 con el valor y la alarma dados
+static void tramaResultado(uint8_t* t, uint16_t alcohol, uint8_t alarma) {
+  t[0] = BYTE_INICIO;
+  t[1] = CMD_LEER_RESULTADO;
+  t[2] = (uint8_t)(alcohol >> 8);
+  t[3] = (uint8_t)alcohol;
+  t[4] = t[5] = t[6] = 0;
+  t[7] = alarma;
+  t[8] = checksumTrama(t);
+}
+
+static double percentil(std::vector<uint32_t>& v, double p) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[(size_t)(p * (v.size() - 1))];
+}
+
+int main(int argc, char** argv) {
+  uint32_t n = 200000;
+  int c;
+  while ((c = getopt(argc, argv, "n:")) != -1) {
+    switch (c) {
+      case 'n': n = (uint32_t)atoi(optarg); break;
+      default:
+        fprintf(stderr, "uso: %s [-n tramas]\n", argv[0]);
+        return 2;
+    }
+  }
+  if (n == 0) {
+    fprintf(stderr, "parámetros no válidos\n");
+    return 2;
+  }
+
+  // Una de cada ocho tramas no es válida: checksum roto u otro comando
+  std::vector<uint8_t> tramas((size_t)n * LONGITUD_TRAMA);
+  std::vector<int> esperada(n);
+  for (uint32_t i = 0; i < n; i++) {
+    uint8_t* t = &tramas[(size_t)i * LONGITUD_TRAMA];
+    uint8_t alarma = (uint8_t)(i % 3);
+    tramaResultado(t, (uint16_t)(alarma * 50 + i % 20), alarma);
+    esperada[i] = alarma;
+    if (i % 8 == 7) {
+      if (i % 16 == 7) {
+        t[8] ^= 0x5A;
+      } else {
+        t[1] = CMD_LEER_ESTADO;
+        t[8] = checksumTrama(t);
+      }
+      esperada[i] = -1;
+    }
+  }
+  std::vector<uint32_t> internaNs, externaNs;
+  internaNs.reserve(n);
+  externaNs.reserve(n);
+
+  AnalizadorTramas analizador(false);
+  IndicadorSimulado indicador;
+  LatenciaAlarma latencia = {};
+  ResultadoPrueba resultado;
+  uint32_t errores = 0, validas = 0;
+  uint64_t reservasAntes = reservas;
+  for (uint32_t i = 0; i < n; i++) {
+    const uint8_t* t = &tramas[(size_t)i * LONGITUD_TRAMA];
+    uint8_t previa = indicador.ultima;
+    uint32_t llamadas = indicador.llamadas;
+    bool completa = false;
+    for (uint8_t j = 0; j < LONGITUD_TRAMA && !completa; j++) {
+      completa = analizador.alimentar(t[j]);
+    }
+    uint32_t marca = marcaTramaCompleta();
+    uint64_t inicio = ahoraNs();
+    if (!completa) {
+      errores++;
+      continue;
+    }
+    bool valida = decodificarEIndicar(analizador.trama(), indicador, resultado,
+                                      latencia, marca);
+    if (esperada[i] < 0) {
+      errores += valida || indicador.llamadas != llamadas || indicador.ultima != previa;
+      continue;
+    }
+    validas++;
+    errores += !valida || indicador.llamadas != llamadas + 1 ||
+               indicador.ultima != esperada[i] || resultado.alarma != esperada[i];
+    internaNs.push_back(latencia.ultimaNs);
+    externaNs.push_back((uint32_t)(indicador.indicadoNs - inicio));
+  }
+  uint64_t reservasRuta = reservas - reservasAntes;
+  errores += latencia.muestras != validas;
+
+  double internaP999 = percentil(internaNs, 0.999);
+  double externaP999 = percentil(externaNs, 0.999);
+  bool dentroCota = internaP999 <= LATENCIA_MAXIMA_ALARMA_NS &&
+                    externaP999 <= LATENCIA_MAXIMA_ALARMA_NS;
+  printf("prueba=salida_alarma tramas=%u validas=%u errores=%u reservas=%llu cota_ns=%u "
+         "interna_ns_p50=%.0f interna_ns_p999=%.0f interna_ns_max=%u "
+         "externa_ns_p50=%.0f externa_ns_p999=%.0f excedidas=%u dentro_cota=%d\n",
+         n, validas, errores, (unsigned long long)reservasRuta, LATENCIA_MAXIMA_ALARMA_NS,
+         percentil(internaNs, 0.5), internaP999, latencia.maximaNs, percentil(externaNs, 0.5),
+         externaP999, latencia.excedidas, dentroCota ? 1 : 0);
+  return errores == 0 && reservasRuta == 0 && dentroCota ? 0 : 1;
+}
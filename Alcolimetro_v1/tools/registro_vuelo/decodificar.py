@@ -0,0 +1,209 @@
+#!/usr/bin/env python3
+"""
+Decodifica el registro de vuelo del alcoholímetro y lo simboliza.
+
+Lee la salida del comando 'v' (líneas "VUELO ...") de un fichero de
+captura de la consola o directamente del puerto serie, y para cada volcado
+imprime la cabecera, el fallo (PC y motivo) y los eventos del más antiguo
+al más reciente. Las direcciones se pasan a addr2line contra firmware.elf
+en una sola llamada.
+
+    python3 tools/registro_vuelo/decodificar.py captura.txt
+    python3 tools/registro_vuelo/decodificar.py --serie /dev/ttyUSB0 \\
+        --elf .pio/build/esp32doit-devkit-v1/firmware.elf
+
+El formato es el de lib/RegistroVuelo/registro_vuelo.h: si cambia allí,
+hay que cambiarlo aquí.
+"""
+import argparse
+import os
+import struct
+import subprocess
+import sys
+
+MAGIA_VUELO = 0x4F4C5556
+VERSION_VUELO = 1
+CABECERA = struct.Struct("<IHHIIIII20s")
+EVENTO = struct.Struct("<IIIBBBB")
+
+ELF_DEFECTO = ".pio/build/esp32doit-devkit-v1/firmware.elf"
+ADDR2LINE_DEFECTO = "xtensa-esp32-elf-addr2line"
+
+MOTIVOS_REINICIO = {
+    0: "desconocido", 1: "encendido", 2: "externo", 3: "software",
+    4: "pánico", 5: "watchdog de interrupción", 6: "watchdog de tarea",
+    7: "watchdog", 8: "sueño profundo", 9: "brownout", 10: "SDIO",
+}
+FALLOS_ENLACE = ["timeout", "respuesta inválida", "checksum", "rechazo"]
+ALARMAS = {0x00: "ninguna", 0x01: "bebido", 0x02: "ebrio"}
+
+
+def hexa(v):
+    return "0x%02X" % v
+
+
+# Misma lista que TipoEventoVuelo
+def describir(tipo, a, b, c, valor):
+    if tipo == 1:
+        return "arranque (%s)" % MOTIVOS_REINICIO.get(a, a)
+    if tipo == 2:
+        return "comando %s dato %s" % (hexa(a), hexa(b))
+    if tipo == 3:
+        return "comando %s bloqueado en el estado %s" % (hexa(a), hexa(c))
+    if tipo == 4:
+        return "respuesta %s %s en %d ms%s" % (
+            hexa(a), hexa(b), valor, "" if c else " (checksum inválido)")
+    if tipo == 5:
+        return "estado %s -> %s tras %d ms" % (hexa(a), hexa(b), valor)
+    if tipo == 6:
+        return "resultado %d mg/100ml, alarma %s" % (valor, ALARMAS.get(a, hexa(a)))
+    if tipo == 7:
+        nombre = FALLOS_ENLACE[a] if a < len(FALLOS_ENLACE) else str(a)
+        return "fallo del enlace: %s (comando %s, %d bytes)" % (nombre, hexa(b), c)
+    if tipo == 8:
+        return "permanencia excedida en %s: %d ms" % (hexa(a), valor)
+    if tipo == 9:
+        return "latencia de alarma %d ns" % valor
+    return "tipo %d (%d %d %d %d)" % (tipo, a, b, c, valor)
+
+
+def leer_bloques(lineas):
+    """Devuelve [(numero, reinicio, bytes)] de las líneas VUELO."""
+    bloques = []
+    for linea in lineas:
+        linea = linea.strip()
+        if not linea.startswith("VUELO "):
+            continue
+        resto = linea[len("VUELO "):]
+        if resto.startswith("volcado"):
+            campos = dict(c.split("=") for c in resto.split()[1:])
+            bloques.append([int(campos["numero"]), int(campos["reinicio"]), bytearray()])
+        elif resto.startswith(":") and bloques:
+            bloques[-1][2] += bytes.fromhex(resto[1:])
+    return bloques
+
+
+def leer_serie(dispositivo, baudios):
+    import serial
+    puerto = serial.Serial(dispositivo, baudios, timeout=3)
+    puerto.reset_input_buffer()
+    puerto.write(b"v")
+    lineas = []
+    while True:
+        linea = puerto.readline().decode("utf-8", "replace")
+        if not linea:
+            raise TimeoutError("sin respuesta del equipo")
+        if linea.strip() == "VUELO fin":
+            return lineas
+        lineas.append(linea)
+
+
+class Simbolizador:
+    def __init__(self, elf, addr2line):
+        self.elf = elf
+        self.addr2line = addr2line
+        self.cache = {}
+
+    def resolver(self, direcciones):
+        pendientes = sorted({d for d in direcciones if d and d not in self.cache})
+        if not pendientes or not self.elf:
+            return
+        try:
+            salida = subprocess.run(
+                [self.addr2line, "-pfiaC", "-e", self.elf] + ["0x%08x" % d for d in pendientes],
+                capture_output=True, text=True, check=True).stdout
+        except (OSError, subprocess.CalledProcessError) as e:
+            print("addr2line no disponible (%s): direcciones sin simbolizar" % e,
+                  file=sys.stderr)
+            self.elf = None
+            return
+        # Una entrada por dirección: "0x...: función at fichero:línea",
+        # seguida de líneas " (inlined by) ..." si hubo expansión en línea
+        actual = None
+        for linea in salida.splitlines():
+            if linea.startswith("0x"):
+                direccion, _, texto = linea.partition(": ")
+                actual = int(direccion, 16)
+                self.cache[actual] = texto
+            elif actual is not None:
+                self.cache[actual] += " " + linea.strip()
+
+    def simbolo(self, direccion):
+        return self.cache.get(direccion, "")
+
+
+def decodificar(numero, reinicio, datos, simbolizador):
+    magia, version, capacidad, total, arranques, fallo, pc_fallo, marca_fallo, motivo = \
+        CABECERA.unpack_from(datos, 0)
+    titulo = "anillo actual" if numero == 0 else "volcado %d" % numero
+    if magia != MAGIA_VUELO or version != VERSION_VUELO:
+        print("== %s: formato desconocido" % titulo)
+        return
+    print("== %s, reinicio por %s, %d arranques, %d eventos registrados" % (
+        titulo, MOTIVOS_REINICIO.get(reinicio, reinicio), arranques, total))
+
+    # El anillo empieza en el evento más antiguo que sigue guardado
+    n = min(total, capacidad)
+    primero = total - n
+    eventos = []
+    for i in range(primero, total):
+        eventos.append(EVENTO.unpack_from(datos, CABECERA.size + (i % capacidad) * EVENTO.size))
+
+    # Las direcciones de retorno apuntan a la instrucción que sigue a la
+    # llamada (call8, 3 bytes); restarlas da la línea de la llamada
+    simbolizador.resolver([pc - 3 for _, pc, *_ in eventos if pc] + [pc_fallo])
+
+    if fallo:
+        motivo = motivo.split(b"\0", 1)[0].decode("utf-8", "replace")
+        print("Pánico a los %.3f s: %s" % (marca_fallo / 1e6, motivo))
+        print("  PC 0x%08x %s" % (pc_fallo, simbolizador.simbolo(pc_fallo)))
+
+    anterior = None
+    for marca, pc, valor, tipo, a, b, c in eventos:
+        if tipo == 0:
+            continue
+        # La marca vuelve a cero en cada arranque
+        delta = "" if anterior is None or marca < anterior else "+%.3f" % ((marca - anterior) / 1e3)
+        anterior = marca
+        linea = "%10.3f %10s  %s" % (marca / 1e3, delta, describir(tipo, a, b, c, valor))
+        simbolo = simbolizador.simbolo(pc - 3) if pc else ""
+        if simbolo:
+            linea += "  [%s]" % simbolo
+        print(linea)
+    print()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[1])
+    parser.add_argument("captura", nargs="?", help="fichero con la salida de 'v'")
+    parser.add_argument("--serie", help="leer del puerto serie en vez de un fichero")
+    parser.add_argument("--baudios", type=int, default=115200)
+    parser.add_argument("--elf", default=ELF_DEFECTO if os.path.exists(ELF_DEFECTO) else None)
+    parser.add_argument("--addr2line", default=ADDR2LINE_DEFECTO)
+    parser.add_argument("--ultimo", action="store_true", help="sólo el volcado más reciente")
+    args = parser.parse_args()
+
+    if args.serie:
+        lineas = leer_serie(args.serie, args.baudios)
+    elif args.captura:
+        with open(args.captura, encoding="utf-8", errors="replace") as f:
+            lineas = f.readlines()
+    else:
+        parser.error("indicar un fichero de captura o --serie")
+
+    bloques = leer_bloques(lineas)
+    if not bloques:
+        sys.exit("no hay líneas VUELO en la entrada")
+    # Los volcados guardados por orden y el anillo actual (número 0) al final
+    bloques.sort(key=lambda b: (b[0] == 0, b[0]))
+    if args.ultimo:
+        guardados = [b for b in bloques if b[0] != 0]
+        bloques = guardados[-1:] if guardados else bloques
+
+    simbolizador = Simbolizador(args.elf, args.addr2line)
+    for numero, reinicio, datos in bloques:
+        decodificar(numero, reinicio, bytes(datos), simbolizador)
+
+
+if __name__ == "__main__":
+    main()